@@ -21,6 +21,7 @@
 #endif //H5Acreate_vers
 
 #cmakedefine HAVE_MKSTEMP 1 
+#cmakedefine HAVE_MMAP 1
 #cmakedefine HAVE_STRERROR 1 
 #cmakedefine HAVE_FLOAT_H 1 
 
@@ -35,6 +36,7 @@
 #cmakedefine HAVE_INT16_T 1 
 #cmakedefine HAVE_INT32_T 1 
 #cmakedefine HAVE_INTTYPES_H 1 
+#cmakedefine HAVE_IMMINTRIN_H 1
 #cmakedefine HAVE_MEMORY_H 1 
 #cmakedefine HAVE_MKSTEMP 1 
 #cmakedefine HAVE_NDIR_H 1 
@@ -49,6 +51,7 @@
 #cmakedefine HAVE_SYS_DIR_H 1 
 #cmakedefine HAVE_SYS_NDIR_H 1 
 #cmakedefine HAVE_SYS_STAT_H 1 
+#cmakedefine HAVE_SYS_MMAN_H 1
 #cmakedefine HAVE_SYS_TIME_H 1 
 #cmakedefine HAVE_TIME_H 1 
 #cmakedefine HAVE_SYS_TYPES_H 1 
@@ -63,6 +66,7 @@
 #cmakedefine HAVE_WORKING_FORK 1 
 #cmakedefine HAVE_WORKING_VFORK 1 
 #cmakedefine HAVE_ZLIB 1 
+#cmakedefine HAVE_BZIP2 1
 #cmakedefine HAVE_STRINGS_H 1 
 #cmakedefine HAVE_STRING_H 1 
 #cmakedefine HAVE_SRAND48 1 
@@ -71,4 +75,5 @@
 #cmakedefine HAVE_CLOCK_GETTIME 1
 #cmakedefine HAVE_GETTIMEOFDAY 1
 #cmakedefine HAVE_RINT 1
+#cmakedefine HAVE_PTHREAD 1
 
@@ -311,14 +311,23 @@ image dimensions */
 #define MI2_MAX_DIM_NAME 256
 
 #define MI2_CHUNK_SIZE 32 /* Length of chunk, per dimension */
+#define MI2_DEFAULT_CHUNK_BYTES (1024 * 1024) /* Target chunk size for access hints */
 #define MI2_DEFAULT_ZLIB_LEVEL 4
+#define MI2_DEFAULT_STATS_BINS 256 /* Histogram bins of volume statistics */
 #define MI2_MAX_ZLIB_LEVEL 9
+#define MI2_DEFAULT_ZSTD_LEVEL 3
+#define MI2_MAX_ZSTD_LEVEL 22
+
+/* Registered HDF5 filter identifiers of the LZ4 and Zstandard plugins */
+#define MI2_H5Z_FILTER_LZ4 32004
+#define MI2_H5Z_FILTER_ZSTD 32015
 
 #define MI2_MAX_PATH 128
 #define MI2_MAX_RESOLUTION_GROUP 16
 
 #define MI2_OPEN_READ 0x0001
 #define MI2_OPEN_RDWR 0x0002
+#define MI2_OPEN_HEADER_ONLY 0x0004 /* With MI2_OPEN_READ, open the image on first use */
 
 #define MI_VERSION_2_0 "MINC Version    2.0"
 
@@ -42,7 +42,13 @@ static const char *_CONFIG_VAR[]=
       "MINC_MAX_MEMORY_KB",
       "MINC_FILE_CACHE_MB",
       "MINC_CHECKSUM",
-      "MINC_PREFER_V2_API"
+      "MINC_PREFER_V2_API",
+      "MINC_READ_THREADS",
+      "MINC_COMPRESS_THREADS",
+      "MINC_SIMD",
+      "MINC_PYRAMID_THREADS",
+      "MINC_DECOMPRESS_MEMORY_MB",
+      "MINC_IO_STATS"
   };
 
 enum {
@@ -149,3 +155,59 @@ double miget_cfg_double(int id)
   const char *_var=miget_cfg_str(id);
   return atof(_var);
 }
+
+/** Parse MINC_COMPRESS, either a zlib level as for MINC 1.0 files or
+ * the name of a codec (none, zlib, shuffle-zlib, lz4 or zstd) optionally
+ * followed by a colon and a level, e.g. "zstd:5". Returns 0 if it is not
+ * set or not understood, otherwise 1 with the MICFG_CODEC_* codec and the
+ * level, -1 if none was given.
+ */
+int miget_cfg_compression(int *codec, int *level)
+{
+  static const char *codecs[]=
+    {
+      "none",
+      "zlib",
+      "shuffle-zlib",
+      "lz4",
+      "zstd"
+    };
+  const char *spec;
+  size_t length;
+  int i;
+
+  if(!miget_cfg_present(MICFG_COMPRESS)) return 0;
+
+  spec=miget_cfg_str(MICFG_COMPRESS);
+  while(isspace((unsigned char)*spec))
+    spec++;
+  if(isdigit((unsigned char)*spec))
+  {
+    *level=atoi(spec);
+    *codec=(*level>0)?MICFG_CODEC_ZLIB:MICFG_CODEC_NONE;
+    return 1;
+  }
+
+  length=strcspn(spec,": \t\r\n");
+  for(i=0;i<(int)(sizeof(codecs)/sizeof(codecs[0]));i++)
+  {
+    if(strlen(codecs[i])==length && !strncasecmp(spec,codecs[i],length))
+    {
+      *codec=i;
+      *level=(spec[length]==':')?atoi(spec+length+1):-1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** Read every setting into the cache. The cache is not locked, so this
+ * has to be done before the settings are looked up from several threads.
+ */
+void miload_cfg(void)
+{
+  int id;
+
+  for(id=0;id<MICFG_COUNT;id++)
+    miget_cfg_str(id);
+}
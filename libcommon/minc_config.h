@@ -12,13 +12,30 @@ enum MINC_CONFIG {
   MICFG_MINC_FILE_CACHE,
   MICFG_MINC_CHECKSUM,
   MICFG_MINC_PREFER_V2_API,
+  MICFG_READ_THREADS,
+  MICFG_COMPRESS_THREADS,
+  MICFG_SIMD,
+  MICFG_PYRAMID_THREADS,
+  MICFG_DECOMPRESS_MEMORY,
+  MICFG_IO_STATS,
   MICFG_COUNT
 };
 
+/** Codecs that can be named in MINC_COMPRESS */
+enum MINC_CONFIG_CODEC {
+  MICFG_CODEC_NONE=0,
+  MICFG_CODEC_ZLIB,
+  MICFG_CODEC_SHUFFLE_ZLIB,
+  MICFG_CODEC_LZ4,
+  MICFG_CODEC_ZSTD
+};
+
 int          miget_cfg_present(int);
 int          miget_cfg_bool(int);
 int          miget_cfg_int(int);
 const char * miget_cfg_str(int);
 double       miget_cfg_double(int);
+void         miload_cfg(void);
+int          miget_cfg_compression(int *codec, int *level);
 
 #endif /* __MINC_CONFIG_H__ */
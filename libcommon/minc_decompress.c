@@ -0,0 +1,325 @@
+/** \file minc_decompress.c
+ * \brief In-process decompression of gzip and bzip2 compressed files.
+ *
+ * Used to read compressed MINC files without running gunzip or bunzip2
+ * and, when they fit in memory, without a temporary file.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+
+#ifdef HAVE_BZIP2
+#include <bzlib.h>
+#endif /*HAVE_BZIP2*/
+
+#include "minc_decompress.h"
+
+/* Size of the reads from the compressed file */
+#define MIDECOMPRESS_BLOCK (256 * 1024)
+
+/* First size of the buffer of a file of unknown length */
+#define MIDECOMPRESS_INITIAL (1024 * 1024)
+
+/** A compressed file open for reading.
+ */
+struct mireader {
+  midecompress_t type;
+  gzFile gz;
+#ifdef HAVE_BZIP2
+  FILE *fp;
+  BZFILE *bz;
+  char unused[BZ_MAX_UNUSED];
+  int n_unused;
+  int done;
+#endif /*HAVE_BZIP2*/
+};
+
+midecompress_t midecompress_type(const char *path)
+{
+  unsigned char magic[3];
+  size_t n;
+  FILE *fp;
+
+  if ((fp = fopen(path, "rb")) == NULL) {
+    return MIDECOMPRESS_NONE;
+  }
+  n = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return MIDECOMPRESS_GZIP;
+  }
+#ifdef HAVE_BZIP2
+  if (n == 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h') {
+    return MIDECOMPRESS_BZIP2;
+  }
+#endif /*HAVE_BZIP2*/
+  return MIDECOMPRESS_NONE;
+}
+
+/** Open the compressed file \a path for reading.
+ */
+static int mireader_open(struct mireader *reader, const char *path)
+{
+  memset(reader, 0, sizeof(*reader));
+  reader->type = midecompress_type(path);
+  switch (reader->type) {
+  case MIDECOMPRESS_GZIP:
+    if ((reader->gz = gzopen(path, "rb")) == NULL) {
+      return -1;
+    }
+    gzbuffer(reader->gz, MIDECOMPRESS_BLOCK);
+    return 0;
+#ifdef HAVE_BZIP2
+  case MIDECOMPRESS_BZIP2:
+    {
+      int error;
+
+      if ((reader->fp = fopen(path, "rb")) == NULL) {
+        return -1;
+      }
+      reader->bz = BZ2_bzReadOpen(&error, reader->fp, 0, 0, NULL, 0);
+      if (error != BZ_OK) {
+        BZ2_bzReadClose(&error, reader->bz);
+        fclose(reader->fp);
+        return -1;
+      }
+      return 0;
+    }
+#endif /*HAVE_BZIP2*/
+  default:
+    return -1;
+  }
+}
+
+/** Read up to \a length decompressed bytes into \a buffer.
+ * \return the number of bytes read, 0 at the end of the file, -1 on error.
+ */
+static long mireader_read(struct mireader *reader, void *buffer, size_t length)
+{
+  if (length > MIDECOMPRESS_BLOCK) {
+    length = MIDECOMPRESS_BLOCK;
+  }
+  if (reader->type == MIDECOMPRESS_GZIP) {
+    int n = gzread(reader->gz, buffer, (unsigned int) length);
+    return (n < 0) ? -1 : n;
+  }
+#ifdef HAVE_BZIP2
+  while (!reader->done) {
+    void *unused;
+    int error;
+    int n = BZ2_bzRead(&error, reader->bz, buffer, (int) length);
+
+    if (error == BZ_OK) {
+      return n;
+    }
+    if (error != BZ_STREAM_END) {
+      return -1;
+    }
+
+    /* Files made by concatenation hold several streams */
+    BZ2_bzReadGetUnused(&error, reader->bz, &unused, &reader->n_unused);
+    memcpy(reader->unused, unused, reader->n_unused);
+    BZ2_bzReadClose(&error, reader->bz);
+    reader->bz = NULL;
+    if (reader->n_unused == 0) {
+      int c = getc(reader->fp);
+
+      if (c == EOF) {
+        reader->done = 1;
+      } else {
+        ungetc(c, reader->fp);
+      }
+    }
+    if (!reader->done) {
+      reader->bz = BZ2_bzReadOpen(&error, reader->fp, 0, 0,
+                                  reader->unused, reader->n_unused);
+      if (error != BZ_OK) {
+        return -1;
+      }
+    }
+    if (n > 0) {
+      return n;
+    }
+  }
+#endif /*HAVE_BZIP2*/
+  return 0;
+}
+
+static void mireader_close(struct mireader *reader)
+{
+  if (reader->gz != NULL) {
+    gzclose(reader->gz);
+  }
+#ifdef HAVE_BZIP2
+  if (reader->bz != NULL) {
+    int error;
+    BZ2_bzReadClose(&error, reader->bz);
+  }
+  if (reader->fp != NULL) {
+    fclose(reader->fp);
+  }
+#endif /*HAVE_BZIP2*/
+}
+
+/** The length of the contents of the gzip file \a path as recorded in its
+ * trailer, modulo 2^32 and only for the last member, so only a hint.
+ */
+static size_t gzip_length_hint(const char *path)
+{
+  unsigned char trailer[4];
+  size_t length = 0;
+  FILE *fp;
+
+  if ((fp = fopen(path, "rb")) == NULL) {
+    return 0;
+  }
+  if (fseek(fp, -4, SEEK_END) == 0 && fread(trailer, 1, 4, fp) == 4) {
+    length = (size_t) trailer[0] | ((size_t) trailer[1] << 8) |
+             ((size_t) trailer[2] << 16) | ((size_t) trailer[3] << 24);
+  }
+  fclose(fp);
+  return length;
+}
+
+int midecompress_to_memory(const char *path, size_t max_length,
+                           void **buffer, size_t *length)
+{
+  struct mireader reader;
+  unsigned char *data = NULL;
+  size_t capacity;
+  size_t total = 0;
+  long n;
+
+  if (mireader_open(&reader, path) < 0) {
+    return -1;
+  }
+
+  /* One byte more than the expected length to see the end without
+   * growing the buffer
+   */
+  capacity = MIDECOMPRESS_INITIAL;
+  if (reader.type == MIDECOMPRESS_GZIP) {
+    size_t hint = gzip_length_hint(path);
+    if (hint > 0) {
+      capacity = hint + 1;
+    }
+  }
+  if (capacity > max_length + 1) {
+    capacity = max_length + 1;
+  }
+
+  for (;;) {
+    if (total == capacity) {
+      unsigned char *grown;
+
+      if (capacity > max_length) {
+        free(data);
+        mireader_close(&reader);
+        return 1;
+      }
+      capacity = (capacity > (max_length + 1) / 2) ? max_length + 1 : capacity * 2;
+      if ((grown = (unsigned char *) realloc(data, capacity)) == NULL) {
+        break;
+      }
+      data = grown;
+    } else if (data == NULL &&
+               (data = (unsigned char *) malloc(capacity)) == NULL) {
+      break;
+    }
+    if ((n = mireader_read(&reader, data + total, capacity - total)) <= 0) {
+      mireader_close(&reader);
+      if (n < 0 || total == 0) {
+        free(data);
+        return -1;
+      }
+      *buffer = data;
+      *length = total;
+      return 0;
+    }
+    total += (size_t) n;
+  }
+  free(data);
+  mireader_close(&reader);
+  return -1;
+}
+
+int midecompress_to_file(const char *path, const char *outfile)
+{
+  struct mireader reader;
+  unsigned char *block;
+  FILE *fp;
+  long n;
+  int result = 0;
+
+  if (mireader_open(&reader, path) < 0) {
+    return -1;
+  }
+  if ((block = (unsigned char *) malloc(MIDECOMPRESS_BLOCK)) == NULL ||
+      (fp = fopen(outfile, "wb")) == NULL) {
+    free(block);
+    mireader_close(&reader);
+    return -1;
+  }
+  while ((n = mireader_read(&reader, block, MIDECOMPRESS_BLOCK)) > 0) {
+    if (fwrite(block, 1, (size_t) n, fp) != (size_t) n) {
+      result = -1;
+      break;
+    }
+  }
+  if (fclose(fp) != 0 || n < 0) {
+    result = -1;
+  }
+  free(block);
+  mireader_close(&reader);
+  return result;
+}
+
+char *midecompress_to_tempfile(const char *path)
+{
+  const char pat_str[] = "/minc-XXXXXX";
+  const char *tmpdir_ptr;
+  char *tmpfile_ptr;
+
+  if ((tmpdir_ptr = getenv("TMPDIR")) == NULL) {
+    tmpdir_ptr = P_tmpdir;
+  }
+  tmpfile_ptr = (char *) malloc(strlen(tmpdir_ptr) + sizeof(pat_str));
+  if (tmpfile_ptr == NULL) {
+    return NULL;
+  }
+  strcpy(tmpfile_ptr, tmpdir_ptr);
+  strcat(tmpfile_ptr, pat_str);
+#ifdef HAVE_MKSTEMP
+  {
+    int fd = mkstemp(tmpfile_ptr);
+
+    if (fd < 0) {
+      free(tmpfile_ptr);
+      return NULL;
+    }
+    close(fd);
+  }
+#else
+  if (mktemp(tmpfile_ptr) == NULL) {
+    free(tmpfile_ptr);
+    return NULL;
+  }
+#endif /*HAVE_MKSTEMP*/
+  if (midecompress_to_file(path, tmpfile_ptr) < 0) {
+    remove(tmpfile_ptr);
+    free(tmpfile_ptr);
+    return NULL;
+  }
+  return tmpfile_ptr;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
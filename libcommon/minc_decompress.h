@@ -0,0 +1,44 @@
+/*
+ * \file minc_decompress.h
+ * \brief Declares the prototypes of the in-process decompression of
+ * gzip and bzip2 compressed files.
+ */
+#ifndef MINC_DECOMPRESS_H
+#define MINC_DECOMPRESS_H
+
+#include <stddef.h>
+
+/** Compression of a file, told by its first bytes.
+ */
+typedef enum {
+  MIDECOMPRESS_NONE = 0,        /**< Not compressed, or not known */
+  MIDECOMPRESS_GZIP,            /**< gzip, read with zlib */
+  MIDECOMPRESS_BZIP2            /**< bzip2, read with libbz2 if present */
+} midecompress_t;
+
+/** Return the compression of the file \a path, MIDECOMPRESS_NONE if it
+ *  cannot be read or is compressed in a way that cannot be decompressed
+ *  in process.
+ */
+midecompress_t midecompress_type(const char *path);
+
+/** Decompress the file \a path into a new buffer allocated with malloc()
+ *  of at most \a max_length bytes, returned with its length.
+ *  \return 0 on success, 1 if the contents are longer than
+ *  \a max_length, -1 if the file cannot be decompressed.
+ */
+int midecompress_to_memory(const char *path, size_t max_length,
+                           void **buffer, size_t *length);
+
+/** Decompress the file \a path into the file \a outfile.
+ *  \return 0 on success, -1 on error.
+ */
+int midecompress_to_file(const char *path, const char *outfile);
+
+/** Decompress the file \a path into a new temporary file in TMPDIR.
+ *  \return the name of the temporary file, to be released with free(),
+ *  or NULL on error.
+ */
+char *midecompress_to_tempfile(const char *path);
+
+#endif /*MINC_DECOMPRESS_H*/
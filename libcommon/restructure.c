@@ -1,8 +1,9 @@
 /** \file restructure.c
- * \brief In-place reordering of multidimensional arrays.
+ * \brief Reordering of multidimensional arrays.
  * \author Bert Vincent
  *
  ************************************************************************/
+#include <stddef.h>
 #include <stdlib.h>
 #include <memory.h>
 #ifdef _DEBUG
@@ -243,3 +244,342 @@ void restructure_array(size_t ndims,    /* Dimension count */
   free(temp);
 }
 
+/* Edge of the square tiles moved by transpose_array(), in elements.
+ * A tile of the widest elements and its source lines fit in the level 1
+ * data cache.
+ */
+#define TRANSPOSE_TILE 32
+
+#define TRANSPOSE_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define TRANSPOSE_ABS(x) ((x) < 0 ? -(x) : (x))
+
+/* Copy a row of n elements, the source elements stride apart.
+ */
+#define TRANSPOSE_ROW(type) \
+  { \
+    const type *_s = (const type *)src + src_offset; \
+    type *_d = (type *)dst + dst_offset; \
+    for (j = 0; j < n; j++, _s += stride) \
+      _d[j] = *_s; \
+  }
+
+/* Copy a len_i by len_j block through square tiles. Rows of the block
+ * are contiguous and dst_row apart in the destination, the source
+ * elements of a row are stride_j apart and consecutive rows stride_i
+ * apart.
+ */
+#define TRANSPOSE_BLOCK(type) \
+  { \
+    for (i0 = 0; i0 < len_i; i0 += TRANSPOSE_TILE) { \
+      size_t i1 = TRANSPOSE_MIN(len_i, i0 + TRANSPOSE_TILE); \
+      for (j0 = 0; j0 < len_j; j0 += TRANSPOSE_TILE) { \
+        size_t j1 = TRANSPOSE_MIN(len_j, j0 + TRANSPOSE_TILE); \
+        for (i = i0; i < i1; i++) { \
+          const type *_s = (const type *)src + src_offset + \
+            (ptrdiff_t)i * stride_i + (ptrdiff_t)j0 * stride_j; \
+          type *_d = (type *)dst + dst_offset + i * dst_row; \
+          for (j = j0; j < j1; j++, _s += stride_j) \
+            _d[j] = *_s; \
+        } \
+      } \
+    } \
+  }
+
+/** Copy \a n elements of \a el_size bytes at \a src_offset in \a src
+ * to consecutive elements at \a dst_offset in \a dst.
+ */
+static void
+transpose_row(const unsigned char *src, unsigned char *dst, size_t el_size,
+              ptrdiff_t src_offset, size_t dst_offset, size_t n,
+              ptrdiff_t stride, int aligned)
+{
+  size_t j;
+
+  if (stride == 1) {
+    memcpy(dst + dst_offset * el_size, src + src_offset * el_size, n * el_size);
+  } else if (aligned && el_size == sizeof(unsigned char)) {
+    TRANSPOSE_ROW(unsigned char);
+  } else if (aligned && el_size == sizeof(unsigned short)) {
+    TRANSPOSE_ROW(unsigned short);
+  } else if (aligned && el_size == sizeof(unsigned int)) {
+    TRANSPOSE_ROW(unsigned int);
+  } else if (aligned && el_size == sizeof(unsigned long long)) {
+    TRANSPOSE_ROW(unsigned long long);
+  } else {
+    for (j = 0; j < n; j++) {
+      memcpy(dst + (dst_offset + j) * el_size,
+             src + (src_offset + (ptrdiff_t)j * stride) * el_size, el_size);
+    }
+  }
+}
+
+/** Transpose a \a len_i by \a len_j block of elements into rows
+ * \a dst_row elements apart at \a dst_offset in \a dst.
+ */
+static void
+transpose_block(const unsigned char *src, unsigned char *dst, size_t el_size,
+                ptrdiff_t src_offset, size_t dst_offset, size_t dst_row,
+                size_t len_i, ptrdiff_t stride_i,
+                size_t len_j, ptrdiff_t stride_j, int aligned)
+{
+  size_t i0, j0, i, j;
+
+  if (aligned && el_size == sizeof(unsigned char)) {
+    TRANSPOSE_BLOCK(unsigned char);
+  } else if (aligned && el_size == sizeof(unsigned short)) {
+    TRANSPOSE_BLOCK(unsigned short);
+  } else if (aligned && el_size == sizeof(unsigned int)) {
+    TRANSPOSE_BLOCK(unsigned int);
+  } else if (aligned && el_size == sizeof(unsigned long long)) {
+    TRANSPOSE_BLOCK(unsigned long long);
+  } else {
+    for (i0 = 0; i0 < len_i; i0 += TRANSPOSE_TILE) {
+      size_t i1 = TRANSPOSE_MIN(len_i, i0 + TRANSPOSE_TILE);
+      for (j0 = 0; j0 < len_j; j0 += TRANSPOSE_TILE) {
+        size_t j1 = TRANSPOSE_MIN(len_j, j0 + TRANSPOSE_TILE);
+        for (i = i0; i < i1; i++) {
+          for (j = j0; j < j1; j++) {
+            memcpy(dst + (dst_offset + i * dst_row + j) * el_size,
+                   src + (src_offset + (ptrdiff_t)i * stride_i +
+                          (ptrdiff_t)j * stride_j) * el_size, el_size);
+          }
+        }
+      }
+    }
+  }
+}
+
+/** Out-of-place version of restructure_array(). The elements of \a src
+ * are stored in \a dst in the order described by \a lengths_perm,
+ * \a map and \a dir, exactly as restructure_array() would leave them.
+ *
+ * Dimensions of length one are dropped, and neighbouring dimensions
+ * that stay contiguous in both arrays are merged, so that most
+ * permutations and flips of 3D and 4D volumes end up as plain row
+ * copies, reversed rows or a stack of 2D transposes. The transposes go
+ * through square tiles, so that the lines of both arrays stay in cache
+ * while a tile is moved.
+ */
+void transpose_array(size_t ndims,    /* Dimension count */
+                     const unsigned char *src, /* Raw data */
+                     unsigned char *dst, /* Restructured data */
+                     const size_t *lengths_perm, /* Permuted lengths */
+                     size_t el_size,  /* Element size, in bytes */
+                     const int *map, /* Mapping array */
+                     const int *dir) /* Direction array, in permuted order */
+{
+  size_t lengths[MAX_ARRAY_DIMS];    /* Raw (unpermuted) lengths */
+  ptrdiff_t raw_stride[MAX_ARRAY_DIMS]; /* Raw strides, in elements */
+  size_t len[MAX_ARRAY_DIMS];        /* Merged lengths, permuted order */
+  ptrdiff_t stride[MAX_ARRAY_DIMS];  /* Merged source strides */
+  size_t dst_stride[MAX_ARRAY_DIMS]; /* Merged destination strides */
+  size_t index[MAX_ARRAY_DIMS];      /* Index of the outer dimensions */
+  ptrdiff_t base = 0;
+  size_t n = 0;
+  int tile;                          /* Dimension tiled with the last */
+  int aligned;
+  size_t i;
+  int k;
+
+  for (i = 0; i < ndims; i++) {
+    lengths[map[i]] = lengths_perm[i];
+    if (lengths_perm[i] == 0) {
+      return;
+    }
+  }
+  for (i = ndims; i > 0; i--) {
+    raw_stride[i - 1] = (i == ndims) ? 1 : raw_stride[i] * (ptrdiff_t)lengths[i];
+  }
+
+  for (i = 0; i < ndims; i++) {
+    size_t l = lengths_perm[i];
+    ptrdiff_t s = raw_stride[map[i]];
+
+    if (dir[i] < 0) {
+      base += (ptrdiff_t)(l - 1) * s;
+      s = -s;
+    }
+    if (l == 1) {
+      continue;
+    }
+    if (n > 0 && stride[n - 1] == s * (ptrdiff_t)l) {
+      len[n - 1] *= l;
+      stride[n - 1] = s;
+    } else {
+      len[n] = l;
+      stride[n] = s;
+      n++;
+    }
+  }
+  if (n == 0) {
+    memcpy(dst, src + base * (ptrdiff_t)el_size, el_size);
+    return;
+  }
+  dst_stride[n - 1] = 1;
+  for (i = n - 1; i > 0; i--) {
+    dst_stride[i - 1] = dst_stride[i] * len[i];
+  }
+
+  aligned = ((size_t)src % el_size) == 0 && ((size_t)dst % el_size) == 0;
+
+  /* Unless the rows are contiguous, or reversed, in the source, tile
+   * the last dimension with the one that moves least in the source.
+   */
+  tile = -1;
+  if (TRANSPOSE_ABS(stride[n - 1]) != 1) {
+    for (k = 0; k < (int)n - 1; k++) {
+      if (tile < 0 || TRANSPOSE_ABS(stride[k]) < TRANSPOSE_ABS(stride[tile])) {
+        tile = k;
+      }
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    index[i] = 0;
+  }
+  for (;;) {
+    ptrdiff_t src_offset = base;
+    size_t dst_offset = 0;
+
+    for (k = 0; k < (int)n - 1; k++) {
+      if (k != tile) {
+        src_offset += (ptrdiff_t)index[k] * stride[k];
+        dst_offset += index[k] * dst_stride[k];
+      }
+    }
+    if (tile < 0) {
+      transpose_row(src, dst, el_size, src_offset, dst_offset,
+                    len[n - 1], stride[n - 1], aligned);
+    } else {
+      transpose_block(src, dst, el_size, src_offset, dst_offset, dst_stride[tile],
+                      len[tile], stride[tile], len[n - 1], stride[n - 1], aligned);
+    }
+
+    /* Next outer index */
+    for (k = (int)n - 2; k >= 0; k--) {
+      if (k == tile) {
+        continue;
+      }
+      if (++index[k] < len[k]) {
+        break;
+      }
+      index[k] = 0;
+    }
+    if (k < 0) {
+      break;
+    }
+  }
+}
+
+/** Swap the \a n elements of \a el_size bytes of the rows at \a a and
+ * \a b, the elements of \a b taken in reverse order if \a reversed is
+ * set.
+ */
+static void
+flip_swap_rows(unsigned char *a, unsigned char *b, size_t n, size_t el_size,
+               int reversed)
+{
+  unsigned char temp[256];
+  size_t i, j;
+
+  if (!reversed) {
+    size_t bytes = n * el_size;
+    for (i = 0; i < bytes; i += sizeof(temp)) {
+      size_t m = TRANSPOSE_MIN(bytes - i, sizeof(temp));
+      memcpy(temp, a + i, m);
+      memcpy(a + i, b + i, m);
+      memcpy(b + i, temp, m);
+    }
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    unsigned char *x = a + i * el_size;
+    unsigned char *y = b + (n - 1 - i) * el_size;
+    for (j = 0; j < el_size; j++) {
+      unsigned char t = x[j];
+      x[j] = y[j];
+      y[j] = t;
+    }
+  }
+}
+
+/** Reverse the \a n elements of \a el_size bytes of the row at \a a.
+ */
+static void
+flip_reverse_row(unsigned char *a, size_t n, size_t el_size)
+{
+  size_t i, j;
+
+  for (i = 0; i < n / 2; i++) {
+    unsigned char *x = a + i * el_size;
+    unsigned char *y = a + (n - 1 - i) * el_size;
+    for (j = 0; j < el_size; j++) {
+      unsigned char t = x[j];
+      x[j] = y[j];
+      y[j] = t;
+    }
+  }
+}
+
+/** Reverse, in place, the dimensions of a multidimensional array that
+ * have a negative \a dir. Every element is swapped with its mirror
+ * image, one row at a time, so no extra memory is needed and the
+ * array is only walked once.
+ */
+void flip_array(size_t ndims,       /* Dimension count */
+                unsigned char *array, /* Raw data */
+                const size_t *lengths, /* Lengths */
+                size_t el_size,     /* Element size, in bytes */
+                const int *dir)     /* Direction array */
+{
+  size_t index[MAX_ARRAY_DIMS];     /* Index of the row */
+  size_t row_stride[MAX_ARRAY_DIMS]; /* Strides in rows */
+  size_t row_length;
+  size_t row_bytes;
+  size_t row;
+  int reversed;
+  int k;
+
+  if (ndims == 0) {
+    return;
+  }
+  row_length = lengths[ndims - 1];
+  row_bytes = row_length * el_size;
+  reversed = dir[ndims - 1] < 0;
+  for (k = 0; k < (int)ndims; k++) {
+    if (lengths[k] == 0) {
+      return;
+    }
+    index[k] = 0;
+  }
+  if (ndims > 1) {
+    row_stride[ndims - 2] = 1;
+    for (k = (int)ndims - 3; k >= 0; k--) {
+      row_stride[k] = row_stride[k + 1] * lengths[k + 1];
+    }
+  }
+
+  for (row = 0; ; row++) {
+    size_t mirror = 0;
+
+    for (k = 0; k < (int)ndims - 1; k++) {
+      mirror += ((dir[k] < 0) ? lengths[k] - 1 - index[k] : index[k]) * row_stride[k];
+    }
+    if (mirror > row) {
+      flip_swap_rows(array + row * row_bytes, array + mirror * row_bytes,
+                     row_length, el_size, reversed);
+    } else if (mirror == row && reversed) {
+      flip_reverse_row(array + row * row_bytes, row_length, el_size);
+    }
+
+    for (k = (int)ndims - 2; k >= 0; k--) {
+      if (++index[k] < lengths[k]) {
+        break;
+      }
+      index[k] = 0;
+    }
+    if (k < 0) {
+      break;
+    }
+  }
+}
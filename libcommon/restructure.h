@@ -1,6 +1,7 @@
 /*
  * \file restructure.h
- * \brief Just declares the prototype of restructure_array().
+ * \brief Declares the prototypes of restructure_array(), transpose_array()
+ * and flip_array().
  */
 #ifndef MINC_RESTRUCTURE_H
 #define MINC_RESTRUCTURE_H
@@ -15,4 +16,23 @@ void restructure_array(size_t ndims,
                       const int *map,
                       const int *dir);
 
+/** Reorganize data in a multidimensional array from \a src into \a dst,
+ *  which must not overlap. Much faster than restructure_array().
+ */
+void transpose_array(size_t ndims,
+                     const unsigned char *src,
+                     unsigned char *dst,
+                     const size_t *lengths_perm,
+                     size_t el_size,
+                     const int *map,
+                     const int *dir);
+
+/** Reverse some dimensions of a multidimensional array "in place".
+ */
+void flip_array(size_t ndims,
+                unsigned char *array,
+                const size_t *lengths,
+                size_t el_size,
+                const int *dir);
+
 #endif /*MINC_RESTRUCTURE_H*/
\ No newline at end of file
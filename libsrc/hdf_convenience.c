@@ -1285,6 +1285,7 @@ hdf_vardef(int fd, const char *varnm, nc_type vartype, int ndims,
     struct m2_dim *dim;
     int chunk_length;
     int comp_level;
+    int shuffle = FALSE;
 
     /* Ignore deprecated variables */
     if (!strcmp(varnm, MIrootvariable)) {
@@ -1328,7 +1329,24 @@ hdf_vardef(int fd, const char *varnm, nc_type vartype, int ndims,
     spc_id = H5Screate_simple(ndims, dims, NULL);
 
         if (file->comp_type == MI2_COMP_UNKNOWN) {
-            comp_level = miget_cfg_int(MICFG_COMPRESS);
+            int codec;
+
+            /* MINC 1.0 files are written with zlib, the codecs that
+               need an HDF5 plugin use it at its default level */
+            comp_level = 0;
+            if (miget_cfg_compression(&codec, &comp_level)) {
+                if (codec == MICFG_CODEC_NONE) {
+                    comp_level = 0;
+                } else if (codec == MICFG_CODEC_ZLIB ||
+                           codec == MICFG_CODEC_SHUFFLE_ZLIB) {
+                    shuffle = (codec == MICFG_CODEC_SHUFFLE_ZLIB);
+                    if (comp_level < 0) {
+                        comp_level = MI2_DEFAULT_ZLIB_LEVEL;
+                    }
+                } else {
+                    comp_level = MI2_DEFAULT_ZLIB_LEVEL;
+                }
+            }
         } else {
             if (file->comp_type == MI2_COMP_ZLIB) {
                 comp_level = file->comp_param;
@@ -1386,6 +1404,9 @@ hdf_vardef(int fd, const char *varnm, nc_type vartype, int ndims,
                 }
             }
             
+            if (shuffle) {
+                H5Pset_shuffle(prp_id);
+            }
             H5Pset_deflate(prp_id, comp_level);
             H5Pset_chunk(prp_id, ndims, chkdims);
             
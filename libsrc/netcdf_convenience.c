@@ -181,6 +181,7 @@
 
 #include "minc_private.h"
 #include "ParseArgv.h"
+#include "minc_decompress.h"
 
 #if HAVE_UNISTD_H
 #include <unistd.h>
@@ -412,15 +413,24 @@ MNCAPI char *miexpand_file(const char *path, char *tempfile, int header_only,
    }
    *created_tempfile = TRUE;
 
+   /* Decompress gzip and bzip2 files in process, without running
+      another program */
+   status = 1;
+   if (((compress_type == GZIPPED) || (compress_type == BZIPPED)) &&
+       (midecompress_type(path) != MIDECOMPRESS_NONE)) {
+      status = midecompress_to_file(path, newfile);
+   }
+
    /* Try to use gunzip */
-   if ((compress_type == GZIPPED) || 
-       (compress_type == COMPRESSED) ||
-       (compress_type == PACKED) ||
-       (compress_type == ZIPPED)) {
+   if (status != 0 &&
+       (compress_type == GZIPPED ||
+        compress_type == COMPRESSED ||
+        compress_type == PACKED ||
+        compress_type == ZIPPED)) {
       status = execute_decompress_command("gunzip -c", path, newfile, 
                                           header_only);
    }
-   else if (compress_type == BZIPPED) {
+   else if (status != 0 && compress_type == BZIPPED) {
       status = execute_decompress_command("bunzip2 -c", path, newfile, 
                                           header_only);
    }
@@ -0,0 +1,555 @@
+/** \file async.c
+ * \brief MINC 2.0 asynchronous hyperslab reads
+ *
+ * Hyperslab reads queued on a background thread of the volume, so that
+ * file I/O and chunk decoding overlap with computation in the caller,
+ * and slab streams which keep the next few slabs along one dimension
+ * read ahead into a fixed set of buffers.
+ *
+ * Each volume has at most one background thread, started by the first
+ * queued read, which runs the reads of all requests and streams of the
+ * volume in the order they were queued. Without thread support, or
+ * with an HDF5 library that is not thread-safe, reads are performed
+ * when they are queued.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+/* States of a queued read */
+#define MIASYNC_IDLE 0          /* Never queued */
+#define MIASYNC_QUEUED 1        /* Waiting for the background thread */
+#define MIASYNC_RUNNING 2       /* Being read */
+#define MIASYNC_DONE 3          /* Read, failed or cancelled */
+
+/** \internal
+ * A read queued on the background thread of a volume. Requests and
+ * the buffers of slab streams are both jobs.
+ */
+struct miasyncreq {
+  struct miasyncreq *next;      /* Next job in the queue */
+  mihyperplan_t plan;           /* Plan executed by the job */
+  int owns_plan;                /* TRUE if the plan is freed with the job */
+  misize_t start[MI2_MAX_VAR_DIMS];
+  void *buffer;
+  int state;
+  int result;
+};
+
+/** \internal
+ * Background thread and queued reads of a volume.
+ */
+struct miasync_queue {
+  struct miasyncreq *head;
+  struct miasyncreq *tail;
+  struct mislabstream *streams; /* Open streams of the volume */
+  int synchronous;              /* TRUE if reads are performed when queued */
+  int closing;                  /* TRUE once the volume is being closed */
+#ifdef HAVE_PTHREAD
+  pthread_cond_t wake;          /* Signalled when a job is queued or on close */
+  pthread_t thread;
+  int started;
+#endif /*HAVE_PTHREAD*/
+};
+
+/** \internal
+ * Slabs along one dimension read ahead into a ring of buffers.
+ */
+struct mislabstream {
+  mihandle_t volume;            /* NULL once the volume is closed */
+  mihyperplan_t plan;           /* Shared by the jobs of the stream */
+  int dimension;                /* Apparent dimension the slabs follow */
+  misize_t n_slabs;
+  misize_t next_slab;           /* Next slab handed to the caller */
+  misize_t next_queued;         /* Next slab to read ahead */
+  int n_buffers;
+  int current;                  /* Buffer held by the caller, or -1 */
+  struct miasyncreq *jobs;      /* One per buffer */
+  unsigned char *buffers;
+  struct mislabstream *next;    /* Next stream of the same volume */
+};
+
+/* One lock guards the queues and job states of all volumes, so that a
+ * request can still be waited on after its volume has been closed.
+ */
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t miasync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t miasync_done = PTHREAD_COND_INITIALIZER;
+#define MIASYNC_LOCK() pthread_mutex_lock(&miasync_mutex)
+#define MIASYNC_UNLOCK() pthread_mutex_unlock(&miasync_mutex)
+#else
+#define MIASYNC_LOCK()
+#define MIASYNC_UNLOCK()
+#endif /*HAVE_PTHREAD*/
+
+static void miasync_run(struct miasyncreq *job)
+{
+  job->result = miexecute_hyperslab(job->plan, MI_HYPERSLAB_READ, job->start, job->buffer);
+  if (job->owns_plan) {
+    mifree_hyperslab(job->plan);
+    job->plan = NULL;
+  }
+}
+
+#ifdef HAVE_PTHREAD
+static void *miasync_worker(void *arg)
+{
+  struct miasync_queue *queue = (struct miasync_queue *) arg;
+  struct miasyncreq *job;
+
+  MIASYNC_LOCK();
+  for (;;) {
+    while (queue->head == NULL && !queue->closing) {
+      pthread_cond_wait(&queue->wake, &miasync_mutex);
+    }
+    if ((job = queue->head) == NULL) {
+      break;
+    }
+    queue->head = job->next;
+    if (queue->head == NULL) {
+      queue->tail = NULL;
+    }
+    job->next = NULL;
+    job->state = MIASYNC_RUNNING;
+    MIASYNC_UNLOCK();
+
+    miasync_run(job);
+
+    MIASYNC_LOCK();
+    job->state = MIASYNC_DONE;
+    pthread_cond_broadcast(&miasync_done);
+  }
+  MIASYNC_UNLOCK();
+  return NULL;
+}
+#endif /*HAVE_PTHREAD*/
+
+/** Wait until \a job is no longer queued or running. Called with the
+ * lock held.
+ */
+static void miasync_wait(struct miasyncreq *job)
+{
+#ifdef HAVE_PTHREAD
+  while (job->state == MIASYNC_QUEUED || job->state == MIASYNC_RUNNING) {
+    pthread_cond_wait(&miasync_done, &miasync_mutex);
+  }
+#endif /*HAVE_PTHREAD*/
+}
+
+/** Take \a job off the queue if it has not started yet, or wait for it
+ * to finish otherwise. Called with the lock held.
+ */
+static void miasync_cancel(struct miasync_queue *queue, struct miasyncreq *job)
+{
+  struct miasyncreq **link;
+
+  if (job->state == MIASYNC_QUEUED) {
+    for (link = &queue->head; *link != NULL; link = &(*link)->next) {
+      if (*link == job) {
+        *link = job->next;
+        break;
+      }
+    }
+    queue->tail = NULL;
+    for (link = &queue->head; *link != NULL; link = &(*link)->next) {
+      queue->tail = *link;
+    }
+    job->next = NULL;
+    job->state = MIASYNC_DONE;
+    job->result = MI_ERROR;
+    if (job->owns_plan) {
+      mifree_hyperslab(job->plan);
+      job->plan = NULL;
+    }
+  } else {
+    miasync_wait(job);
+  }
+}
+
+/** The queue of \a volume, created on first use.
+ */
+static struct miasync_queue *miasync_queue(mihandle_t volume)
+{
+  struct miasync_queue *queue;
+  hbool_t threadsafe = FALSE;
+
+  if (volume->async != NULL) {
+    return volume->async;
+  }
+  queue = (struct miasync_queue *) calloc(1, sizeof(struct miasync_queue));
+  if (queue == NULL) {
+    MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) sizeof(struct miasync_queue));
+    return NULL;
+  }
+  /* Concurrent calls into HDF5 need a thread-safe build of it */
+  if (H5is_library_threadsafe(&threadsafe) < 0 || !threadsafe) {
+    queue->synchronous = TRUE;
+  }
+#ifdef HAVE_PTHREAD
+  pthread_cond_init(&queue->wake, NULL);
+#else
+  queue->synchronous = TRUE;
+#endif /*HAVE_PTHREAD*/
+  volume->async = queue;
+  return queue;
+}
+
+/** Queue \a job on the background thread of \a volume, or perform it
+ * straight away if there is none.
+ */
+static int miasync_submit(mihandle_t volume, struct miasyncreq *job)
+{
+  struct miasync_queue *queue = miasync_queue(volume);
+
+  if (queue == NULL) {
+    return (MI_ERROR);
+  }
+
+  MIASYNC_LOCK();
+#ifdef HAVE_PTHREAD
+  if (!queue->synchronous && !queue->started) {
+    if (pthread_create(&queue->thread, NULL, miasync_worker, queue) == 0) {
+      queue->started = TRUE;
+    } else {
+      queue->synchronous = TRUE;
+    }
+  }
+#endif /*HAVE_PTHREAD*/
+  if (queue->synchronous) {
+    job->state = MIASYNC_RUNNING;
+    MIASYNC_UNLOCK();
+    miasync_run(job);
+    MIASYNC_LOCK();
+    job->state = MIASYNC_DONE;
+    MIASYNC_UNLOCK();
+    return (MI_NOERROR);
+  }
+  job->next = NULL;
+  job->state = MIASYNC_QUEUED;
+  if (queue->tail != NULL) {
+    queue->tail->next = job;
+  } else {
+    queue->head = job;
+  }
+  queue->tail = job;
+#ifdef HAVE_PTHREAD
+  pthread_cond_signal(&queue->wake);
+#endif /*HAVE_PTHREAD*/
+  MIASYNC_UNLOCK();
+  return (MI_NOERROR);
+}
+
+/** Cancel the queued reads of \a volume, wait for the one in progress
+ * and stop its background thread. Requests and streams of the volume
+ * remain valid, but their reads fail from now on.
+ */
+void miasync_close(mihandle_t volume)
+{
+  struct miasync_queue *queue = volume->async;
+  struct mislabstream *stream;
+
+  if (queue == NULL) {
+    return;
+  }
+
+  MIASYNC_LOCK();
+  queue->closing = TRUE;
+  while (queue->head != NULL) {
+    miasync_cancel(queue, queue->head);
+  }
+  MIASYNC_UNLOCK();
+
+#ifdef HAVE_PTHREAD
+  if (queue->started) {
+    pthread_cond_signal(&queue->wake);
+    pthread_join(queue->thread, NULL);
+  }
+  pthread_cond_destroy(&queue->wake);
+#endif /*HAVE_PTHREAD*/
+
+  for (stream = queue->streams; stream != NULL; stream = stream->next) {
+    mifree_hyperslab(stream->plan);
+    stream->plan = NULL;
+    stream->volume = NULL;
+  }
+  free(queue);
+  volume->async = NULL;
+}
+
+/** Start reading a hyperslab of real values in the background. The
+ * read is the one miget_real_value_hyperslab() performs, \a buffer
+ * must stay allocated until the request is waited on.
+ */
+int miget_real_value_hyperslab_async(mihandle_t volume,
+                                     mitype_t buffer_data_type,
+                                     const misize_t start[],
+                                     const misize_t count[],
+                                     void *buffer,
+                                     miasyncreq_t *request)
+{
+  struct miasyncreq *job;
+  int i;
+
+  if (volume == NULL || buffer == NULL || request == NULL ||
+      ((start == NULL || count == NULL) && volume->number_of_dims > 0)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to start an asynchronous read with null volume or null variables");
+  }
+
+  job = (struct miasyncreq *) calloc(1, sizeof(struct miasyncreq));
+  if (job == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) sizeof(struct miasyncreq));
+  }
+  if (miprepare_hyperslab(volume, MI_HYPERSLAB_REAL, buffer_data_type, count,
+                          &job->plan) < 0) {
+    free(job);
+    return (MI_ERROR);
+  }
+  job->owns_plan = TRUE;
+  job->buffer = buffer;
+  for (i = 0; i < volume->number_of_dims; i++) {
+    job->start[i] = start[i];
+  }
+  if (miasync_submit(volume, job) < 0) {
+    mifree_hyperslab(job->plan);
+    free(job);
+    return (MI_ERROR);
+  }
+  *request = job;
+  return (MI_NOERROR);
+}
+
+/** Wait for an asynchronous read to complete and release the request.
+ * Returns the result of the read, MI_ERROR if it was cancelled because
+ * the volume was closed.
+ */
+int miwait_hyperslab_async(miasyncreq_t request)
+{
+  int result;
+
+  if (request == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to wait for a null request");
+  }
+  MIASYNC_LOCK();
+  miasync_wait(request);
+  MIASYNC_UNLOCK();
+
+  result = request->result;
+  if (request->owns_plan && request->plan != NULL) {
+    mifree_hyperslab(request->plan);
+  }
+  free(request);
+  return (result);
+}
+
+/** Queue the read of \a slab into buffer \a index of \a stream.
+ */
+static int mislab_queue(mislabstream_t stream, int index, misize_t slab)
+{
+  struct miasyncreq *job = &stream->jobs[index];
+  int i;
+
+  for (i = 0; i < stream->plan->ndims; i++) {
+    job->start[i] = 0;
+  }
+  job->start[stream->dimension] = slab;
+  return miasync_submit(stream->volume, job);
+}
+
+/** Create a stream of the slabs of \a volume along the apparent
+ * dimension \a dimension, each of them one voxel thick and covering
+ * the whole extent of the other dimensions in apparent order. Up to
+ * \a n_prefetch slabs following the one being processed are read in
+ * the background, so the stream holds \a n_prefetch + 1 slab buffers.
+ * \a mode is MI_HYPERSLAB_VOXEL or MI_HYPERSLAB_REAL.
+ */
+int micreate_slab_stream(mihandle_t volume,
+                         mihyperslab_mode_t mode,
+                         mitype_t buffer_data_type,
+                         int dimension,
+                         int n_prefetch,
+                         mislabstream_t *stream_ptr)
+{
+  mislabstream_t stream;
+  struct miasync_queue *queue;
+  misize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hid_t fspc_id;
+  int i;
+
+  if (volume == NULL || stream_ptr == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to create a slab stream with null volume or null variables");
+  }
+  if (dimension < 0 || dimension >= volume->number_of_dims) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Slab stream dimension out of range");
+  }
+  if (mode != MI_HYPERSLAB_VOXEL && mode != MI_HYPERSLAB_REAL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Slab streams read voxel or real values");
+  }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to create a slab stream for a volume without image");
+  }
+  if (n_prefetch < 1) {
+    n_prefetch = 1;
+  }
+
+  /* Edge lengths of the selected resolution in apparent order */
+  MI_CHECK_HDF_CALL(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  if (fspc_id < 0) {
+    return (MI_ERROR);
+  }
+  H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  for (i = 0; i < volume->number_of_dims; i++) {
+    count[(volume->dim_indices != NULL) ? volume->dim_indices[i] : i] = dims[i];
+  }
+
+  stream = (mislabstream_t) calloc(1, sizeof(struct mislabstream));
+  if (stream == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) sizeof(struct mislabstream));
+  }
+  stream->volume = volume;
+  stream->dimension = dimension;
+  stream->n_slabs = count[dimension];
+  stream->current = -1;
+  count[dimension] = 1;
+
+  stream->n_buffers = n_prefetch + 1;
+  if ((misize_t) stream->n_buffers > stream->n_slabs) {
+    stream->n_buffers = (int) stream->n_slabs;
+  }
+
+  if (miprepare_hyperslab(volume, mode, buffer_data_type, count, &stream->plan) < 0) {
+    free(stream);
+    return (MI_ERROR);
+  }
+  stream->jobs = (struct miasyncreq *) calloc(stream->n_buffers, sizeof(struct miasyncreq));
+  stream->buffers = (unsigned char *) malloc(stream->n_buffers * stream->plan->buffer_size);
+  if ((queue = miasync_queue(volume)) == NULL ||
+      (stream->n_buffers > 0 && (stream->jobs == NULL || stream->buffers == NULL))) {
+    int n_buffers = stream->n_buffers;
+
+    mifree_hyperslab(stream->plan);
+    free(stream->jobs);
+    free(stream->buffers);
+    free(stream);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, n_buffers);
+  }
+  for (i = 0; i < stream->n_buffers; i++) {
+    stream->jobs[i].plan = stream->plan;
+    stream->jobs[i].buffer = stream->buffers + i * stream->plan->buffer_size;
+  }
+
+  MIASYNC_LOCK();
+  stream->next = queue->streams;
+  queue->streams = stream;
+  MIASYNC_UNLOCK();
+
+  for (i = 0; i < stream->n_buffers; i++) {
+    if (mislab_queue(stream, i, stream->next_queued++) < 0) {
+      mifree_slab_stream(stream);
+      return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to queue the reads of a slab stream");
+    }
+  }
+  *stream_ptr = stream;
+  return (MI_NOERROR);
+}
+
+/** Get the next slab of a stream. The buffer handed out stays valid
+ * until the next call, which reuses it to read ahead. At the end of
+ * the stream \a *buffer_ptr is set to NULL. \a slab_ptr, if not NULL,
+ * receives the index of the slab along the dimension of the stream.
+ */
+int miread_slab_stream(mislabstream_t stream, void **buffer_ptr, misize_t *slab_ptr)
+{
+  struct miasyncreq *job;
+  int index;
+
+  if (stream == NULL || buffer_ptr == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to read a slab stream with null variables");
+  }
+  if (stream->volume == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to read a slab stream of a closed volume");
+  }
+
+  /* The caller is done with the previous slab */
+  if (stream->current >= 0) {
+    if (stream->next_queued < stream->n_slabs &&
+        mislab_queue(stream, stream->current, stream->next_queued++) < 0) {
+      return (MI_ERROR);
+    }
+    stream->current = -1;
+  }
+
+  *buffer_ptr = NULL;
+  if (stream->next_slab >= stream->n_slabs) {
+    return (MI_NOERROR);
+  }
+
+  index = (int) (stream->next_slab % stream->n_buffers);
+  job = &stream->jobs[index];
+  MIASYNC_LOCK();
+  miasync_wait(job);
+  MIASYNC_UNLOCK();
+  if (job->result < 0) {
+    return (MI_ERROR);
+  }
+
+  *buffer_ptr = job->buffer;
+  if (slab_ptr != NULL) {
+    *slab_ptr = stream->next_slab;
+  }
+  stream->current = index;
+  stream->next_slab++;
+  return (MI_NOERROR);
+}
+
+/** Cancel the reads ahead of a slab stream and release it, along with
+ * its buffers. This may be called after the volume has been closed.
+ */
+int mifree_slab_stream(mislabstream_t stream)
+{
+  struct miasync_queue *queue;
+  struct mislabstream **link;
+  int i;
+
+  if (stream == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to free a null slab stream");
+  }
+
+  if (stream->volume != NULL && (queue = stream->volume->async) != NULL) {
+    MIASYNC_LOCK();
+    for (i = 0; i < stream->n_buffers; i++) {
+      miasync_cancel(queue, &stream->jobs[i]);
+    }
+    for (link = &queue->streams; *link != NULL; link = &(*link)->next) {
+      if (*link == stream) {
+        *link = stream->next;
+        break;
+      }
+    }
+    MIASYNC_UNLOCK();
+  }
+  if (stream->plan != NULL) {
+    mifree_hyperslab(stream->plan);
+  }
+  free(stream->jobs);
+  free(stream->buffers);
+  free(stream);
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,643 @@
+/** \file chunkcache.c
+ * \brief MINC 2.0 image chunk cache
+ *
+ * Functions to size the HDF5 raw data chunk cache of each image
+ * dataset from its chunk shape and from the selections read from it,
+ * and to keep hit, miss and eviction counters for that cache.
+ *
+ * HDF5 does not report what its chunk cache does, so the counters come
+ * from a model of it: a least recently used list of chunks holding as
+ * many chunks as fit in the cache. The cache is given
+ * MI2_CHUNK_CACHE_SLOTS_PER_CHUNK hash slots per chunk it holds, so slot
+ * collisions are rare. The preemption weight w0 is kept from the dataset
+ * access properties; the model ignores the preference it gives to
+ * evicting chunks that were read or written in full.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Largest chunk cache given to an image dataset automatically. */
+#define MI2_MAX_CHUNK_CACHE_BYTES (256 * 1024 * 1024)
+
+/** Largest number of hash slots given to an image dataset automatically. */
+#define MI2_MAX_CHUNK_CACHE_SLOTS 262144
+
+/** Hash slots per chunk held in the cache, as recommended by HDF5. */
+#define MI2_CHUNK_CACHE_SLOTS_PER_CHUNK 100
+
+#define MI2_CHUNK_NIL ((size_t) -1)
+
+/** \internal
+ * A chunk held in the model of the cache.
+ */
+struct michunk_entry {
+  misize_t key;                 /* Linear index of the chunk */
+  size_t prev;                  /* Towards the most recently used */
+  size_t next;                  /* Towards the least recently used */
+  size_t chain;                 /* Next entry in the same hash bucket */
+};
+
+/** \internal
+ * Chunk cache settings and model of the image dataset of a volume.
+ */
+struct michunk_cache {
+  int ndims;
+  hsize_t chunk_dims[MI2_MAX_VAR_DIMS]; /* Chunk edge lengths */
+  hsize_t dset_dims[MI2_MAX_VAR_DIMS];  /* Image edge lengths */
+  hsize_t n_chunks[MI2_MAX_VAR_DIMS];   /* Chunks along each dimension */
+  size_t chunk_bytes;           /* Size of a decoded chunk */
+  size_t nbytes;                /* Settings of the HDF5 chunk cache */
+  size_t nslots;
+  double w0;
+  int fixed;                    /* TRUE once set by miset_volume_chunk_cache() */
+  size_t capacity;              /* Chunks held by the cache */
+  struct michunk_entry *entries;
+  size_t n_used;                /* Chunks held in the model */
+  size_t n_entries;             /* Entries in use or on the free list */
+  size_t max_entries;           /* Entries allocated */
+  size_t *buckets;
+  size_t n_buckets;             /* A power of two */
+  size_t head;                  /* Most recently used chunk */
+  size_t tail;                  /* Least recently used chunk */
+  size_t free_list;
+  misize_t hits;
+  misize_t misses;
+  misize_t evictions;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;         /* Guards the model and the counters */
+#endif /*HAVE_PTHREAD*/
+};
+
+#ifdef HAVE_PTHREAD
+#define MICHUNK_LOCK(cache) pthread_mutex_lock(&(cache)->lock)
+#define MICHUNK_UNLOCK(cache) pthread_mutex_unlock(&(cache)->lock)
+#else
+#define MICHUNK_LOCK(cache)
+#define MICHUNK_UNLOCK(cache)
+#endif /*HAVE_PTHREAD*/
+
+/** Returns the smallest prime not below \a n.
+ */
+static size_t michunk_next_prime(size_t n)
+{
+  size_t d;
+
+  if (n <= 2) {
+    return 2;
+  }
+  for (n |= 1;; n += 2) {
+    for (d = 3; d * d <= n && n % d != 0; d += 2)
+      ;
+    if (d * d > n) {
+      return n;
+    }
+  }
+}
+
+/** Empty the model, leaving the counters alone.
+ */
+static void michunk_cache_clear(struct michunk_cache *cache)
+{
+  size_t n_buckets = 1;
+
+  free(cache->entries);
+  free(cache->buckets);
+  cache->entries = NULL;
+  cache->buckets = NULL;
+  cache->n_used = 0;
+  cache->n_entries = 0;
+  cache->max_entries = 0;
+  cache->head = cache->tail = cache->free_list = MI2_CHUNK_NIL;
+
+  cache->capacity = cache->chunk_bytes > 0 ? cache->nbytes / cache->chunk_bytes : 0;
+  while (n_buckets < cache->capacity && n_buckets < MI2_MAX_CHUNK_CACHE_SLOTS) {
+    n_buckets <<= 1;
+  }
+  cache->n_buckets = n_buckets;
+}
+
+/** Give the image dataset a chunk cache of \a nbytes bytes. HDF5 only
+ * applies the cache settings of a dataset when it is opened, and shares
+ * one cache between all handles of a dataset, so the image is closed
+ * and opened again. Opening the new handle before closing the old one
+ * would leave the old settings in place. Should the image fail to open
+ * with the new settings it is opened again with the old ones.
+ */
+static int michunk_cache_apply(mihandle_t volume, size_t nbytes)
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+  char path[MI2_MAX_PATH];
+  hid_t dapl_id;
+  hid_t old_dapl_id;
+  hid_t image_id;
+  size_t n_fit;
+  size_t nslots;
+
+  n_fit = nbytes / cache->chunk_bytes;
+  nslots = n_fit * MI2_CHUNK_CACHE_SLOTS_PER_CHUNK;
+  if (nslots > MI2_MAX_CHUNK_CACHE_SLOTS) {
+    nslots = MI2_MAX_CHUNK_CACHE_SLOTS;
+  }
+  if (nslots < cache->nslots) {
+    nslots = cache->nslots;
+  }
+  nslots = michunk_next_prime(nslots);
+
+  if (H5Iget_name(volume->image_id, path, sizeof(path)) <= 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to get the path of the image dataset");
+  }
+  MI_CHECK_HDF_CALL_RET(dapl_id = H5Pcreate(H5P_DATASET_ACCESS),"H5Pcreate");
+  if (H5Pset_chunk_cache(dapl_id, nslots, nbytes, cache->w0) < 0) {
+    H5Pclose(dapl_id);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to set the chunk cache");
+  }
+  old_dapl_id = H5Dget_access_plist(volume->image_id);
+  if (old_dapl_id < 0) {
+    H5Pclose(dapl_id);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to get the image access properties");
+  }
+  H5Dclose(volume->image_id);
+  image_id = H5Dopen2(volume->hdf_id, path, dapl_id);
+  H5Pclose(dapl_id);
+  if (image_id < 0) {
+    volume->image_id = H5Dopen2(volume->hdf_id, path, old_dapl_id);
+    H5Pclose(old_dapl_id);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to reopen the image dataset with a new chunk cache");
+  }
+  H5Pclose(old_dapl_id);
+  volume->image_id = image_id;
+
+  cache->nbytes = nbytes;
+  cache->nslots = nslots;
+  michunk_cache_clear(cache);
+  return (MI_NOERROR);
+}
+
+/** Set up the chunk cache of the image dataset of a volume after it has
+ * been opened or created. The cache is made large enough to hold every
+ * chunk of a slice, that is all chunks covering the two fastest varying
+ * dimensions, so that reading slice after slice decodes each chunk
+ * only once.
+ */
+int michunk_cache_init(mihandle_t volume)
+{
+  struct michunk_cache *cache;
+  hid_t dcpl_id;
+  hid_t dapl_id;
+  hid_t type_id;
+  hid_t fspc_id;
+  size_t fixed_bytes = 0;
+  size_t nbytes;
+  int i;
+
+  if (volume->chunk_cache != NULL) {
+    if (volume->chunk_cache->fixed) {
+      fixed_bytes = volume->chunk_cache->nbytes;
+    }
+    michunk_cache_free(volume);
+  }
+  if (volume->image_id < 0 || volume->number_of_dims <= 0) {
+    return (MI_NOERROR);
+  }
+
+  cache = (struct michunk_cache *) calloc(1, sizeof(struct michunk_cache));
+  if (cache == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int)sizeof(struct michunk_cache));
+  }
+  cache->ndims = volume->number_of_dims;
+
+  MI_CHECK_HDF_CALL_RET(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+  if (H5Pget_layout(dcpl_id) != H5D_CHUNKED ||
+      H5Pget_chunk(dcpl_id, cache->ndims, cache->chunk_dims) != cache->ndims) {
+    /* Contiguous images have no chunk cache */
+    H5Pclose(dcpl_id);
+    free(cache);
+    return (MI_NOERROR);
+  }
+  H5Pclose(dcpl_id);
+
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  i = H5Sget_simple_extent_dims(fspc_id, cache->dset_dims, NULL);
+  H5Sclose(fspc_id);
+  MI_CHECK_HDF_CALL_RET(type_id = H5Dget_type(volume->image_id),"H5Dget_type");
+  cache->chunk_bytes = H5Tget_size(type_id);
+  H5Tclose(type_id);
+  if (i != cache->ndims) {
+    free(cache);
+    return (MI_NOERROR);
+  }
+  for (i = 0; i < cache->ndims; i++) {
+    cache->n_chunks[i] = (cache->dset_dims[i] + cache->chunk_dims[i] - 1) / cache->chunk_dims[i];
+    cache->chunk_bytes *= (size_t) cache->chunk_dims[i];
+  }
+
+  /* Start from the file-wide settings of _hdf_open() and _hdf_create() */
+  MI_CHECK_HDF_CALL_RET(dapl_id = H5Dget_access_plist(volume->image_id),"H5Dget_access_plist");
+  H5Pget_chunk_cache(dapl_id, &cache->nslots, &cache->nbytes, &cache->w0);
+  H5Pclose(dapl_id);
+  michunk_cache_clear(cache);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&cache->lock, NULL);
+#endif /*HAVE_PTHREAD*/
+  volume->chunk_cache = cache;
+
+  if (fixed_bytes != 0) {
+    cache->fixed = TRUE;
+    return michunk_cache_apply(volume, fixed_bytes);
+  }
+
+  nbytes = cache->chunk_bytes;
+  for (i = cache->ndims - 1; i >= 0 && i >= cache->ndims - 2; i--) {
+    nbytes *= (size_t) cache->n_chunks[i];
+  }
+  if (nbytes > MI2_MAX_CHUNK_CACHE_BYTES) {
+    nbytes = MI2_MAX_CHUNK_CACHE_BYTES;
+  }
+  if (nbytes > cache->nbytes) {
+    return michunk_cache_apply(volume, nbytes);
+  }
+  return (MI_NOERROR);
+}
+
+/** Grow the chunk cache of the image if needed to hold all chunks
+ * touched by a selection of \a count elements, in file order, wherever
+ * it lies. Successive selections then only decode the chunks they do
+ * not share with the previous one. Selections of the whole image have
+ * nothing to share and leave the cache alone. Resizing the cache
+ * reopens the image, so it stops once reads run in the background or
+ * the volume is shared by concurrent readers.
+ */
+int michunk_cache_fit(mihandle_t volume, const hsize_t count[])
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+  size_t nbytes;
+  int whole = TRUE;
+  int i;
+
+  if (cache == NULL || cache->fixed || volume->async != NULL ||
+      volume->concurrent_reads) {
+    return (MI_NOERROR);
+  }
+  nbytes = cache->chunk_bytes;
+  for (i = 0; i < cache->ndims; i++) {
+    hsize_t n = 1;
+
+    if (count[i] > 1) {
+      n = (count[i] + cache->chunk_dims[i] - 2) / cache->chunk_dims[i] + 1;
+    }
+    if (n > cache->n_chunks[i]) {
+      n = cache->n_chunks[i];
+    }
+    if (count[i] < cache->dset_dims[i]) {
+      whole = FALSE;
+    }
+    nbytes *= (size_t) n;
+  }
+  if (whole) {
+    return (MI_NOERROR);
+  }
+  if (nbytes > MI2_MAX_CHUNK_CACHE_BYTES) {
+    nbytes = MI2_MAX_CHUNK_CACHE_BYTES;
+  }
+  if (nbytes > cache->nbytes) {
+    return michunk_cache_apply(volume, nbytes);
+  }
+  return (MI_NOERROR);
+}
+
+/** Follow the image of \a volume after frames were appended to it, to
+ * \a n_slabs along the slowest dimension. Chunks are numbered with the
+ * slowest dimension first, so those already in the model keep their
+ * numbers.
+ */
+void michunk_cache_extend(mihandle_t volume, hsize_t n_slabs)
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+
+  if (cache == NULL || cache->ndims == 0) {
+    return;
+  }
+  cache->dset_dims[0] = n_slabs;
+  cache->n_chunks[0] = (n_slabs + cache->chunk_dims[0] - 1) / cache->chunk_dims[0];
+}
+
+/** Release the chunk cache model of a volume.
+ */
+void michunk_cache_free(mihandle_t volume)
+{
+  if (volume->chunk_cache != NULL) {
+    free(volume->chunk_cache->entries);
+    free(volume->chunk_cache->buckets);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&volume->chunk_cache->lock);
+#endif /*HAVE_PTHREAD*/
+    free(volume->chunk_cache);
+    volume->chunk_cache = NULL;
+  }
+}
+
+static void michunk_unlink(struct michunk_cache *cache, size_t e)
+{
+  struct michunk_entry *entry = &cache->entries[e];
+
+  if (entry->prev != MI2_CHUNK_NIL) {
+    cache->entries[entry->prev].next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != MI2_CHUNK_NIL) {
+    cache->entries[entry->next].prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+static void michunk_push_front(struct michunk_cache *cache, size_t e)
+{
+  struct michunk_entry *entry = &cache->entries[e];
+
+  entry->prev = MI2_CHUNK_NIL;
+  entry->next = cache->head;
+  if (cache->head != MI2_CHUNK_NIL) {
+    cache->entries[cache->head].prev = e;
+  } else {
+    cache->tail = e;
+  }
+  cache->head = e;
+}
+
+/** Find the entry of chunk \a key, and the link pointing at it in its
+ * hash bucket.
+ */
+static size_t michunk_find(struct michunk_cache *cache, misize_t key, size_t **link_ptr)
+{
+  size_t *link = &cache->buckets[key & (cache->n_buckets - 1)];
+
+  while (*link != MI2_CHUNK_NIL && cache->entries[*link].key != key) {
+    link = &cache->entries[*link].chain;
+  }
+  *link_ptr = link;
+  return *link;
+}
+
+/** Drop entry \a e from the model and put it on the free list.
+ */
+static void michunk_remove(struct michunk_cache *cache, size_t e)
+{
+  size_t *link;
+
+  michunk_find(cache, cache->entries[e].key, &link);
+  *link = cache->entries[e].chain;
+  michunk_unlink(cache, e);
+  cache->entries[e].next = cache->free_list;
+  cache->free_list = e;
+  cache->n_used--;
+}
+
+/** Returns a free entry, evicting the least recently used chunk if the
+ * cache is full.
+ */
+static size_t michunk_alloc(struct michunk_cache *cache)
+{
+  size_t e;
+
+  if (cache->n_used >= cache->capacity) {
+    cache->evictions++;
+    michunk_remove(cache, cache->tail);
+  }
+  if (cache->free_list != MI2_CHUNK_NIL) {
+    e = cache->free_list;
+    cache->free_list = cache->entries[e].next;
+    cache->n_used++;
+    return e;
+  }
+  if (cache->n_entries == cache->max_entries) {
+    size_t n = cache->max_entries ? 2 * cache->max_entries : 64;
+    struct michunk_entry *entries;
+
+    if (n > cache->capacity) {
+      n = cache->capacity;
+    }
+    entries = realloc(cache->entries, n * sizeof(struct michunk_entry));
+    if (entries == NULL) {
+      return MI2_CHUNK_NIL;
+    }
+    cache->entries = entries;
+    cache->max_entries = n;
+  }
+  cache->n_used++;
+  return cache->n_entries++;
+}
+
+/** Record the chunks of the box of \a count elements at \a start in
+ * the model. Called with the lock held.
+ */
+static void michunk_record(struct michunk_cache *cache, const hsize_t start[],
+                           const hsize_t count[])
+{
+  hsize_t first[MI2_MAX_VAR_DIMS];
+  hsize_t last[MI2_MAX_VAR_DIMS];
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  int i;
+
+  for (i = 0; i < cache->ndims; i++) {
+    if (count[i] == 0) {
+      return;
+    }
+    first[i] = start[i] / cache->chunk_dims[i];
+    last[i] = (start[i] + count[i] - 1) / cache->chunk_dims[i];
+    index[i] = first[i];
+  }
+  if (cache->capacity > 0 && cache->buckets == NULL) {
+    cache->buckets = malloc(cache->n_buckets * sizeof(size_t));
+    if (cache->buckets == NULL) {
+      return;
+    }
+    memset(cache->buckets, 0xff, cache->n_buckets * sizeof(size_t));
+  }
+
+  for (;;) {
+    misize_t key = 0;
+    size_t *link;
+    size_t e;
+
+    for (i = 0; i < cache->ndims; i++) {
+      key = key * cache->n_chunks[i] + index[i];
+    }
+    if (cache->capacity == 0) {
+      /* Chunks larger than the cache are never kept */
+      cache->misses++;
+    } else if ((e = michunk_find(cache, key, &link)) != MI2_CHUNK_NIL) {
+      cache->hits++;
+      michunk_unlink(cache, e);
+      michunk_push_front(cache, e);
+    } else {
+      cache->misses++;
+      if ((e = michunk_alloc(cache)) != MI2_CHUNK_NIL) {
+        cache->entries[e].key = key;
+        cache->entries[e].chain = cache->buckets[key & (cache->n_buckets - 1)];
+        cache->buckets[key & (cache->n_buckets - 1)] = e;
+        michunk_push_front(cache, e);
+      }
+    }
+
+    for (i = cache->ndims - 1; i >= 0; i--) {
+      if (++index[i] <= last[i]) {
+        break;
+      }
+      index[i] = first[i];
+    }
+    if (i < 0) {
+      break;
+    }
+  }
+}
+
+/** Record a read or write through H5Dread() or H5Dwrite() of the box of
+ * \a count elements at \a start, in file order, in the chunk cache
+ * model of the volume.
+ */
+void michunk_cache_access(mihandle_t volume, const hsize_t start[], const hsize_t count[])
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+
+  if (cache != NULL) {
+    MICHUNK_LOCK(cache);
+    michunk_record(cache, start, count);
+    MICHUNK_UNLOCK(cache);
+  }
+}
+
+/** Record \a n_chunks chunks read with H5Dread_chunk(), which bypasses
+ * the chunk cache.
+ */
+void michunk_cache_bypass(mihandle_t volume, size_t n_chunks)
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+
+  if (cache != NULL) {
+    MICHUNK_LOCK(cache);
+    cache->misses += n_chunks;
+    MICHUNK_UNLOCK(cache);
+  }
+}
+
+/** Record the chunk at \a offset, in elements, being written with
+ * H5Dwrite_chunk(), which drops any copy of it from the chunk cache.
+ */
+void michunk_cache_discard(mihandle_t volume, const hsize_t offset[])
+{
+  struct michunk_cache *cache = volume->chunk_cache;
+  misize_t key = 0;
+  size_t *link;
+  size_t e;
+  int i;
+
+  if (cache == NULL) {
+    return;
+  }
+  for (i = 0; i < cache->ndims; i++) {
+    key = key * cache->n_chunks[i] + offset[i] / cache->chunk_dims[i];
+  }
+  MICHUNK_LOCK(cache);
+  if (cache->buckets != NULL && (e = michunk_find(cache, key, &link)) != MI2_CHUNK_NIL) {
+    michunk_remove(cache, e);
+  }
+  MICHUNK_UNLOCK(cache);
+}
+
+/** Set the size of the chunk cache of the image of \a volume, replacing
+ * the size chosen from its chunk shape and the selections read.
+ */
+int miset_volume_chunk_cache(mihandle_t volume, misize_t nbytes)
+{
+  if (volume != NULL && miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (volume == NULL || volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to set the chunk cache of a null volume or a volume without image");
+  }
+  if (volume->chunk_cache == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to set the chunk cache of an image that is not chunked");
+  }
+  if (micheck_not_concurrent(volume) < 0) {
+    return (MI_ERROR);
+  }
+  /* Let the number of slots shrink along with the cache */
+  volume->chunk_cache->fixed = TRUE;
+  volume->chunk_cache->nslots = 0;
+  return michunk_cache_apply(volume, (size_t) nbytes);
+}
+
+/** Get the size in bytes and the number of hash slots of the chunk
+ * cache of the image of \a volume. Both are zero if the image is not
+ * chunked.
+ */
+int miget_volume_chunk_cache(mihandle_t volume, misize_t *nbytes, misize_t *nslots)
+{
+  if (volume == NULL || nbytes == NULL || nslots == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get the chunk cache with null volume or null variables");
+  }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (volume->chunk_cache == NULL) {
+    *nbytes = *nslots = 0;
+  } else {
+    *nbytes = volume->chunk_cache->nbytes;
+    *nslots = volume->chunk_cache->nslots;
+  }
+  return (MI_NOERROR);
+}
+
+/** Get the number of chunk cache hits, misses and evictions since the
+ * volume was opened or the counters were last reset.
+ */
+int miget_volume_chunk_cache_stats(mihandle_t volume, misize_t *hits,
+                                   misize_t *misses, misize_t *evictions)
+{
+  if (volume == NULL || hits == NULL || misses == NULL || evictions == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get chunk cache statistics with null volume or null variables");
+  }
+  if (volume->chunk_cache == NULL) {
+    *hits = *misses = *evictions = 0;
+  } else {
+    MICHUNK_LOCK(volume->chunk_cache);
+    *hits = volume->chunk_cache->hits;
+    *misses = volume->chunk_cache->misses;
+    *evictions = volume->chunk_cache->evictions;
+    MICHUNK_UNLOCK(volume->chunk_cache);
+  }
+  return (MI_NOERROR);
+}
+
+/** Reset the chunk cache counters of \a volume to zero.
+ */
+int mireset_volume_chunk_cache_stats(mihandle_t volume)
+{
+  if (volume == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to reset chunk cache statistics of a null volume");
+  }
+  if (volume->chunk_cache != NULL) {
+    MICHUNK_LOCK(volume->chunk_cache);
+    volume->chunk_cache->hits = 0;
+    volume->chunk_cache->misses = 0;
+    volume->chunk_cache->evictions = 0;
+    MICHUNK_UNLOCK(volume->chunk_cache);
+  }
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,1137 @@
+/** \file chunkio.c
+ * \brief MINC 2.0 direct chunk I/O
+ *
+ * Functions to read and write compressed image chunks directly, and
+ * decode or encode them on a pool of worker threads, instead of going
+ * through the serial filter pipeline of H5Dread() and H5Dwrite().
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+#include <zlib.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+
+#include "minc_config.h"
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Largest number of worker threads used for one transfer. */
+#define MI2_MAX_THREADS 64
+
+/** Upper bound on the number of raw chunk bytes held in memory at once. */
+#define MI2_CHUNK_BATCH_BYTES (64 * 1024 * 1024)
+
+/** Upper bound on the number of chunks fetched before decoding them. */
+#define MI2_CHUNK_BATCH_COUNT 1024
+
+/** \internal
+ * Work shared between the threads of a pool.
+ */
+struct michunk_pool {
+  michunk_task_t task;          /* Function applied to every task */
+  void *ctx;                    /* Task context */
+  size_t n_tasks;               /* Number of tasks */
+  size_t next_task;             /* Next task to hand out */
+  size_t scratch_size;          /* Per-thread scratch memory */
+  int error;                    /* Non-zero once a task has failed */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif /*HAVE_PTHREAD*/
+};
+
+/** \internal
+ * State of a direct chunk read.
+ */
+struct michunk_read {
+  mihyperplan_t plan;
+  size_t chunk_bytes;           /* Size of a decoded chunk */
+  unsigned char *dest;          /* Selection in file order and file type */
+  const int *dir;               /* Flipped dimensions of dest, or NULL */
+  hsize_t *offsets;             /* Chunk offsets, ndims per chunk */
+  void **raw;                   /* Raw chunk data as stored, NULL if unallocated */
+  size_t *raw_size;             /* Size of the raw chunk data */
+  unsigned int *filter_mask;    /* Filters skipped for each chunk */
+  unsigned char *fill_chunk;    /* A chunk of fill values, made on demand */
+};
+
+/** \internal
+ * State of a direct chunk write.
+ */
+struct michunk_write {
+  mihyperplan_t plan;
+  size_t chunk_bytes;           /* Size of a decoded chunk */
+  size_t scratch_bytes;         /* Room for a chunk at any filter stage */
+  const unsigned char *src;     /* Selection in file order and file type */
+  const int *dir;               /* Flipped dimensions of src, or NULL */
+  hsize_t *offsets;             /* Chunk offsets, ndims per chunk */
+  void **packed;                /* Encoded chunk data, NULL if not stored */
+  size_t *packed_size;          /* Size of the encoded chunk data */
+  int *allocated;               /* FALSE if the chunk has no storage yet */
+};
+
+static void *michunk_worker(void *arg)
+{
+  struct michunk_pool *pool = (struct michunk_pool *) arg;
+  void *scratch = NULL;
+  size_t index;
+
+  if (pool->scratch_size != 0 && (scratch = malloc(pool->scratch_size)) == NULL) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+    pool->error = 1;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+    return NULL;
+  }
+
+  for (;;) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+    index = pool->error ? pool->n_tasks : pool->next_task++;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+
+    if (index >= pool->n_tasks) {
+      break;
+    }
+    if (pool->task(pool->ctx, index, scratch) < 0) {
+#ifdef HAVE_PTHREAD
+      pthread_mutex_lock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+      pool->error = 1;
+#ifdef HAVE_PTHREAD
+      pthread_mutex_unlock(&pool->lock);
+#endif /*HAVE_PTHREAD*/
+    }
+  }
+  free(scratch);
+  return NULL;
+}
+
+/** Run \a task for every index below \a n_tasks on up to \a n_threads
+ * threads, the calling thread included. Each thread gets its own
+ * \a scratch_size bytes of scratch memory.
+ */
+int michunk_run(int n_threads, size_t n_tasks, size_t scratch_size,
+                michunk_task_t task, void *ctx)
+{
+  struct michunk_pool pool;
+#ifdef HAVE_PTHREAD
+  pthread_t threads[MI2_MAX_THREADS];
+  int n_started = 0;
+  int i;
+#endif /*HAVE_PTHREAD*/
+
+  pool.task = task;
+  pool.ctx = ctx;
+  pool.n_tasks = n_tasks;
+  pool.next_task = 0;
+  pool.scratch_size = scratch_size;
+  pool.error = 0;
+
+  if ((size_t) n_threads > n_tasks) {
+    n_threads = (int) n_tasks;
+  }
+  if (n_threads > MI2_MAX_THREADS) {
+    n_threads = MI2_MAX_THREADS;
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&pool.lock, NULL);
+  for (i = 1; i < n_threads; i++) {
+    if (pthread_create(&threads[n_started], NULL, michunk_worker, &pool) == 0) {
+      n_started++;
+    }
+  }
+#endif /*HAVE_PTHREAD*/
+
+  michunk_worker(&pool);
+
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < n_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool.lock);
+#endif /*HAVE_PTHREAD*/
+
+  return (pool.error ? MI_ERROR : MI_NOERROR);
+}
+
+/** Returns the number of worker threads configured with the \a cfg
+ * key, defaulting to the number of online processors.
+ */
+int michunk_default_threads(int cfg)
+{
+  if (miget_cfg_present(cfg)) {
+    int n = miget_cfg_int(cfg);
+    return (n < 0 ? 0 : n);
+  }
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+  {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > MI2_MAX_THREADS) {
+      n = MI2_MAX_THREADS;
+    }
+    return (n > 0 ? (int) n : 1);
+  }
+#else
+  return 1;
+#endif
+}
+
+/** Check whether the image of a plan can be read chunk by chunk,
+ * and record its chunk layout and filter pipeline in the plan.
+ */
+int michunk_init_plan(mihyperplan_t plan)
+{
+#ifdef MI2_DIRECT_CHUNK_IO
+  mihandle_t volume = plan->volume;
+  hid_t dcpl_id;
+  H5T_class_t type_class;
+  int n_filters;
+  int i;
+
+  plan->chunk_io = FALSE;
+  if (plan->ndims == 0) {
+    return (MI_NOERROR);
+  }
+
+  MI_CHECK_HDF_CALL_RET(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+
+  if (H5Pget_layout(dcpl_id) != H5D_CHUNKED ||
+      H5Pget_chunk(dcpl_id, plan->ndims, plan->chunk_dims) != plan->ndims) {
+    H5Pclose(dcpl_id);
+    return (MI_NOERROR);
+  }
+
+  /* Only pipelines made entirely of filters we can code ourselves
+   * (deflate and byte shuffle) are handled, anything else (checksums,
+   * LZ4 or Zstandard plugins for example) goes through H5Dread() and
+   * H5Dwrite().
+   */
+  n_filters = H5Pget_nfilters(dcpl_id);
+  if (n_filters <= 0 || n_filters > MI2_MAX_CHUNK_FILTERS) {
+    H5Pclose(dcpl_id);
+    return (MI_NOERROR);
+  }
+  for (i = 0; i < n_filters; i++) {
+    unsigned int flags;
+    unsigned int cd_values[8];
+    size_t cd_nelmts = 8;
+    H5Z_filter_t filter_id;
+
+    filter_id = H5Pget_filter2(dcpl_id, i, &flags, &cd_nelmts, cd_values, 0, NULL, NULL);
+    if (filter_id != H5Z_FILTER_DEFLATE && filter_id != H5Z_FILTER_SHUFFLE) {
+      H5Pclose(dcpl_id);
+      return (MI_NOERROR);
+    }
+    plan->chunk_filters[i] = filter_id;
+    plan->chunk_filter_arg[i] = cd_nelmts > 0 ? cd_values[0] : 0;
+  }
+  plan->n_chunk_filters = n_filters;
+
+  if ((plan->file_type_id = H5Dget_type(volume->image_id)) < 0) {
+    H5Pclose(dcpl_id);
+    return MI_LOG_ERROR(MI2_MSG_HDF5,"H5Dget_type");
+  }
+  type_class = H5Tget_class(plan->file_type_id);
+  plan->file_type_size = H5Tget_size(plan->file_type_id);
+  if ((type_class != H5T_INTEGER && type_class != H5T_FLOAT) ||
+      plan->file_type_size > MI2_MAX_FILL_BYTES) {
+    H5Pclose(dcpl_id);
+    return (MI_NOERROR);
+  }
+
+  /* Unallocated chunks read as the fill value, which is zero unless
+   * one was set when the image was created.
+   */
+  memset(plan->fill_value, 0, sizeof(plan->fill_value));
+  if (H5Pget_fill_value(dcpl_id, plan->file_type_id, plan->fill_value) < 0) {
+    H5Pclose(dcpl_id);
+    return (MI_NOERROR);
+  }
+  H5Pclose(dcpl_id);
+
+  if (H5Sget_simple_extent_dims(plan->fspc_id, plan->dset_dims, NULL) != plan->ndims) {
+    return (MI_NOERROR);
+  }
+  plan->chunk_io = TRUE;
+#else
+  plan->chunk_io = FALSE;
+#endif /*MI2_DIRECT_CHUNK_IO*/
+  return (MI_NOERROR);
+}
+
+/** Copy the part of the chunk at \a chunk_offset that falls inside the
+ * selection of the plan between \a chunk and \a selection, which holds
+ * the selection in file order, except that the dimensions with a
+ * negative \a dir are reversed if \a dir is not NULL. The copy goes
+ * into the chunk if \a to_chunk is TRUE, into the selection otherwise.
+ */
+static void michunk_copy(mihyperplan_t plan, const hsize_t chunk_offset[],
+                         unsigned char *chunk, size_t el_size,
+                         unsigned char *selection, const int *dir, int to_chunk)
+{
+  const hsize_t *start = plan->hdf_start;
+  const hsize_t *count = plan->hdf_count;
+  const hsize_t *chunk_dims = plan->chunk_dims;
+  hsize_t lo[MI2_MAX_VAR_DIMS];
+  hsize_t hi[MI2_MAX_VAR_DIMS];
+  hsize_t idx[MI2_MAX_VAR_DIMS];
+  int ndims = plan->ndims;
+  size_t run;
+  int reversed;
+  int i;
+
+  for (i = 0; i < ndims; i++) {
+    lo[i] = chunk_offset[i] > start[i] ? chunk_offset[i] : start[i];
+    hi[i] = chunk_offset[i] + chunk_dims[i] < start[i] + count[i] ?
+            chunk_offset[i] + chunk_dims[i] : start[i] + count[i];
+    if (lo[i] >= hi[i]) {
+      return;
+    }
+    idx[i] = lo[i];
+  }
+  run = (size_t) (hi[ndims - 1] - lo[ndims - 1]);
+  reversed = dir != NULL && dir[ndims - 1] < 0;
+
+  for (;;) {
+    size_t chunk_off = 0;
+    size_t sel_off = 0;
+
+    for (i = 0; i < ndims; i++) {
+      hsize_t sel_idx = idx[i] - start[i];
+
+      if (dir != NULL && dir[i] < 0) {
+        sel_idx = count[i] - 1 - sel_idx;
+      }
+      chunk_off = chunk_off * chunk_dims[i] + (idx[i] - chunk_offset[i]);
+      sel_off = sel_off * count[i] + sel_idx;
+    }
+    if (reversed) {
+      /* Rows run backwards through the selection */
+      size_t j;
+      for (j = 0; j < run; j++) {
+        unsigned char *c = chunk + (chunk_off + j) * el_size;
+        unsigned char *e = selection + (sel_off - j) * el_size;
+        if (to_chunk) {
+          memcpy(c, e, el_size);
+        } else {
+          memcpy(e, c, el_size);
+        }
+      }
+    } else if (to_chunk) {
+      memcpy(chunk + chunk_off * el_size, selection + sel_off * el_size, run * el_size);
+    } else {
+      memcpy(selection + sel_off * el_size, chunk + chunk_off * el_size, run * el_size);
+    }
+
+    for (i = ndims - 2; i >= 0; i--) {
+      if (++idx[i] < hi[i]) {
+        break;
+      }
+      idx[i] = lo[i];
+    }
+    if (i < 0) {
+      break;
+    }
+  }
+}
+
+/** Byte shuffle (or unshuffle) \a size bytes of \a el_size byte elements
+ * from \a src into \a dst, the same way as the HDF5 shuffle filter.
+ */
+static void michunk_shuffle(unsigned char *dst, const unsigned char *src,
+                            size_t size, size_t el_size, int unshuffle)
+{
+  size_t n = el_size > 1 ? size / el_size : 0;
+  size_t b, j;
+
+  for (b = 0; b < el_size && n != 0; b++) {
+    if (unshuffle) {
+      const unsigned char *in = src + b * n;
+      for (j = 0; j < n; j++) {
+        dst[j * el_size + b] = in[j];
+      }
+    } else {
+      unsigned char *out = dst + b * n;
+      for (j = 0; j < n; j++) {
+        out[j] = src[j * el_size + b];
+      }
+    }
+  }
+  /* Trailing bytes that do not make up an element are copied as is */
+  memcpy(dst + n * el_size, src + n * el_size, size - n * el_size);
+}
+
+/** Get the size in bytes of the chunk of \a image_id at \a offset as
+ * stored in the file, zero if the chunk has no storage.
+ */
+#ifdef MI2_DIRECT_CHUNK_IO
+static herr_t michunk_storage_size(hid_t image_id, const hsize_t offset[],
+                                   hsize_t *nbytes)
+{
+  herr_t status;
+#if H5_VERSION_GE(1,10,5)
+  /* H5Dget_chunk_storage_size() fails on chunks without storage in some
+   * chunk index types, this tells them apart from errors.
+   */
+  unsigned int filter_mask;
+  haddr_t addr = HADDR_UNDEF;
+
+  H5E_BEGIN_TRY {
+    status = H5Dget_chunk_info_by_coord(image_id, offset, &filter_mask, &addr, nbytes);
+  } H5E_END_TRY;
+  if (status >= 0 && addr == HADDR_UNDEF) {
+    *nbytes = 0;
+  }
+#else
+  H5E_BEGIN_TRY {
+    status = H5Dget_chunk_storage_size(image_id, offset, nbytes);
+  } H5E_END_TRY;
+#endif
+  return status;
+}
+#endif /*MI2_DIRECT_CHUNK_IO*/
+
+/** Step \a index to the next chunk of the box [\a first, \a last] of
+ * chunk indices, the last dimension varying fastest.
+ */
+static void michunk_next_index(int ndims, const hsize_t first[],
+                               const hsize_t last[], hsize_t index[])
+{
+  int i;
+
+  for (i = ndims - 1; i >= 0; i--) {
+    if (++index[i] <= last[i]) {
+      break;
+    }
+    index[i] = first[i];
+  }
+}
+
+/** Returns a new chunk of \a chunk_bytes bytes holding the fill value
+ * of the image of a plan.
+ */
+static unsigned char *michunk_fill_chunk(mihyperplan_t plan, size_t chunk_bytes)
+{
+  unsigned char *chunk = malloc(chunk_bytes);
+  size_t j;
+
+  if (chunk == NULL) {
+    return NULL;
+  }
+  for (j = 0; j < chunk_bytes; j += plan->file_type_size) {
+    memcpy(chunk + j, plan->fill_value, plan->file_type_size);
+  }
+  return chunk;
+}
+
+/** Returns TRUE if the \a chunk_bytes bytes of \a chunk all hold the
+ * fill value of the image of a plan.
+ */
+static int michunk_is_fill(mihyperplan_t plan, const unsigned char *chunk,
+                           size_t chunk_bytes)
+{
+  size_t j;
+
+  for (j = 0; j < chunk_bytes; j += plan->file_type_size) {
+    if (memcmp(chunk + j, plan->fill_value, plan->file_type_size) != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/** Undo the filter pipeline of one raw chunk, then scatter it into
+ * the destination buffer.
+ */
+static int michunk_decode_task(void *ctx, size_t index, void *scratch)
+{
+  struct michunk_read *rd = (struct michunk_read *) ctx;
+  mihyperplan_t plan = rd->plan;
+  const unsigned char *src = rd->raw[index];
+  size_t src_size = rd->raw_size[index];
+  unsigned char *bufs[2];
+  int which = 0;
+  int i;
+
+  bufs[0] = (unsigned char *) scratch;
+  bufs[1] = (unsigned char *) scratch + rd->chunk_bytes;
+
+  if (src == NULL) {
+    /* Never written, holds only the fill value */
+    michunk_copy(plan, rd->offsets + index * plan->ndims, rd->fill_chunk,
+                 plan->file_type_size, rd->dest, rd->dir, FALSE);
+    return (MI_NOERROR);
+  }
+
+  for (i = plan->n_chunk_filters - 1; i >= 0; i--) {
+    unsigned char *dst;
+
+    if (rd->filter_mask[index] & (1u << i)) {
+      continue;                 /* Filter was skipped for this chunk */
+    }
+    dst = bufs[which];
+    which ^= 1;
+
+    switch (plan->chunk_filters[i]) {
+    case H5Z_FILTER_DEFLATE:
+      {
+        uLongf length = (uLongf) rd->chunk_bytes;
+        if (uncompress(dst, &length, src, (uLong) src_size) != Z_OK) {
+          return (MI_ERROR);
+        }
+        src_size = length;
+      }
+      break;
+    case H5Z_FILTER_SHUFFLE:
+      if (src_size > rd->chunk_bytes) {
+        return (MI_ERROR);
+      }
+      michunk_shuffle(dst, src, src_size, plan->chunk_filter_arg[i], TRUE);
+      break;
+    default:
+      return (MI_ERROR);
+    }
+    src = dst;
+  }
+
+  if (src_size != rd->chunk_bytes) {
+    return (MI_ERROR);
+  }
+  michunk_copy(plan, rd->offsets + index * plan->ndims, (unsigned char *) src,
+               plan->file_type_size, rd->dest, rd->dir, FALSE);
+  return (MI_NOERROR);
+}
+
+/** Read the current selection of a plan by fetching the raw chunks it
+ * touches and decoding them on the volume's worker threads. The result
+ * is converted to \a mem_type_id and stored in \a buffer in file
+ * order, exactly as H5Dread() would. If \a dir is not NULL the
+ * dimensions with a negative direction are reversed as the chunks are
+ * scattered into \a buffer. Returns MI_ERROR if the chunks could not be
+ * handled, or are better served by the chunk cache, in which case the
+ * caller should use H5Dread().
+ */
+int miread_hyperslab_chunks(mihyperplan_t plan, hid_t mem_type_id, void *buffer,
+                            const int *dir)
+{
+#ifdef MI2_DIRECT_CHUNK_IO
+  mihandle_t volume = plan->volume;
+  struct michunk_read rd;
+  hsize_t first[MI2_MAX_VAR_DIMS];
+  hsize_t last[MI2_MAX_VAR_DIMS];
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  size_t n_chunks = 1;
+  size_t n_elements = 1;
+  size_t max_batch;
+  size_t n_done = 0;
+  size_t mem_size;
+  int need_convert;
+  int result = MI_NOERROR;
+  int i;
+
+  memset(&rd, 0, sizeof(rd));
+  rd.plan = plan;
+  rd.dir = dir;
+  rd.chunk_bytes = plan->file_type_size;
+
+  for (i = 0; i < plan->ndims; i++) {
+    if (plan->hdf_count[i] == 0) {
+      return (MI_NOERROR);
+    }
+    first[i] = plan->hdf_start[i] / plan->chunk_dims[i];
+    last[i] = (plan->hdf_start[i] + plan->hdf_count[i] - 1) / plan->chunk_dims[i];
+    index[i] = first[i];
+    n_chunks *= (size_t) (last[i] - first[i] + 1);
+    n_elements *= (size_t) plan->hdf_count[i];
+    rd.chunk_bytes *= (size_t) plan->chunk_dims[i];
+  }
+
+  /* Decoded chunks are not cached, so leave selections that use only a
+   * small part of the chunks they touch, and single chunks, to the
+   * chunk cache of H5Dread().
+   */
+  if (n_chunks < 2 ||
+      2 * n_elements * plan->file_type_size < n_chunks * rd.chunk_bytes) {
+    return (MI_ERROR);
+  }
+
+  mem_size = H5Tget_size(mem_type_id);
+  need_convert = H5Tequal(plan->file_type_id, mem_type_id) <= 0;
+
+  /* Gather the data in the user buffer if it is large enough to hold
+   * the selection in file type, and convert in place.
+   */
+  if (!need_convert || mem_size >= plan->file_type_size) {
+    rd.dest = (unsigned char *) buffer;
+  } else if ((rd.dest = malloc(n_elements * plan->file_type_size)) == NULL) {
+    return (MI_ERROR);
+  }
+
+  max_batch = n_chunks < MI2_CHUNK_BATCH_COUNT ? n_chunks : MI2_CHUNK_BATCH_COUNT;
+  rd.offsets = malloc(max_batch * plan->ndims * sizeof(hsize_t));
+  rd.raw = calloc(max_batch, sizeof(void *));
+  rd.raw_size = malloc(max_batch * sizeof(size_t));
+  rd.filter_mask = malloc(max_batch * sizeof(unsigned int));
+  if (rd.offsets == NULL || rd.raw == NULL || rd.raw_size == NULL ||
+      rd.filter_mask == NULL) {
+    result = MI_ERROR;
+    goto cleanup;
+  }
+
+  while (n_done < n_chunks && result == MI_NOERROR) {
+    size_t n_batch = 0;
+    size_t batch_bytes = 0;
+    size_t j;
+
+    /* Fetch a batch of raw chunks, HDF5 calls stay on this thread.
+     */
+    while (n_done < n_chunks && n_batch < max_batch &&
+           batch_bytes < MI2_CHUNK_BATCH_BYTES) {
+      hsize_t *offset = rd.offsets + n_batch * plan->ndims;
+      hsize_t nbytes = 0;
+      uint32_t filter_mask = 0;
+      herr_t status;
+
+      for (i = 0; i < plan->ndims; i++) {
+        offset[i] = index[i] * plan->chunk_dims[i];
+      }
+
+      /* Unallocated chunks hold only the fill value, they are filled
+       * in without reading anything.
+       */
+      status = michunk_storage_size(volume->image_id, offset, &nbytes);
+      if (status < 0) {
+        result = MI_ERROR;
+        break;
+      }
+      if (nbytes == 0) {
+        if (rd.fill_chunk == NULL &&
+            (rd.fill_chunk = michunk_fill_chunk(plan, rd.chunk_bytes)) == NULL) {
+          result = MI_ERROR;
+          break;
+        }
+        rd.raw[n_batch] = NULL;
+        rd.raw_size[n_batch] = 0;
+        rd.filter_mask[n_batch] = 0;
+        n_batch++;
+        n_done++;
+        michunk_next_index(plan->ndims, first, last, index);
+        continue;
+      }
+      if ((rd.raw[n_batch] = malloc(nbytes)) == NULL) {
+        result = MI_ERROR;
+        break;
+      }
+      rd.raw_size[n_batch] = (size_t) nbytes;
+      n_batch++;
+
+      if (H5Dread_chunk(volume->image_id, H5P_DEFAULT, offset, &filter_mask,
+                        rd.raw[n_batch - 1]) < 0) {
+        result = MI_ERROR;
+        break;
+      }
+      rd.filter_mask[n_batch - 1] = filter_mask;
+      batch_bytes += (size_t) nbytes;
+      n_done++;
+      michunk_next_index(plan->ndims, first, last, index);
+    }
+
+    if (result == MI_NOERROR) {
+      /* Decoding makes no HDF5 calls, other readers can go on meanwhile */
+      mihdf_unlock(volume);
+      result = michunk_run(volume->read_threads, n_batch, 2 * rd.chunk_bytes,
+                           michunk_decode_task, &rd);
+      mihdf_lock(volume);
+    }
+    for (j = 0; j < n_batch; j++) {
+      free(rd.raw[j]);
+      rd.raw[j] = NULL;
+    }
+  }
+
+  if (result == MI_NOERROR) {
+    michunk_cache_bypass(volume, n_chunks);
+  }
+  if (result == MI_NOERROR && need_convert) {
+    if (H5Tconvert(plan->file_type_id, mem_type_id, n_elements, rd.dest,
+                   NULL, H5P_DEFAULT) < 0) {
+      result = MI_ERROR;
+    } else if (rd.dest != buffer) {
+      memcpy(buffer, rd.dest, n_elements * mem_size);
+    }
+  }
+
+cleanup:
+  if (rd.dest != NULL && rd.dest != buffer) {
+    free(rd.dest);
+  }
+  free(rd.offsets);
+  free(rd.raw);
+  free(rd.raw_size);
+  free(rd.filter_mask);
+  free(rd.fill_chunk);
+  return (result);
+#else
+  return (MI_ERROR);
+#endif /*MI2_DIRECT_CHUNK_IO*/
+}
+
+/** Gather one complete chunk from the selection and run it through the
+ * filter pipeline, leaving the encoded chunk in wr->packed[index].
+ */
+static int michunk_encode_task(void *ctx, size_t index, void *scratch)
+{
+  struct michunk_write *wr = (struct michunk_write *) ctx;
+  mihyperplan_t plan = wr->plan;
+  size_t src_size = wr->chunk_bytes;
+  unsigned char *bufs[2];
+  unsigned char *src;
+  int which = 1;
+  int i;
+
+  bufs[0] = (unsigned char *) scratch;
+  bufs[1] = (unsigned char *) scratch + wr->scratch_bytes;
+
+  src = bufs[0];
+  michunk_copy(plan, wr->offsets + index * plan->ndims, src,
+               plan->file_type_size, (unsigned char *) wr->src, wr->dir, TRUE);
+
+  /* A chunk never written reads as the fill value already, leave it
+   * unallocated if that is all it would hold.
+   */
+  if (!wr->allocated[index] && michunk_is_fill(plan, src, src_size)) {
+    wr->packed[index] = NULL;
+    wr->packed_size[index] = 0;
+    return (MI_NOERROR);
+  }
+
+  for (i = 0; i < plan->n_chunk_filters; i++) {
+    unsigned char *dst = bufs[which];
+    which ^= 1;
+
+    switch (plan->chunk_filters[i]) {
+    case H5Z_FILTER_DEFLATE:
+      {
+        uLongf length = (uLongf) wr->scratch_bytes;
+        if (compress2(dst, &length, src, (uLong) src_size,
+                      (int) plan->chunk_filter_arg[i]) != Z_OK) {
+          return (MI_ERROR);
+        }
+        src_size = length;
+      }
+      break;
+    case H5Z_FILTER_SHUFFLE:
+      michunk_shuffle(dst, src, src_size, plan->chunk_filter_arg[i], FALSE);
+      break;
+    default:
+      return (MI_ERROR);
+    }
+    src = dst;
+  }
+
+  if ((wr->packed[index] = malloc(src_size)) == NULL) {
+    return (MI_ERROR);
+  }
+  memcpy(wr->packed[index], src, src_size);
+  wr->packed_size[index] = src_size;
+  return (MI_NOERROR);
+}
+
+/** Write \a buffer, holding the current selection of a plan in file
+ * order and \a mem_type_id, to the image. Chunks lying entirely inside
+ * the selection are encoded on the volume's worker threads and stored
+ * with H5Dwrite_chunk(), the partial chunks around them go through
+ * H5Dwrite(). If \a dir is not NULL the dimensions of \a buffer with a
+ * negative direction are reversed, which is only possible when the
+ * selection is made of complete chunks. Returns MI_ERROR if the
+ * selection could not be handled this way, in which case the caller
+ * should use H5Dwrite().
+ */
+int miwrite_hyperslab_chunks(mihyperplan_t plan, hid_t mem_type_id, const void *buffer,
+                             const int *dir)
+{
+#ifdef MI2_DIRECT_CHUNK_IO
+  mihandle_t volume = plan->volume;
+  struct michunk_write wr;
+  hsize_t first[MI2_MAX_VAR_DIMS];
+  hsize_t last[MI2_MAX_VAR_DIMS];
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  hsize_t lo[MI2_MAX_VAR_DIMS];
+  hsize_t hi[MI2_MAX_VAR_DIMS];
+  size_t n_chunks = 1;
+  size_t n_elements = 1;
+  size_t max_batch;
+  size_t n_done = 0;
+  size_t mem_size;
+  int need_convert;
+  int has_remainder = FALSE;
+  int result = MI_NOERROR;
+  int i;
+
+  memset(&wr, 0, sizeof(wr));
+  wr.plan = plan;
+  wr.dir = dir;
+  wr.chunk_bytes = plan->file_type_size;
+
+  /* Only chunks covered entirely by the selection are written
+   * directly, they form a box of chunk indices [first, last].
+   */
+  for (i = 0; i < plan->ndims; i++) {
+    hsize_t c = plan->chunk_dims[i];
+
+    first[i] = (plan->hdf_start[i] + c - 1) / c;
+    if ((plan->hdf_start[i] + plan->hdf_count[i]) / c <= first[i]) {
+      return (MI_ERROR);
+    }
+    last[i] = (plan->hdf_start[i] + plan->hdf_count[i]) / c - 1;
+    index[i] = first[i];
+    lo[i] = first[i] * c;
+    hi[i] = (last[i] + 1) * c;
+    if (lo[i] != plan->hdf_start[i] ||
+        hi[i] != plan->hdf_start[i] + plan->hdf_count[i]) {
+      has_remainder = TRUE;
+    }
+    n_chunks *= (size_t) (last[i] - first[i] + 1);
+    n_elements *= (size_t) plan->hdf_count[i];
+    wr.chunk_bytes *= (size_t) c;
+  }
+
+  /* H5Dwrite() of the partial chunks needs the buffer in file order */
+  if (has_remainder && dir != NULL) {
+    return (MI_ERROR);
+  }
+  wr.scratch_bytes = (size_t) compressBound((uLong) wr.chunk_bytes);
+
+  mem_size = H5Tget_size(mem_type_id);
+  need_convert = H5Tequal(plan->file_type_id, mem_type_id) <= 0;
+
+  if (!need_convert) {
+    wr.src = (const unsigned char *) buffer;
+  } else {
+    unsigned char *converted;
+    size_t size = n_elements * (mem_size > plan->file_type_size ?
+                                mem_size : plan->file_type_size);
+
+    if ((converted = malloc(size)) == NULL) {
+      return (MI_ERROR);
+    }
+    memcpy(converted, buffer, n_elements * mem_size);
+    if (H5Tconvert(mem_type_id, plan->file_type_id, n_elements, converted,
+                   NULL, H5P_DEFAULT) < 0) {
+      free(converted);
+      return (MI_ERROR);
+    }
+    wr.src = converted;
+  }
+
+  max_batch = MI2_CHUNK_BATCH_BYTES / wr.scratch_bytes;
+  if (max_batch > MI2_CHUNK_BATCH_COUNT) {
+    max_batch = MI2_CHUNK_BATCH_COUNT;
+  }
+  if (max_batch > n_chunks) {
+    max_batch = n_chunks;
+  }
+  if (max_batch == 0) {
+    max_batch = 1;
+  }
+  wr.offsets = malloc(max_batch * plan->ndims * sizeof(hsize_t));
+  wr.packed = calloc(max_batch, sizeof(void *));
+  wr.packed_size = malloc(max_batch * sizeof(size_t));
+  wr.allocated = malloc(max_batch * sizeof(int));
+  if (wr.offsets == NULL || wr.packed == NULL || wr.packed_size == NULL ||
+      wr.allocated == NULL) {
+    result = MI_ERROR;
+    goto cleanup;
+  }
+
+  while (n_done < n_chunks && result == MI_NOERROR) {
+    size_t n_batch = 0;
+    size_t j;
+
+    for (; n_done < n_chunks && n_batch < max_batch; n_done++, n_batch++) {
+      hsize_t *offset = wr.offsets + n_batch * plan->ndims;
+      hsize_t nbytes = 0;
+      herr_t status;
+
+      for (i = 0; i < plan->ndims; i++) {
+        offset[i] = index[i] * plan->chunk_dims[i];
+      }
+      status = michunk_storage_size(volume->image_id, offset, &nbytes);
+      wr.allocated[n_batch] = (status < 0 || nbytes != 0);
+      michunk_next_index(plan->ndims, first, last, index);
+    }
+
+    result = michunk_run(volume->write_threads, n_batch, 2 * wr.scratch_bytes,
+                         michunk_encode_task, &wr);
+
+    /* Store the encoded chunks, HDF5 calls stay on this thread.
+     */
+    for (j = 0; j < n_batch; j++) {
+      if (result == MI_NOERROR && wr.packed[j] != NULL &&
+          H5Dwrite_chunk(volume->image_id, H5P_DEFAULT, 0,
+                         wr.offsets + j * plan->ndims,
+                         wr.packed_size[j], wr.packed[j]) < 0) {
+        result = MI_ERROR;
+      }
+      michunk_cache_discard(volume, wr.offsets + j * plan->ndims);
+      free(wr.packed[j]);
+      wr.packed[j] = NULL;
+    }
+  }
+
+  /* Whatever is left of the selection around the box of complete
+   * chunks is peeled off one dimension at a time into at most two
+   * slabs per dimension, and written in a single H5Dwrite().
+   */
+  if (result == MI_NOERROR && has_remainder) {
+    hid_t fspc_id;
+    hid_t mspc_id;
+    hsize_t box_lo[MI2_MAX_VAR_DIMS];
+    hsize_t box_hi[MI2_MAX_VAR_DIMS];
+    hsize_t slab_start[MI2_MAX_VAR_DIMS];
+    hsize_t slab_count[MI2_MAX_VAR_DIMS];
+    H5S_seloper_t op = H5S_SELECT_SET;
+    int d, side;
+
+    fspc_id = H5Scopy(plan->fspc_id);
+    mspc_id = H5Screate_simple(plan->ndims, plan->hdf_count, NULL);
+    if (fspc_id < 0 || mspc_id < 0) {
+      result = MI_ERROR;
+    }
+
+    for (i = 0; i < plan->ndims; i++) {
+      box_lo[i] = plan->hdf_start[i];
+      box_hi[i] = plan->hdf_start[i] + plan->hdf_count[i];
+    }
+    for (d = 0; d < plan->ndims && result == MI_NOERROR; d++) {
+      for (side = 0; side < 2; side++) {
+        hsize_t from = side ? hi[d] : box_lo[d];
+        hsize_t to = side ? box_hi[d] : lo[d];
+
+        if (from >= to) {
+          continue;
+        }
+        for (i = 0; i < plan->ndims; i++) {
+          slab_start[i] = box_lo[i];
+          slab_count[i] = box_hi[i] - box_lo[i];
+        }
+        slab_start[d] = from;
+        slab_count[d] = to - from;
+        if (H5Sselect_hyperslab(fspc_id, op, slab_start, NULL, slab_count, NULL) < 0) {
+          result = MI_ERROR;
+        }
+        michunk_cache_access(volume, slab_start, slab_count);
+        for (i = 0; i < plan->ndims; i++) {
+          slab_start[i] -= plan->hdf_start[i];
+        }
+        if (H5Sselect_hyperslab(mspc_id, op, slab_start, NULL, slab_count, NULL) < 0) {
+          result = MI_ERROR;
+        }
+        op = H5S_SELECT_OR;
+      }
+      box_lo[d] = lo[d];
+      box_hi[d] = hi[d];
+    }
+
+    if (result == MI_NOERROR &&
+        H5Dwrite(volume->image_id, mem_type_id, mspc_id, fspc_id,
+                 H5P_DEFAULT, buffer) < 0) {
+      result = MI_ERROR;
+    }
+    if (fspc_id >= 0) {
+      H5Sclose(fspc_id);
+    }
+    if (mspc_id >= 0) {
+      H5Sclose(mspc_id);
+    }
+  }
+
+cleanup:
+  if (wr.src != NULL && wr.src != buffer) {
+    free((void *) wr.src);
+  }
+  free(wr.offsets);
+  free(wr.packed);
+  free(wr.packed_size);
+  free(wr.allocated);
+  return (result);
+#else
+  return (MI_ERROR);
+#endif /*MI2_DIRECT_CHUNK_IO*/
+}
+
+/** Set the number of worker threads used to decode compressed chunks
+ * when reading hyperslabs from \a volume. Zero disables the direct
+ * chunk reader, all reads then go through H5Dread().
+ */
+int miset_volume_read_threads(mihandle_t volume, int threads)
+{
+  if (volume == NULL || threads < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to set read threads with null volume or negative count");
+  }
+  volume->read_threads = threads;
+  return (MI_NOERROR);
+}
+
+/** Get the number of worker threads used to decode compressed chunks
+ * when reading hyperslabs from \a volume.
+ */
+int miget_volume_read_threads(mihandle_t volume, int *threads)
+{
+  if (volume == NULL || threads == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get read threads with null volume or null variables");
+  }
+  *threads = volume->read_threads;
+  return (MI_NOERROR);
+}
+
+/** Get the chunk edge lengths of the image of \a volume and the number
+ * of chunks along each dimension, returns the number of dimensions.
+ */
+static int michunk_grid(mihandle_t volume, misize_t array_length,
+                        misize_t chunk_lengths[], misize_t chunk_counts[])
+{
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hsize_t chunk_dims[MI2_MAX_VAR_DIMS];
+  hid_t fspc_id;
+  hid_t dcpl_id;
+  int ndims;
+  int i;
+
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume has no image");
+  }
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  if (ndims < 0 || (misize_t) ndims > array_length) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Array too short for the dimensions of the image");
+  }
+  MI_CHECK_HDF_CALL_RET(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+  if (H5Pget_layout(dcpl_id) != H5D_CHUNKED ||
+      H5Pget_chunk(dcpl_id, ndims, chunk_dims) != ndims) {
+    memcpy(chunk_dims, dims, ndims * sizeof(hsize_t));
+  }
+  H5Pclose(dcpl_id);
+
+  for (i = 0; i < ndims; i++) {
+    chunk_lengths[i] = (misize_t) chunk_dims[i];
+    chunk_counts[i] = chunk_dims[i] == 0 ? 0 :
+                      (misize_t) ((dims[i] + chunk_dims[i] - 1) / chunk_dims[i]);
+  }
+  return ndims;
+}
+
+/** Get the chunk edge lengths of the image of \a volume, and the number
+ * of chunks along each dimension, in file order. An image that is not
+ * chunked is one single chunk.
+ */
+int miget_volume_chunk_grid(mihandle_t volume, misize_t array_length,
+                            misize_t chunk_lengths[], misize_t chunk_counts[])
+{
+  if (volume == NULL || chunk_lengths == NULL || chunk_counts == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get the chunk grid with null volume or null variables");
+  }
+  return (michunk_grid(volume, array_length, chunk_lengths, chunk_counts) < 0 ?
+          MI_ERROR : MI_NOERROR);
+}
+
+/** Set \a mask[k] to TRUE if the k-th chunk of the grid given by
+ * miget_volume_chunk_grid(), counted with the last dimension varying
+ * fastest, holds data in the file, and to FALSE if it was never written
+ * and so holds only the fill value.
+ */
+int miget_allocated_region_mask(mihandle_t volume, misize_t mask_length,
+                                unsigned char mask[], misize_t *n_allocated)
+{
+  misize_t chunk_lengths[MI2_MAX_VAR_DIMS];
+  misize_t chunk_counts[MI2_MAX_VAR_DIMS];
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  hsize_t offset[MI2_MAX_VAR_DIMS];
+  misize_t n_chunks = 1;
+  misize_t count = 0;
+  misize_t k;
+  hid_t dcpl_id;
+  H5D_layout_t layout;
+  int ndims;
+  int i;
+
+  if (volume == NULL || mask == NULL || n_allocated == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get the allocated regions with null volume or null variables");
+  }
+  if ((ndims = michunk_grid(volume, MI2_MAX_VAR_DIMS, chunk_lengths,
+                            chunk_counts)) < 0) {
+    return (MI_ERROR);
+  }
+  for (i = 0; i < ndims; i++) {
+    n_chunks *= chunk_counts[i];
+    index[i] = 0;
+  }
+  if (mask_length < n_chunks) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Mask too short for the chunks of the image");
+  }
+
+  MI_CHECK_HDF_CALL_RET(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+  layout = H5Pget_layout(dcpl_id);
+  H5Pclose(dcpl_id);
+
+  if (layout != H5D_CHUNKED) {
+    if (n_chunks != 0) {
+      mask[0] = H5Dget_storage_size(volume->image_id) != 0;
+      count = mask[0];
+    }
+    *n_allocated = count;
+    return (MI_NOERROR);
+  }
+
+  mihdf_lock(volume);
+  for (k = 0; k < n_chunks; k++) {
+    hsize_t nbytes = 0;
+    herr_t status;
+
+    for (i = 0; i < ndims; i++) {
+      offset[i] = index[i] * chunk_lengths[i];
+    }
+#ifdef MI2_DIRECT_CHUNK_IO
+    status = michunk_storage_size(volume->image_id, offset, &nbytes);
+#else
+    status = 0;
+    nbytes = 1;                 /* Assume every chunk holds data */
+#endif /*MI2_DIRECT_CHUNK_IO*/
+    mask[k] = (status >= 0 && nbytes != 0);
+    count += mask[k];
+
+    for (i = ndims - 1; i >= 0; i--) {
+      if (++index[i] < chunk_counts[i]) {
+        break;
+      }
+      index[i] = 0;
+    }
+  }
+  mihdf_unlock(volume);
+  *n_allocated = count;
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
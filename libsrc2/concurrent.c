@@ -0,0 +1,143 @@
+/** \file concurrent.c
+ * \brief MINC 2.0 concurrent reads of a shared volume
+ *
+ * A volume opened for reading can be shared by several reader threads
+ * once concurrent reads are enabled on it. The volume state that reads
+ * depend on (resolution, apparent dimension order and voxel order,
+ * chunk cache settings) is then frozen, and each read works on its own
+ * hyperslab plan.
+ *
+ * HDF5 serializes its own calls when it is built thread-safe. When it
+ * is not, the hyperslab functions take a library-wide lock instead,
+ * and release it while compressed chunks are decoded, so that decoding
+ * still runs in parallel.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <hdf5.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t mihdf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mihdf_once = PTHREAD_ONCE_INIT;
+static int mihdf_needed = FALSE;
+
+static void mihdf_init(void)
+{
+  hbool_t threadsafe = FALSE;
+
+  mihdf_needed = (H5is_library_threadsafe(&threadsafe) < 0 || !threadsafe);
+}
+#endif /*HAVE_PTHREAD*/
+
+/** Take the HDF5 lock if HDF5 does not serialize calls itself, around
+ * work that uses HDF5 from several threads.
+ */
+void mihdf_lock_library(void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_once(&mihdf_once, mihdf_init);
+  if (mihdf_needed) {
+    pthread_mutex_lock(&mihdf_mutex);
+  }
+#endif /*HAVE_PTHREAD*/
+}
+
+/** Release the HDF5 lock taken by mihdf_lock_library().
+ */
+void mihdf_unlock_library(void)
+{
+#ifdef HAVE_PTHREAD
+  if (mihdf_needed) {
+    pthread_mutex_unlock(&mihdf_mutex);
+  }
+#endif /*HAVE_PTHREAD*/
+}
+
+/** Take the HDF5 lock before a hyperslab function uses \a volume, if it
+ * is shared by concurrent readers and HDF5 does not serialize calls
+ * itself.
+ */
+void mihdf_lock(mihandle_t volume)
+{
+  if (volume != NULL && volume->concurrent_reads) {
+    mihdf_lock_library();
+  }
+}
+
+/** Release the HDF5 lock taken by mihdf_lock().
+ */
+void mihdf_unlock(mihandle_t volume)
+{
+  if (volume != NULL && volume->concurrent_reads) {
+    mihdf_unlock_library();
+  }
+}
+
+/** Returns MI_ERROR, with a message, if \a volume is shared by
+ * concurrent readers and its state must not change.
+ */
+int micheck_not_concurrent(mihandle_t volume)
+{
+  if (volume != NULL && volume->concurrent_reads) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume is shared by concurrent readers");
+  }
+  return (MI_NOERROR);
+}
+
+/** Allow the hyperslab read functions to be called on \a volume from
+ * several threads at once. Only volumes opened with MI2_OPEN_READ can
+ * be shared. While concurrent reads are enabled, the resolution, the
+ * apparent dimension and voxel order and the chunk cache size of the
+ * volume cannot be changed; set them up before. Enabling or disabling
+ * concurrent reads must not happen while reads are in progress.
+ */
+int miset_volume_concurrent_reads(mihandle_t volume, miboolean_t enable)
+{
+  if (volume == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to set concurrent reads of a null volume");
+  }
+  if (enable && (volume->mode & MI2_OPEN_RDWR) != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only volumes opened for reading can be shared by concurrent readers");
+  }
+  /* What is read on first use is read now rather than by the readers */
+  if (enable) {
+    int i;
+
+    if (miload_volume_image(volume) < 0) {
+      return (MI_ERROR);
+    }
+    for (i = 0; i < volume->number_of_dims; i++) {
+      if (miload_dimension_spacing(volume->dim_handles[i]) < 0) {
+        return (MI_ERROR);
+      }
+    }
+    if (volume->has_slice_scaling && mislice_range_load(volume) < 0) {
+      return (MI_ERROR);
+    }
+  }
+  volume->concurrent_reads = enable ? TRUE : FALSE;
+  return (MI_NOERROR);
+}
+
+/** Get whether \a volume can be read from several threads at once.
+ */
+int miget_volume_concurrent_reads(mihandle_t volume, miboolean_t *enabled)
+{
+  if (volume == NULL || enabled == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get concurrent reads with null volume or null variables");
+  }
+  *enabled = volume->concurrent_reads;
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -47,6 +47,10 @@ int miconvert_real_to_voxel(mihandle_t volume,
     double voxel_range, voxel_offset;
     double real_range, real_offset;
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     /* get valid min/max, image min/max 
      */
     miget_volume_valid_range(volume, &valid_max, &valid_min);
@@ -98,6 +102,10 @@ int miconvert_voxel_to_real(mihandle_t volume,
     double voxel_range, voxel_offset;
     double real_range, real_offset;
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     if( volume->volume_type==MI_TYPE_FLOAT    || volume->volume_type==MI_TYPE_DOUBLE ||
       volume->volume_type==MI_TYPE_FCOMPLEX || volume->volume_type==MI_TYPE_DCOMPLEX ){
       // If floating values voxel_value is the real value
@@ -121,6 +129,11 @@ int miconvert_voxel_to_real(mihandle_t volume,
     voxel_range = valid_max - valid_min;
     real_range = slice_max - slice_min;
     
+    /* An empty valid range maps every voxel to the slice minimum */
+    if (voxel_range == 0.0) {
+        *real_value_ptr = real_offset;
+        return (result);
+    }
     voxel_value = (voxel_value - voxel_offset) / voxel_range;
     *real_value_ptr = (voxel_value * real_range) + real_offset;
     return (result);
@@ -525,6 +538,16 @@ int miget_volume_real_range(mihandle_t volume, double real_range[])
     double *buffer;
     int i;
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
+    /* Slice ranges are taken from the tables kept with the volume.
+     */
+    if (volume->has_slice_scaling) {
+        return mislice_range_bounds(volume, real_range);
+    }
+
     /* First find the real minimum.
      */
     spc_id = H5Dget_space(volume->imin_id);
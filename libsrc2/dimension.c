@@ -61,7 +61,7 @@ int micopy_dimension ( midimhandle_t dim_ptr, midimhandle_t *new_dim_ptr )
   misize_t i;
   midimhandle_t handle;
 
-  if ( dim_ptr == NULL ) {
+  if ( dim_ptr == NULL || miload_dimension_spacing ( dim_ptr ) < 0 ) {
     return ( MI_ERROR );
   }
 
@@ -152,6 +152,8 @@ int micopy_dimension ( midimhandle_t dim_ptr, midimhandle_t *new_dim_ptr )
   }
 
   handle->volume_handle = dim_ptr->volume_handle;
+  handle->spacing_pending = FALSE;
+  handle->unlimited = dim_ptr->unlimited;
 
   *new_dim_ptr = handle;
 
@@ -326,6 +328,8 @@ int micreate_dimension(const char *name, midimclass_t dimclass, midimattr_t attr
   /* volume_handle is the only NULL value once the dimension is created.
    */
   handle->volume_handle = NULL;
+  handle->spacing_pending = FALSE;
+  handle->unlimited = FALSE;
 
   *new_dim_ptr = handle;
 
@@ -470,6 +474,9 @@ int miset_apparent_dimension_order ( mihandle_t volume, int array_length,
   if ( volume == NULL || array_length <= 0 ) {
     return ( MI_ERROR );
   }
+  if ( micheck_not_concurrent ( volume ) < 0 ) {
+    return ( MI_ERROR );
+  }
 
   /* If array_length was more than the number of dimensions
     the rest of the given dimensions will be ignored.
@@ -515,6 +522,8 @@ int miset_apparent_dimension_order ( mihandle_t volume, int array_length,
     }
   }
 
+  volume->layout_generation++;
+
   /*
   printf(" apparent dimension order \n");
   for(i=0; i < volume->number_of_dims; i++) {
@@ -544,6 +553,9 @@ int miset_apparent_dimension_order_by_name ( mihandle_t volume, int array_length
   if ( volume == NULL ) {
     return ( MI_ERROR );
   }
+  if ( micheck_not_concurrent ( volume ) < 0 ) {
+    return ( MI_ERROR );
+  }
 
   if ( names == NULL || array_length <= 0 ) {
     /* Reset the dimension ordering */
@@ -551,6 +563,7 @@ int miset_apparent_dimension_order_by_name ( mihandle_t volume, int array_length
       free ( volume->dim_indices );
       volume->dim_indices = NULL;
     }
+    volume->layout_generation++;
 
     return ( MI_NOERROR );
   }
@@ -612,6 +625,7 @@ int miset_apparent_dimension_order_by_name ( mihandle_t volume, int array_length
     }
 
   }
+  volume->layout_generation++;
 
   return ( MI_NOERROR );
 }
@@ -652,6 +666,7 @@ int miset_apparent_record_dimension_flag ( mihandle_t volume, int record_flag )
      will appear to have (n+1) dimensions
    */
   volume->number_of_dims++;
+  volume->layout_generation++;
 
   return ( MI_NOERROR );
 }
@@ -737,6 +752,9 @@ int miset_dimension_apparent_voxel_order ( midimhandle_t dimension,
   if ( dimension == NULL ) {
     return ( MI_ERROR );
   }
+  if ( micheck_not_concurrent ( dimension->volume_handle ) < 0 ) {
+    return ( MI_ERROR );
+  }
 
   switch ( flipping_order ) {
   case MI_FILE_ORDER:
@@ -754,6 +772,9 @@ int miset_dimension_apparent_voxel_order ( midimhandle_t dimension,
   default:
     return ( MI_ERROR );
   }
+  if ( dimension->volume_handle != NULL ) {
+    dimension->volume_handle->layout_generation++;
+  }
 
   return ( MI_NOERROR );
 }
@@ -1018,7 +1039,8 @@ int miget_dimension_offsets( midimhandle_t dimension, misize_t array_length,
   misize_t end_position;
   misize_t i, j;
 
-  if ( dimension == NULL || start_position > dimension->length ) {
+  if ( dimension == NULL || start_position > dimension->length ||
+       miload_dimension_spacing ( dimension ) < 0 ) {
     return ( MI_ERROR );
   }
 
@@ -1066,7 +1088,8 @@ int miset_dimension_offsets ( midimhandle_t dimension,
    */
   if ( dimension == NULL ||
        ( dimension->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED ) == 0 ||
-       start_position > dimension->length ) {
+       start_position > dimension->length ||
+       miload_dimension_spacing ( dimension ) < 0 ) {
     return ( MI_ERROR );
   }
 
@@ -1566,7 +1589,8 @@ int miget_dimension_widths ( midimhandle_t dimension,
   misize_t end_position;
   misize_t i, j = 0;
 
-  if ( dimension == NULL || start_position > dimension->length ) {
+  if ( dimension == NULL || start_position > dimension->length ||
+       miload_dimension_spacing ( dimension ) < 0 ) {
     return ( MI_ERROR );
   }
 
@@ -1635,7 +1659,8 @@ int miset_dimension_widths ( midimhandle_t dimension,
    */
   if ( dimension == NULL ||
        ( dimension->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED ) == 0 ||
-       start_position > dimension->length ) {
+       start_position > dimension->length ||
+       miload_dimension_spacing ( dimension ) < 0 ) {
     return ( MI_ERROR );
   }
 
@@ -1662,4 +1687,77 @@ int miset_dimension_widths ( midimhandle_t dimension,
   return ( MI_NOERROR );
 }
 
+/**
+  * Get whether a dimension is unlimited, that is whether frames can be
+  * appended along it with miappend_volume_frame().
+  * \param dimension The dimension handle.
+  * \param unlimited A pointer to the unlimited flag.
+  * \ingroup mi2Dim
+  */
+int miget_dimension_unlimited ( midimhandle_t dimension, miboolean_t *unlimited )
+{
+  if ( dimension == NULL || unlimited == NULL ) {
+    return ( MI_ERROR );
+  }
+
+  *unlimited = dimension->unlimited;
+  return ( MI_NOERROR );
+}
+
+/**
+  * Make a dimension unlimited, or limited again, before the volume is
+  * created. Only a dimension of class MI_DIMCLASS_TIME can be unlimited,
+  * and it has to be the first dimension of the volume in file order. Its
+  * length is then the number of frames the volume starts with, possibly
+  * zero, and grows by one with each call to miappend_volume_frame().
+  * \param dimension The dimension handle.
+  * \param unlimited TRUE to make the dimension unlimited.
+  * \ingroup mi2Dim
+  */
+int miset_dimension_unlimited ( midimhandle_t dimension, miboolean_t unlimited )
+{
+  if ( dimension == NULL || dimension->volume_handle != NULL ) {
+    return ( MI_ERROR );
+  }
+  if ( unlimited && dimension->dim_class != MI_DIMCLASS_TIME ) {
+    return MI_LOG_ERROR ( MI2_MSG_GENERIC, "Only a time dimension can be unlimited" );
+  }
+
+  dimension->unlimited = unlimited ? TRUE : FALSE;
+  return ( MI_NOERROR );
+}
+
+/** Grow an unlimited dimension to \a length samples. The offsets and
+ * widths of an irregular dimension are extended, the new samples follow
+ * the start and step of the dimension with a width of one.
+ */
+int miextend_dimension ( midimhandle_t dimension, misize_t length )
+{
+  double *offsets;
+  double *widths;
+  misize_t i;
+
+  if ( length <= dimension->length ) {
+    return ( MI_NOERROR );
+  }
+  if ( ( dimension->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED ) != 0 ) {
+    offsets = ( double * ) realloc ( dimension->offsets, length * sizeof ( double ) );
+    if ( offsets == NULL ) {
+      return MI_LOG_ERROR ( MI2_MSG_OUTOFMEM, ( int ) ( length * sizeof ( double ) ) );
+    }
+    dimension->offsets = offsets;
+    widths = ( double * ) realloc ( dimension->widths, length * sizeof ( double ) );
+    if ( widths == NULL ) {
+      return MI_LOG_ERROR ( MI2_MSG_OUTOFMEM, ( int ) ( length * sizeof ( double ) ) );
+    }
+    dimension->widths = widths;
+    for ( i = dimension->length; i < length; i++ ) {
+      dimension->offsets[i] = dimension->start + i * dimension->step;
+      dimension->widths[i] = 1.0;
+    }
+  }
+  dimension->length = length;
+  return ( MI_NOERROR );
+}
+
 /* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
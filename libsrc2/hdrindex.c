@@ -0,0 +1,957 @@
+/** \file hdrindex.c
+ * \brief MINC 2.0 persistent index of volume headers
+ *
+ * Tools that scan many files often open each of them only to read its
+ * dimensions, voxel to world transform, data type and a few attributes.
+ * A header index keeps these for a set of files in one compact file, so
+ * that they can be looked up without opening HDF5 at all.
+ *
+ * Each entry is keyed by the path of the file as given, and records the
+ * size and modification time the file had when its header was read.
+ * An entry is used only while the file still has that size and time,
+ * and only if its header was read after the second the file was last
+ * modified in, so that a change made within the same second is not
+ * missed. Stale entries are read again, both by miupdate_header_index()
+ * and by the query functions.
+ *
+ * The index file is written in the byte order of the host. A file that
+ * cannot be read, or was written by another host, is treated as an
+ * empty index and replaced when the index is saved.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <hdf5.h>
+
+#include "minc_config.h"
+#include "minc2.h"
+#include "minc2_private.h"
+
+#define MIINDEX_MAGIC "MINCHIDX"
+#define MIINDEX_VERSION 1
+#define MIINDEX_BYTE_ORDER 0x01020304
+
+/* Type recorded for an attribute missing from a file */
+#define MIINDEX_NO_ATTR (-1)
+
+/** \internal
+ * Values of an attribute of an indexed file, either a string or doubles.
+ */
+struct miindexattr {
+  int type;                     /* MI_TYPE_STRING, MI_TYPE_DOUBLE or MIINDEX_NO_ATTR */
+  size_t length;
+  void *values;
+};
+
+/** \internal
+ * Header of an indexed file.
+ */
+struct miindexentry {
+  char *file;
+  long long size;
+  long long mtime;
+  long long indexed;            /* Time the header was read at */
+  int data_type;
+  int n_dims;                   /* Dimensions in file order */
+  char **dim_names;
+  misize_t *dim_sizes;
+  mi_lin_xfm_t voxel_to_world;
+  struct miindexattr *attrs;    /* One per attribute of the index */
+};
+
+/** \internal
+ * Index of the headers of a set of files.
+ */
+struct miheaderindex {
+  char *index_path;
+  int n_attrs;                  /* Attributes to keep for each file */
+  char **attr_paths;
+  char **attr_names;
+  size_t n_entries;             /* Entries sorted by file */
+  size_t max_entries;
+  struct miindexentry **entries;
+  miboolean_t modified;
+};
+
+/** \internal
+ * State shared by the threads of miupdate_header_index().
+ */
+struct miindexupdate {
+  struct miheaderindex *index;
+  const char *const *files;
+  struct miindexentry **results; /* New entry of each file, or NULL */
+  int *status;                  /* MI_ERROR if a file cannot be indexed */
+};
+
+static char *miindex_strdup(const char *str)
+{
+  size_t length = strlen(str) + 1;
+  char *copy = malloc(length);
+
+  if (copy != NULL) {
+    memcpy(copy, str, length);
+  }
+  return copy;
+}
+
+static void miindex_free_entry(struct miheaderindex *index,
+                               struct miindexentry *entry)
+{
+  int i;
+
+  if (entry == NULL) {
+    return;
+  }
+  if (entry->dim_names != NULL) {
+    for (i = 0; i < entry->n_dims; i++) {
+      free(entry->dim_names[i]);
+    }
+  }
+  if (entry->attrs != NULL) {
+    for (i = 0; i < index->n_attrs; i++) {
+      free(entry->attrs[i].values);
+    }
+  }
+  free(entry->file);
+  free(entry->dim_names);
+  free(entry->dim_sizes);
+  free(entry->attrs);
+  free(entry);
+}
+
+static struct miindexentry *miindex_new_entry(struct miheaderindex *index,
+                                              const char *file, int n_dims)
+{
+  struct miindexentry *entry = calloc(1, sizeof(struct miindexentry));
+  int i;
+
+  if (entry == NULL) {
+    return NULL;
+  }
+  entry->n_dims = n_dims;
+  entry->file = miindex_strdup(file);
+  entry->dim_names = calloc(n_dims + 1, sizeof(char *));
+  entry->dim_sizes = calloc(n_dims + 1, sizeof(misize_t));
+  entry->attrs = calloc(index->n_attrs + 1, sizeof(struct miindexattr));
+  if (entry->file == NULL || entry->dim_names == NULL ||
+      entry->dim_sizes == NULL || entry->attrs == NULL) {
+    miindex_free_entry(index, entry);
+    return NULL;
+  }
+  for (i = 0; i < index->n_attrs; i++) {
+    entry->attrs[i].type = MIINDEX_NO_ATTR;
+  }
+  return entry;
+}
+
+/** Returns the position of the entry of \a file in the index, or the
+ * position it would be inserted at, with \a found set accordingly.
+ */
+static size_t miindex_find(struct miheaderindex *index, const char *file,
+                           miboolean_t *found)
+{
+  size_t lo = 0;
+  size_t hi = index->n_entries;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(index->entries[mid]->file, file);
+
+    if (cmp == 0) {
+      *found = TRUE;
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *found = FALSE;
+  return lo;
+}
+
+/** Put \a entry in the index, replacing the entry of the same file.
+ */
+static int miindex_store(struct miheaderindex *index, struct miindexentry *entry)
+{
+  miboolean_t found;
+  size_t pos = miindex_find(index, entry->file, &found);
+
+  if (found) {
+    miindex_free_entry(index, index->entries[pos]);
+    index->entries[pos] = entry;
+  } else {
+    if (index->n_entries == index->max_entries) {
+      size_t max_entries = index->max_entries ? 2 * index->max_entries : 64;
+      struct miindexentry **entries = realloc(index->entries,
+                                              max_entries * sizeof(*entries));
+      if (entries == NULL) {
+        miindex_free_entry(index, entry);
+        return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, max_entries * sizeof(*entries));
+      }
+      index->entries = entries;
+      index->max_entries = max_entries;
+    }
+    memmove(&index->entries[pos + 1], &index->entries[pos],
+            (index->n_entries - pos) * sizeof(*index->entries));
+    index->entries[pos] = entry;
+    index->n_entries++;
+  }
+  index->modified = TRUE;
+  return MI_NOERROR;
+}
+
+/** Drop the entry of \a file from the index, if any.
+ */
+static void miindex_remove(struct miheaderindex *index, const char *file)
+{
+  miboolean_t found;
+  size_t pos = miindex_find(index, file, &found);
+
+  if (found) {
+    miindex_free_entry(index, index->entries[pos]);
+    memmove(&index->entries[pos], &index->entries[pos + 1],
+            (index->n_entries - pos - 1) * sizeof(*index->entries));
+    index->n_entries--;
+    index->modified = TRUE;
+  }
+}
+
+/** Returns TRUE if \a entry still describes a file with status \a st.
+ */
+static miboolean_t miindex_is_fresh(const struct miindexentry *entry,
+                                    const struct stat *st)
+{
+  return (entry->size == (long long) st->st_size &&
+          entry->mtime == (long long) st->st_mtime &&
+          entry->indexed > entry->mtime);
+}
+
+/** Read the header of \a file into a new entry. This is called from the
+ * threads of miupdate_header_index(), and so only reads the attribute
+ * list of the index.
+ */
+static int miindex_extract(struct miheaderindex *index, const char *file,
+                           const struct stat *st, time_t indexed,
+                           struct miindexentry **entry_ptr)
+{
+  struct miindexentry *entry = NULL;
+  mihandle_t volume;
+  mitype_t data_type;
+  int result = MI_ERROR;
+  int i;
+
+  mihdf_lock_library();
+  if (miopen_volume(file, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY, &volume) < 0) {
+    mihdf_unlock_library();
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Unable to open the header of a file to index");
+  }
+  if (miget_data_type(volume, &data_type) < 0) {
+    goto cleanup;
+  }
+  entry = miindex_new_entry(index, file, volume->number_of_dims);
+  if (entry == NULL) {
+    MI_LOG_ERROR(MI2_MSG_OUTOFMEM, sizeof(struct miindexentry));
+    goto cleanup;
+  }
+  entry->size = (long long) st->st_size;
+  entry->mtime = (long long) st->st_mtime;
+  entry->indexed = (long long) indexed;
+  entry->data_type = (int) data_type;
+  for (i = 0; i < volume->number_of_dims; i++) {
+    entry->dim_sizes[i] = volume->dim_handles[i]->length;
+    if ((entry->dim_names[i] = miindex_strdup(volume->dim_handles[i]->name)) == NULL) {
+      MI_LOG_ERROR(MI2_MSG_OUTOFMEM, strlen(volume->dim_handles[i]->name) + 1);
+      goto cleanup;
+    }
+  }
+  miget_voxel_to_world(volume, entry->voxel_to_world);
+
+  for (i = 0; i < index->n_attrs; i++) {
+    struct miindexattr *attr = &entry->attrs[i];
+    mitype_t attr_type;
+    size_t length;
+
+    if (miget_attr_type(volume, index->attr_paths[i], index->attr_names[i],
+                        &attr_type) < 0 ||
+        miget_attr_length(volume, index->attr_paths[i], index->attr_names[i],
+                          &length) < 0) {
+      continue;                 /* Not in this file */
+    }
+    if (attr_type == MI_TYPE_STRING) {
+      attr->values = malloc(length + 1);
+    } else {
+      attr_type = MI_TYPE_DOUBLE;
+      attr->values = malloc((length + 1) * sizeof(double));
+    }
+    if (attr->values == NULL) {
+      MI_LOG_ERROR(MI2_MSG_OUTOFMEM, length + 1);
+      goto cleanup;
+    }
+    if (miget_attr_values(volume, attr_type, index->attr_paths[i],
+                          index->attr_names[i],
+                          attr_type == MI_TYPE_STRING ? length + 1 : length,
+                          attr->values) < 0) {
+      free(attr->values);
+      attr->values = NULL;
+      continue;
+    }
+    attr->type = (int) attr_type;
+    attr->length = length;
+  }
+  result = MI_NOERROR;
+
+cleanup:
+  miclose_volume(volume);
+  mihdf_unlock_library();
+  if (result < 0) {
+    miindex_free_entry(index, entry);
+    entry = NULL;
+  }
+  *entry_ptr = entry;
+  return result;
+}
+
+/** Get the entry of \a file, reading its header again if it is not in
+ * the index or has changed since.
+ */
+static int miindex_lookup(struct miheaderindex *index, const char *file,
+                          struct miindexentry **entry_ptr)
+{
+  struct miindexentry *entry;
+  struct stat st;
+  miboolean_t found;
+  size_t pos;
+  time_t now;
+
+  if (index == NULL || file == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index or file name");
+  }
+  now = time(NULL);
+  if (stat(file, &st) < 0) {
+    miindex_remove(index, file);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Unable to get the status of an indexed file");
+  }
+  pos = miindex_find(index, file, &found);
+  if (found && miindex_is_fresh(index->entries[pos], &st)) {
+    *entry_ptr = index->entries[pos];
+    return MI_NOERROR;
+  }
+  if (miindex_extract(index, file, &st, now, &entry) < 0) {
+    miindex_remove(index, file);
+    return MI_ERROR;
+  }
+  if (miindex_store(index, entry) < 0) {
+    return MI_ERROR;
+  }
+  *entry_ptr = entry;
+  return MI_NOERROR;
+}
+
+static int miindex_update_task(void *ctx, size_t i, void *scratch)
+{
+  struct miindexupdate *update = (struct miindexupdate *) ctx;
+  struct miheaderindex *index = update->index;
+  const char *file = update->files[i];
+  struct stat st;
+  miboolean_t found;
+  size_t pos;
+  time_t now = time(NULL);
+
+  update->results[i] = NULL;
+  update->status[i] = MI_NOERROR;
+  if (stat(file, &st) < 0) {
+    update->status[i] = MI_LOG_ERROR(MI2_MSG_GENERIC, "Unable to get the status of a file to index");
+    return MI_NOERROR;
+  }
+  pos = miindex_find(index, file, &found);
+  if (!found || !miindex_is_fresh(index->entries[pos], &st)) {
+    update->status[i] = miindex_extract(index, file, &st, now, &update->results[i]);
+  }
+  return MI_NOERROR;
+}
+
+/* Reading and writing the index file */
+
+static int miindex_write(FILE *fp, const void *data, size_t size)
+{
+  return (fwrite(data, 1, size, fp) == size ? MI_NOERROR : MI_ERROR);
+}
+
+static int miindex_write_int(FILE *fp, long long value)
+{
+  return miindex_write(fp, &value, sizeof(value));
+}
+
+static int miindex_write_string(FILE *fp, const char *str)
+{
+  size_t length = strlen(str);
+
+  if (miindex_write_int(fp, (long long) length) < 0) {
+    return MI_ERROR;
+  }
+  return miindex_write(fp, str, length);
+}
+
+static int miindex_read(FILE *fp, void *data, size_t size)
+{
+  return (fread(data, 1, size, fp) == size ? MI_NOERROR : MI_ERROR);
+}
+
+static int miindex_read_int(FILE *fp, long long *value)
+{
+  return miindex_read(fp, value, sizeof(*value));
+}
+
+/* Longest string read back from an index file */
+#define MIINDEX_MAX_STRING (1 << 24)
+
+static int miindex_read_string(FILE *fp, char **str)
+{
+  long long length;
+
+  *str = NULL;
+  if (miindex_read_int(fp, &length) < 0 ||
+      length < 0 || length > MIINDEX_MAX_STRING ||
+      (*str = malloc((size_t) length + 1)) == NULL) {
+    return MI_ERROR;
+  }
+  if (miindex_read(fp, *str, (size_t) length) < 0) {
+    free(*str);
+    *str = NULL;
+    return MI_ERROR;
+  }
+  (*str)[length] = '\0';
+  return MI_NOERROR;
+}
+
+static int miindex_write_entry(FILE *fp, struct miheaderindex *index,
+                               const struct miindexentry *entry)
+{
+  int i;
+
+  if (miindex_write_string(fp, entry->file) < 0 ||
+      miindex_write_int(fp, entry->size) < 0 ||
+      miindex_write_int(fp, entry->mtime) < 0 ||
+      miindex_write_int(fp, entry->indexed) < 0 ||
+      miindex_write_int(fp, entry->data_type) < 0 ||
+      miindex_write_int(fp, entry->n_dims) < 0) {
+    return MI_ERROR;
+  }
+  for (i = 0; i < entry->n_dims; i++) {
+    if (miindex_write_string(fp, entry->dim_names[i]) < 0 ||
+        miindex_write_int(fp, (long long) entry->dim_sizes[i]) < 0) {
+      return MI_ERROR;
+    }
+  }
+  if (miindex_write(fp, entry->voxel_to_world, sizeof(mi_lin_xfm_t)) < 0) {
+    return MI_ERROR;
+  }
+  for (i = 0; i < index->n_attrs; i++) {
+    const struct miindexattr *attr = &entry->attrs[i];
+
+    if (miindex_write_int(fp, attr->type) < 0) {
+      return MI_ERROR;
+    }
+    if (attr->type == MIINDEX_NO_ATTR) {
+      continue;
+    }
+    if (miindex_write_int(fp, (long long) attr->length) < 0 ||
+        miindex_write(fp, attr->values, attr->type == MI_TYPE_STRING ?
+                      attr->length : attr->length * sizeof(double)) < 0) {
+      return MI_ERROR;
+    }
+  }
+  return MI_NOERROR;
+}
+
+static int miindex_read_entry(FILE *fp, struct miheaderindex *index,
+                              struct miindexentry **entry_ptr)
+{
+  struct miindexentry *entry;
+  long long size, mtime, indexed, data_type, n_dims, value;
+  char *file;
+  int i;
+
+  if (miindex_read_string(fp, &file) < 0) {
+    return MI_ERROR;
+  }
+  if (miindex_read_int(fp, &size) < 0 || miindex_read_int(fp, &mtime) < 0 ||
+      miindex_read_int(fp, &indexed) < 0 || miindex_read_int(fp, &data_type) < 0 ||
+      miindex_read_int(fp, &n_dims) < 0 || n_dims < 0 || n_dims > MI2_MAX_VAR_DIMS ||
+      (entry = miindex_new_entry(index, file, (int) n_dims)) == NULL) {
+    free(file);
+    return MI_ERROR;
+  }
+  free(file);
+  entry->size = size;
+  entry->mtime = mtime;
+  entry->indexed = indexed;
+  entry->data_type = (int) data_type;
+  for (i = 0; i < entry->n_dims; i++) {
+    if (miindex_read_string(fp, &entry->dim_names[i]) < 0 ||
+        miindex_read_int(fp, &value) < 0) {
+      goto failed;
+    }
+    entry->dim_sizes[i] = (misize_t) value;
+  }
+  if (miindex_read(fp, entry->voxel_to_world, sizeof(mi_lin_xfm_t)) < 0) {
+    goto failed;
+  }
+  for (i = 0; i < index->n_attrs; i++) {
+    struct miindexattr *attr = &entry->attrs[i];
+    size_t bytes;
+
+    if (miindex_read_int(fp, &value) < 0) {
+      goto failed;
+    }
+    if (value == MIINDEX_NO_ATTR) {
+      continue;
+    }
+    if (value != MI_TYPE_STRING && value != MI_TYPE_DOUBLE) {
+      goto failed;
+    }
+    attr->type = (int) value;
+    if (miindex_read_int(fp, &value) < 0 || value < 0 || value > MIINDEX_MAX_STRING) {
+      goto failed;
+    }
+    attr->length = (size_t) value;
+    bytes = attr->type == MI_TYPE_STRING ? attr->length : attr->length * sizeof(double);
+    if ((attr->values = malloc(bytes + 1)) == NULL ||
+        miindex_read(fp, attr->values, bytes) < 0) {
+      goto failed;
+    }
+  }
+  *entry_ptr = entry;
+  return MI_NOERROR;
+
+failed:
+  miindex_free_entry(index, entry);
+  return MI_ERROR;
+}
+
+/** Load the index file of \a index, if it can be read. Entries are
+ * stored sorted by file.
+ */
+static void miindex_load(struct miheaderindex *index)
+{
+  FILE *fp = fopen(index->index_path, "rb");
+  char magic[sizeof(MIINDEX_MAGIC) - 1];
+  long long version, byte_order, n_attrs, n_entries;
+  struct miindexentry *entry;
+  long long i;
+
+  if (fp == NULL) {
+    return;
+  }
+  if (miindex_read(fp, magic, sizeof(magic)) < 0 ||
+      memcmp(magic, MIINDEX_MAGIC, sizeof(magic)) != 0 ||
+      miindex_read_int(fp, &version) < 0 || version != MIINDEX_VERSION ||
+      miindex_read_int(fp, &byte_order) < 0 || byte_order != MIINDEX_BYTE_ORDER ||
+      miindex_read_int(fp, &n_attrs) < 0 || n_attrs < 0 || n_attrs > MIINDEX_MAX_STRING) {
+    fclose(fp);
+    return;
+  }
+  index->attr_paths = calloc((size_t) n_attrs + 1, sizeof(char *));
+  index->attr_names = calloc((size_t) n_attrs + 1, sizeof(char *));
+  if (index->attr_paths == NULL || index->attr_names == NULL) {
+    fclose(fp);
+    return;
+  }
+  for (i = 0; i < n_attrs; i++) {
+    if (miindex_read_string(fp, &index->attr_paths[i]) < 0 ||
+        miindex_read_string(fp, &index->attr_names[i]) < 0) {
+      goto failed;
+    }
+    index->n_attrs++;
+  }
+  if (miindex_read_int(fp, &n_entries) < 0 || n_entries < 0) {
+    goto failed;
+  }
+  for (i = 0; i < n_entries; i++) {
+    if (miindex_read_entry(fp, index, &entry) < 0 ||
+        miindex_store(index, entry) < 0) {
+      goto failed;
+    }
+  }
+  fclose(fp);
+  index->modified = FALSE;
+  return;
+
+failed:
+  /* Start again from an empty index */
+  fclose(fp);
+  for (i = 0; i < (long long) index->n_entries; i++) {
+    miindex_free_entry(index, index->entries[i]);
+  }
+  index->n_entries = 0;
+  for (i = 0; i < index->n_attrs; i++) {
+    free(index->attr_paths[i]);
+    free(index->attr_names[i]);
+  }
+  index->n_attrs = 0;
+  index->modified = TRUE;
+}
+
+/** Open the header index stored in \a index_path, or start an empty
+ * one if there is no such file.
+ */
+int miopen_header_index(const char *index_path, miheaderindex_t *index)
+{
+  struct miheaderindex *new_index;
+
+  if (index_path == NULL || index == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index path or handle");
+  }
+  new_index = calloc(1, sizeof(struct miheaderindex));
+  if (new_index == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, sizeof(struct miheaderindex));
+  }
+  if ((new_index->index_path = miindex_strdup(index_path)) == NULL) {
+    free(new_index);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, strlen(index_path) + 1);
+  }
+  miindex_load(new_index);
+  *index = new_index;
+  return MI_NOERROR;
+}
+
+/** Keep the attribute \a name of \a path in the index. Entries indexed
+ * before are read again when next used.
+ */
+int miadd_header_index_attr(miheaderindex_t index, const char *path,
+                            const char *name)
+{
+  char **attr_paths;
+  char **attr_names;
+  size_t i;
+
+  if (index == NULL || path == NULL || name == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index or attribute");
+  }
+  for (i = 0; i < (size_t) index->n_attrs; i++) {
+    if (!strcmp(index->attr_paths[i], path) && !strcmp(index->attr_names[i], name)) {
+      return MI_NOERROR;
+    }
+  }
+  /* Entries do not have the new attribute */
+  for (i = 0; i < index->n_entries; i++) {
+    miindex_free_entry(index, index->entries[i]);
+  }
+  index->n_entries = 0;
+
+  attr_paths = realloc(index->attr_paths, (index->n_attrs + 1) * sizeof(char *));
+  if (attr_paths != NULL) {
+    index->attr_paths = attr_paths;
+  }
+  attr_names = realloc(index->attr_names, (index->n_attrs + 1) * sizeof(char *));
+  if (attr_names != NULL) {
+    index->attr_names = attr_names;
+  }
+  if (attr_paths == NULL || attr_names == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (index->n_attrs + 1) * sizeof(char *));
+  }
+  attr_paths[index->n_attrs] = miindex_strdup(path);
+  attr_names[index->n_attrs] = miindex_strdup(name);
+  if (attr_paths[index->n_attrs] == NULL || attr_names[index->n_attrs] == NULL) {
+    free(attr_paths[index->n_attrs]);
+    free(attr_names[index->n_attrs]);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, strlen(path) + strlen(name) + 2);
+  }
+  index->n_attrs++;
+  index->modified = TRUE;
+  return MI_NOERROR;
+}
+
+/** Bring the entries of \a n_files files up to date, reading the
+ * headers of the new and changed ones on up to \a n_threads threads.
+ */
+int miupdate_header_index(miheaderindex_t index, int n_files,
+                          const char *const files[], int n_threads)
+{
+  struct miindexupdate update;
+  int n_read = 0;
+  int result = MI_NOERROR;
+  int i;
+
+  if (index == NULL || n_files < 0 || (n_files > 0 && files == NULL)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index or file list");
+  }
+  if (n_files == 0) {
+    return 0;
+  }
+  if (n_threads <= 0) {
+    n_threads = michunk_default_threads(MICFG_READ_THREADS);
+  }
+  update.index = index;
+  update.files = files;
+  update.results = calloc(n_files, sizeof(struct miindexentry *));
+  update.status = calloc(n_files, sizeof(int));
+  if (update.results == NULL || update.status == NULL) {
+    free(update.results);
+    free(update.status);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, n_files * sizeof(struct miindexentry *));
+  }
+
+  /* The index is only read while the headers are. The settings used
+   * to open a volume are cached first, their cache is not thread safe.
+   */
+  miload_cfg();
+  michunk_run(n_threads, (size_t) n_files, 0, miindex_update_task, &update);
+
+  for (i = 0; i < n_files; i++) {
+    if (update.status[i] < 0) {
+      miindex_remove(index, files[i]);
+      result = MI_ERROR;
+    } else if (update.results[i] != NULL) {
+      if (miindex_store(index, update.results[i]) < 0) {
+        result = MI_ERROR;
+      } else {
+        n_read++;
+      }
+    }
+  }
+  free(update.results);
+  free(update.status);
+  return (result < 0 ? MI_ERROR : n_read);
+}
+
+/** Write the index to its file, if it has changed since it was opened
+ * or last saved.
+ */
+int misave_header_index(miheaderindex_t index)
+{
+  char *tmp_path;
+  FILE *fp;
+  int result = MI_NOERROR;
+  size_t i;
+
+  if (index == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index");
+  }
+  if (!index->modified) {
+    return MI_NOERROR;
+  }
+
+  /* Write a new file and put it in place, so that readers never see a
+   * partial index.
+   */
+  tmp_path = malloc(strlen(index->index_path) + 5);
+  if (tmp_path == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, strlen(index->index_path) + 5);
+  }
+  sprintf(tmp_path, "%s.tmp", index->index_path);
+  if ((fp = fopen(tmp_path, "wb")) == NULL) {
+    free(tmp_path);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Unable to create the header index file");
+  }
+  if (miindex_write(fp, MIINDEX_MAGIC, sizeof(MIINDEX_MAGIC) - 1) < 0 ||
+      miindex_write_int(fp, MIINDEX_VERSION) < 0 ||
+      miindex_write_int(fp, MIINDEX_BYTE_ORDER) < 0 ||
+      miindex_write_int(fp, index->n_attrs) < 0) {
+    result = MI_ERROR;
+  }
+  for (i = 0; result == MI_NOERROR && i < (size_t) index->n_attrs; i++) {
+    if (miindex_write_string(fp, index->attr_paths[i]) < 0 ||
+        miindex_write_string(fp, index->attr_names[i]) < 0) {
+      result = MI_ERROR;
+    }
+  }
+  if (result == MI_NOERROR &&
+      miindex_write_int(fp, (long long) index->n_entries) < 0) {
+    result = MI_ERROR;
+  }
+  for (i = 0; result == MI_NOERROR && i < index->n_entries; i++) {
+    result = miindex_write_entry(fp, index, index->entries[i]);
+  }
+  if (fclose(fp) != 0) {
+    result = MI_ERROR;
+  }
+  if (result == MI_NOERROR && rename(tmp_path, index->index_path) != 0) {
+    result = MI_ERROR;
+  }
+  if (result < 0) {
+    remove(tmp_path);
+    free(tmp_path);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Unable to write the header index file");
+  }
+  free(tmp_path);
+  index->modified = FALSE;
+  return MI_NOERROR;
+}
+
+/** Save the index if it has changed, and release it.
+ */
+int miclose_header_index(miheaderindex_t index)
+{
+  int result;
+  size_t i;
+
+  if (index == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Null header index");
+  }
+  result = misave_header_index(index);
+  for (i = 0; i < index->n_entries; i++) {
+    miindex_free_entry(index, index->entries[i]);
+  }
+  for (i = 0; i < (size_t) index->n_attrs; i++) {
+    free(index->attr_paths[i]);
+    free(index->attr_names[i]);
+  }
+  free(index->attr_paths);
+  free(index->attr_names);
+  free(index->entries);
+  free(index->index_path);
+  free(index);
+  return result;
+}
+
+/** Get the sizes and, if \a names is not NULL, the names of the
+ * dimensions of an indexed file, in file order.
+ */
+int miget_indexed_dimensions(miheaderindex_t index, const char *file,
+                             int array_length, misize_t sizes[], char *names[])
+{
+  struct miindexentry *entry;
+  int i;
+
+  if (miindex_lookup(index, file, &entry) < 0) {
+    return MI_ERROR;
+  }
+  if (array_length < entry->n_dims) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Array too short for the dimensions of the file");
+  }
+  for (i = 0; i < entry->n_dims; i++) {
+    if (sizes != NULL) {
+      sizes[i] = entry->dim_sizes[i];
+    }
+    if (names != NULL) {
+      names[i] = miindex_strdup(entry->dim_names[i]);
+    }
+  }
+  return entry->n_dims;
+}
+
+/** Get the voxel to world transform of an indexed file.
+ */
+int miget_indexed_voxel_to_world(miheaderindex_t index, const char *file,
+                                 double voxel_to_world[4][4])
+{
+  struct miindexentry *entry;
+
+  if (miindex_lookup(index, file, &entry) < 0) {
+    return MI_ERROR;
+  }
+  memcpy(voxel_to_world, entry->voxel_to_world, sizeof(mi_lin_xfm_t));
+  return MI_NOERROR;
+}
+
+/** Get the data type of an indexed file.
+ */
+int miget_indexed_data_type(miheaderindex_t index, const char *file,
+                            mitype_t *data_type)
+{
+  struct miindexentry *entry;
+
+  if (miindex_lookup(index, file, &entry) < 0) {
+    return MI_ERROR;
+  }
+  *data_type = (mitype_t) entry->data_type;
+  return MI_NOERROR;
+}
+
+/** Returns the attribute \a name of \a path of an indexed file, or NULL
+ * if it is missing from the file or not kept in the index.
+ */
+static struct miindexattr *miindex_find_attr(miheaderindex_t index,
+                                             const char *file, const char *path,
+                                             const char *name)
+{
+  struct miindexentry *entry;
+  int i;
+
+  if (path == NULL || name == NULL || miindex_lookup(index, file, &entry) < 0) {
+    return NULL;
+  }
+  for (i = 0; i < index->n_attrs; i++) {
+    if (!strcmp(index->attr_paths[i], path) && !strcmp(index->attr_names[i], name)) {
+      return (entry->attrs[i].type == MIINDEX_NO_ATTR ? NULL : &entry->attrs[i]);
+    }
+  }
+  return NULL;
+}
+
+/** Get the length of an attribute of an indexed file, as
+ * miget_attr_length() does.
+ */
+int miget_indexed_attr_length(miheaderindex_t index, const char *file,
+                              const char *path, const char *name,
+                              size_t *length)
+{
+  struct miindexattr *attr = miindex_find_attr(index, file, path, name);
+
+  if (attr == NULL) {
+    return MI_ERROR;
+  }
+  *length = attr->length;
+  return MI_NOERROR;
+}
+
+/** Get the values of an attribute of an indexed file, as
+ * miget_attr_values() does.
+ */
+int miget_indexed_attr_values(miheaderindex_t index, const char *file,
+                              mitype_t data_type, const char *path,
+                              const char *name, size_t length, void *values)
+{
+  struct miindexattr *attr = miindex_find_attr(index, file, path, name);
+  const double *doubles;
+  size_t i;
+
+  if (attr == NULL) {
+    return MI_ERROR;
+  }
+  if (length < attr->length) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Array too short for the attribute values");
+  }
+  if (data_type == MI_TYPE_STRING) {
+    if (attr->type != MI_TYPE_STRING) {
+      return MI_LOG_ERROR(MI2_MSG_GENERIC, "Attribute is not a string");
+    }
+    memcpy(values, attr->values, attr->length);
+    if (length > attr->length) {
+      ((char *) values)[attr->length] = '\0';
+    }
+    return MI_NOERROR;
+  }
+  if (attr->type != MI_TYPE_DOUBLE) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC, "Attribute is a string");
+  }
+  doubles = (const double *) attr->values;
+  for (i = 0; i < attr->length; i++) {
+    switch (data_type) {
+    case MI_TYPE_INT:
+      ((int *) values)[i] = (int) doubles[i];
+      break;
+    case MI_TYPE_FLOAT:
+      ((float *) values)[i] = (float) doubles[i];
+      break;
+    case MI_TYPE_DOUBLE:
+      ((double *) values)[i] = doubles[i];
+      break;
+    default:
+      return MI_LOG_ERROR(MI2_MSG_GENERIC, "Unsupported attribute data type");
+    }
+  }
+  return MI_NOERROR;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -10,6 +10,7 @@
 
 #include <float.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <limits.h>
 #ifdef _DEBUG
@@ -20,8 +21,8 @@
 #include "minc2_private.h"
 #include "restructure.h"
 
-#define MIRW_OP_READ 1
-#define MIRW_OP_WRITE 2
+#define MIRW_OP_READ MI_HYPERSLAB_READ
+#define MIRW_OP_WRITE MI_HYPERSLAB_WRITE
 
 #ifndef HAVE_COPYSIGN
 double
@@ -167,657 +168,734 @@ int mitranslate_hyperslab_origin(mihandle_t volume,
   return (n_different);
 }
 
-/** Read/write a hyperslab of data.  This is the simplified function
- * which performs no value conversion.  It is much more efficient than
- * mirw_hyperslab_icv()
+
+/** Allocate a scratch buffer owned by a hyperslab plan the first time
+ * it is needed, so that repeated executions reuse the same memory.
  */
-static int mirw_hyperslab_raw(int opcode,
-                              mihandle_t volume,
-                              mitype_t midatatype,
-                              const misize_t start[],
-                              const misize_t count[],
-                              void *buffer)
+static void *mihyperplan_scratch(void **buffer_ptr, misize_t size)
 {
-  hid_t dset_id = -1;
-  hid_t mspc_id = -1;
-  hid_t fspc_id = -1;
-  hid_t type_id = -1;
-  int result = MI_ERROR;
-  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
-  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
-  int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
-  int ndims;
-  int n_different = 0;
-  misize_t buffer_size;
-  void *temp_buffer=NULL;
-  char path[MI2_MAX_PATH];
-  size_t icount[MI2_MAX_VAR_DIMS];
-
-  /* Disallow write operations to anything but the highest resolution.
-   */
-  if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
-    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to write to a volume thumbnail");
-  }
-
-  snprintf(path, sizeof(path), MI_ROOT_PATH "/image/%d/image", volume->selected_resolution);
-  /*printf("Using:%s\n",path);*/
-  
-  /* Open the dataset with the specified path
-  */
-  MI_CHECK_HDF_CALL(dset_id = H5Dopen1(volume->hdf_id, path),"H5Dopen1");
-  if (dset_id < 0) {
-    return (MI_ERROR);
+  if (*buffer_ptr == NULL) {
+    *buffer_ptr = malloc(size);
+    if (*buffer_ptr == NULL) {
+      MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int)size);
+    }
   }
+  return *buffer_ptr;
+}
 
-  MI_CHECK_HDF_CALL(fspc_id = H5Dget_space(dset_id),"H5Dget_space");
-  if (fspc_id < 0) {
-    /*TODO: report can't get dataset*/
-    goto cleanup;
-  }
+/** Reorder a hyperslab buffer between file order and the apparent
+ * order of the volume, in the direction appropriate for \a opcode.
+ */
+static void mihyperplan_restructure(mihyperplan_t plan, int opcode, void *buffer)
+{
+  double t0 = MIIO_START();
 
-  if (midatatype == MI_TYPE_UNKNOWN) {
-    type_id = H5Tcopy(volume->mtype_id);
+  if (opcode == MIRW_OP_READ) {
+    restructure_array(plan->ndims, buffer, plan->icount, plan->buffer_type_size,
+                      plan->map, plan->dir);
   } else {
-    type_id = mitype_to_hdftype(midatatype, TRUE);
+    restructure_array(plan->ndims, buffer, plan->wcount, plan->buffer_type_size,
+                      plan->wmap, plan->wdir);
   }
+  MIIO_STOP(plan->volume, MIIO_RESTRUCTURE, t0);
+}
 
-  ndims = volume->number_of_dims;
+/** Reorder a hyperslab from \a src into \a dst between file order and
+ * the apparent order of the volume, in the direction appropriate for
+ * \a opcode. This is much faster than reordering in place.
+ */
+static void mihyperplan_transpose(mihyperplan_t plan, int opcode,
+                                  const void *src, void *dst)
+{
+  double t0 = MIIO_START();
 
-  if (ndims == 0) {
-    /* A scalar volume is possible but extremely unlikely, not to
-     * mention useless!
-     */
-    mspc_id = H5Screate(H5S_SCALAR);
+  if (opcode == MIRW_OP_READ) {
+    transpose_array(plan->ndims, src, dst, plan->icount, plan->buffer_type_size,
+                    plan->map, plan->dir);
   } else {
-
-    n_different = mitranslate_hyperslab_origin(volume, start, count, hdf_start, hdf_count, dir);
-
-    MI_CHECK_HDF_CALL(mspc_id = H5Screate_simple(ndims, hdf_count, NULL),"H5Screate_simple");
-    if (mspc_id < 0) {
-      goto cleanup;
-    }
+    transpose_array(plan->ndims, src, dst, plan->wcount, plan->buffer_type_size,
+                    plan->wmap, plan->wdir);
   }
+  MIIO_STOP(plan->volume, MIIO_RESTRUCTURE, t0);
+}
 
-  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, hdf_start, NULL,
-                               hdf_count, NULL),"H5Sselect_hyperslab");
-  if (result < 0) {
-    goto cleanup;
+/** Scratch buffer a read is reordered from, or NULL if there is no
+ * memory for it, in which case the data is reordered in place in the
+ * user buffer.
+ */
+static void *mihyperplan_read_buffer(mihyperplan_t plan)
+{
+  if (plan->temp_buffer == NULL) {
+    plan->temp_buffer = malloc(plan->buffer_size);
   }
+  return plan->temp_buffer;
+}
 
-  miget_hyperslab_size_hdf(type_id,ndims,hdf_count,&buffer_size);
-  
-  
-  if (opcode == MIRW_OP_READ) {
-    MI_CHECK_HDF_CALL(result = H5Dread(dset_id, type_id, mspc_id, fspc_id, H5P_DEFAULT,buffer),"H5Dread");
-    
-    /* Restructure the array after reading the data in file orientation.
-     */
-    if (n_different != 0) {
-      int i;
-
-      for (i = 0; i < ndims; i++) {
-        icount[i] = count[i];
-      }
-      restructure_array(ndims, buffer, icount, H5Tget_size(type_id),
-                        volume->dim_indices, dir);
-    }
-  } else {
-
-    volume->is_dirty = TRUE; /* Mark as modified. */
-
-    /* Restructure array before writing to file.
-     * TODO: use temporary buffer for that!
-     */
-
-    if (n_different != 0) {
-      int idir[MI2_MAX_VAR_DIMS];
-      int imap[MI2_MAX_VAR_DIMS];
-      int i;
-
-      /* Invert before calling */
-      for (i = 0; i < ndims; i++) {
-        icount[volume->dim_indices[i]] = count[i];
-
-        idir[volume->dim_indices[i]] = dir[i];
-
-        // this one was correct the original way
-        imap[volume->dim_indices[i]] = i;
-
-      }
-
-      /*Use temporary array to preserve input data*/
-      temp_buffer=malloc(buffer_size);
-      if(temp_buffer==NULL)
-      {
-        /*TODO: report memory error*/
-        result=MI_ERROR;
-        goto cleanup;
-      }
-      
-      memcpy(temp_buffer,buffer,buffer_size);
-      
-      restructure_array(ndims, temp_buffer, icount, H5Tget_size(type_id),
-                        imap, idir);
-      MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, type_id, mspc_id, fspc_id, H5P_DEFAULT,
-                      temp_buffer),"H5Dwrite");
-    } else {
-      MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, type_id, mspc_id, fspc_id, H5P_DEFAULT,
-                        buffer),"H5Dwrite");
+/** Read the current selection of a plan into \a buffer in file order.
+ * Compressed images are decoded chunk by chunk on the volume's worker
+ * threads when possible, everything else goes through H5Dread().
+ */
+static int mihyperplan_read(mihyperplan_t plan, hid_t mem_type_id, void *buffer)
+{
+  mihandle_t volume = plan->volume;
+  int result;
+  double t0;
+
+  if (plan->chunk_io && volume->read_threads > 0) {
+    t0 = MIIO_START();
+    result = miread_hyperslab_chunks(plan, mem_type_id, buffer, NULL);
+    MIIO_STOP(volume, MIIO_CHUNK_READ, t0);
+    if (result == MI_NOERROR) {
+      return (MI_NOERROR);
     }
-
-  }
-
-cleanup:
-
-  if (type_id >= 0) {
-    H5Tclose(type_id);
-  }
-  if (mspc_id >= 0) {
-    H5Sclose(mspc_id);
-  }
-  if (fspc_id >= 0) {
-    H5Sclose(fspc_id);
-  }
-  if ( dset_id >=0 ) {
-    H5Dclose(dset_id);
-  }
-  if ( temp_buffer!= NULL) {
-    free( temp_buffer );
   }
+  michunk_cache_access(volume, plan->hdf_start, plan->hdf_count);
+  t0 = MIIO_START();
+  MI_CHECK_HDF_CALL(result = H5Dread(volume->image_id, mem_type_id, plan->mspc_id,
+                                     plan->fspc_id, H5P_DEFAULT, buffer),"H5Dread");
+  MIIO_STOP(volume, MIIO_READ, t0);
   return (result);
 }
 
-#define APPLY_DESCALING(type_in,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,voxel_min,voxel_max) \
-  { \
-    hsize_t _i,_j;\
-    type_in *_buffer=(type_in *)buffer;\
-    for(_i=0;_i<total_number_of_slices;_i++)\
-    {\
-      double _scale=(image_slice_max_buffer[_i]-image_slice_min_buffer[_i])/(voxel_max-voxel_min); \
-      double _offset=image_slice_min_buffer[_i]-voxel_min*_scale; \
-      for(_j=0;_j<image_slice_length;_j++)\
-      {\
-        double _temp;\
-        _temp=(double)*_buffer;\
-        _temp=_temp*_scale  + _offset ; \
-        *_buffer=(type_in)(_temp); \
-        _buffer++;\
-      }\
-    }\
+/** Read the current selection of a plan that only flips dimensions
+ * into \a buffer in apparent order. Chunks decoded directly are
+ * scattered to their flipped place, otherwise the selection is read in
+ * file order and flipped in place, without a scratch buffer.
+ */
+static int mihyperplan_read_flipped(mihyperplan_t plan, hid_t mem_type_id, void *buffer)
+{
+  mihandle_t volume = plan->volume;
+  int result;
+  double t0;
+
+  if (plan->chunk_io && volume->read_threads > 0) {
+    t0 = MIIO_START();
+    result = miread_hyperslab_chunks(plan, mem_type_id, buffer, plan->dir);
+    MIIO_STOP(volume, MIIO_CHUNK_READ, t0);
+    if (result == MI_NOERROR) {
+      return (MI_NOERROR);
+    }
   }
-
-#define APPLY_SCALING(type_in,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,voxel_min,voxel_max) \
-  { \
-    hsize_t _i,_j;\
-    type_in *_buffer=(type_in *)buffer;\
-    for(_i=0;_i<total_number_of_slices;_i++)\
-    {\
-      double _scale= (voxel_max-voxel_min)/(image_slice_max_buffer[_i]-image_slice_min_buffer[_i]); \
-      double _offset= image_slice_min_buffer[_i]*_scale-voxel_min; \
-      for(_j=0;_j<image_slice_length;_j++)\
-      {\
-        double _temp;\
-        _temp=(double)(*_buffer);\
-        _temp= rint(_temp *_scale - _offset); \
-        *_buffer = (type_in)(_temp); \
-        _buffer++;\
-      }\
-    }\
+  michunk_cache_access(volume, plan->hdf_start, plan->hdf_count);
+  t0 = MIIO_START();
+  MI_CHECK_HDF_CALL(result = H5Dread(volume->image_id, mem_type_id, plan->mspc_id,
+                                     plan->fspc_id, H5P_DEFAULT, buffer),"H5Dread");
+  MIIO_STOP(volume, MIIO_READ, t0);
+  if (result < 0) {
+    return (MI_ERROR);
   }
+  t0 = MIIO_START();
+  flip_array(plan->ndims, buffer, plan->icount, H5Tget_size(mem_type_id), plan->dir);
+  MIIO_STOP(volume, MIIO_RESTRUCTURE, t0);
+  return (MI_NOERROR);
+}
 
-/** Read/write a hyperslab of data, performing dimension remapping
- * and data rescaling as needed.
+/** Write \a buffer, holding the current selection of a plan in file
+ * order, to the image. Complete chunks of compressed images are encoded
+ * on the volume's worker threads when possible, everything else goes
+ * through H5Dwrite().
  */
-static int mirw_hyperslab_icv(int opcode,
-                              mihandle_t volume,
-                              mitype_t buffer_data_type,
-                              const misize_t start[],
-                              const misize_t count[],
-                              void *buffer)
+static int mihyperplan_write(mihyperplan_t plan, hid_t mem_type_id, const void *buffer)
 {
-  hid_t dset_id = -1;
-  hid_t mspc_id = -1;
-  hid_t fspc_id = -1;
-  hid_t buffer_type_id = -1;
-  int result = MI_ERROR;
-  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
-  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
-  int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
-  hsize_t ndims;
-  int slice_ndims;
-  int n_different = 0;
-  double volume_valid_min, volume_valid_max;
-  misize_t buffer_size;
-  void *temp_buffer=NULL;
-  size_t icount[MI2_MAX_VAR_DIMS];
-  int idir[MI2_MAX_VAR_DIMS];
-  int imap[MI2_MAX_VAR_DIMS];
-  double *image_slice_max_buffer=NULL;
-  double *image_slice_min_buffer=NULL;
-  int scaling_needed=0;
-  char path[MI2_MAX_PATH];
-  
-  hsize_t image_slice_start[MI2_MAX_VAR_DIMS];
-  hsize_t image_slice_count[MI2_MAX_VAR_DIMS];
-  hsize_t image_slice_length=0;
-  hsize_t total_number_of_slices=0;
-  hsize_t i;
-  int j;
+  mihandle_t volume = plan->volume;
+  int result;
+  double t0;
+
+  if (plan->chunk_io && volume->write_threads > 0) {
+    t0 = MIIO_START();
+    result = miwrite_hyperslab_chunks(plan, mem_type_id, buffer, NULL);
+    MIIO_STOP(volume, MIIO_CHUNK_WRITE, t0);
+    if (result == MI_NOERROR) {
+      return (MI_NOERROR);
+    }
+  }
+  michunk_cache_access(volume, plan->hdf_start, plan->hdf_count);
+  t0 = MIIO_START();
+  MI_CHECK_HDF_CALL(result = H5Dwrite(volume->image_id, mem_type_id, plan->mspc_id,
+                                      plan->fspc_id, H5P_DEFAULT, buffer),"H5Dwrite");
+  MIIO_STOP(volume, MIIO_WRITE, t0);
+  return (result);
+}
 
+/** Set up the slice ranges of a plan. If the volume uses slice scaling
+ * the ranges of the slices covered come from the image-max/image-min
+ * tables kept with the volume, otherwise the volume-wide range is used.
+ */
+static int mihyperplan_prepare_scaling(mihyperplan_t plan)
+{
+  mihandle_t volume = plan->volume;
+  int use_slices = volume->has_slice_scaling;
+  int i;
 
-  /* Disallow write operations to anything but the highest resolution.
+  /* Normalized transfers never apply slice scaling to floating point
+   * volumes, according to MINC1 specs.
    */
-  if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
-    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to write to a volume thumbnail");
-  }
-  
-  snprintf(path, sizeof(path), MI_ROOT_PATH "/image/%d/image", volume->selected_resolution);
-  /*printf("Using:%s\n",path);*/
-  
-  /* Open the dataset with the specified path
-  */
-  MI_CHECK_HDF_CALL(dset_id = H5Dopen1(volume->hdf_id, path),"H5Dopen1");
-  if (dset_id < 0) {
-    return (MI_ERROR);
-  }
-
-  MI_CHECK_HDF_CALL(fspc_id = H5Dget_space(dset_id),"H5Dget_space");
-  if (fspc_id < 0) {
-    goto cleanup;
+  if (plan->mode == MI_HYPERSLAB_NORMALIZED &&
+      (volume->volume_type == MI_TYPE_FLOAT    || volume->volume_type == MI_TYPE_DOUBLE ||
+       volume->volume_type == MI_TYPE_FCOMPLEX || volume->volume_type == MI_TYPE_DCOMPLEX)) {
+    use_slices = FALSE;
   }
 
- 
-  buffer_type_id = mitype_to_hdftype(buffer_data_type, TRUE);
-  if(buffer_type_id<0)
-  {
-    goto cleanup;
-  }
-  
-  ndims = volume->number_of_dims;
-  
-  if (ndims == 0) {
-    /* A scalar volume is possible but extremely unlikely, not to
-     * mention useless!
-     */
-    mspc_id = H5Screate(H5S_SCALAR);
-    hdf_count[0]=1; 
-  } else {
+  plan->total_number_of_slices = 1;
+  plan->image_slice_length = 1;
+  plan->slice_scaling = use_slices;
 
-    n_different = mitranslate_hyperslab_origin(volume, start, count, hdf_start, hdf_count, dir);
+  if (use_slices) {
+    plan->slice_ndims = mislice_range_load(volume);
+    if (plan->slice_ndims < 0) {
+      return (MI_ERROR);
+    }
+    if (plan->slice_ndims > plan->ndims) { /*Can this really happen?*/
+      plan->slice_ndims = plan->ndims;
+    }
 
-    mspc_id = H5Screate_simple(ndims, hdf_count, NULL);
-    
-    if (mspc_id < 0) {
-      fprintf(stderr,"H5Screate_simple: Fail %s:%d\n",__FILE__,__LINE__);
-      goto cleanup;
+    for (i = 0; i < plan->slice_ndims; i++) {
+      plan->image_slice_count[i] = plan->hdf_count[i];
+      if (plan->hdf_count[i] > 1) /*avoid zero sized dimensions?*/
+        plan->total_number_of_slices *= plan->hdf_count[i];
+    }
+    for (i = plan->slice_ndims; i < plan->ndims; i++) {
+      if (plan->hdf_count[i] > 1) /*avoid zero sized dimensions?*/
+        plan->image_slice_length *= plan->hdf_count[i];
+    }
+  } else {
+    plan->slice_ndims = 0;
+    for (i = 0; i < plan->ndims; i++) {
+      plan->image_slice_length *= plan->hdf_count[i];
     }
   }
-  
-  miget_hyperslab_size_hdf(buffer_type_id, ndims, hdf_count, &buffer_size);
 
-  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, hdf_start, NULL,
-                               hdf_count, NULL),"H5Sselect_hyperslab");
-  if (result < 0) {
-    goto cleanup;
+  plan->image_slice_max_buffer = malloc(plan->total_number_of_slices * sizeof(double));
+  plan->image_slice_min_buffer = malloc(plan->total_number_of_slices * sizeof(double));
+  if (plan->image_slice_max_buffer == NULL || plan->image_slice_min_buffer == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int)(plan->total_number_of_slices * sizeof(double)));
   }
+  return (MI_NOERROR);
+}
 
-  if((result=miget_volume_valid_range( volume, &volume_valid_max, &volume_valid_min))<0)
-  {
-    goto cleanup;
+/** Get the real range of the slices covered by the current selection
+ * of a plan.
+ */
+static int mihyperplan_load_range(mihyperplan_t plan)
+{
+  mihandle_t volume = plan->volume;
+
+  if (!plan->slice_scaling) {
+    plan->image_slice_max_buffer[0] = 1.0;
+    plan->image_slice_min_buffer[0] = 0.0;
+    miget_volume_range(volume, plan->image_slice_max_buffer, plan->image_slice_min_buffer);
+    return (MI_NOERROR);
   }
+  return mislice_range_read(volume, plan->hdf_start, plan->image_slice_count,
+                            plan->image_slice_max_buffer, plan->image_slice_min_buffer);
+}
 
-#ifdef _DEBUG
-  printf("mirw_hyperslab_icv:Volume:%lx valid_max:%f valid_min:%f scaling:%d n_different:%d\n",(long int)(volume),volume_valid_max,volume_valid_min,volume->has_slice_scaling,n_different);
-#endif  
-  
-  if(volume->has_slice_scaling)
-  {
-    hid_t image_max_fspc_id;
-    hid_t image_min_fspc_id;
-    hid_t scaling_mspc_id;
-    total_number_of_slices=1;
-    image_slice_length=1;
-    scaling_needed=1;
-
-    image_max_fspc_id=H5Dget_space(volume->imax_id);
-    image_min_fspc_id=H5Dget_space(volume->imin_id);
-
-    if ( image_max_fspc_id < 0 ) {
-      /*Report error that image-max is not found!*/
-      return ( MI_ERROR );
-    }
+/** Read/write a hyperslab of data.  This is the simplified function
+ * which performs no value conversion.  It is much more efficient than
+ * mirw_hyperslab_icv()
+ */
+static int mirw_hyperslab_raw(int opcode,
+                              mihyperplan_t plan,
+                              void *buffer)
+{
+  mihandle_t volume = plan->volume;
+  void *temp_buffer;
+  int result;
 
-    slice_ndims = H5Sget_simple_extent_ndims ( image_max_fspc_id );
-    if(slice_ndims<0)
-    {
-      /*TODO: report read error somehow*/
-      fprintf(stderr,"H5Sget_simple_extent_ndims: Fail %s:%d\n",__FILE__,__LINE__);
-      goto cleanup;
+  if (opcode == MIRW_OP_READ) {
+    if (plan->flip_only) {
+      return mihyperplan_read_flipped(plan, plan->buffer_type_id, buffer);
     }
-
-    if ( (hsize_t)slice_ndims > ndims ) { /*Can this really happen?*/
-      slice_ndims = ndims;
+    if (plan->n_different != 0 && (temp_buffer = mihyperplan_read_buffer(plan)) != NULL) {
+      result = mihyperplan_read(plan, plan->buffer_type_id, temp_buffer);
+      if (result < 0) {
+        return (MI_ERROR);
+      }
+      mihyperplan_transpose(plan, opcode, temp_buffer, buffer);
+      return (MI_NOERROR);
     }
 
-    for ( j = 0; j < slice_ndims; j++ ) {
-      image_slice_count[j] = hdf_count[j];
-      image_slice_start[j] = hdf_start[j];
-      
-      if(hdf_count[j]>1) /*avoid zero sized dimensions?*/
-        total_number_of_slices*=hdf_count[j];
+    result = mihyperplan_read(plan, plan->buffer_type_id, buffer);
+    if (result < 0) {
+      return (MI_ERROR);
     }
-    
-    for (i = slice_ndims; i < ndims; i++ ) {
-      if(hdf_count[i]>1) /*avoid zero sized dimensions?*/
-        image_slice_length*=hdf_count[i];
-      
-      image_slice_count[i] = 0;
-      image_slice_start[i] = 0;
-    }
-    
-    image_slice_max_buffer=malloc(total_number_of_slices*sizeof(double));
-    if(!image_slice_max_buffer)
-    {
-      result=MI_ERROR;
-      MI_LOG_ERROR(MI2_MSG_OUTOFMEM,total_number_of_slices*sizeof(double));
-      goto cleanup;
-    }
-    
-    image_slice_min_buffer=malloc(total_number_of_slices*sizeof(double));
-    
-    if(!image_slice_min_buffer)
-    {
-      result=MI_ERROR;
-      MI_LOG_ERROR(MI2_MSG_OUTOFMEM,total_number_of_slices*sizeof(double));
-      goto cleanup;
+
+    /* Restructure the array after reading the data in file orientation.
+     */
+    if (plan->n_different != 0) {
+      mihyperplan_restructure(plan, opcode, buffer);
     }
-    
-    scaling_mspc_id = H5Screate_simple(slice_ndims, image_slice_count, NULL);
-    
-    if( (result=H5Sselect_hyperslab(image_max_fspc_id, H5S_SELECT_SET, image_slice_start, NULL, image_slice_count, NULL))>=0 )
-    {
-      if((result=H5Dread(volume->imax_id, H5T_NATIVE_DOUBLE, scaling_mspc_id, image_max_fspc_id, H5P_DEFAULT,image_slice_max_buffer))<0)
-      {
-        MI_LOG_ERROR(MI2_MSG_HDF5,"H5Dread");
-        goto cleanup;
+  } else {
+
+    volume->is_dirty = TRUE; /* Mark as modified. */
+
+    /* Selections of complete chunks are flipped as they are gathered */
+    if (plan->flip_only && plan->chunk_io && volume->write_threads > 0 &&
+        !mistats_enabled(volume)) {
+      double t0 = MIIO_START();
+
+      result = miwrite_hyperslab_chunks(plan, plan->buffer_type_id, buffer, plan->dir);
+      MIIO_STOP(volume, MIIO_CHUNK_WRITE, t0);
+      if (result == MI_NOERROR) {
+        return (MI_NOERROR);
       }
-    } else {
-      MI_LOG_ERROR(MI2_MSG_HDF5,"H5Sselect_hyperslab");
-      goto cleanup;
     }
-    
-    if((result=H5Sselect_hyperslab(image_min_fspc_id, H5S_SELECT_SET, image_slice_start, NULL, image_slice_count, NULL))>=0 )
-    {
-      if((result=H5Dread(volume->imin_id, H5T_NATIVE_DOUBLE, scaling_mspc_id, image_min_fspc_id, H5P_DEFAULT,image_slice_min_buffer))<0)
-      {
-        MI_LOG_ERROR(MI2_MSG_HDF5,"H5Dread");
-        goto cleanup;
+
+    if (plan->n_different != 0) {
+      /*Use temporary array to preserve input data*/
+      temp_buffer = mihyperplan_scratch(&plan->temp_buffer, plan->buffer_size);
+      if (temp_buffer == NULL) {
+        return (MI_ERROR);
       }
+      mihyperplan_transpose(plan, opcode, buffer, temp_buffer);
+      mistats_add(plan, plan->buffer_data_type, temp_buffer, TRUE);
+      result = mihyperplan_write(plan, plan->buffer_type_id, temp_buffer);
     } else {
-      /*TODO: report read error somehow*/
-      MI_LOG_ERROR(MI2_MSG_HDF5,"H5Sselect_hyperslab");
-      goto cleanup;
+      mistats_add(plan, plan->buffer_data_type, buffer, TRUE);
+      result = mihyperplan_write(plan, plan->buffer_type_id, buffer);
     }
-    H5Sclose(scaling_mspc_id);
-    H5Sclose(image_max_fspc_id);
-    H5Sclose(image_min_fspc_id);
+  }
+  return (result);
+}
+
+/** Read/write a hyperslab of data, performing dimension remapping
+ * and data rescaling as needed.
+ */
+static int mirw_hyperslab_icv(int opcode,
+                              mihyperplan_t plan,
+                              void *buffer)
+{
+  mihandle_t volume = plan->volume;
+  int result;
+  double volume_valid_min, volume_valid_max;
+  void *temp_buffer;
+  double *image_slice_max_buffer = plan->image_slice_max_buffer;
+  double *image_slice_min_buffer = plan->image_slice_min_buffer;
+  hsize_t image_slice_length = plan->image_slice_length;
+  hsize_t total_number_of_slices = plan->total_number_of_slices;
+  int scaling_needed;
+
+  if ((result = miget_volume_valid_range(volume, &volume_valid_max, &volume_valid_min)) < 0) {
+    return (result);
+  }
+
+  if (plan->slice_scaling) {
+    scaling_needed = 1;
   } else {
-    slice_ndims=0;
-    total_number_of_slices=1;
-    image_slice_max_buffer=malloc(sizeof(double));
-    image_slice_min_buffer=malloc(sizeof(double));
-    miget_volume_range(volume,image_slice_max_buffer,image_slice_min_buffer);
-    image_slice_length=1;
     /*it produces unity scaling*/
-    scaling_needed=(*image_slice_max_buffer!=volume_valid_max) || (*image_slice_min_buffer!=volume_valid_min);
-    for (i = 0; i < ndims; i++) {
-      image_slice_length *= hdf_count[i];
-    }
-#ifdef _DEBUG    
-    printf("mirw_hyperslab_icv:Real max:%f min:%f\n",*image_slice_max_buffer,*image_slice_min_buffer);
-#endif    
+    scaling_needed = (*image_slice_max_buffer != volume_valid_max) ||
+                     (*image_slice_min_buffer != volume_valid_min);
   }
-  
+
+#ifdef _DEBUG
+  printf("mirw_hyperslab_icv:Volume:%lx valid_max:%f valid_min:%f scaling:%d n_different:%d\n",(long int)(volume),volume_valid_max,volume_valid_min,volume->has_slice_scaling,plan->n_different);
+#endif
+
   //A hack to disable interslice scaling when it is not needed according to MINC1 specs
-  if( volume->volume_type==MI_TYPE_FLOAT    || volume->volume_type==MI_TYPE_DOUBLE || 
+  if( volume->volume_type==MI_TYPE_FLOAT    || volume->volume_type==MI_TYPE_DOUBLE ||
       volume->volume_type==MI_TYPE_FCOMPLEX || volume->volume_type==MI_TYPE_DCOMPLEX )
   {
     scaling_needed=0;
-  } 
-#ifdef _DEBUG  
-  printf("mirw_hyperslab_icv:Slice_ndim:%zu total_number_of_slices:%zu image_slice_length:%zu scaling_needed:%zu\n",(size_t)slice_ndims,(size_t)total_number_of_slices,(size_t)image_slice_length,(size_t)scaling_needed);
+  }
+#ifdef _DEBUG
+  printf("mirw_hyperslab_icv:Slice_ndim:%zu total_number_of_slices:%zu image_slice_length:%zu scaling_needed:%zu\n",(size_t)plan->slice_ndims,(size_t)total_number_of_slices,(size_t)image_slice_length,(size_t)scaling_needed);
 #endif
 
-  if (opcode == MIRW_OP_READ) 
+  if (opcode == MIRW_OP_READ)
   {
-    MI_CHECK_HDF_CALL(result = H5Dread(dset_id, buffer_type_id, mspc_id, fspc_id, H5P_DEFAULT, buffer),"H5Dread");
+    /*Read into a scratch buffer if the data has to be reordered*/
+    void *file_order_buffer = buffer;
+
+    if (plan->flip_only) {
+      /*Flipped as it is read, the slice ranges have to follow*/
+      result = mihyperplan_read_flipped(plan, plan->buffer_type_id, buffer);
+      if (result >= 0 && scaling_needed && plan->slice_ndims > 0) {
+        flip_array(plan->slice_ndims, (unsigned char *)image_slice_max_buffer,
+                   plan->icount, sizeof(double), plan->dir);
+        flip_array(plan->slice_ndims, (unsigned char *)image_slice_min_buffer,
+                   plan->icount, sizeof(double), plan->dir);
+      }
+    } else {
+      if (plan->n_different != 0 && (temp_buffer = mihyperplan_read_buffer(plan)) != NULL)
+        file_order_buffer = temp_buffer;
+
+      result = mihyperplan_read(plan, plan->buffer_type_id, file_order_buffer);
+    }
     if(result<0)
     {
-      goto cleanup;
+      return (MI_ERROR);
     }
-    
+
     if(scaling_needed)
     {
-      switch(buffer_data_type)
-      {
-        case MI_TYPE_FLOAT:
-#ifdef _DEBUG  
-          printf("Descaling  float\n");
-#endif
-          APPLY_DESCALING(float,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_DOUBLE:
-#ifdef _DEBUG  
-          printf("Descaling  double\n");
-#endif
-          APPLY_DESCALING(double,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_INT:
-#ifdef _DEBUG  
-          printf("Descaling  int\n");
-#endif
-          APPLY_DESCALING(int,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_UINT:
-#ifdef _DEBUG  
-          printf("Descaling  uint\n");
-#endif
-          APPLY_DESCALING(unsigned int,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_SHORT:
-#ifdef _DEBUG  
-          printf("Descaling  short\n");
-#endif
-          APPLY_DESCALING(short,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_USHORT:
-#ifdef _DEBUG  
-          printf("Descaling  ushort\n");
-#endif
-          APPLY_DESCALING(unsigned short,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_BYTE:
-#ifdef _DEBUG  
-          printf("Descaling  byte\n");
-#endif
-          APPLY_DESCALING(char,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        case MI_TYPE_UBYTE:
-#ifdef _DEBUG  
-          printf("Descaling  ubyte\n");
-#endif
-          APPLY_DESCALING(unsigned char,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-          break;
-        default:
-          /*TODO: report unsupported conversion*/
-          result=MI_ERROR;
-          goto cleanup;
-      } 
-    } else {
-#ifdef _DEBUG  
-      printf("Descaling  not needed!\n");
-#endif
-    }
-    
-    if (n_different != 0 ) {
-      for (i = 0; i < ndims; i++) {
-        icount[i] = count[i];
+      double t0 = MIIO_START();
+
+      result = miapply_descaling(plan->buffer_data_type, file_order_buffer, image_slice_length,
+                                 total_number_of_slices, image_slice_min_buffer,
+                                 image_slice_max_buffer, volume_valid_min,
+                                 volume_valid_max);
+      MIIO_STOP(volume, MIIO_SCALING, t0);
+      if (result < 0) {
+        /*TODO: report unsupported conversion*/
+        return (MI_ERROR);
       }
-      restructure_array(ndims, buffer, icount, H5Tget_size(buffer_type_id),volume->dim_indices, dir);
+    }
+
+    if (file_order_buffer != buffer) {
+      mihyperplan_transpose(plan, opcode, file_order_buffer, buffer);
+    } else if (plan->n_different != 0 && !plan->flip_only) {
+      mihyperplan_restructure(plan, opcode, buffer);
       /*TODO: check if we managed to restructure the array*/
       result=0;
     }
   } else { /*opcode != MIRW_OP_READ*/
 
     volume->is_dirty = TRUE; /* Mark as modified. */
-    
-    if (n_different != 0 ) {
-      /* Invert before calling */
-      for (i = 0; i < ndims; i++) {
-        icount[volume->dim_indices[i]] = count[i];
-        idir[volume->dim_indices[i]] = dir[i];
-        /* this one was correct the original way*/
-        imap[volume->dim_indices[i]] = i;
 
-      }
-    }
-    if(scaling_needed || n_different != 0) 
+    if(scaling_needed || plan->n_different != 0)
     {
       /*create temporary copy, to be destroyed*/
-      temp_buffer=malloc(buffer_size);
+      temp_buffer = mihyperplan_scratch(&plan->temp_buffer, plan->buffer_size);
       if(!temp_buffer)
       {
-        MI_LOG_ERROR(MI2_MSG_OUTOFMEM,buffer_size);
-        result=MI_ERROR; /*TODO: error code?*/
-        goto cleanup;
+        return (MI_ERROR);
       }
-      memcpy(temp_buffer,buffer,buffer_size);
-
-      if (n_different != 0 )
-        restructure_array(ndims, temp_buffer, icount, H5Tget_size(buffer_type_id), imap, idir);
+      if (plan->n_different != 0 )
+        mihyperplan_transpose(plan, opcode, buffer, temp_buffer);
+      else
+        memcpy(temp_buffer,buffer,plan->buffer_size);
 
+      mistats_add(plan, plan->buffer_data_type, temp_buffer, FALSE);
       if(scaling_needed)
       {
-        switch(buffer_data_type)
-        {
-          case MI_TYPE_FLOAT:
-#ifdef _DEBUG  
-            printf("scaling  float\n");
-#endif
-            APPLY_SCALING(float,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_DOUBLE:
-#ifdef _DEBUG  
-            printf("scaling  double\n");
-#endif
-            APPLY_SCALING(double,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_INT:
-#ifdef _DEBUG  
-            printf("scaling  int\n");
-#endif
-            APPLY_SCALING(int,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_UINT:
-#ifdef _DEBUG  
-            printf("scaling  unsigned int\n");
-#endif
-            APPLY_SCALING(unsigned int,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_SHORT:
-#ifdef _DEBUG  
-            printf("scaling  short\n");
-#endif
-            APPLY_SCALING(short,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_USHORT:
-#ifdef _DEBUG  
-            printf("scaling  unsigned short\n");
-#endif
-            APPLY_SCALING(unsigned short,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_BYTE:
-#ifdef _DEBUG
-            printf("scaling  char\n");
-#endif
-            APPLY_SCALING(char,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          case MI_TYPE_UBYTE:
-#ifdef _DEBUG
-            printf("scaling  unsigned char\n");
-#endif
-            APPLY_SCALING(unsigned char,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max);
-            break;
-          default:
-            /*TODO: report unsupported conversion*/
-            result=MI_ERROR;
-            goto cleanup;
+        double t0 = MIIO_START();
+
+        result = miapply_scaling(plan->buffer_data_type, temp_buffer, image_slice_length,
+                                 total_number_of_slices, image_slice_min_buffer,
+                                 image_slice_max_buffer, volume_valid_min,
+                                 volume_valid_max);
+        MIIO_STOP(volume, MIIO_SCALING, t0);
+        if (result < 0) {
+          /*TODO: report unsupported conversion*/
+          return (MI_ERROR);
         }
       }
-      MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, buffer_type_id, mspc_id, fspc_id, H5P_DEFAULT, temp_buffer),"H5Dwrite");
+      result = mihyperplan_write(plan, plan->buffer_type_id, temp_buffer);
     } else {
-      MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, buffer_type_id, mspc_id, fspc_id, H5P_DEFAULT, buffer),"H5Dwrite");
-    }
-    
-    if(result<0)
-    {
-      goto cleanup;
+      mistats_add(plan, plan->buffer_data_type, buffer, FALSE);
+      result = mihyperplan_write(plan, plan->buffer_type_id, buffer);
     }
   }
-      
-cleanup:
+  return (result);
+}
+
+/* Voxels converted at a time by the normalized read, and the number of
+ * file rows interleaved when the fastest file dimension is not the
+ * fastest apparent dimension.
+ */
+#define MINORM_BLOCK 256
+#define MINORM_ROWS 16
+#define MINORM_ABS(x) ((x) < 0 ? -(x) : (x))
 
-  if (buffer_type_id >= 0) {
-    H5Tclose(buffer_type_id);
+/** Value conversion of a normalized read, from the voxel type of the
+ * file to the type of the user buffer.
+ */
+struct minorm_pass {
+  mitype_t in_type;             /* Voxel type read from the file */
+  mitype_t out_type;            /* Type of the user buffer */
+  const double *slice_min;      /* Real range of each slice */
+  const double *slice_max;
+  hsize_t slice_length;         /* Voxels sharing one slice range */
+  double voxel_offset;
+  double voxel_range;
+  double data_offset;
+  double data_range;
+  double norm_min;              /* Full range of the buffer type */
+  double norm_max;
+  double norm_offset;
+  double norm_range;
+};
+
+#define MINORM_LOAD(type) \
+  { \
+    const type *_in = (const type *)in + offset; \
+    for (i = 0; i < n; i++) \
+      out[i] = (double)_in[i]; \
   }
-  if (mspc_id >= 0) {
-    H5Sclose(mspc_id);
+
+/** Convert \a n voxels of the file type at \a offset in \a in to
+ * doubles.
+ */
+static void minorm_load(mitype_t type, const void *in, hsize_t offset,
+                        size_t n, double *out)
+{
+  size_t i;
+
+  switch (type) {
+  case MI_TYPE_BYTE:   MINORM_LOAD(signed char);    break;
+  case MI_TYPE_UBYTE:  MINORM_LOAD(unsigned char);  break;
+  case MI_TYPE_SHORT:  MINORM_LOAD(short);          break;
+  case MI_TYPE_USHORT: MINORM_LOAD(unsigned short); break;
+  case MI_TYPE_INT:    MINORM_LOAD(int);            break;
+  case MI_TYPE_UINT:   MINORM_LOAD(unsigned int);   break;
+  case MI_TYPE_FLOAT:  MINORM_LOAD(float);          break;
+  default:             MINORM_LOAD(double);         break;
   }
-  if (fspc_id >= 0) {
-    H5Sclose(fspc_id);
+}
+
+/** Map \a n voxel values, the first one at linear position \a start of
+ * the selection in file order, onto the full range of the buffer type.
+ */
+static void minorm_normalize(const struct minorm_pass *p, hsize_t start,
+                             double *v, size_t n)
+{
+  while (n > 0) {
+    hsize_t slice = start / p->slice_length;
+    size_t run = (size_t)(p->slice_length - start % p->slice_length);
+    double slice_min = p->slice_min[slice];
+    double slice_range = p->slice_max[slice] - p->slice_min[slice];
+    size_t i;
+
+    if (run > n) {
+      run = n;
+    }
+    for (i = 0; i < run; i++) {
+      double temp = ((v[i] - p->voxel_offset) / p->voxel_range) * slice_range + slice_min;
+      temp = (temp - p->data_offset) / p->data_range;
+      v[i] = (temp < 0.0) ? p->norm_min : (temp >= 1.0) ? p->norm_max :
+             (rint(temp * p->norm_range) + p->norm_offset);
+    }
+    v += run;
+    start += run;
+    n -= run;
   }
-  if ( dset_id >=0 ) {
-    H5Dclose(dset_id);
+}
+
+#define MINORM_STORE(type) \
+  { \
+    type *_out = (type *)out; \
+    for (j = 0; j < n; j++) \
+      for (r = 0; r < n_rows; r++) \
+        _out[offset + (ptrdiff_t)r * row_stride + (ptrdiff_t)j * stride] = \
+          (type)v[r * MINORM_BLOCK + j]; \
   }
-  
-  if(temp_buffer!=NULL)
-  {
-    free(temp_buffer);
+
+/** Store \a n_rows rows of \a n normalized values, held MINORM_BLOCK
+ * apart in \a v, at \a offset in \a out. Consecutive values of a row
+ * are \a stride elements apart and consecutive rows \a row_stride.
+ */
+static void minorm_store(mitype_t type, const double *v, size_t n, size_t n_rows,
+                         void *out, ptrdiff_t offset, ptrdiff_t row_stride,
+                         ptrdiff_t stride)
+{
+  size_t j, r;
+
+  switch (type) {
+  case MI_TYPE_BYTE:   MINORM_STORE(signed char);    break;
+  case MI_TYPE_UBYTE:  MINORM_STORE(unsigned char);  break;
+  case MI_TYPE_SHORT:  MINORM_STORE(short);          break;
+  case MI_TYPE_USHORT: MINORM_STORE(unsigned short); break;
+  case MI_TYPE_INT:    MINORM_STORE(int);            break;
+  case MI_TYPE_UINT:   MINORM_STORE(unsigned int);   break;
+  case MI_TYPE_FLOAT:  MINORM_STORE(float);          break;
+  default:             MINORM_STORE(double);         break;
   }
-  if(image_slice_min_buffer!=NULL)
-  {
-    free(image_slice_min_buffer);
+}
+
+/** Read the current selection of a normalized plan into \a buffer.
+ * The voxels are read in the type of the file, then scaled, normalized,
+ * converted and moved to their place in apparent order in one pass
+ * over blocks small enough to stay in cache, so no buffer of doubles
+ * the size of the selection is needed. Without dimension remapping,
+ * and when the voxels of the file are no larger than the elements of
+ * \a buffer, the voxels are read straight into \a buffer and converted
+ * in place.
+ */
+static int mihyperplan_read_normalized(mihyperplan_t plan, void *buffer,
+                                       double valid_min, double valid_max)
+{
+  mihandle_t volume = plan->volume;
+  struct minorm_pass p;
+  double v[MINORM_ROWS * MINORM_BLOCK];
+  hsize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t in_stride[MI2_MAX_VAR_DIMS];
+  ptrdiff_t out_stride[MI2_MAX_VAR_DIMS];
+  ptrdiff_t stride[MI2_MAX_VAR_DIMS];
+  hsize_t idx[MI2_MAX_VAR_DIMS];
+  hsize_t n_voxels = 1;
+  ptrdiff_t base = 0;
+  double t0;
+  hid_t in_type_id;
+  size_t in_size;
+  void *in;
+  int ndims;
+  int a, b;
+  int i;
+
+  switch (volume->volume_type) {
+  case MI_TYPE_BYTE:   in_type_id = H5T_NATIVE_SCHAR;  break;
+  case MI_TYPE_UBYTE:  in_type_id = H5T_NATIVE_UCHAR;  break;
+  case MI_TYPE_SHORT:  in_type_id = H5T_NATIVE_SHORT;  break;
+  case MI_TYPE_USHORT: in_type_id = H5T_NATIVE_USHORT; break;
+  case MI_TYPE_INT:    in_type_id = H5T_NATIVE_INT;    break;
+  case MI_TYPE_UINT:   in_type_id = H5T_NATIVE_UINT;   break;
+  case MI_TYPE_FLOAT:  in_type_id = H5T_NATIVE_FLOAT;  break;
+  default:             in_type_id = H5T_NATIVE_DOUBLE; break;
   }
-  if(image_slice_max_buffer!=NULL)
-  {
-    free(image_slice_max_buffer);
+  p.in_type = (in_type_id == H5T_NATIVE_DOUBLE) ? MI_TYPE_DOUBLE : volume->volume_type;
+  in_size = H5Tget_size(in_type_id);
+
+  /*WARNING: floating point types will be normalized between 0.0 and 1.0*/
+  p.out_type = plan->buffer_data_type;
+  switch (p.out_type) {
+  case MI_TYPE_FLOAT:
+  case MI_TYPE_DOUBLE:
+    p.norm_min = 0.0;       p.norm_max = 1.0;       break;
+  case MI_TYPE_INT:
+    p.norm_min = INT_MIN;   p.norm_max = INT_MAX;   break;
+  case MI_TYPE_UINT:
+    p.norm_min = 0;         p.norm_max = UINT_MAX;  break;
+  case MI_TYPE_SHORT:
+    p.norm_min = SHRT_MIN;  p.norm_max = SHRT_MAX;  break;
+  case MI_TYPE_USHORT:
+    p.norm_min = 0;         p.norm_max = USHRT_MAX; break;
+  case MI_TYPE_BYTE:
+    p.norm_min = SCHAR_MIN; p.norm_max = SCHAR_MAX; break;
+  case MI_TYPE_UBYTE:
+    p.norm_min = 0;         p.norm_max = UCHAR_MAX; break;
+  default:
+    /*TODO: report unsupported conversion*/
+    return (MI_ERROR);
+  }
+  p.norm_offset = p.norm_min;
+  p.norm_range = p.norm_max - p.norm_min;
+  p.voxel_offset = valid_min;
+  p.voxel_range = valid_max - valid_min;
+  p.data_offset = plan->data_min;
+  p.data_range = plan->data_max - plan->data_min;
+  p.slice_min = plan->image_slice_min_buffer;
+  p.slice_max = plan->image_slice_max_buffer;
+  p.slice_length = plan->image_slice_length;
+
+  /* A scalar volume is a single row of one voxel */
+  ndims = (plan->ndims > 0) ? plan->ndims : 1;
+  for (i = 0; i < ndims; i++) {
+    count[i] = (plan->ndims > 0) ? plan->hdf_count[i] : 1;
+    n_voxels *= count[i];
   }
-  return (result);
-}
 
-#define APPLY_DESCALING_NORM(type_out,buffer_in,buffer_out,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,voxel_min,voxel_max,data_min,data_max,norm_min,norm_max) \
-  { \
-    hsize_t _i,_j;\
-    double voxel_offset=voxel_min;\
-    double voxel_range=voxel_max-voxel_min;\
-    double norm_offset=(double)norm_min;\
-    double norm_range=(double)norm_max-(double)norm_min;\
-    double data_offset=data_min;\
-    double data_range=(double)data_max-(double)data_min;\
-    type_out *_buffer_out=(type_out *)buffer_out;\
-    double *_buffer_in=(double *)buffer_in; \
-    for(_i=0;_i<total_number_of_slices;_i++)\
-      for(_j=0;_j<image_slice_length;_j++)\
-      {\
-        double _temp=(( (*_buffer_in) - voxel_offset) / voxel_range)*(image_slice_max_buffer[_i]-image_slice_min_buffer[_i]) + image_slice_min_buffer[_i] ;\
-        _temp=(_temp-data_offset)/data_range;\
-        _temp=(_temp<0.0)?norm_min:(_temp>=1.0)?norm_max:(rint(_temp*norm_range)+norm_offset); \
-        *_buffer_out=(type_out)(_temp);\
-        _buffer_in++;\
-        _buffer_out++;\
-      }\
+  if (plan->n_different == 0 && in_size <= plan->buffer_type_size) {
+    hsize_t end;
+
+    if (mihyperplan_read(plan, in_type_id, buffer) < 0) {
+      return (MI_ERROR);
+    }
+    /* Going backwards every block is loaded before the wider results
+     * overwrite it.
+     */
+    t0 = MIIO_START();
+    for (end = n_voxels; end > 0; ) {
+      size_t n = (end > MINORM_BLOCK) ? MINORM_BLOCK : (size_t)end;
+
+      end -= n;
+      minorm_load(p.in_type, buffer, end, n, v);
+      minorm_normalize(&p, end, v, n);
+      minorm_store(p.out_type, v, n, 1, buffer, (ptrdiff_t)end, 0, 1);
+    }
+    MIIO_STOP(volume, MIIO_SCALING, t0);
+    return (MI_NOERROR);
+  }
+
+  in = mihyperplan_scratch(&plan->file_buffer, n_voxels * in_size);
+  if (in == NULL) {
+    return (MI_ERROR);
+  }
+  if (mihyperplan_read(plan, in_type_id, in) < 0) {
+    return (MI_ERROR);
+  }
+
+  /* Strides of the selection in file order, and signed strides in the
+   * user buffer of each file dimension.
+   */
+  in_stride[ndims - 1] = 1;
+  out_stride[ndims - 1] = 1;
+  for (i = ndims - 1; i > 0; i--) {
+    in_stride[i - 1] = in_stride[i] * count[i];
+    out_stride[i - 1] = out_stride[i] * (ptrdiff_t)plan->count[i];
+  }
+  for (i = 0; i < ndims; i++) {
+    if (plan->ndims == 0) {
+      stride[i] = 1;
+    } else if (plan->wdir[i] < 0) {
+      stride[i] = -out_stride[plan->wmap[i]];
+      base += (ptrdiff_t)(count[i] - 1) * out_stride[plan->wmap[i]];
+    } else {
+      stride[i] = out_stride[plan->wmap[i]];
+    }
+  }
+
+  /* Rows run along the fastest file dimension. When it is not also the
+   * fastest dimension of the buffer, a few rows along the dimension with
+   * the smallest stride in the buffer are handled together, so that the
+   * stores of a block are close to each other.
+   */
+  a = ndims - 1;
+  b = -1;
+  if (stride[a] != 1 && stride[a] != -1) {
+    for (i = 0; i < a; i++) {
+      if (count[i] > 1 && (b < 0 || MINORM_ABS(stride[i]) < MINORM_ABS(stride[b]))) {
+        b = i;
+      }
+    }
+  }
+
+  t0 = MIIO_START();
+  for (i = 0; i < a; i++) {
+    idx[i] = 0;
   }
+  for (;;) {
+    size_t n_rows = 1;
+    hsize_t in_offset = 0;
+    ptrdiff_t out_offset = base;
+    hsize_t j0;
+    size_t r;
+
+    if (b >= 0) {
+      n_rows = (count[b] - idx[b] > MINORM_ROWS) ? MINORM_ROWS : (size_t)(count[b] - idx[b]);
+    }
+    for (i = 0; i < a; i++) {
+      in_offset += idx[i] * in_stride[i];
+      out_offset += (ptrdiff_t)idx[i] * stride[i];
+    }
+    for (j0 = 0; j0 < count[a]; j0 += MINORM_BLOCK) {
+      size_t n = (count[a] - j0 > MINORM_BLOCK) ? MINORM_BLOCK : (size_t)(count[a] - j0);
+
+      for (r = 0; r < n_rows; r++) {
+        hsize_t row = in_offset + (b >= 0 ? r * in_stride[b] : 0) + j0;
+
+        minorm_load(p.in_type, in, row, n, v + r * MINORM_BLOCK);
+        minorm_normalize(&p, row, v + r * MINORM_BLOCK, n);
+      }
+      minorm_store(p.out_type, v, n, n_rows, buffer,
+                   out_offset + (ptrdiff_t)j0 * stride[a],
+                   (b >= 0) ? stride[b] : 0, stride[a]);
+    }
 
+    /* Next group of rows */
+    for (i = a - 1; i >= 0; i--) {
+      idx[i] += (i == b) ? n_rows : 1;
+      if (idx[i] < count[i]) {
+        break;
+      }
+      idx[i] = 0;
+    }
+    if (i < 0) {
+      break;
+    }
+  }
+  MIIO_STOP(volume, MIIO_SCALING, t0);
+  return (MI_NOERROR);
+}
 
 #define APPLY_SCALING_NORM(type_in,buffer_in,buffer_out,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,voxel_min,voxel_max,data_min,data_max,norm_min,norm_max) \
   { \
@@ -848,296 +926,55 @@ cleanup:
  * and data rescaling as needed. Data in the range (min-max) will map to the appropriate full range of buffer_data_type
  */
 static int mirw_hyperslab_normalized(int opcode,
-                              mihandle_t volume,
-                              mitype_t buffer_data_type,
-                              const misize_t start[],
-                              const misize_t count[],
-                              double data_min,
-                              double data_max,
-                              void *buffer)
+                                     mihyperplan_t plan,
+                                     void *buffer)
 {
-  hid_t dset_id = -1;
-  hid_t mspc_id = -1;
-  hid_t fspc_id = -1;
-  hid_t volume_type_id = -1;
-  hid_t buffer_type_id = -1;
-  int result = MI_ERROR;
-  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
-  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
-  int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
-  hsize_t ndims;
-  int slice_ndims;
-  int n_different = 0;
+  mihandle_t volume = plan->volume;
+  int result;
   double volume_valid_min, volume_valid_max;
-  misize_t buffer_size;
-  misize_t input_buffer_size;
-  double *temp_buffer=NULL;
-  size_t icount[MI2_MAX_VAR_DIMS];
-  int idir[MI2_MAX_VAR_DIMS];
-  int imap[MI2_MAX_VAR_DIMS];
-  double *image_slice_max_buffer=NULL;
-  double *image_slice_min_buffer=NULL;
-
-  char path[MI2_MAX_PATH];
-  
-  hsize_t image_slice_start[MI2_MAX_VAR_DIMS];
-  hsize_t image_slice_count[MI2_MAX_VAR_DIMS];
-  hsize_t image_slice_length=0;
-  hsize_t total_number_of_slices=0;
-  hsize_t i;
-  int j;
-
-
-  /* Disallow write operations to anything but the highest resolution.
-   */
-  if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
-    /*TODO: report error that we are not dealing with the rihgt image here*/
-    return (MI_ERROR);
-  }
-  
-  snprintf(path, sizeof(path), MI_ROOT_PATH "/image/%d/image", volume->selected_resolution);
-
-  /* Open the dataset with the specified path
-  */
-  MI_CHECK_HDF_CALL(dset_id = H5Dopen1(volume->hdf_id, path),"H5Dopen1");
-  if (dset_id < 0) {
-    return (MI_ERROR);
-  }
-
-  MI_CHECK_HDF_CALL(fspc_id = H5Dget_space(dset_id),"H5Dget_space");
-  if (fspc_id < 0) {
-    /*TODO: report can't get dataset*/
-    goto cleanup;
-  }
-  buffer_type_id = mitype_to_hdftype(buffer_data_type,TRUE);
-  if(buffer_type_id<0)
-  {
-    goto cleanup;
-  }
-  
-  MI_CHECK_HDF_CALL(volume_type_id = H5Tcopy ( H5T_NATIVE_DOUBLE ),"H5Tcopy");
-  if(volume_type_id<0)
-  {
-    fprintf(stderr,"H5Tcopy: Fail %s:%d\n",__FILE__,__LINE__);
-    goto cleanup;
-  }
-  
-  ndims = volume->number_of_dims;
-  
-  if (ndims == 0) {
-    /* A scalar volume is possible but extremely unlikely, not to
-     * mention useless!
-     */
-    mspc_id = H5Screate(H5S_SCALAR);
-  } else {
-
-    n_different = mitranslate_hyperslab_origin(volume,start,count, hdf_start,hdf_count,dir);
-
-    MI_CHECK_HDF_CALL(mspc_id = H5Screate_simple(ndims, hdf_count, NULL),"H5Screate_simple");
-    
-    if (mspc_id < 0) {
-      goto cleanup;
-    }
-  }
-  
-  miget_hyperslab_size_hdf(volume_type_id,ndims,hdf_count,&buffer_size);
-  miget_hyperslab_size_hdf(buffer_type_id,ndims,hdf_count,&input_buffer_size);
-
-  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, hdf_start, NULL,
-                               hdf_count, NULL),"H5Sselect_hyperslab");
-  if (result < 0) {
-    goto cleanup;
-  }
+  double data_min = plan->data_min;
+  double data_max = plan->data_max;
+  double *temp_buffer;
+  void *temp_buffer2;
+  double t0;
+  double *image_slice_max_buffer = plan->image_slice_max_buffer;
+  double *image_slice_min_buffer = plan->image_slice_min_buffer;
+  hsize_t image_slice_length = plan->image_slice_length;
+  hsize_t total_number_of_slices = plan->total_number_of_slices;
 
   miget_volume_valid_range( volume, &volume_valid_max, &volume_valid_min);
 
 #ifdef _DEBUG
   printf("mirw_hyperslab_normalized:Volume:%p valid_max:%f valid_min:%f scaling:%d\n",volume,volume_valid_max,volume_valid_min,volume->has_slice_scaling);
-#endif  
-  
-  if(volume->has_slice_scaling && 
-    !(volume->volume_type==MI_TYPE_FLOAT    || volume->volume_type==MI_TYPE_DOUBLE || 
-      volume->volume_type==MI_TYPE_FCOMPLEX || volume->volume_type==MI_TYPE_DCOMPLEX) )
-  {
-    hid_t image_max_fspc_id;
-    hid_t image_min_fspc_id;
-    hid_t scaling_mspc_id;
-    total_number_of_slices=1;
-    image_slice_length=1;
-
-    MI_CHECK_HDF_CALL(image_max_fspc_id=H5Dget_space(volume->imax_id),"H5Dget_space");
-    MI_CHECK_HDF_CALL(image_min_fspc_id=H5Dget_space(volume->imin_id),"H5Dget_space");
-
-    if ( image_max_fspc_id < 0 || image_min_fspc_id<0 ) {
-      result=MI_ERROR;
-      goto cleanup;
-    }
-
-    MI_CHECK_HDF_CALL(slice_ndims = H5Sget_simple_extent_ndims ( image_max_fspc_id ),"H5Sget_simple_extent_ndims");
-    if(slice_ndims<0)
-    {
-      goto cleanup;
-    }
-
-    if ( (hsize_t)slice_ndims > ndims ) { /*Can this really happen?*/
-      slice_ndims = ndims;
-    }
-
-    for ( j = 0; j < slice_ndims; j++ ) {
-      image_slice_count[j] = hdf_count[j];
-      image_slice_start[j] = hdf_start[j];
-      
-      if(hdf_count[j]>1) /*avoid zero sized dimensions?*/
-        total_number_of_slices*=hdf_count[j];
-    }
-    
-    for (i = slice_ndims; i < ndims; i++ ) {
-      if(hdf_count[i]>1) /*avoid zero sized dimensions?*/
-        image_slice_length*=hdf_count[i];
-      
-      image_slice_count[i] = 0;
-      image_slice_start[i] = 0;
-    }
-    
-    image_slice_max_buffer=malloc(total_number_of_slices*sizeof(double));
-    image_slice_min_buffer=malloc(total_number_of_slices*sizeof(double));
-    /*TODO check for allocation failure ?*/
-    
-    MI_CHECK_HDF_CALL(scaling_mspc_id = H5Screate_simple(slice_ndims, image_slice_count, NULL),"H5Screate_simple");
-    
-    if( (result=H5Sselect_hyperslab(image_max_fspc_id, H5S_SELECT_SET, image_slice_start, NULL, image_slice_count, NULL))>=0 )
-    {
-      if( ( result=H5Dread(volume->imax_id, H5T_NATIVE_DOUBLE, scaling_mspc_id, image_max_fspc_id, H5P_DEFAULT,image_slice_max_buffer))<0)
-      {
-        MI_LOG_ERROR(MI2_MSG_HDF5,"H5Dread");
-        goto cleanup;
-      }
-    } else {
-      MI_LOG_ERROR(MI2_MSG_HDF5,"H5Sselect_hyperslab");
-      goto cleanup;
-    }
-    
-    if( (result=H5Sselect_hyperslab(image_min_fspc_id, H5S_SELECT_SET, image_slice_start, NULL, image_slice_count, NULL))>=0 )
-    {
-      if( (result=H5Dread(volume->imin_id, H5T_NATIVE_DOUBLE, scaling_mspc_id, image_min_fspc_id, H5P_DEFAULT,image_slice_min_buffer))<0)
-      {
-        MI_LOG_ERROR(MI2_MSG_HDF5,"H5Dread");
-        goto cleanup;
-      }
-    } else {
-      MI_LOG_ERROR(MI2_MSG_HDF5,"H5Sselect_hyperslab");
-      goto cleanup;
-    }
-    H5Sclose(scaling_mspc_id);
-    H5Sclose(image_max_fspc_id);
-    
-  } else {
-    slice_ndims=0;
-    total_number_of_slices=1;
-    image_slice_max_buffer=malloc(sizeof(double));
-    image_slice_min_buffer=malloc(sizeof(double));
-    miget_volume_range( volume,image_slice_max_buffer,image_slice_min_buffer );
-    image_slice_length=1;
-    for (i = 0; i < ndims; i++) {
-      image_slice_length *= hdf_count[i];
-    }
-#ifdef _DEBUG
-    printf("mirw_hyperslab_normalized:Real max:%f min:%f\n",*image_slice_max_buffer,*image_slice_min_buffer);
-#endif
-  }
-
-#ifdef _DEBUG  
-  printf("mirw_hyperslab_normalized:Slice_ndim:%d total_number_of_slices:%zu image_slice_length:%zu\n",slice_ndims,(size_t)total_number_of_slices,(size_t)image_slice_length);
-  printf("mirw_hyperslab_normalized:data min:%f data max:%f buffer_data_type:%d\n",data_min,data_max,buffer_data_type);
+  printf("mirw_hyperslab_normalized:data min:%f data max:%f buffer_data_type:%d\n",data_min,data_max,plan->buffer_data_type);
 #endif
 
-  /*Allocate temporary Buffer*/
-  temp_buffer=(double*)malloc(buffer_size);
-  if(!temp_buffer)
-  {
-    MI_LOG_ERROR(MI2_MSG_OUTOFMEM,buffer_size);
-    result=MI_ERROR;
-    goto cleanup;
-  }
-  
-  if (opcode == MIRW_OP_READ) 
+  if (opcode == MIRW_OP_READ)
   {
-    MI_CHECK_HDF_CALL(result = H5Dread(dset_id, volume_type_id, mspc_id, fspc_id, H5P_DEFAULT, temp_buffer),"H5Dread");
-    if(result<0)
-    {
-      goto cleanup;
-    }
-    
-    /*WARNING: floating point types will be normalized between 0.0 and 1.0*/
-    switch(buffer_data_type)
-    {
-      case MI_TYPE_FLOAT:
-        APPLY_DESCALING_NORM(float,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0.0f,1.0f);
-        break;
-      case MI_TYPE_DOUBLE:
-        APPLY_DESCALING_NORM(double,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0.0,1.0);
-        break;
-      case MI_TYPE_INT:
-        APPLY_DESCALING_NORM(int,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,INT_MIN,INT_MAX);
-        break;
-      case MI_TYPE_UINT:
-        APPLY_DESCALING_NORM(unsigned int,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0,UINT_MAX);
-        break;
-      case MI_TYPE_SHORT:
-        APPLY_DESCALING_NORM(short,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,SHRT_MIN,SHRT_MAX);
-        break;
-      case MI_TYPE_USHORT:
-        APPLY_DESCALING_NORM(unsigned short,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0,USHRT_MAX);
-        break;
-      case MI_TYPE_BYTE:
-        APPLY_DESCALING_NORM(char,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,SCHAR_MIN,SCHAR_MAX);
-        break;
-      case MI_TYPE_UBYTE:
-        APPLY_DESCALING_NORM(unsigned char,temp_buffer,buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0,UCHAR_MAX);
-        break;
-      default:
-        /*TODO: report unsupported conversion*/
-        result=MI_ERROR;
-        goto cleanup;
-    }
-    
-    if (n_different != 0 ) {
-      for (i = 0; i < ndims; i++) {
-         icount[i] = count[i];
-      }
-      restructure_array(ndims, buffer, icount, H5Tget_size(buffer_type_id),volume->dim_indices, dir);
-      /*TODO: check if we managed to restructure the array*/
-      result=0;
-    }
+    result = mihyperplan_read_normalized(plan, buffer, volume_valid_min, volume_valid_max);
   } else { /*opcode != MIRW_OP_READ*/
-    void *temp_buffer2;
     volume->is_dirty = TRUE; /* Mark as modified. */
-    
-    if (n_different != 0 ) {
-      /* Invert before calling */
-      for (i = 0; i < ndims; i++) {
-        icount[volume->dim_indices[i]] = count[i];
-        idir[volume->dim_indices[i]] = dir[i];
-        /* this one was correct the original way*/
-        imap[volume->dim_indices[i]] = i;
 
-      }
+    /*Temporary buffer holding the voxel values as doubles*/
+    temp_buffer = mihyperplan_scratch(&plan->real_buffer, plan->real_buffer_size);
+    if(!temp_buffer)
+    {
+      return (MI_ERROR);
     }
-    
+
     /*create temporary copy, to be destroyed*/
-    temp_buffer2=malloc(input_buffer_size);
+    temp_buffer2 = mihyperplan_scratch(&plan->temp_buffer, plan->buffer_size);
     if(!temp_buffer2)
     {
-      MI_LOG_ERROR(MI2_MSG_OUTOFMEM,input_buffer_size);
-      result=MI_ERROR; /*TODO: error code?*/
-      goto cleanup;
+      return (MI_ERROR);
     }
-    memcpy(temp_buffer2,buffer,input_buffer_size);
-    
-    if (n_different != 0 ) 
-      restructure_array(ndims, temp_buffer2, icount, H5Tget_size(buffer_type_id), imap, idir);
-    
-    switch(buffer_data_type)
+    if (plan->n_different != 0 )
+      mihyperplan_transpose(plan, opcode, buffer, temp_buffer2);
+    else
+      memcpy(temp_buffer2,buffer,plan->buffer_size);
+
+    t0 = MIIO_START();
+    switch(plan->buffer_data_type)
     {
       case MI_TYPE_FLOAT:
         APPLY_SCALING_NORM(float,temp_buffer2,temp_buffer,image_slice_length,total_number_of_slices,image_slice_min_buffer,image_slice_max_buffer,volume_valid_min,volume_valid_max,data_min,data_max,0.0,1.0);
@@ -1165,51 +1002,368 @@ static int mirw_hyperslab_normalized(int opcode,
         break;
       default:
         /*TODO: report unsupported conversion*/
-        free(temp_buffer2);
-        result=MI_ERROR;
-        goto cleanup;
+        return (MI_ERROR);
     }
-    free(temp_buffer2);
-    
-    MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, volume_type_id, mspc_id, fspc_id, H5P_DEFAULT, temp_buffer),"H5Dwrite");
-    if(result<0)
-    {
-      goto cleanup;
+    MIIO_STOP(volume, MIIO_SCALING, t0);
+
+    mistats_add(plan, MI_TYPE_DOUBLE, temp_buffer, TRUE);
+    result = mihyperplan_write(plan, H5T_NATIVE_DOUBLE, temp_buffer);
+  }
+  return (result);
+}
+
+/** Release a hyperslab plan and all HDF5 objects it holds.
+ */
+static void mihyperplan_free(mihyperplan_t plan)
+{
+  if (plan->buffer_type_id >= 0) {
+    H5Tclose(plan->buffer_type_id);
+  }
+  if (plan->mspc_id >= 0) {
+    H5Sclose(plan->mspc_id);
+  }
+  if (plan->fspc_id >= 0) {
+    H5Sclose(plan->fspc_id);
+  }
+  if (plan->file_type_id >= 0) {
+    H5Tclose(plan->file_type_id);
+  }
+  free(plan->temp_buffer);
+  free(plan->real_buffer);
+  free(plan->file_buffer);
+  free(plan->image_slice_max_buffer);
+  free(plan->image_slice_min_buffer);
+  free(plan);
+}
+
+/** Release a hyperslab plan.
+ */
+int mifree_hyperslab(mihyperplan_t plan)
+{
+  mihandle_t volume;
+
+  if (plan == NULL) {
+    return (MI_ERROR);
+  }
+  volume = plan->volume;
+  mihdf_lock(volume);
+  mihyperplan_free(plan);
+  mihdf_unlock(volume);
+  return (MI_NOERROR);
+}
+
+/** Set up a plan, see miprepare_hyperslab().
+ */
+static int mihyperplan_prepare(mihandle_t volume,
+                               mihyperslab_mode_t mode,
+                               mitype_t buffer_data_type,
+                               const misize_t count[],
+                               mihyperplan_t *plan_ptr)
+{
+  mihyperplan_t plan;
+  misize_t start[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+  int i;
+
+  if (volume == NULL || plan_ptr == NULL ||
+      (count == NULL && volume->number_of_dims > 0)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to prepare a hyperslab plan with null volume or null variables");
+  }
+  if (mode != MI_HYPERSLAB_VOXEL && mode != MI_HYPERSLAB_REAL &&
+      mode != MI_HYPERSLAB_NORMALIZED) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unknown hyperslab mode");
+  }
+  if (volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to prepare a hyperslab plan for a volume without image");
+  }
+
+  plan = (mihyperplan_t) calloc(1, sizeof(struct mihyperplan));
+  if (plan == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int)sizeof(struct mihyperplan));
+  }
+  plan->volume = volume;
+  plan->mode = mode;
+  plan->buffer_data_type = buffer_data_type;
+  plan->resolution = volume->selected_resolution;
+  plan->layout_generation = volume->layout_generation;
+  plan->ndims = volume->number_of_dims;
+  plan->buffer_type_id = -1;
+  plan->fspc_id = -1;
+  plan->mspc_id = -1;
+  plan->file_type_id = -1;
+  plan->data_min = 0.0;
+  plan->data_max = 1.0;
+
+  if (mode == MI_HYPERSLAB_VOXEL && buffer_data_type == MI_TYPE_UNKNOWN) {
+    MI_CHECK_HDF_CALL(plan->buffer_type_id = H5Tcopy(volume->mtype_id),"H5Tcopy");
+  } else {
+    plan->buffer_type_id = mitype_to_hdftype(buffer_data_type, TRUE);
+  }
+  if (plan->buffer_type_id < 0) {
+    goto failure;
+  }
+  plan->buffer_type_size = H5Tget_size(plan->buffer_type_id);
+
+  MI_CHECK_HDF_CALL(plan->fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  if (plan->fspc_id < 0) {
+    goto failure;
+  }
+  if (plan->ndims > 0) {
+    plan->extent = volume->dim_handles[0]->length;
+  }
+
+  if (plan->ndims == 0) {
+    /* A scalar volume is possible but extremely unlikely, not to
+     * mention useless!
+     */
+    plan->hdf_count[0] = 1;
+    MI_CHECK_HDF_CALL(plan->mspc_id = H5Screate(H5S_SCALAR),"H5Screate");
+  } else {
+    for (i = 0; i < plan->ndims; i++) {
+      plan->count[i] = count[i];
+      start[i] = 0;
     }
+    plan->n_different = mitranslate_hyperslab_origin(volume, start, plan->count,
+                                                     hdf_start, plan->hdf_count,
+                                                     plan->dir);
+    MI_CHECK_HDF_CALL(plan->mspc_id = H5Screate_simple(plan->ndims, plan->hdf_count, NULL),"H5Screate_simple");
+  }
+  if (plan->mspc_id < 0) {
+    goto failure;
   }
-      
-cleanup:
 
-  if (volume_type_id >= 0) {
-    H5Tclose(volume_type_id);
+  /* Remapping from file order into apparent order for reads, and the
+   * inverse remapping for writes.
+   */
+  for (i = 0; i < plan->ndims; i++) {
+    int user_i = (volume->dim_indices != NULL) ? volume->dim_indices[i] : i;
+
+    plan->icount[i] = plan->count[i];
+    plan->map[i] = user_i;
+    plan->wcount[user_i] = plan->count[i];
+    plan->wdir[user_i] = plan->dir[i];
+    plan->wmap[user_i] = i;
   }
-  if (buffer_type_id >= 0) {
-    H5Tclose(buffer_type_id);
+  plan->flip_only = (plan->n_different != 0);
+  for (i = 0; i < plan->ndims; i++) {
+    if (plan->map[i] != i) {
+      plan->flip_only = FALSE;
+    }
   }
-  if (mspc_id >= 0) {
-    H5Sclose(mspc_id);
+
+  miget_hyperslab_size_hdf(plan->buffer_type_id, plan->ndims, plan->hdf_count,
+                           &plan->buffer_size);
+  miget_hyperslab_size_hdf(H5T_NATIVE_DOUBLE, plan->ndims, plan->hdf_count,
+                           &plan->real_buffer_size);
+
+  if (plan->ndims > 0 && michunk_cache_fit(volume, plan->hdf_count) < 0) {
+    goto failure;
   }
-  if (fspc_id >= 0) {
-    H5Sclose(fspc_id);
+  if (michunk_init_plan(plan) < 0) {
+    goto failure;
   }
-  if ( dset_id >=0 ) {
-    H5Dclose(dset_id);
+
+  if (mode != MI_HYPERSLAB_VOXEL && mihyperplan_prepare_scaling(plan) < 0) {
+    goto failure;
   }
-  if(temp_buffer!=NULL)
-  {
-    free(temp_buffer);
+
+  *plan_ptr = plan;
+  return (MI_NOERROR);
+
+failure:
+  mihyperplan_free(plan);
+  return (MI_ERROR);
+}
+
+/** Prepare a plan for repeated transfers of hyperslabs with the edge
+ * lengths \a count and the buffer type \a buffer_data_type. The
+ * dataspaces, memory type, dimension remapping and scratch buffers are
+ * set up once, each call to miexecute_hyperslab() then only moves the
+ * selection. The plan uses the resolution, apparent dimension order and
+ * voxel order set at the time it is prepared, executing it fails once
+ * they change. It must be released with mifree_hyperslab() before the
+ * volume is closed.
+ */
+int miprepare_hyperslab(mihandle_t volume,
+                        mihyperslab_mode_t mode,
+                        mitype_t buffer_data_type,
+                        const misize_t count[],
+                        mihyperplan_t *plan_ptr)
+{
+  int result;
+
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
   }
-  if(image_slice_min_buffer!=NULL)
-  {
-    free(image_slice_min_buffer);
+
+  mihdf_lock(volume);
+  result = mihyperplan_prepare(volume, mode, buffer_data_type, count, plan_ptr);
+  mihdf_unlock(volume);
+  return (result);
+}
+
+/** Set the real range mapped onto the full range of the buffer type
+ * by a plan prepared with MI_HYPERSLAB_NORMALIZED.
+ */
+int miset_hyperslab_normalization(mihyperplan_t plan,
+                                  double data_min,
+                                  double data_max)
+{
+  if (plan == NULL || plan->mode != MI_HYPERSLAB_NORMALIZED) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Hyperslab plan is not normalized");
   }
-  if(image_slice_max_buffer!=NULL)
-  {
-    free(image_slice_max_buffer);
+  plan->data_min = data_min;
+  plan->data_max = data_max;
+  return (MI_NOERROR);
+}
+
+/** Transfer the hyperslab at \a start, see miexecute_hyperslab().
+ */
+static int mihyperplan_execute(mihyperplan_t plan,
+                               mihyperslab_op_t opcode,
+                               const misize_t start[],
+                               void *buffer)
+{
+  mihandle_t volume;
+  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+  int dir[MI2_MAX_VAR_DIMS];
+  int result;
+
+  if (plan == NULL || buffer == NULL || (start == NULL && plan->ndims > 0)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to execute a hyperslab plan with null variables");
+  }
+  volume = plan->volume;
+
+  if (opcode != MI_HYPERSLAB_READ && opcode != MI_HYPERSLAB_WRITE) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unknown hyperslab operation");
+  }
+  if (plan->resolution != volume->selected_resolution) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Hyperslab plan was prepared for a different resolution");
+  }
+  if (plan->layout_generation != volume->layout_generation) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Hyperslab plan was prepared for a different dimension order");
+  }
+  /* Disallow write operations to anything but the highest resolution.
+   */
+  if (opcode == MI_HYPERSLAB_WRITE && volume->selected_resolution != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to write to a volume thumbnail");
+  }
+
+  /* Frames may have been appended since the plan was prepared */
+  if (plan->ndims > 0 && plan->extent != volume->dim_handles[0]->length) {
+    hid_t fspc_id;
+
+    MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+    H5Sclose(plan->fspc_id);
+    plan->fspc_id = fspc_id;
+    plan->extent = volume->dim_handles[0]->length;
+    plan->dset_dims[0] = plan->extent;
+  }
+
+  if (plan->ndims == 0) {
+    MI_CHECK_HDF_CALL(result = H5Sselect_all(plan->fspc_id),"H5Sselect_all");
+  } else {
+    mitranslate_hyperslab_origin(volume, start, plan->count, plan->hdf_start, hdf_count, dir);
+    MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(plan->fspc_id, H5S_SELECT_SET, plan->hdf_start, NULL,
+                                                   plan->hdf_count, NULL),"H5Sselect_hyperslab");
+  }
+  if (result < 0) {
+    return (MI_ERROR);
+  }
+
+  switch (plan->mode) {
+  case MI_HYPERSLAB_VOXEL:
+    result = mirw_hyperslab_raw(opcode, plan, buffer);
+    break;
+  case MI_HYPERSLAB_REAL:
+    if (mihyperplan_load_range(plan) < 0) {
+      return (MI_ERROR);
+    }
+    result = mirw_hyperslab_icv(opcode, plan, buffer);
+    break;
+  case MI_HYPERSLAB_NORMALIZED:
+    if (mihyperplan_load_range(plan) < 0) {
+      return (MI_ERROR);
+    }
+    result = mirw_hyperslab_normalized(opcode, plan, buffer);
+    break;
+  default:
+    return (MI_ERROR);
+  }
+  if (miio_enabled && result >= 0) {
+    miio_count(plan, opcode == MI_HYPERSLAB_WRITE);
+  }
+
+  /* The reduced resolutions of the slabs written have to be rebuilt */
+  if (opcode == MI_HYPERSLAB_WRITE && result >= 0) {
+    hsize_t slab_voxels = 1;
+    int i;
+
+    for (i = 1; i < plan->ndims; i++) {
+      slab_voxels *= plan->hdf_count[i];
+    }
+    if (plan->ndims == 0) {
+      mipyramid_mark(volume, 0, 1, 1);
+    } else {
+      mipyramid_mark(volume, plan->hdf_start[0], plan->hdf_count[0], slab_voxels);
+    }
+  }
+  return (result);
+}
+
+/** Read (\a opcode MI_HYPERSLAB_READ) or write (MI_HYPERSLAB_WRITE)
+ * the hyperslab at \a start using a prepared plan.
+ */
+int miexecute_hyperslab(mihyperplan_t plan,
+                        mihyperslab_op_t opcode,
+                        const misize_t start[],
+                        void *buffer)
+{
+  int result;
+
+  if (plan == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to execute a null hyperslab plan");
   }
+  mihdf_lock(plan->volume);
+  result = mihyperplan_execute(plan, opcode, start, buffer);
+  mihdf_unlock(plan->volume);
   return (result);
 }
 
+/** Transfer a single hyperslab through a temporary plan, this is what
+ * all the one-shot hyperslab functions use.
+ */
+static int mirw_hyperslab(int opcode,
+                          mihandle_t volume,
+                          mihyperslab_mode_t mode,
+                          mitype_t buffer_data_type,
+                          const misize_t start[],
+                          const misize_t count[],
+                          double data_min,
+                          double data_max,
+                          void *buffer)
+{
+  mihyperplan_t plan;
+  int result;
+
+  /* Disallow write operations to anything but the highest resolution.
+   */
+  if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to write to a volume thumbnail");
+  }
+
+  if (miprepare_hyperslab(volume, mode, buffer_data_type, count, &plan) < 0) {
+    return (MI_ERROR);
+  }
+  if (mode == MI_HYPERSLAB_NORMALIZED) {
+    miset_hyperslab_normalization(plan, data_min, data_max);
+  }
+  result = miexecute_hyperslab(plan, opcode, start, buffer);
+  mifree_hyperslab(plan);
+  return (result);
+}
+
+
 
 /** Reads the real values in the volume from the interval min through
  *  max, mapped to the maximum representable range for the requested
@@ -1224,8 +1378,8 @@ int miget_hyperslab_normalized(mihandle_t volume,
                                void *buffer)
 {
 
-    return mirw_hyperslab_normalized(MIRW_OP_READ, volume, buffer_data_type, 
-                                     start, count, data_min, data_max, buffer);
+    return mirw_hyperslab(MIRW_OP_READ, volume, MI_HYPERSLAB_NORMALIZED, buffer_data_type,
+                          start, count, data_min, data_max, buffer);
 }
 
 /** Writes the real values in the volume from the interval min through
@@ -1240,8 +1394,8 @@ int miset_hyperslab_normalized(mihandle_t volume,
                                double data_max,
                                void *buffer)
 {
-    return mirw_hyperslab_normalized(MIRW_OP_WRITE, volume, buffer_data_type, 
-                                     start, count, data_min, data_max, buffer);
+    return mirw_hyperslab(MIRW_OP_WRITE, volume, MI_HYPERSLAB_NORMALIZED, buffer_data_type,
+                          start, count, data_min, data_max, buffer);
 }
 
 
@@ -1254,7 +1408,8 @@ int miget_hyperslab_with_icv(mihandle_t volume,           /**< A MINC 2.0 volume
                              const misize_t count[], /**< Lengths of edges  */
                              void *buffer)                /**< Output memory buffer */
 {
-  return mirw_hyperslab_icv(MIRW_OP_READ, volume, buffer_data_type, start, count,buffer);
+  return mirw_hyperslab(MIRW_OP_READ, volume, MI_HYPERSLAB_REAL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /** Write a hyperslab to the file, converting real values into voxel values
@@ -1265,7 +1420,8 @@ int miset_hyperslab_with_icv(mihandle_t volume,        /**< A MINC 2.0 volume ha
                          const misize_t count[],       /**< Lengths of edges  */
                          void *buffer)                 /**< Output memory buffer */
 {
-  return  mirw_hyperslab_icv(MIRW_OP_WRITE,volume,buffer_data_type,start,count,buffer);
+  return mirw_hyperslab(MIRW_OP_WRITE, volume, MI_HYPERSLAB_REAL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /** Read a hyperslab from the file into the preallocated buffer,
@@ -1279,12 +1435,8 @@ int miget_real_value_hyperslab(mihandle_t volume,       /**< A MINC 2.0 volume h
                            void *buffer)                /**< Output memory buffer */ 
 {
 
-  return mirw_hyperslab_icv(MIRW_OP_READ,
-                              volume,
-                              buffer_data_type,
-                              start,
-                              count,
-                              (void *) buffer);
+  return mirw_hyperslab(MIRW_OP_READ, volume, MI_HYPERSLAB_REAL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /** Write a hyperslab to the file from the preallocated buffer,
@@ -1297,12 +1449,8 @@ int miset_real_value_hyperslab(mihandle_t volume,
                            const misize_t count[],
                            void *buffer)
 {
-  return mirw_hyperslab_icv(MIRW_OP_WRITE,
-                                volume,
-                                buffer_data_type,
-                                start,
-                                count,
-                                (void *) buffer);
+  return mirw_hyperslab(MIRW_OP_WRITE, volume, MI_HYPERSLAB_REAL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /** Read a hyperslab from the file into the preallocated buffer,
@@ -1315,8 +1463,8 @@ int miget_voxel_value_hyperslab(mihandle_t volume,
                             const misize_t count[],
                             void *buffer)
 {
-  return mirw_hyperslab_raw(MIRW_OP_READ, volume, buffer_data_type,
-                            start, count, buffer);
+  return mirw_hyperslab(MIRW_OP_READ, volume, MI_HYPERSLAB_VOXEL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /** Write a hyperslab to the file from the preallocated buffer,
@@ -1329,8 +1477,8 @@ int miset_voxel_value_hyperslab(mihandle_t volume,
                             const misize_t count[],
                             void *buffer)
 {
-  return mirw_hyperslab_raw(MIRW_OP_WRITE, volume, buffer_data_type,
-                            start, count, (void *) buffer);
+  return mirw_hyperslab(MIRW_OP_WRITE, volume, MI_HYPERSLAB_VOXEL, buffer_data_type,
+                        start, count, 0.0, 1.0, buffer);
 }
 
 /* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
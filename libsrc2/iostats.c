@@ -0,0 +1,333 @@
+/** \file iostats.c
+ * \brief MINC 2.0 I/O statistics
+ *
+ * Counters of the hyperslabs transferred and of the time spent in the
+ * main stages of a transfer, kept for each volume and for the whole
+ * process. They are only collected once enabled, either with
+ * miset_io_statistics() or with the MINC_IO_STATS configuration
+ * variable; until then each hyperslab costs a test of a flag.
+ *
+ * MINC_IO_STATS names the file the statistics are written to as JSON
+ * when the process exits, "-" for the standard error.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+
+#include "minc_config.h"
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Statistics of a closed volume, kept to be written at exit.
+ */
+struct miio_record {
+  char *file_name;
+  miiostatistics_t stats;
+  struct miio_record *next;
+};
+
+int miio_enabled = FALSE;
+
+static miiostatistics_t miio_total;
+static struct miio_record *miio_records = NULL;
+static struct miio_record **miio_records_end = &miio_records;
+static char *miio_dump_path = NULL;
+static int miio_initialized = FALSE;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t miio_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define MIIO_LOCK() pthread_mutex_lock(&miio_mutex)
+#define MIIO_UNLOCK() pthread_mutex_unlock(&miio_mutex)
+#else
+#define MIIO_LOCK()
+#define MIIO_UNLOCK()
+#endif /*HAVE_PTHREAD*/
+
+/** Seconds since an arbitrary origin, never 0.
+ */
+double miio_clock(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1.0 + (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+#elif defined(HAVE_GETTIMEOFDAY)
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return 1.0 + (double) tv.tv_sec + 1e-6 * (double) tv.tv_usec;
+#else
+  return 1.0 + (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/** The per-volume statistics of \a volume, allocated the first time.
+ * Called with the lock held.
+ */
+static miiostatistics_t *miio_volume(mihandle_t volume)
+{
+  if (volume->io_stats == NULL) {
+    volume->io_stats = (miiostatistics_t *) calloc(1, sizeof(miiostatistics_t));
+  }
+  return volume->io_stats;
+}
+
+/** Add the time since \a start, a value of miio_clock(), to the
+ * counter \a timer of \a volume and of the process.
+ */
+void miio_add_time(mihandle_t volume, miio_timer_t timer, double start)
+{
+  double elapsed;
+  miiostatistics_t *stats[2];
+  int i;
+
+  if (start == 0.0) {
+    return;                     /* Enabled after the timer started */
+  }
+  elapsed = miio_clock() - start;
+  MIIO_LOCK();
+  stats[0] = &miio_total;
+  stats[1] = (volume != NULL) ? miio_volume(volume) : NULL;
+  for (i = 0; i < 2; i++) {
+    if (stats[i] == NULL) {
+      continue;
+    }
+    switch (timer) {
+    case MIIO_READ:
+      stats[i]->read_seconds += elapsed;
+      break;
+    case MIIO_WRITE:
+      stats[i]->write_seconds += elapsed;
+      break;
+    case MIIO_CHUNK_READ:
+      stats[i]->chunk_read_seconds += elapsed;
+      break;
+    case MIIO_CHUNK_WRITE:
+      stats[i]->chunk_write_seconds += elapsed;
+      break;
+    case MIIO_SCALING:
+      stats[i]->scaling_seconds += elapsed;
+      break;
+    case MIIO_RESTRUCTURE:
+      stats[i]->restructure_seconds += elapsed;
+      break;
+    case MIIO_THUMBNAIL:
+      stats[i]->thumbnail_seconds += elapsed;
+      break;
+    }
+  }
+  MIIO_UNLOCK();
+}
+
+/** Count the hyperslab of \a plan at its current origin as read, or
+ * written if \a write is TRUE.
+ */
+void miio_count(mihyperplan_t plan, int write)
+{
+  miiostatistics_t *stats[2];
+  misize_t n_chunks = 1;
+  int i;
+
+  /* Chunks overlapped by the selection, a contiguous image is one */
+  for (i = 0; i < plan->ndims; i++) {
+    if (plan->chunk_dims[i] > 0 && plan->hdf_count[i] > 0) {
+      n_chunks *= (plan->hdf_start[i] + plan->hdf_count[i] - 1) / plan->chunk_dims[i] -
+                  plan->hdf_start[i] / plan->chunk_dims[i] + 1;
+    }
+  }
+
+  MIIO_LOCK();
+  stats[0] = &miio_total;
+  stats[1] = miio_volume(plan->volume);
+  for (i = 0; i < 2; i++) {
+    if (stats[i] == NULL) {
+      continue;
+    }
+    if (write) {
+      stats[i]->hyperslab_writes++;
+      stats[i]->bytes_written += plan->buffer_size;
+      stats[i]->chunks_written += n_chunks;
+    } else {
+      stats[i]->hyperslab_reads++;
+      stats[i]->bytes_read += plan->buffer_size;
+      stats[i]->chunks_read += n_chunks;
+    }
+  }
+  MIIO_UNLOCK();
+}
+
+/** Write \a s to \a fp as the members of a JSON object.
+ */
+static void miio_write_json(FILE *fp, const miiostatistics_t *s)
+{
+  fprintf(fp, "\"hyperslab_reads\": %llu, \"hyperslab_writes\": %llu, "
+          "\"bytes_read\": %llu, \"bytes_written\": %llu, "
+          "\"chunks_read\": %llu, \"chunks_written\": %llu, "
+          "\"read_seconds\": %.6f, \"write_seconds\": %.6f, "
+          "\"chunk_read_seconds\": %.6f, \"chunk_write_seconds\": %.6f, "
+          "\"scaling_seconds\": %.6f, \"restructure_seconds\": %.6f, "
+          "\"thumbnail_seconds\": %.6f",
+          (unsigned long long) s->hyperslab_reads,
+          (unsigned long long) s->hyperslab_writes,
+          (unsigned long long) s->bytes_read,
+          (unsigned long long) s->bytes_written,
+          (unsigned long long) s->chunks_read,
+          (unsigned long long) s->chunks_written,
+          s->read_seconds, s->write_seconds,
+          s->chunk_read_seconds, s->chunk_write_seconds,
+          s->scaling_seconds, s->restructure_seconds,
+          s->thumbnail_seconds);
+}
+
+/** Write \a str to \a fp as a JSON string.
+ */
+static void miio_write_string(FILE *fp, const char *str)
+{
+  fputc('"', fp);
+  for (; *str != '\0'; str++) {
+    unsigned char c = (unsigned char) *str;
+
+    if (c == '"' || c == '\\') {
+      fprintf(fp, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(fp, "\\u%04x", c);
+    } else {
+      fputc(c, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+/** Write the statistics of the process and of the volumes closed so far
+ * to the file named by MINC_IO_STATS, at exit.
+ */
+static void miio_dump(void)
+{
+  struct miio_record *record;
+  FILE *fp;
+
+  if (miio_dump_path == NULL) {
+    return;
+  }
+  if (strcmp(miio_dump_path, "-") == 0) {
+    fp = stderr;
+  } else if ((fp = fopen(miio_dump_path, "w")) == NULL) {
+    return;
+  }
+  MIIO_LOCK();
+  fprintf(fp, "{\n  \"total\": {");
+  miio_write_json(fp, &miio_total);
+  fprintf(fp, "},\n  \"volumes\": [");
+  for (record = miio_records; record != NULL; record = record->next) {
+    fprintf(fp, "%s\n    {\"file\": ", record == miio_records ? "" : ",");
+    miio_write_string(fp, record->file_name);
+    fprintf(fp, ", ");
+    miio_write_json(fp, &record->stats);
+    fprintf(fp, "}");
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  MIIO_UNLOCK();
+  if (fp != stderr) {
+    fclose(fp);
+  }
+}
+
+/** Enable the statistics, and their dump at exit, if MINC_IO_STATS is
+ * set. Called by miinit().
+ */
+void miio_init(void)
+{
+  const char *path;
+
+  MIIO_LOCK();
+  if (!miio_initialized) {
+    miio_initialized = TRUE;
+    if (miget_cfg_present(MICFG_IO_STATS) &&
+        *(path = miget_cfg_str(MICFG_IO_STATS)) != '\0' &&
+        (miio_dump_path = strdup(path)) != NULL) {
+      miio_enabled = TRUE;
+      atexit(miio_dump);
+    }
+  }
+  MIIO_UNLOCK();
+}
+
+/** Release the statistics of \a volume, keeping them for the dump at
+ * exit if there is one.
+ */
+void miio_close(mihandle_t volume)
+{
+  struct miio_record *record;
+  ssize_t length;
+
+  if (volume->io_stats == NULL) {
+    return;
+  }
+  if (miio_dump_path != NULL &&
+      (record = (struct miio_record *) calloc(1, sizeof(*record))) != NULL) {
+    record->stats = *volume->io_stats;
+    length = H5Fget_name(volume->hdf_id, NULL, 0);
+    if (length >= 0 && (record->file_name = (char *) malloc(length + 1)) != NULL) {
+      H5Fget_name(volume->hdf_id, record->file_name, length + 1);
+    } else {
+      record->file_name = strdup("");
+    }
+    MIIO_LOCK();
+    *miio_records_end = record;
+    miio_records_end = &record->next;
+    MIIO_UNLOCK();
+  }
+  free(volume->io_stats);
+  volume->io_stats = NULL;
+}
+
+/** Enable or disable the collection of I/O statistics.
+ * \ingroup mi2Vol
+ */
+int miset_io_statistics(miboolean_t enable)
+{
+  miio_init();
+  miio_enabled = enable ? TRUE : FALSE;
+  return (MI_NOERROR);
+}
+
+/** Get the I/O statistics of \a volume, or of the whole process if
+ * \a volume is NULL.
+ * \ingroup mi2Vol
+ */
+int miget_io_statistics(mihandle_t volume, miiostatistics_t *stats)
+{
+  if (stats == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get I/O statistics into a null pointer");
+  }
+  MIIO_LOCK();
+  if (volume == NULL) {
+    *stats = miio_total;
+  } else if (volume->io_stats != NULL) {
+    *stats = *volume->io_stats;
+  } else {
+    memset(stats, 0, sizeof(*stats));
+  }
+  MIIO_UNLOCK();
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -54,6 +54,10 @@ int  midefine_label(mihandle_t volume, int value, const char *name)
         return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to use null volume or variable");
     }
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     if (strlen(name) > MI_LABEL_MAX) {
         return MI_LOG_ERROR(MI2_MSG_GENERIC,"Label name is too long");
     }
@@ -102,6 +106,10 @@ int miget_label_name(mihandle_t volume, int value, char **name)
        return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to use null volume or variable");
     }
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     if (volume->volume_class != MI_CLASS_LABEL) {
          MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume class is not label");
     }
@@ -133,6 +141,10 @@ int miget_label_value(mihandle_t volume, const char *name, int *value_ptr)
         return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to use null volume or variable");
     }
 
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     if (volume->volume_class != MI_CLASS_LABEL) {
         return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume class is not label");
     }
@@ -159,6 +171,9 @@ int miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels)
   if (volume == NULL) {
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to use null volume");
   }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
   if (volume->volume_class != MI_CLASS_LABEL) {
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume class is not label");
   }
@@ -187,6 +202,9 @@ int miget_label_value_by_index(mihandle_t volume, int idx, int *value)
   if (volume == NULL) {
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to use null volume");
   }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
   if (volume->volume_class != MI_CLASS_LABEL) {
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume class is not label");
   }
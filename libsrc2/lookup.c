@@ -0,0 +1,310 @@
+/** \file lookup.c
+ * \brief MINC 2.0 batched voxel lookup
+ *
+ * Reads the values at a list of voxel positions with one read per
+ * image chunk touched, instead of one hyperslab read per voxel. The
+ * positions are sorted by chunk, the voxels falling in each chunk are
+ * read at once, either as their bounding box or as a point selection
+ * when they are scattered, and the values are put back in the order
+ * the positions were given.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <hdf5.h>
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Voxels of a chunk read as a point selection once their bounding box
+ * holds this many times more voxels.
+ */
+#define MI2_LOOKUP_BOX_RATIO 8
+
+/** \internal
+ * One voxel position.
+ */
+struct milookup_point {
+  hsize_t chunk;                /* Chunk holding the voxel */
+  hsize_t offset;               /* Voxel index in the image */
+  size_t index;                 /* Position in the caller's arrays */
+};
+
+static int milookup_compare(const void *a, const void *b)
+{
+  const struct milookup_point *p = (const struct milookup_point *) a;
+  const struct milookup_point *q = (const struct milookup_point *) b;
+
+  if (p->chunk != q->chunk) {
+    return (p->chunk < q->chunk) ? -1 : 1;
+  }
+  if (p->offset != q->offset) {
+    return (p->offset < q->offset) ? -1 : 1;
+  }
+  return 0;
+}
+
+/** \internal
+ * Voxel to real conversion of the current resolution of a volume.
+ */
+struct milookup_scaling {
+  int identity;                 /* Floating point voxels are real values */
+  int slice_scaling;            /* Ranges come from image-max/image-min */
+  double volume_max;
+  double volume_min;
+  double valid_min;
+  double voxel_range;
+  hsize_t ones[MI2_MAX_VAR_DIMS]; /* Extent of a single slice range */
+};
+
+static int milookup_scaling_init(mihandle_t volume, struct milookup_scaling *scaling)
+{
+  double valid_max;
+  int i;
+
+  for (i = 0; i < MI2_MAX_VAR_DIMS; i++) {
+    scaling->ones[i] = 1;
+  }
+  scaling->volume_max = volume->scale_max;
+  scaling->volume_min = volume->scale_min;
+  scaling->identity = (volume->volume_type == MI_TYPE_FLOAT ||
+                       volume->volume_type == MI_TYPE_DOUBLE ||
+                       volume->volume_type == MI_TYPE_FCOMPLEX ||
+                       volume->volume_type == MI_TYPE_DCOMPLEX);
+  miget_volume_valid_range(volume, &valid_max, &scaling->valid_min);
+  scaling->voxel_range = valid_max - scaling->valid_min;
+  scaling->slice_scaling = (!scaling->identity && volume->has_slice_scaling);
+
+  if (scaling->slice_scaling && mislice_range_load(volume) < 0) {
+    return (MI_ERROR);
+  }
+  return (MI_NOERROR);
+}
+
+/** The real value of \a voxel at file position \a pos.
+ */
+static double milookup_real(mihandle_t volume, const struct milookup_scaling *scaling,
+                            const hsize_t pos[], double voxel)
+{
+  double slice_max = scaling->volume_max;
+  double slice_min = scaling->volume_min;
+
+  if (scaling->identity) {
+    return voxel;
+  }
+  if (scaling->slice_scaling) {
+    mislice_range_read(volume, pos, scaling->ones, &slice_max, &slice_min);
+  }
+  if (scaling->voxel_range == 0.0) {
+    return slice_min;
+  }
+  return (voxel - scaling->valid_min) / scaling->voxel_range *
+         (slice_max - slice_min) + slice_min;
+}
+
+/** Read the \a n voxels of a chunk whose file positions are \a pos
+ * (ndims each) into \a voxels, in the same order.
+ */
+static int milookup_read_chunk(hid_t dset_id, hid_t fspc_id, int ndims,
+                               size_t n, const hsize_t *pos, double *voxels,
+                               double *box)
+{
+  hsize_t lo[MI2_MAX_VAR_DIMS];
+  hsize_t hi[MI2_MAX_VAR_DIMS];
+  hsize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t box_voxels = 1;
+  hsize_t n_points = n;
+  hid_t mspc_id;
+  size_t p;
+  int result;
+  int i;
+
+  for (i = 0; i < ndims; i++) {
+    lo[i] = hi[i] = pos[i];
+  }
+  for (p = 1; p < n; p++) {
+    for (i = 0; i < ndims; i++) {
+      if (pos[p * ndims + i] < lo[i]) {
+        lo[i] = pos[p * ndims + i];
+      }
+      if (pos[p * ndims + i] > hi[i]) {
+        hi[i] = pos[p * ndims + i];
+      }
+    }
+  }
+  for (i = 0; i < ndims; i++) {
+    count[i] = hi[i] - lo[i] + 1;
+    box_voxels *= count[i];
+  }
+
+  if (box_voxels > MI2_LOOKUP_BOX_RATIO * n_points) {
+    MI_CHECK_HDF_CALL_RET(mspc_id = H5Screate_simple(1, &n_points, NULL),"H5Screate_simple");
+    MI_CHECK_HDF_CALL(result = H5Sselect_elements(fspc_id, H5S_SELECT_SET, n, pos),"H5Sselect_elements");
+    if (result >= 0) {
+      MI_CHECK_HDF_CALL(result = H5Dread(dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id,
+                                         H5P_DEFAULT, voxels),"H5Dread");
+    }
+    H5Sclose(mspc_id);
+    return (result < 0 ? MI_ERROR : MI_NOERROR);
+  }
+
+  MI_CHECK_HDF_CALL_RET(mspc_id = H5Screate_simple(ndims, count, NULL),"H5Screate_simple");
+  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, lo, NULL,
+                                                 count, NULL),"H5Sselect_hyperslab");
+  if (result >= 0) {
+    MI_CHECK_HDF_CALL(result = H5Dread(dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id,
+                                       H5P_DEFAULT, box),"H5Dread");
+  }
+  H5Sclose(mspc_id);
+  if (result < 0) {
+    return (MI_ERROR);
+  }
+  for (p = 0; p < n; p++) {
+    hsize_t k = 0;
+
+    for (i = 0; i < ndims; i++) {
+      k = k * count[i] + (pos[p * ndims + i] - lo[i]);
+    }
+    voxels[p] = box[k];
+  }
+  return (MI_NOERROR);
+}
+
+static int milookup_values(mihandle_t volume, misize_t n, const misize_t coords[],
+                           double values[])
+{
+  int ndims = volume->number_of_dims;
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hsize_t chunk[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+  misize_t ones[MI2_MAX_VAR_DIMS];
+  int dir[MI2_MAX_VAR_DIMS];
+  struct milookup_scaling scaling;
+  struct milookup_point *points = NULL;
+  hsize_t *file_pos = NULL;
+  hsize_t *pos = NULL;
+  double *voxels = NULL;
+  double *box = NULL;
+  hsize_t chunk_voxels = 1;
+  hid_t fspc_id;
+  hid_t dcpl_id;
+  misize_t p, q, e;
+  int result = MI_ERROR;
+  int i;
+
+  if (volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume image has not been created");
+  }
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  if (H5Sget_simple_extent_dims(fspc_id, dims, NULL) != ndims || ndims == 0) {
+    H5Sclose(fspc_id);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unexpected image dimensions");
+  }
+
+  /* Contiguous images are read a slice at a time */
+  MI_CHECK_HDF_CALL(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+  if (dcpl_id < 0 || H5Pget_layout(dcpl_id) != H5D_CHUNKED ||
+      H5Pget_chunk(dcpl_id, ndims, chunk) != ndims) {
+    for (i = 0; i < ndims; i++) {
+      chunk[i] = (i >= ndims - 2) ? dims[i] : 1;
+    }
+  }
+  if (dcpl_id >= 0) {
+    H5Pclose(dcpl_id);
+  }
+  for (i = 0; i < ndims; i++) {
+    chunk_voxels *= chunk[i];
+    ones[i] = 1;
+  }
+
+  if (milookup_scaling_init(volume, &scaling) < 0) {
+    goto cleanup;
+  }
+
+  points = (struct milookup_point *) malloc(n * sizeof(struct milookup_point));
+  file_pos = (hsize_t *) malloc(n * ndims * sizeof(hsize_t));
+  pos = (hsize_t *) malloc(n * ndims * sizeof(hsize_t));
+  voxels = (double *) malloc(n * sizeof(double));
+  box = (double *) malloc(chunk_voxels * sizeof(double));
+  if (points == NULL || file_pos == NULL || pos == NULL || voxels == NULL || box == NULL) {
+    MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n * sizeof(struct milookup_point)));
+    goto cleanup;
+  }
+
+  for (p = 0; p < n; p++) {
+    hsize_t c = 0;
+    hsize_t o = 0;
+
+    mitranslate_hyperslab_origin(volume, coords + p * ndims, ones, hdf_start, hdf_count, dir);
+    for (i = 0; i < ndims; i++) {
+      if (hdf_start[i] >= dims[i]) {
+        MI_LOG_ERROR(MI2_MSG_GENERIC,"Voxel position out of range");
+        goto cleanup;
+      }
+      c = c * ((dims[i] + chunk[i] - 1) / chunk[i]) + hdf_start[i] / chunk[i];
+      o = o * dims[i] + hdf_start[i];
+      file_pos[p * ndims + i] = hdf_start[i];
+    }
+    points[p].chunk = c;
+    points[p].offset = o;
+    points[p].index = p;
+  }
+  qsort(points, n, sizeof(struct milookup_point), milookup_compare);
+
+  for (p = 0; p < n; p = q) {
+    for (q = p; q < n && points[q].chunk == points[p].chunk; q++) {
+      for (i = 0; i < ndims; i++) {
+        pos[(q - p) * ndims + i] = file_pos[points[q].index * ndims + i];
+      }
+    }
+    if (milookup_read_chunk(volume->image_id, fspc_id, ndims, q - p, pos,
+                            voxels + p, box) < 0) {
+      goto cleanup;
+    }
+    for (e = p; e < q; e++) {
+      size_t index = points[e].index;
+      values[index] = milookup_real(volume, &scaling, file_pos + index * ndims, voxels[e]);
+    }
+  }
+  result = MI_NOERROR;
+
+cleanup:
+  free(points);
+  free(file_pos);
+  free(pos);
+  free(voxels);
+  free(box);
+  H5Sclose(fspc_id);
+  return (result);
+}
+
+/** Get the real values of \a n voxels of \a volume. The position of
+ * voxel i is given by coords[i * ndims] to coords[i * ndims + ndims - 1],
+ * in the apparent dimension order, ndims being the number of
+ * dimensions of the volume, and its value is returned in values[i].
+ * Each image chunk holding some of the voxels is read once.
+ */
+int miget_real_values_at(mihandle_t volume, misize_t n, const misize_t coords[],
+                         double values[])
+{
+  int result;
+
+  if (volume == NULL || (n > 0 && (coords == NULL || values == NULL))) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get voxel values with null volume or null variables");
+  }
+  if (n == 0) {
+    return (MI_NOERROR);
+  }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  mihdf_lock(volume);
+  result = milookup_values(volume, n, coords, values);
+  mihdf_unlock(volume);
+  return (result);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -387,33 +388,15 @@ int miset_attribute ( mihandle_t volume, const char *path, const char *name,
   return ( MI_NOERROR );
 }
 
-/** Get a double attribute from a minc file */
-int miget_attribute ( mihandle_t volume, const char *path, const char *name,
-                      mitype_t data_type, size_t length, void *values )
+/** Get an attribute of the group or dataset \a hdf_loc */
+int miget_attr_at_loc ( hid_t hdf_loc, const char *name, mitype_t data_type,
+                        size_t length, void *values )
 {
-  hid_t hdf_file;
-  hid_t hdf_loc;
   hid_t mtyp_id = -1;         /* Parameter type */
   hid_t spc_id = -1;
   hid_t hdf_attr = -1;
   int status = MI_ERROR;      /* Guilty until proven innocent */
 
-  /* Get a handle to the actual HDF file
-  */
-  hdf_file = volume->hdf_id;
-
-  if ( hdf_file < 0 ) {
-    return ( MI_ERROR );
-  }
-
-  /* Find the group or dataset referenced by the path.
-  */
-  hdf_loc = midescend_path ( hdf_file, path );
-
-  if ( hdf_loc < 0 ) {
-    return ( MI_ERROR );
-  }
-
   H5E_BEGIN_TRY {
     hdf_attr = H5Aopen_name ( hdf_loc, name );
   } H5E_END_TRY;
@@ -496,14 +479,41 @@ cleanup:
     H5Sclose ( spc_id );
   }
 
-  if ( hdf_loc >= 0 ) {
-    /* The hdf_loc identifier could be a group or a dataset.
-    */
-    if ( H5Iget_type ( hdf_loc ) == H5I_GROUP ) {
-      H5Gclose ( hdf_loc );
-    } else {
-      H5Dclose ( hdf_loc );
-    }
+  return ( status );
+}
+
+/** Get a double attribute from a minc file */
+int miget_attribute ( mihandle_t volume, const char *path, const char *name,
+                      mitype_t data_type, size_t length, void *values )
+{
+  hid_t hdf_file;
+  hid_t hdf_loc;
+  int status;
+
+  /* Get a handle to the actual HDF file
+  */
+  hdf_file = volume->hdf_id;
+
+  if ( hdf_file < 0 ) {
+    return ( MI_ERROR );
+  }
+
+  /* Find the group or dataset referenced by the path.
+  */
+  hdf_loc = midescend_path ( hdf_file, path );
+
+  if ( hdf_loc < 0 ) {
+    return ( MI_ERROR );
+  }
+
+  status = miget_attr_at_loc ( hdf_loc, name, data_type, length, values );
+
+  /* The hdf_loc identifier could be a group or a dataset.
+  */
+  if ( H5Iget_type ( hdf_loc ) == H5I_GROUP ) {
+    H5Gclose ( hdf_loc );
+  } else {
+    H5Dclose ( hdf_loc );
   }
 
   return ( status );
@@ -660,47 +670,115 @@ void mitransform_coord ( double out_coord[],
 */
 static int rounding_enabled = FALSE;
 
-static void miswap8 ( unsigned char *tmp_ptr )
+/* Elements converted at a time. The conversions run in place, so each
+ * block is first copied to local storage, converted there by simple
+ * loops over native types that the compiler can vectorize, and copied
+ * back.
+ */
+#define MI2_CONV_BLOCK 256
+
+/** Reverse the byte order of \a n elements of \a size bytes.
+ */
+static void miswap_block ( void *block, size_t n, size_t size )
 {
-  unsigned char x;
+  size_t i;
 
-  x = tmp_ptr[0];
-  tmp_ptr[0] = tmp_ptr[7];
-  tmp_ptr[7] = x;
+  switch ( size ) {
+  case 8:
+    {
+      unsigned long long *p = ( unsigned long long * ) block;
 
-  x = tmp_ptr[1];
-  tmp_ptr[1] = tmp_ptr[6];
-  tmp_ptr[6] = x;
+      for ( i = 0; i < n; i++ ) {
+        unsigned long long x = p[i];
+        x = ( ( x >> 8 ) & 0x00ff00ff00ff00ffULL ) | ( ( x & 0x00ff00ff00ff00ffULL ) << 8 );
+        x = ( ( x >> 16 ) & 0x0000ffff0000ffffULL ) | ( ( x & 0x0000ffff0000ffffULL ) << 16 );
+        p[i] = ( x >> 32 ) | ( x << 32 );
+      }
+    }
+    break;
+  case 4:
+    {
+      unsigned int *p = ( unsigned int * ) block;
 
-  x = tmp_ptr[2];
-  tmp_ptr[2] = tmp_ptr[5];
-  tmp_ptr[5] = x;
+      for ( i = 0; i < n; i++ ) {
+        unsigned int x = p[i];
+        p[i] = ( x >> 24 ) | ( ( x >> 8 ) & 0xff00U ) | ( ( x << 8 ) & 0xff0000U ) | ( x << 24 );
+      }
+    }
+    break;
+  case 2:
+    {
+      unsigned short *p = ( unsigned short * ) block;
 
-  x = tmp_ptr[3];
-  tmp_ptr[3] = tmp_ptr[4];
-  tmp_ptr[4] = x;
+      for ( i = 0; i < n; i++ ) {
+        p[i] = ( unsigned short ) ( ( p[i] >> 8 ) | ( p[i] << 8 ) );
+      }
+    }
+    break;
+  default:
+    break;
+  }
 }
 
-static void miswap4 ( unsigned char *tmp_ptr )
+#define MI2_INT_TO_DBL(type) \
+  { \
+    const type *_in = ( const type * ) in; \
+    for ( i = 0; i < n; i++ ) \
+      out[i] = _in[i]; \
+  }
+
+/** Convert \a n integers of \a src_nb bytes at \a src to doubles at
+ * \a dst. The two may overlap.
+ */
+static void mi2_int_to_dbl_block ( const unsigned char *src,
+                                   unsigned char *dst,
+                                   size_t n,
+                                   size_t src_nb,
+                                   H5T_sign_t src_sg,
+                                   int src_swap,
+                                   int dst_swap )
 {
-  unsigned char x;
+  double in[MI2_CONV_BLOCK];
+  double out[MI2_CONV_BLOCK];
+  size_t i;
 
-  x = tmp_ptr[0];
-  tmp_ptr[0] = tmp_ptr[3];
-  tmp_ptr[3] = x;
+  memcpy ( in, src, n * src_nb );
 
-  x = tmp_ptr[1];
-  tmp_ptr[1] = tmp_ptr[2];
-  tmp_ptr[2] = x;
-}
+  if ( src_swap ) {
+    miswap_block ( in, n, src_nb );
+  }
 
-static void miswap2 ( unsigned char *tmp_ptr )
-{
-  unsigned char x;
+  if ( src_sg == H5T_SGN_2 ) {
+    switch ( src_nb ) {
+    case 4:
+      MI2_INT_TO_DBL ( int );
+      break;
+    case 2:
+      MI2_INT_TO_DBL ( short );
+      break;
+    default:
+      MI2_INT_TO_DBL ( signed char );
+      break;
+    }
+  } else {
+    switch ( src_nb ) {
+    case 4:
+      MI2_INT_TO_DBL ( unsigned int );
+      break;
+    case 2:
+      MI2_INT_TO_DBL ( unsigned short );
+      break;
+    default:
+      MI2_INT_TO_DBL ( unsigned char );
+      break;
+    }
+  }
+
+  if ( dst_swap ) {
+    miswap_block ( out, n, sizeof ( double ) );
+  }
 
-  x = tmp_ptr[0];
-  tmp_ptr[0] = tmp_ptr[1];
-  tmp_ptr[1] = x;
+  memcpy ( dst, out, n * sizeof ( double ) );
 }
 
 /** Generic HDF5 integer-to-double converter.
@@ -716,14 +794,10 @@ static herr_t mi2_int_to_dbl ( hid_t src_id,
                                void *bkg_ptr,
                                hid_t dset_xfer_plist )
 {
-  unsigned char *dst_ptr;
-  unsigned char *src_ptr;
+  unsigned char *buf = ( unsigned char * ) buf_ptr;
   size_t src_nb;
   size_t dst_nb;
   H5T_sign_t src_sg;
-  double t;
-  size_t dst_cnt;
-  size_t src_cnt;
   int src_swap;
   int dst_swap;
 
@@ -748,149 +822,24 @@ static herr_t mi2_int_to_dbl ( hid_t src_id,
     src_nb = H5Tget_size ( src_id );
     src_sg = H5Tget_sign ( src_id );
     dst_nb = H5Tget_size ( dst_id );
+    src_swap = src_nb > 1 && H5Tget_order ( H5T_NATIVE_INT ) != H5Tget_order ( src_id );
+    dst_swap = H5Tget_order ( H5T_NATIVE_DOUBLE ) != H5Tget_order ( dst_id );
 
+    /* Convert starting from the "far side" of the buffer, the doubles
+     * are wider than the integers they replace.
+     */
     if ( buf_stride == 0 ) {
-      dst_cnt = dst_nb;
-      src_cnt = src_nb;
-    } else {
-      dst_cnt = buf_stride;
-      src_cnt = buf_stride;
-    }
-
-    /* Convert starting from "far side" of buffer... (Hope this works!)
-    */
-    dst_ptr = ( ( unsigned char * ) buf_ptr ) + ( ( nelements - 1 ) * dst_nb );
-    src_ptr = ( ( unsigned char * ) buf_ptr ) + ( ( nelements - 1 ) * src_nb );
-
-    if ( H5Tget_order ( H5T_NATIVE_INT ) != H5Tget_order ( src_id ) ) {
-      src_swap = 1;
-    } else {
-      src_swap = 0;
-    }
-
-    if ( H5Tget_order ( H5T_NATIVE_DOUBLE ) != H5Tget_order ( dst_id ) ) {
-      dst_swap = 1;
-    } else {
-      dst_swap = 0;
-    }
-
-    if ( src_sg == H5T_SGN_2 ) {
-      switch ( src_nb ) {
-      case 4:
-
-        while ( nelements-- > 0 ) {
-          if ( src_swap ) {
-            miswap4 ( src_ptr );
-          }
-
-          t = * ( int * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
+      while ( nelements > 0 ) {
+        size_t n = nelements < MI2_CONV_BLOCK ? nelements : MI2_CONV_BLOCK;
 
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      case 2:
-
-        while ( nelements-- > 0 ) {
-          if ( src_swap ) {
-            miswap2 ( src_ptr );
-          }
-
-          t = * ( short * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
-
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      case 1:
-
-        while ( nelements-- > 0 ) {
-          t = * ( char * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
-
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      default:
-        /* Should not happen! */
-        break;
+        nelements -= n;
+        mi2_int_to_dbl_block ( buf + nelements * src_nb, buf + nelements * dst_nb,
+                               n, src_nb, src_sg, src_swap, dst_swap );
       }
     } else {
-      switch ( src_nb ) {
-      case 4:
-
-        while ( nelements-- > 0 ) {
-          if ( src_swap ) {
-            miswap4 ( src_ptr );
-          }
-
-          t = * ( unsigned int * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
-
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      case 2:
-
-        while ( nelements-- > 0 ) {
-          if ( src_swap ) {
-            miswap2 ( src_ptr );
-          }
-
-          t = * ( unsigned short * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
-
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      case 1:
-
-        while ( nelements-- > 0 ) {
-          t = * ( unsigned char * ) src_ptr;
-          * ( double * ) dst_ptr = t;
-
-          if ( dst_swap ) {
-            miswap8 ( dst_ptr );
-          }
-
-          src_ptr -= src_cnt;
-          dst_ptr -= dst_cnt;
-        }
-
-        break;
-      default:
-        /* Should not happen! */
-        break;
+      while ( nelements-- > 0 ) {
+        mi2_int_to_dbl_block ( buf + nelements * buf_stride, buf + nelements * buf_stride,
+                               1, src_nb, src_sg, src_swap, dst_swap );
       }
     }
 
@@ -907,7 +856,78 @@ static herr_t mi2_int_to_dbl ( hid_t src_id,
   return ( 0 );
 }
 
-/** Generic HDF5 double-to-integer converter.
+/* Values below lo, and NaN, become lo; values above hi become hi. */
+#define MI2_DBL_TO_INT(type, lo, hi) \
+  { \
+    type *_out = ( type * ) out; \
+    for ( i = 0; i < n; i++ ) \
+      _out[i] = ( type ) ( ( in[i] > ( hi ) ) ? ( hi ) : ( in[i] >= ( lo ) ) ? in[i] : ( lo ) ); \
+  }
+
+/** Convert \a n doubles at \a src to integers of \a dst_nb bytes at
+ * \a dst, clamping them to the range of the integer type. The two may
+ * overlap.
+ */
+static void mi2_dbl_to_int_block ( const unsigned char *src,
+                                   unsigned char *dst,
+                                   size_t n,
+                                   size_t dst_nb,
+                                   H5T_sign_t dst_sg,
+                                   int src_swap,
+                                   int dst_swap )
+{
+  double in[MI2_CONV_BLOCK];
+  double out[MI2_CONV_BLOCK];
+  size_t i;
+
+  memcpy ( in, src, n * sizeof ( double ) );
+
+  if ( src_swap ) {
+    miswap_block ( in, n, sizeof ( double ) );
+  }
+
+  if ( rounding_enabled ) {
+    for ( i = 0; i < n; i++ ) {
+      in[i] = rint ( in[i] );
+    }
+  }
+
+  if ( dst_sg == H5T_SGN_2 ) {
+    switch ( dst_nb ) {
+    case 4:
+      MI2_DBL_TO_INT ( int, INT_MIN, INT_MAX );
+      break;
+    case 2:
+      MI2_DBL_TO_INT ( short, SHRT_MIN, SHRT_MAX );
+      break;
+    default:
+      MI2_DBL_TO_INT ( signed char, SCHAR_MIN, SCHAR_MAX );
+      break;
+    }
+  } else {
+    switch ( dst_nb ) {
+    case 4:
+      MI2_DBL_TO_INT ( unsigned int, 0, UINT_MAX );
+      break;
+    case 2:
+      MI2_DBL_TO_INT ( unsigned short, 0, USHRT_MAX );
+      break;
+    default:
+      MI2_DBL_TO_INT ( unsigned char, 0, UCHAR_MAX );
+      break;
+    }
+  }
+
+  if ( dst_swap ) {
+    miswap_block ( out, n, dst_nb );
+  }
+
+  memcpy ( dst, out, n * dst_nb );
+}
+
+/** Generic HDF5 double-to-integer converter. Values are truncated
+ * (or rounded, if enabled) and clamped to the range of the integer
+ * type, NaN becomes the lowest value of the type.
 */
 static herr_t mi2_dbl_to_int ( hid_t src_id,
                                hid_t dst_id,
@@ -919,16 +939,13 @@ static herr_t mi2_dbl_to_int ( hid_t src_id,
                                void *bkg_ptr,
                                hid_t dset_xfer_plist )
 {
-  unsigned char *dst_ptr;
-  unsigned char *src_ptr;
+  unsigned char *buf = ( unsigned char * ) buf_ptr;
   size_t src_nb;
   size_t dst_nb;
   H5T_sign_t dst_sg;
-  double t;
-  size_t dst_cnt;
-  size_t src_cnt;
   int src_swap;
   int dst_swap;
+  size_t i;
 
   switch ( cdata->command ) {
   case H5T_CONV_INIT:
@@ -953,20 +970,8 @@ static herr_t mi2_dbl_to_int ( hid_t src_id,
     dst_nb = H5Tget_size ( dst_id );
     dst_sg = H5Tget_sign ( dst_id );
     src_nb = H5Tget_size ( src_id );
-    dst_ptr = ( unsigned char * ) buf_ptr;
-    src_ptr = ( unsigned char * ) buf_ptr;
-
-    if ( H5Tget_order ( H5T_NATIVE_DOUBLE ) != H5Tget_order ( src_id ) ) {
-      src_swap = 1;
-    } else {
-      src_swap = 0;
-    }
-
-    if ( H5Tget_order ( H5T_NATIVE_INT ) != H5Tget_order ( dst_id ) ) {
-      dst_swap = 1;
-    } else {
-      dst_swap = 0;
-    }
+    src_swap = H5Tget_order ( H5T_NATIVE_DOUBLE ) != H5Tget_order ( src_id );
+    dst_swap = dst_nb > 1 && H5Tget_order ( H5T_NATIVE_INT ) != H5Tget_order ( dst_id );
 
     /* The logic of HDF5 seems to be that if a stride is specified,
     * both the source and destination pointers should advance by that
@@ -974,346 +979,16 @@ static herr_t mi2_dbl_to_int ( hid_t src_id,
     * and that's what their own type converters do.
     */
     if ( buf_stride == 0 ) {
-      dst_cnt = dst_nb;
-      src_cnt = src_nb;
-    } else {
-      dst_cnt = buf_stride;
-      src_cnt = buf_stride;
-    }
-
-    if ( rounding_enabled ) {
-      if ( dst_sg == H5T_SGN_2 ) {
-        switch ( dst_nb ) {
-        case 4:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > INT_MAX ) {
-              t = INT_MAX;
-            } else
-              if ( t < INT_MIN ) {
-                t = INT_MIN;
-              }
-
-            * ( ( int * ) dst_ptr ) = ( int ) t;
-
-            if ( dst_swap ) {
-              miswap4 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 2:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > SHRT_MAX ) {
-              t = SHRT_MAX;
-            } else
-              if ( t < SHRT_MIN ) {
-                t = SHRT_MIN;
-              }
-
-            * ( ( short * ) dst_ptr ) = ( short ) t;
-
-            if ( dst_swap ) {
-              miswap2 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 1:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > CHAR_MAX ) {
-              t = CHAR_MAX;
-            } else
-              if ( t < CHAR_MIN ) {
-                t = CHAR_MIN;
-              }
-
-            * ( ( char * ) src_ptr ) = ( char ) t;
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        default:
-          /* Can't handle this! */
-          break;
-        }
-      } else {
-        switch ( dst_nb ) {
-        case 4:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > UINT_MAX ) {
-              t = UINT_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
-
-            * ( ( unsigned int * ) dst_ptr ) = ( unsigned int ) t;
-
-            if ( dst_swap ) {
-              miswap4 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-
-        case 2:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > USHRT_MAX ) {
-              t = USHRT_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
+      for ( i = 0; i < nelements; i += MI2_CONV_BLOCK ) {
+        size_t n = nelements - i < MI2_CONV_BLOCK ? nelements - i : MI2_CONV_BLOCK;
 
-            * ( ( unsigned short * ) dst_ptr ) = ( unsigned short ) t;
-
-            if ( dst_swap ) {
-              miswap2 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 1:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = rint ( * ( double * ) src_ptr );
-
-            if ( t > UCHAR_MAX ) {
-              t = UCHAR_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
-
-            * ( ( unsigned char * ) dst_ptr ) = ( unsigned char ) t;
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        default:
-          /* Can't handle any other values */
-          break;
-        }
+        mi2_dbl_to_int_block ( buf + i * src_nb, buf + i * dst_nb,
+                               n, dst_nb, dst_sg, src_swap, dst_swap );
       }
     } else {
-      if ( dst_sg == H5T_SGN_2 ) {
-        switch ( dst_nb ) {
-        case 4:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > INT_MAX ) {
-              t = INT_MAX;
-            } else
-              if ( t < INT_MIN ) {
-                t = INT_MIN;
-              }
-
-            * ( ( int * ) dst_ptr ) = ( int ) t;
-
-            if ( dst_swap ) {
-              miswap4 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 2:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > SHRT_MAX ) {
-              t = SHRT_MAX;
-            } else
-              if ( t < SHRT_MIN ) {
-                t = SHRT_MIN;
-              }
-
-            * ( ( short * ) dst_ptr ) = ( short ) t;
-
-            if ( dst_swap ) {
-              miswap4 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 1:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > CHAR_MAX ) {
-              t = CHAR_MAX;
-            } else
-              if ( t < CHAR_MIN ) {
-                t = CHAR_MIN;
-              }
-
-            * ( ( char * ) src_ptr ) = ( char ) t;
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        default:
-          /* Can't handle this! */
-          break;
-        }
-      } else {
-        switch ( dst_nb ) {
-        case 4:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > UINT_MAX ) {
-              t = UINT_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
-
-            * ( ( unsigned int * ) dst_ptr ) = ( unsigned int ) t;
-
-            if ( dst_swap ) {
-              miswap4 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-
-        case 2:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > USHRT_MAX ) {
-              t = USHRT_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
-
-            * ( ( unsigned short * ) dst_ptr ) = ( unsigned short ) t;
-
-            if ( dst_swap ) {
-              miswap2 ( dst_ptr );
-            }
-
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        case 1:
-
-          while ( nelements-- > 0 ) {
-            if ( src_swap ) {
-              miswap8 ( src_ptr );
-            }
-
-            t = ( int ) ( * ( double * ) src_ptr );
-
-            if ( t > UCHAR_MAX ) {
-              t = UCHAR_MAX;
-            } else
-              if ( t < 0 ) {
-                t = 0;
-              }
-
-            * ( ( unsigned char * ) dst_ptr ) = ( unsigned char ) t;
-            dst_ptr += dst_cnt;
-            src_ptr += src_cnt;
-          }
-
-          break;
-        default:
-          /* Can't handle any other values */
-          break;
-        }
+      for ( i = 0; i < nelements; i++ ) {
+        mi2_dbl_to_int_block ( buf + i * buf_stride, buf + i * buf_stride,
+                               1, dst_nb, dst_sg, src_swap, dst_swap );
       }
     }
 
@@ -1331,8 +1006,9 @@ static herr_t mi2_dbl_to_int ( hid_t src_id,
 }
 
 
-/** Initialize some critical pieces of the library.  For now all this does
-is install the double-to-integer and integer-to-double conversion functions.
+/** Initialize some critical pieces of the library.  This installs the
+double-to-integer and integer-to-double conversion functions, and enables
+the I/O statistics if they are configured.
 */
 void miinit ( void )
 {
@@ -1341,37 +1017,42 @@ void miinit ( void )
 
   MI_CHECK_HDF_CALL(H5Tregister ( H5T_PERS_SOFT, "d2i", H5T_NATIVE_DOUBLE, H5T_NATIVE_INT,
                 mi2_dbl_to_int ),"H5Tregister")
+
+  miio_init();
 }
 
 /** HDF5 type conversion function for converting among integer types.
  * This handles byte-swapping for enumerated types where needed.
  */
 static herr_t mi2_int_to_int ( hid_t src_id,
-			       hid_t dst_id,
-			       H5T_cdata_t *cdata,
-			       size_t nelements,
-			       size_t buf_stride,
-			       size_t bkg_stride,
-			       void *buf_ptr,
-			       void *bkg_ptr,
-			       hid_t dset_xfer_plist )
+                               hid_t dst_id,
+                               H5T_cdata_t *cdata,
+                               size_t nelements,
+                               size_t buf_stride,
+                               size_t bkg_stride,
+                               void *buf_ptr,
+                               void *bkg_ptr,
+                               hid_t dset_xfer_plist )
 {
-  unsigned char *dst_ptr;
-  size_t dst_cnt;
+  unsigned char *buf = ( unsigned char * ) buf_ptr;
+  double block[MI2_CONV_BLOCK];
   size_t dst_sz;
+  size_t i;
 
   switch ( cdata->command ) {
   case H5T_CONV_INIT:
     break;
   case H5T_CONV_CONV:
-    dst_ptr = ( unsigned char * ) buf_ptr;
     dst_sz = H5Tget_size( dst_id );
 
     if (dst_sz != H5Tget_size( src_id )) {
-      return -1;		/* Can't change size for now. */
+      return -1;                /* Can't change size for now. */
     }
-    if ( H5Tget_order ( dst_id ) == H5Tget_order ( src_id ) ) {
-      return 0;			/* Nothing to do. */
+    if ( H5Tget_order ( dst_id ) == H5Tget_order ( src_id ) || dst_sz == 1 ) {
+      return 0;                 /* Nothing to do. */
+    }
+    if ( dst_sz != 2 && dst_sz != 4 && dst_sz != 8 ) {
+      return (-1);
     }
 
     /* The logic of HDF5 seems to be that if a stride is specified,
@@ -1380,34 +1061,19 @@ static herr_t mi2_int_to_int ( hid_t src_id,
     * and that's what their own type converters do.
     */
     if ( buf_stride == 0 ) {
-      dst_cnt = dst_sz;
-    } else {
-      dst_cnt = buf_stride;
-    }
+      for ( i = 0; i < nelements; i += MI2_CONV_BLOCK ) {
+        size_t n = nelements - i < MI2_CONV_BLOCK ? nelements - i : MI2_CONV_BLOCK;
 
-    switch ( dst_sz ) {
-    case 8:
-      while ( nelements-- > 0 ) {
-	miswap8 ( dst_ptr );
-	dst_ptr += dst_cnt;
+        memcpy ( block, buf + i * dst_sz, n * dst_sz );
+        miswap_block ( block, n, dst_sz );
+        memcpy ( buf + i * dst_sz, block, n * dst_sz );
       }
-      break;
-    case 4:
-      while ( nelements-- > 0 ) {
-	miswap4 ( dst_ptr );
-	dst_ptr += dst_cnt;
-      }
-      break;
-    case 2:
-      while ( nelements-- > 0 ) {
-	miswap2 ( dst_ptr );
-	dst_ptr += dst_cnt;
+    } else {
+      for ( i = 0; i < nelements; i++ ) {
+        memcpy ( block, buf + i * buf_stride, dst_sz );
+        miswap_block ( block, 1, dst_sz );
+        memcpy ( buf + i * buf_stride, block, dst_sz );
       }
-      break;
-    case 1:
-      break;
-    default:
-      return (-1);
     }
     break;
 
@@ -1436,478 +1102,6 @@ void miinit_enum ( hid_t type_id )
                 mi2_int_to_dbl );
 }
 
-int minc_create_thumbnail ( mihandle_t volume, int grp )
-{
-  char path[MI2_MAX_PATH];
-  hid_t grp_id;
-  
-  /* Don't handle negative or overly large numbers!
-  */
-  if ( grp <= 0 || grp > MI2_MAX_RESOLUTION_GROUP ) {
-    return ( MI_ERROR );
-  }
-
-  snprintf ( path, sizeof(path), MI_ROOT_PATH "/image/%d", grp );
-  grp_id = H5Gcreate2 ( volume->hdf_id, path, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-
-  if ( grp_id < 0 ) {
-    return ( MI_ERROR );
-  }
-
-  H5Gclose ( grp_id );
-  return ( MI_NOERROR );
-}
-
-/** Function to downsample a single slice of an image.
-* \param in_ptr the 3D input slice, scale x isize[1] x isize[2]
-* \param out_ptr the 2D output slice, osize[1] x osize[2]
-*/
-static void midownsample_slice ( double *in_ptr, double *out_ptr, hsize_t isize[],
-                                 hsize_t osize[], int scale )
-{
-  hsize_t j, k;
-  int x, y, z;
-  double d;
-  double total;
-
-  total = (double) scale * (double) scale * (double) scale;
-
-  /* These two loops iterate over all of the voxels in the 2D output
-  * image.
-  */
-  for ( j = 0; j < osize[1]; j++ ) {
-    for ( k = 0; k < osize[2]; k++ ) {
-      /* The three inner loops iterate all scale^3
-      * voxels in the input image which will be averaged
-      * to form the output image.
-      */
-      d = 0;
-
-      for ( x = 0; x < scale; x++ ) {
-        for ( y = 0; y < scale; y++ ) {
-          for ( z = 0; z < scale; z++ ) {
-            size_t x1, y1, z1;
-            double t;
-            x1 = x;
-            y1 = y + ( j * scale );
-            z1 = z + ( k * scale );
-            t = in_ptr[ ( ( x1 * isize[1] ) + y1 ) * isize[2] + z1];
-            d += t;
-          }
-        }
-      }
-
-      d /= total;
-      out_ptr[ ( j * osize[2] ) + k] = d;
-    }
-  }
-}
-
-/** Convert the hyperslab from real to voxel values, calculating and
-* returning the minimum and maximum real values for the slab.  This
-* could form the basis for a public function one day, but for now it
-* is considered private.
-*/
-static void miconvert_hyperslab_to_voxel ( mihandle_t volume, hsize_t start[],
-    hsize_t count[], double *slab_ptr,
-    double *max_ptr, double *min_ptr )
-{
-  /* This code is not intended to be a general hyperslab-to-voxel
-  * converter yet.  That is why it is not public.
-  */
-  double real_min, real_max;  /* Minimum and maximum values */
-  hsize_t index;
-  hsize_t total;
-  double voxel_range, voxel_offset;
-  double real_range, real_offset;
-  int i;
-  double tmp_val;
-
-  real_min = DBL_MAX;
-  real_max = -DBL_MAX;
-
-  total = 1;
-
-  for ( i = 0; i < volume->number_of_dims; i++ ) {
-    total *= count[i];
-  }
-
-  /* Find the global minimum and maximum for this hyperslab.
-  */
-  for ( index = 0; index < total; index++ ) {
-    tmp_val = slab_ptr[index];
-
-    if ( tmp_val > real_max ) {
-      real_max = tmp_val;
-    }
-
-    if ( tmp_val < real_min ) {
-      real_min = tmp_val;
-    }
-  }
-
-  voxel_range = volume->valid_max - volume->valid_min;
-  voxel_offset = volume->valid_min;
-  real_range = real_max - real_min;
-  real_offset = real_min;
-
-  for ( index = 0; index < total; index++ ) {
-    tmp_val = slab_ptr[index];
-    tmp_val = ( tmp_val - real_offset ) / real_range;
-    tmp_val = ( tmp_val * voxel_range ) + voxel_offset;
-    slab_ptr[index] = rint ( tmp_val );
-  }
-
-  if ( min_ptr != NULL ) {
-    *min_ptr = real_min;
-  }
-
-  if ( max_ptr != NULL ) {
-    *max_ptr = real_max;
-  }
-}
-
-/** Convert the hyperslab from voxel to real values.  This could form
-* the basis for a public function one day, but for now it is
-* considered private.
-*/
-static void miconvert_hyperslab_to_real ( mihandle_t volume, hsize_t start[],
-    hsize_t count[], double *slab_ptr )
-{
-  /* This code is not intended to be a general hyperslab-to-real
-  * converter yet.  That is why it is not public.
-  */
-  double real_min, real_max;  /* Minimum and maximum values */
-  hsize_t index;
-  hsize_t total;
-  double voxel_range, voxel_offset;
-  double real_range, real_offset;
-  int i;
-  double tmp_val;
-  misize_t pos[MI2_MAX_VAR_DIMS];
-  int r;
-
-  total = 1;
-
-  for ( i = 0; i < volume->number_of_dims; i++ ) {
-    total *= count[i];
-    pos[i] = start[i];
-  }
-
-  voxel_offset = volume->valid_min;
-  voxel_range = volume->valid_max - volume->valid_min;
-
-  /* Get the initial real minimum & maximum.
-  */
-  r = miget_slice_range ( volume, pos, volume->number_of_dims,
-                          &real_max, &real_min );
-
-  if ( r == MI_ERROR ) {
-    fprintf ( stderr, "Oops - failed to get slice range\n" );
-  }
-
-  real_offset = real_min;
-  real_range = real_max - real_min;
-
-
-  for ( index = 0; index < total; index++ ) {
-    /* Since this calculation may cross slice boundaries, I need to
-    * grab the correct real minimum and maximum for the coordinates
-    * I happen to be in at the time.
-    *
-    * This next loop attempts to keep track of the current position,
-    * and reloads the minimum and maximum whenever we change any other
-    * than the fastest-varying dimension.
-    */
-    for ( i = volume->number_of_dims - 1; i >= 0; i-- ) {
-      pos[i]++;
-
-      if ( pos[i] >= count[i] ) {
-        pos[i] = start[i];
-        r = miget_slice_range ( volume, pos, volume->number_of_dims,
-                                &real_max, &real_min );
-
-        if ( r == MI_ERROR ) {
-          fprintf ( stderr, "Oops - failed to get slice range\n" );
-        }
-
-        real_offset = real_min;
-        real_range = real_max - real_min;
-      } else {
-        break;
-      }
-    }
-
-    tmp_val = ( slab_ptr[index] - voxel_offset ) / voxel_range;
-    slab_ptr[index] = ( tmp_val * real_range ) + real_offset;
-  }
-}
-
-/** Update an individual thumbnail for the \a volume.  Updates group
-* number \a ogrp from source group \a igrp.  The whole image tree must
-* be rooted at \a loc_id.
-*/
-int
-minc_update_thumbnail ( mihandle_t volume, hid_t loc_id, int igrp, int ogrp )
-{
-  hsize_t isize[MI2_MAX_VAR_DIMS];
-  hsize_t osize[MI2_MAX_VAR_DIMS];
-  hsize_t count[MI2_MAX_VAR_DIMS];
-  hsize_t start[MI2_MAX_VAR_DIMS];
-  hid_t idst_id=-1;              /* Input dataset */
-  hid_t odst_id=-1;              /* Output dataset */
-  hid_t ifspc_id=-1;             /* Input "file" dataspace */
-  hid_t ofspc_id=-1;             /* Output "file" dataspace */
-  hid_t typ_id=-1;               /* Type ID */
-  hid_t imspc_id=-1;             /* Input memory dataspace */
-  hid_t omspc_id=-1;             /* Output memory dataspace */
-  char path[MI2_MAX_PATH];
-  int ndims;                  /* Number of dimensions in the image */
-  int scale;
-  int i;                      /* Generic loop counter */
-  double *in_ptr;
-  double *out_ptr;
-  hsize_t slice;
-  size_t in_bytes;
-  size_t out_bytes;
-  double smax, smin;          /* Slice minimum and maximum */
-  hid_t omax_id=-1;              /* Output image-max dataset */
-  hid_t omin_id=-1;              /* Output image-min dataset */
-  hid_t tfspc_id=-1;             /* Dimensionality of image-max/image-min */
-  hid_t tmspc_id=-1;
-  hid_t dcpl_id=-1;              /* Dataset creation property list */
-  herr_t result=0;               /* return value for various functions*/
-
-  miinit();
-
-  /* Check arguments for basic validity. */
-  if ( ogrp <= igrp ) {
-    return ( MI_ERROR );
-  }
-
-  /* Calculate scale factor (always a power of 2) */
-  for ( i = igrp, scale = 1; i < ogrp; i++, scale <<= 1 )
-    ;
-
-  /* Open the input path.
-  */
-  snprintf ( path, sizeof(path), "%d/image", igrp );
-  idst_id = H5Dopen1 ( loc_id, path );
-
-  if ( idst_id < 0 ) {
-    return ( MI_ERROR );
-  }
-
-  /* Get the input type.
-  */
-  typ_id = H5Dget_type ( idst_id );
-
-  /* Get the input dataspace.
-  */
-  ifspc_id = H5Dget_space ( idst_id );
-
-  /* Get the input dataset creation property list
-  */
-  dcpl_id = H5Dget_create_plist ( idst_id );
-
-  ndims = H5Sget_simple_extent_ndims ( ifspc_id );
-  H5Sget_simple_extent_dims ( ifspc_id, isize, NULL );
-
-  /* Calculate the size of the new thumbnail.
-  */
-  for ( i = 0; i < ndims; i++ ) {
-    osize[i] = isize[i] / scale;
-
-    if ( osize[i] == 0 ) { /* Too small? */
-      return ( MI_ERROR );
-    }
-  }
-
-  /* Create dataspace for new resolution
-  */
-  ofspc_id = H5Screate_simple ( ndims, osize, NULL );
-
-  snprintf ( path, sizeof(path), "%d/image", ogrp );
-
-  H5E_BEGIN_TRY {
-    odst_id = H5Dcreate1 ( loc_id, path, typ_id, ofspc_id, H5P_DEFAULT );
-  } H5E_END_TRY;
-
-  if ( odst_id < 0 ) {
-    odst_id = H5Dopen1 ( loc_id, path );
-
-    if ( odst_id < 0 ) {
-      return ( MI_ERROR );
-    }
-  }
-
-  H5Pclose ( dcpl_id );       /* No longer needed. */
-
-  if ( volume->volume_class == MI_CLASS_REAL ) {
-    /* TODO: This is a bit of a hack - I need a better way to get the
-    * dimensionality of the source image-min and image-max.
-    */
-
-    tfspc_id = H5Screate_simple ( 1, &osize[0], NULL );
-
-    /* Create a simple scalar dataspace. */
-    tmspc_id = H5Screate ( H5S_SCALAR );
-
-    snprintf ( path, sizeof(path), "%d/image-max", ogrp );
-    H5E_BEGIN_TRY {
-      omax_id = H5Dcreate1 ( loc_id, path, H5T_IEEE_F64LE, tfspc_id,
-      H5P_DEFAULT );
-    } H5E_END_TRY;
-
-    if ( omax_id < 0 ) {
-      omax_id = H5Dopen1 ( loc_id, path );
-    }
-
-    snprintf ( path, sizeof(path), "%d/image-min", ogrp );
-    H5E_BEGIN_TRY {
-      omin_id = H5Dcreate1 ( loc_id, path, H5T_IEEE_F64LE, tfspc_id,
-      H5P_DEFAULT );
-    } H5E_END_TRY;
-
-    if ( omin_id < 0 ) {
-      omin_id = H5Dopen1 ( loc_id, path );
-    }
-  }
-
-  /* Calculate the input buffer size - scale slices.
-  */
-  in_bytes = scale * isize[1] * isize[2] * sizeof ( double );
-  in_ptr = malloc ( in_bytes );
-
-  out_bytes = osize[1] * osize[2] * sizeof ( double );
-  out_ptr = malloc ( out_bytes );
-
-  count[0] = scale;
-  count[1] = isize[1];
-  count[2] = isize[2];
-  imspc_id = H5Screate_simple ( ndims, count, NULL );
-
-  count[0] = 1;
-  count[1] = osize[1];
-  count[2] = osize[2];
-  omspc_id = H5Screate_simple ( ndims, count, NULL );
-
-  /*
-  * read image & TODO: convert to "real" range.
-  */
-  for ( slice = 0; slice < osize[0]; slice++ ) {
-
-    start[0] = slice * scale;
-    start[1] = 0;
-    start[2] = 0;
-    count[0] = scale;
-    count[1] = isize[1];
-    count[2] = isize[2];
-
-    MI_CHECK_HDF_CALL(result=H5Sselect_hyperslab ( ifspc_id, H5S_SELECT_SET, start, NULL, count,
-                          NULL ),"H5Sselect_hyperslab");
-    if(result>=0)
-    {
-      MI_CHECK_HDF_CALL(H5Dread ( idst_id, H5T_NATIVE_DOUBLE, imspc_id, ifspc_id, H5P_DEFAULT,
-                in_ptr ),"H5Dread");
-
-      /* Scale slice from voxel to real values. */
-
-      miconvert_hyperslab_to_real ( volume, start, count, in_ptr );
-
-      midownsample_slice ( in_ptr, out_ptr, isize, osize, scale );
-    }
-    
-    start[0] = slice;
-    start[1] = 0;
-    start[2] = 0;
-    count[0] = 1;
-    count[1] = osize[1];
-    count[2] = osize[2];
-    
-    MI_CHECK_HDF_CALL(result=H5Sselect_hyperslab ( ofspc_id, H5S_SELECT_SET, start, NULL, count,
-                                           NULL ),"H5Sselect_hyperslab");
-    if(result>=0)
-    {
-      miconvert_hyperslab_to_voxel ( volume, start, count, out_ptr,
-                                     &smax, &smin );
-
-      MI_CHECK_HDF_CALL(H5Dwrite ( odst_id, H5T_NATIVE_DOUBLE, omspc_id, ofspc_id, H5P_DEFAULT,
-                                  out_ptr ),"H5Dwrite");
-    }
-    
-    if ( volume->volume_class == MI_CLASS_REAL ) {
-      /* Select the right point in tfspc_id */
-      H5Sselect_elements ( tfspc_id, H5S_SELECT_SET, 1, &start[0] );
-
-      H5Dwrite ( omax_id, H5T_NATIVE_DOUBLE, tmspc_id, tfspc_id,
-                 H5P_DEFAULT, &smax );
-
-      H5Dwrite ( omin_id, H5T_NATIVE_DOUBLE, tmspc_id, tfspc_id,
-                 H5P_DEFAULT, &smin );
-    }
-  }
-
-  free ( in_ptr );
-  free ( out_ptr );
-
-  if(omax_id>0)  H5Dclose ( omax_id );
-  if(omin_id>0)  H5Dclose ( omin_id );
-  if(tfspc_id>0) H5Sclose ( tfspc_id );
-  if(tmspc_id>0) H5Sclose ( tmspc_id );
-
-  if(omspc_id>0) H5Sclose ( omspc_id );
-  if(imspc_id>0) H5Sclose ( imspc_id );
-  if(odst_id>0)  H5Dclose ( odst_id );
-  if(typ_id>0)   H5Tclose ( typ_id );
-  H5Sclose ( ofspc_id );
-  H5Sclose ( ifspc_id );
-
-  return ( MI_NOERROR );
-}
-
-/** Cycle through and update each of the lower-resolution images in
-* the file.
-*/
-int
-minc_update_thumbnails ( mihandle_t volume )
-{
-  int grp_no, prv_grp_no;
-  hid_t grp_id;
-  hsize_t n;
-  hsize_t i;
-  char name[MI2_MAX_PATH];
-
-  grp_id = H5Gopen1 ( volume->hdf_id, MI_ROOT_PATH "/image" );
-
-  if ( grp_id < 0 ) {
-    return ( MI_ERROR );    /* Error opening group. */
-  }
-
-  if ( H5Gget_num_objs ( grp_id, &n ) < 0 ) {
-    return ( MI_ERROR );    /* Error getting object count. */
-  }
-
-  grp_no = -1;
-
-  for ( i = 0; i < n; i++ ) {
-    if ( H5Gget_objname_by_idx ( grp_id, i, name, MI2_MAX_PATH ) < 0 ) {
-      return ( MI_ERROR );
-    }
-
-    prv_grp_no = grp_no;
-    grp_no = atoi ( name );
-
-    if ( grp_no != 0 ) {
-      minc_update_thumbnail ( volume, grp_id, prv_grp_no, grp_no );
-    }
-  }
-
-  H5Gclose ( grp_id );
-  return ( MI_NOERROR );
-
-}
-
 double *
 alloc1d ( int n )
 {
@@ -0,0 +1,232 @@
+/** \file mapped.c
+ * \brief MINC 2.0 memory mapped images
+ *
+ * Read-only views of uncompressed images with contiguous storage,
+ * mapped straight from the file. Processes mapping the same file share
+ * its pages through the page cache, instead of each holding a copy.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <hdf5.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /*HAVE_SYS_MMAN_H*/
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif /*HAVE_SYS_STAT_H*/
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /*HAVE_FCNTL_H*/
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(HAVE_SYS_STAT_H) && \
+    defined(HAVE_FCNTL_H) && defined(HAVE_UNISTD_H)
+#define MI2_MAPPED_IMAGES 1
+#endif
+
+/** \internal
+ * Mapped images of a volume, one per resolution.
+ */
+struct mimapped_image {
+  void *addr[MI2_MAX_RESOLUTION_GROUP + 1];     /* Start of the mapping */
+  size_t length[MI2_MAX_RESOLUTION_GROUP + 1];  /* Length of the mapping */
+  const void *data[MI2_MAX_RESOLUTION_GROUP + 1]; /* First voxel */
+};
+
+#ifdef MI2_MAPPED_IMAGES
+/** Check that the image of the selected resolution of \a volume is
+ * stored as is, in native byte order, and get its position in the file
+ * and its size.
+ */
+static int mimapped_layout(mihandle_t volume, haddr_t *offset, size_t *nbytes,
+                           misize_t strides[])
+{
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hid_t dcpl_id;
+  hid_t fapl_id;
+  hid_t fspc_id;
+  H5D_layout_t layout;
+  H5T_order_t order;
+  hid_t driver;
+  size_t el_size;
+  int n_filters;
+  int ndims;
+  int i;
+
+  MI_CHECK_HDF_CALL_RET(dcpl_id = H5Dget_create_plist(volume->image_id),"H5Dget_create_plist");
+  layout = H5Pget_layout(dcpl_id);
+  n_filters = H5Pget_nfilters(dcpl_id);
+  H5Pclose(dcpl_id);
+  if (layout != H5D_CONTIGUOUS || n_filters != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only uncompressed images with contiguous storage can be mapped");
+  }
+
+  /* Dataset addresses are file offsets only for the default driver */
+  MI_CHECK_HDF_CALL_RET(fapl_id = H5Fget_access_plist(volume->hdf_id),"H5Fget_access_plist");
+  driver = H5Pget_driver(fapl_id);
+  H5Pclose(fapl_id);
+  if (driver != H5FD_SEC2) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only images of files opened with the default driver can be mapped");
+  }
+
+  el_size = H5Tget_size(volume->ftype_id);
+  order = H5Tget_order(volume->ftype_id);
+  if (el_size > 1 && (order == H5T_ORDER_LE || order == H5T_ORDER_BE) &&
+      order != H5Tget_order(H5T_NATIVE_INT)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only images in native byte order can be mapped");
+  }
+
+  if ((*offset = H5Dget_offset(volume->image_id)) == HADDR_UNDEF) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Image has no storage in the file");
+  }
+
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  if (ndims < 0) {
+    return (MI_ERROR);
+  }
+  *nbytes = el_size;
+  for (i = ndims - 1; i >= 0; i--) {
+    if (strides != NULL) {
+      strides[i] = *nbytes;
+    }
+    *nbytes *= (size_t) dims[i];
+  }
+  return (MI_NOERROR);
+}
+
+/** Map \a nbytes of the file of \a volume from \a offset.
+ */
+static int mimapped_map(mihandle_t volume, haddr_t offset, size_t nbytes,
+                        void **addr, size_t *length)
+{
+  char *path;
+  ssize_t path_len;
+  struct stat st;
+  long page_size;
+  off_t base;
+  int fd;
+
+  path_len = H5Fget_name(volume->hdf_id, NULL, 0);
+  if (path_len <= 0 || (path = malloc(path_len + 1)) == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to get the file name of the volume");
+  }
+  H5Fget_name(volume->hdf_id, path, path_len + 1);
+  fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to open the file of the volume for mapping");
+  }
+  if (fstat(fd, &st) < 0 || (haddr_t) st.st_size < offset + nbytes) {
+    close(fd);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Image extends past the end of the file");
+  }
+
+  page_size = sysconf(_SC_PAGESIZE);
+  base = (off_t) (offset - offset % (haddr_t) page_size);
+  *length = nbytes + (size_t) (offset - base);
+  *addr = mmap(NULL, *length, PROT_READ, MAP_SHARED, fd, base);
+  close(fd);
+  if (*addr == MAP_FAILED) {
+    *addr = NULL;
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to map the image");
+  }
+  return (MI_NOERROR);
+}
+#endif /*MI2_MAPPED_IMAGES*/
+
+/** Get a read-only view of the voxels of the selected resolution of
+ * \a volume, mapped from the file. This is only possible for volumes
+ * opened with MI2_OPEN_READ whose image is stored uncompressed, with a
+ * contiguous layout (MI_COMPRESS_NONE and no blocking), in native byte
+ * order. The voxels are in file order, \a strides receives the
+ * distance in bytes between neighbours along each dimension and
+ * \a type the voxel type. The view remains valid until the volume is
+ * closed.
+ */
+int miget_volume_mapped_pointer(mihandle_t volume, const void **data,
+                                misize_t strides[], mitype_t *type)
+{
+#ifdef MI2_MAPPED_IMAGES
+  struct mimapped_image *mapped;
+  int res;
+  haddr_t offset;
+  size_t nbytes;
+
+  if (volume == NULL || data == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to map the image with null volume or null variables");
+  }
+  if ((volume->mode & MI2_OPEN_RDWR) != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only volumes opened for reading can be mapped");
+  }
+  if (miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (volume->image_id < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to map the image of a volume without image");
+  }
+  if (mimapped_layout(volume, &offset, &nbytes, strides) < 0) {
+    return (MI_ERROR);
+  }
+
+  if (volume->mapped == NULL) {
+    volume->mapped = (struct mimapped_image *) calloc(1, sizeof(struct mimapped_image));
+    if (volume->mapped == NULL) {
+      return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) sizeof(struct mimapped_image));
+    }
+  }
+  mapped = volume->mapped;
+  res = volume->selected_resolution;
+  if (mapped->data[res] == NULL) {
+    if (mimapped_map(volume, offset, nbytes, &mapped->addr[res], &mapped->length[res]) < 0) {
+      return (MI_ERROR);
+    }
+    mapped->data[res] = (const char *) mapped->addr[res] +
+                        (mapped->length[res] - nbytes);
+  }
+
+  *data = mapped->data[res];
+  if (type != NULL) {
+    *type = volume->volume_type;
+  }
+  return (MI_NOERROR);
+#else
+  return MI_LOG_ERROR(MI2_MSG_GENERIC,"Mapping images is not supported on this system");
+#endif /*MI2_MAPPED_IMAGES*/
+}
+
+/** Unmap the images mapped by miget_volume_mapped_pointer().
+ */
+void mimapped_free(mihandle_t volume)
+{
+  struct mimapped_image *mapped = volume->mapped;
+  int i;
+
+  if (mapped == NULL) {
+    return;
+  }
+  for (i = 0; i <= MI2_MAX_RESOLUTION_GROUP; i++) {
+#ifdef MI2_MAPPED_IMAGES
+    if (mapped->addr[i] != NULL) {
+      munmap(mapped->addr[i], mapped->length[i]);
+    }
+#endif /*MI2_MAPPED_IMAGES*/
+  }
+  free(mapped);
+  volume->mapped = NULL;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -701,6 +701,27 @@ int miget_dimension_widths(midimhandle_t dimension, mivoxel_order_t voxel_order,
 int miset_dimension_widths(midimhandle_t dimension, misize_t array_length,
                                   misize_t start_position, const double widths[]);
 
+/**
+  * Get whether a dimension is unlimited, that is whether frames can be
+  * appended along it with miappend_volume_frame().
+  * \param dimension The dimension handle.
+  * \param unlimited A pointer to the unlimited flag.
+  * \ingroup mi2Dim
+  */
+int miget_dimension_unlimited(midimhandle_t dimension, miboolean_t *unlimited);
+
+/**
+  * Make a dimension unlimited, or limited again, before the volume is
+  * created. Only a dimension of class MI_DIMCLASS_TIME can be unlimited,
+  * and it has to be the first dimension of the volume in file order. Its
+  * length is then the number of frames the volume starts with, possibly
+  * zero, and grows by one with each call to miappend_volume_frame().
+  * \param dimension The dimension handle.
+  * \param unlimited TRUE to make the dimension unlimited.
+  * \ingroup mi2Dim
+  */
+int miset_dimension_unlimited(midimhandle_t dimension, miboolean_t unlimited);
+
 
 /* VOLUME FUNCTIONS */
 /** Create a volume with the specified name, dimensions,
@@ -715,6 +736,19 @@ int micreate_volume(const char *filename,
                            mivolumeprops_t create_props,
                            mihandle_t *volume);
 
+/** Create a volume held in memory, with the specified dimensions, type,
+  * class and volume properties, and retrieve the volume handle. Nothing
+  * is written to disk; use miserialize_volume_to_buffer() to get the
+  * contents of the volume as a MINC file before closing it.
+  * \ingroup mi2Vol
+*/
+int micreate_volume_in_memory(int number_of_dimensions,
+                              midimhandle_t dimensions[],
+                              mitype_t volume_type,
+                              miclass_t volume_class,
+                              mivolumeprops_t create_props,
+                              mihandle_t *volume);
+
 /** Create the actual image for the volume.
   * Note that the image dataset muct be created in the hierarchy
   * before the image data can be added.
@@ -722,6 +756,20 @@ int micreate_volume(const char *filename,
 */
 int micreate_volume_image(mihandle_t volume);
 
+/** Append a frame to a volume whose first dimension in file order is
+  * unlimited, see miset_dimension_unlimited(). The image grows by one
+  * position along that dimension, and so do the image-max and image-min
+  * tables and the offsets and widths of an irregular dimension. If
+  * \a buffer is not NULL, the voxels of the new frame are written from it
+  * as miset_voxel_value_hyperslab() would, in the apparent order of the
+  * other dimensions; otherwise the frame reads as the fill value until it
+  * is written. The reduced resolutions of the volume are only built when
+  * it is closed.
+  * \ingroup mi2Vol
+*/
+int miappend_volume_frame(mihandle_t volume, mitype_t buffer_data_type,
+                          const void *buffer);
+
 
 /** Return the number of dimensions associated with this volume.
   * \ingroup mi2Vol
@@ -744,10 +792,38 @@ int miget_volume_voxel_count(mihandle_t volume, misize_t *number_of_voxels);
 
 /** Opens an existing MINC volume for read-only access if mode argument is
   * MI2_OPEN_READ, or read-write access if mode argument is MI2_OPEN_RDWR.
+  * MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY only reads the dimensions and
+  * attributes; the image, its scaling and the offsets and widths of
+  * irregular dimensions are read by the first call that needs them,
+  * which makes scanning the headers of many files faster.
+  * Files compressed with gzip, or bzip2 where available, can be opened
+  * read-only. They are decompressed in memory, or in a temporary file if
+  * they are larger than MINC_DECOMPRESS_MEMORY_MB megabytes (1024 by
+  * default).
   * \ingroup mi2Vol
 */
 int miopen_volume(const char *filename, int mode, mihandle_t *volume);
 
+/** Opens the MINC volume whose file contents are the \a length bytes of
+  * \a buffer, for instance a file received over the network, with the
+  * same modes as miopen_volume(). The volume is held in memory and works
+  * on its own copy of the buffer; changes made with MI2_OPEN_RDWR are
+  * never written back to it, use miserialize_volume_to_buffer() to get
+  * them.
+  * \ingroup mi2Vol
+*/
+int miopen_volume_from_memory(const void *buffer, size_t length, int mode,
+                              mihandle_t *volume);
+
+/** Copy the contents of \a volume as a MINC file, with any changes made
+  * so far, into a new buffer of \a length bytes returned in \a buffer.
+  * Works for volumes held in memory and on disk alike. The buffer is
+  * allocated with malloc() and must be released with free().
+  * \ingroup mi2Vol
+*/
+int miserialize_volume_to_buffer(mihandle_t volume, void **buffer,
+                                 size_t *length);
+
 
 /** Close an existing MINC volume. If the volume was newly created,
   *  all changes will be written to disk. In all cases this function closes
@@ -756,6 +832,109 @@ int miopen_volume(const char *filename, int mode, mihandle_t *volume);
 */
 int miclose_volume(mihandle_t volume);
 
+/** Set the number of worker threads used to decode compressed chunks
+  * when reading hyperslabs. Zero disables the direct chunk reader and
+  * makes all reads go through H5Dread(). The default comes from the
+  * MINC_READ_THREADS configuration variable, or the number of online
+  * processors.
+  * \ingroup mi2Vol
+*/
+int miset_volume_read_threads(mihandle_t volume, int threads);
+
+/** Get the number of worker threads used to decode compressed chunks
+  * when reading hyperslabs.
+  * \ingroup mi2Vol
+*/
+int miget_volume_read_threads(mihandle_t volume, int *threads);
+
+/** Allow the hyperslab read functions to be called on a volume opened
+  * with MI2_OPEN_READ from several threads at once. The resolution,
+  * apparent dimension and voxel order and chunk cache size of the
+  * volume cannot be changed while this is enabled.
+  * \ingroup mi2Vol
+*/
+int miset_volume_concurrent_reads(mihandle_t volume, miboolean_t enable);
+
+/** Get whether a volume can be read from several threads at once.
+  * \ingroup mi2Vol
+*/
+int miget_volume_concurrent_reads(mihandle_t volume, miboolean_t *enabled);
+
+/** Get a read-only view of the voxels of a volume opened with
+  * MI2_OPEN_READ, mapped from the file, along with the distance in bytes
+  * between neighbouring voxels along each dimension in file order and
+  * the voxel type. Fails for compressed or chunked images, or images
+  * not in native byte order. The view is valid until the volume is
+  * closed.
+  * \ingroup mi2Vol
+*/
+int miget_volume_mapped_pointer(mihandle_t volume, const void **data,
+                                misize_t strides[], mitype_t *type);
+
+/** Set the size in bytes of the HDF5 chunk cache of the image. By
+  * default the cache is sized to hold the chunks of a whole slice, and
+  * grows with the selections read or written; setting it turns this off.
+  * \ingroup mi2Vol
+*/
+int miset_volume_chunk_cache(mihandle_t volume, misize_t nbytes);
+
+/** Get the size in bytes and the number of hash slots of the HDF5 chunk
+  * cache of the image. Both are zero for images that are not chunked.
+  * \ingroup mi2Vol
+*/
+int miget_volume_chunk_cache(mihandle_t volume, misize_t *nbytes, misize_t *nslots);
+
+/** Get the number of chunks found in the chunk cache (hits), read from
+  * the file (misses) and dropped to make room for others (evictions)
+  * since the volume was opened or the counters were reset.
+  * \ingroup mi2Vol
+*/
+int miget_volume_chunk_cache_stats(mihandle_t volume, misize_t *hits,
+                                   misize_t *misses, misize_t *evictions);
+
+/** Reset the chunk cache counters to zero.
+  * \ingroup mi2Vol
+*/
+int mireset_volume_chunk_cache_stats(mihandle_t volume);
+
+/** Enable or disable the collection of I/O statistics for all volumes:
+  * the hyperslabs, bytes and chunks read and written, and the time spent
+  * in H5Dread() and H5Dwrite(), in the direct chunk reader and writer,
+  * in scaling, in reordering dimensions and in building thumbnails.
+  * Thumbnail time includes the reads and writes made to build them.
+  * Collection is also enabled by setting the MINC_IO_STATS configuration
+  * variable to a file name, or "-" for the standard error, to which the
+  * statistics are written as JSON when the process exits.
+  * \ingroup mi2Vol
+*/
+int miset_io_statistics(miboolean_t enable);
+
+/** Get the I/O statistics collected for \a volume since it was opened,
+  * or for the whole process if \a volume is NULL.
+  * \ingroup mi2Vol
+*/
+int miget_io_statistics(mihandle_t volume, miiostatistics_t *stats);
+
+/** Get the chunk edge lengths of the image at the selected resolution
+  * and the number of chunks along each dimension, in file order. An
+  * image that is not chunked is a single chunk.
+  * \ingroup mi2Vol
+*/
+int miget_volume_chunk_grid(mihandle_t volume, misize_t array_length,
+                            misize_t chunk_lengths[], misize_t chunk_counts[]);
+
+/** Find which chunks of the image hold data. \a mask gets one element
+  * per chunk of the grid given by miget_volume_chunk_grid(), the last
+  * dimension varying fastest, set to TRUE if the chunk has storage in
+  * the file and FALSE if it was never written and so holds only the
+  * fill value. Whole chunks of compressed images written with only the
+  * fill value are not stored, and chunks without storage are read
+  * without any I/O.
+  * \ingroup mi2Vol
+*/
+int miget_allocated_region_mask(mihandle_t volume, misize_t mask_length,
+                                unsigned char mask[], misize_t *n_allocated);
+
 /** Function to get the volume's slice-scaling flag.
  */
 int miget_slice_scaling_flag(mihandle_t volume, 
@@ -836,13 +1015,32 @@ int miselect_resolution(mihandle_t volume, int depth);
  */
 int miflush_from_resolution(mihandle_t volume, int depth);
 
+/** Rebuild the reduced resolutions of a volume while it is written, a
+ * block of full resolution slabs at a time as soon as all of its
+ * voxels have been written, rather than when the volume is closed or a
+ * reduced resolution is selected. The image of the volume must have
+ * been created. Worker threads are taken from the MINC_PYRAMID_THREADS
+ * configuration variable, or the number of online processors.
+ * \ingroup mi2VPrp
+ */
+int miset_volume_incremental_resolution(mihandle_t volume, miboolean_t enable);
+
+/** Get whether the reduced resolutions of a volume are rebuilt while it
+ * is written.
+ * \ingroup mi2VPrp
+ */
+int miget_volume_incremental_resolution(mihandle_t volume, miboolean_t *enabled);
+
 
 /** Set compression type for a volume property list
  * Note that enabling compression will automatically 
  * enable blocking with default parameters. 
+ * MI_COMPRESS_LZ4 and MI_COMPRESS_ZSTD need the corresponding HDF5
+ * filter plugin, MI_ERROR is returned if it cannot be loaded.
  * \param props A volume properties list
- * \param compression_type The type of compression to use (MI_COMPRESS_NONE
- * or MI_COMPRESS_ZLIB)
+ * \param compression_type The type of compression to use (MI_COMPRESS_NONE,
+ * MI_COMPRESS_ZLIB, MI_COMPRESS_SHUFFLE_ZLIB, MI_COMPRESS_LZ4 or
+ * MI_COMPRESS_ZSTD)
  * \ingroup mi2VPrp
  */
 int miset_props_compression_type(mivolumeprops_t props, micompression_t compression_type);
@@ -878,6 +1076,24 @@ int miset_props_zlib_compression(mivolumeprops_t props, int zlib_level);
 int miget_props_zlib_compression(mivolumeprops_t props, int *zlib_level);
 
 
+/** Set the level of the selected compression type: 1 to 9 for the
+ * zlib based types, 1 to 22 for Zstandard. LZ4 ignores the level.
+ * \param props A volume property list handle
+ * \param level The compression level
+ * \ingroup mi2VPrp
+ */
+int miset_props_compression_level(mivolumeprops_t props, int level);
+
+
+/** Get the level of the selected compression type.
+ * \param props A volume property list handle
+ * \param level Pointer to an integer variable that will receive the
+ * current compression level.
+ * \ingroup mi2VPrp
+ */
+int miget_props_compression_level(mivolumeprops_t props, int *level);
+
+
 /** Set blocking structure properties for the volume
  * \param props A volume property list handle
  * \param edge_count The number of edges (dimensions) in a block
@@ -887,6 +1103,32 @@ int miget_props_zlib_compression(mivolumeprops_t props, int *zlib_level);
 int miset_props_blocking(mivolumeprops_t props, int edge_count, const int *edge_lengths);
 
 
+/** Set the access pattern hint (miaccess_hint_t flags) for the volume.
+ * Unless blocking is set explicitly, the chunk shape is chosen to suit
+ * the hinted accesses.
+ * \ingroup mi2VPrp
+ */
+int miset_props_access_hint(mivolumeprops_t props, int access_hint);
+
+
+/** Get the access pattern hint for the volume
+ * \ingroup mi2VPrp
+ */
+int miget_props_access_hint(mivolumeprops_t props, int *access_hint);
+
+
+/** Set the target size in bytes of the chunks chosen for an access hint
+ * \ingroup mi2VPrp
+ */
+int miset_props_chunk_bytes(mivolumeprops_t props, misize_t chunk_bytes);
+
+
+/** Get the target size in bytes of the chunks chosen for an access hint
+ * \ingroup mi2VPrp
+ */
+int miget_props_chunk_bytes(mivolumeprops_t props, misize_t *chunk_bytes);
+
+
 /** Get blocking structure properties for the volume
  * \param props The properties structure from which to get the information
  * \param edge_count Returns the number of edges (dimensions) in a block
@@ -912,6 +1154,31 @@ int miset_props_checksum(mivolumeprops_t props, int on);
  */
 int miget_props_checksum(mivolumeprops_t props, int *on);
 
+/** Set the number of threads compressing complete chunks on write,
+ * zero leaves compression to HDF5. Defaults to MINC_COMPRESS_THREADS,
+ * or the number of processors.
+ * \ingroup mi2VPrp
+ */
+int miset_props_compression_threads(mivolumeprops_t props, int threads);
+
+/** Get the number of threads compressing chunks on write.
+ * \ingroup mi2VPrp
+ */
+int miget_props_compression_threads(mivolumeprops_t props, int *threads);
+
+/** Accumulate statistics of the values written to a new volume, as
+ * MI_STATS_ACCUMULATE in \a flags, and store them in its info group
+ * when it is closed, with MI_STATS_STORE. \a n_bins is the number of
+ * histogram bins, MI2_DEFAULT_STATS_BINS by default.
+ * \ingroup mi2VPrp
+ */
+int miset_props_statistics(mivolumeprops_t props, int flags, int n_bins);
+
+/** Get the statistics flags and number of histogram bins.
+ * \ingroup mi2VPrp
+ */
+int miget_props_statistics(mivolumeprops_t props, int *flags, int *n_bins);
+
 
 
 /** Set properties for uniform/nonuniform record dimension
@@ -1177,6 +1444,82 @@ int miset_voxel_value_hyperslab(mihandle_t volume,
                                        void *buffer);
 
 
+/** Prepare a plan for repeated transfers of hyperslabs of the same
+ * shape and buffer type. The plan only moves the selection offset on
+ * each miexecute_hyperslab() call. It keeps the resolution, apparent
+ * dimension order and voxel order of the volume at the time it is
+ * prepared; miexecute_hyperslab() fails once any of them changes.
+ * \ingroup mi2Hyper
+ */
+int miprepare_hyperslab(mihandle_t volume,
+                               mihyperslab_mode_t mode,
+                               mitype_t buffer_data_type,
+                               const misize_t count[],
+                               mihyperplan_t *plan);
+
+/** Set the real range used by a plan prepared with
+ * MI_HYPERSLAB_NORMALIZED.
+ * \ingroup mi2Hyper
+ */
+int miset_hyperslab_normalization(mihyperplan_t plan,
+                                         double data_min,
+                                         double data_max);
+
+/** Read or write the hyperslab at \a start using a prepared plan.
+ * \ingroup mi2Hyper
+ */
+int miexecute_hyperslab(mihyperplan_t plan,
+                               mihyperslab_op_t opcode,
+                               const misize_t start[],
+                               void *buffer);
+
+/** Release a hyperslab plan.
+ * \ingroup mi2Hyper
+ */
+int mifree_hyperslab(mihyperplan_t plan);
+
+/** Start reading a hyperslab of real values in the background. The
+ * buffer must stay allocated until miwait_hyperslab_async() returns.
+ * While reads of a volume are in progress, the volume must not be
+ * written to, nor its resolution or apparent dimension order changed.
+ * \ingroup mi2Hyper
+ */
+int miget_real_value_hyperslab_async(mihandle_t volume,
+                                            mitype_t buffer_data_type,
+                                            const misize_t start[],
+                                            const misize_t count[],
+                                            void *buffer,
+                                            miasyncreq_t *request);
+
+/** Wait for a hyperslab read started in the background, release the
+ * request and return the result of the read.
+ * \ingroup mi2Hyper
+ */
+int miwait_hyperslab_async(miasyncreq_t request);
+
+/** Create a stream of the one voxel thick slabs of a volume along an
+ * apparent dimension, reading up to \a n_prefetch slabs ahead in the
+ * background.
+ * \ingroup mi2Hyper
+ */
+int micreate_slab_stream(mihandle_t volume,
+                                mihyperslab_mode_t mode,
+                                mitype_t buffer_data_type,
+                                int dimension,
+                                int n_prefetch,
+                                mislabstream_t *stream);
+
+/** Get the next slab of a stream, \a *buffer is set to NULL at the end
+ * of the stream. The buffer remains valid until the next call.
+ * \ingroup mi2Hyper
+ */
+int miread_slab_stream(mislabstream_t stream, void **buffer, misize_t *slab);
+
+/** Cancel the reads ahead of a slab stream and release it.
+ * \ingroup mi2Hyper
+ */
+int mifree_slab_stream(mislabstream_t stream);
+
 /** \defgroup mi2Cvt CONVERT FUNCTIONS */
 
 /** Convert values between real (scaled) values and voxel (unscaled)
@@ -1304,6 +1647,24 @@ int miget_real_value(mihandle_t volume,
                             int ndims,
                             double *value_ptr);
 
+/** This function retrieves the real values of many positions in the
+ *  MINC volume at once. The positions are sorted by image chunk so that
+ *  each chunk holding some of them is read only once, and the values are
+ *  returned in the order the positions were given.
+ *
+ * \param volume A volume handle
+ * \param n The number of positions
+ * \param coords The voxel positions, one after the other, each with one
+ * value per dimension of the volume in the apparent dimension order
+ * \param values Array of \a n doubles to hold the returned values.
+ *
+ * \ingroup mi2Cvt
+ */
+int miget_real_values_at(mihandle_t volume,
+                         misize_t n,
+                         const misize_t coords[],
+                         double values[]);
+
 /** This function sets the  real value of a position in the MINC
  *  volume. The "real" value is the value at the given location 
  *  after scaling has been applied.
@@ -1350,6 +1711,32 @@ int miset_voxel_value(mihandle_t volume,
  */
 int miget_volume_real_range(mihandle_t volume, double real_range[2]);
 
+/** Get the count, minimum, maximum, sum and sum of squares of the real
+ * values written to a volume created with statistics enabled, or
+ * stored in the file it was opened from. Values written more than once
+ * are counted every time.
+ *
+ * \ingroup mi2Cvt
+ */
+int miget_volume_statistics(mihandle_t volume, mistatistics_t *stats);
+
+/** Get the statistics of the values of one slice, the one holding the
+ * voxel at \a start_positions in the apparent dimension order.
+ *
+ * \ingroup mi2Cvt
+ */
+int miget_slice_statistics(mihandle_t volume, const misize_t start_positions[],
+                           size_t array_length, mistatistics_t *stats);
+
+/** Get the histogram of the voxel values of a volume with statistics.
+ * The \a n_bins bins, as set in the volume properties, have equal
+ * widths over the voxel range [\a hist_min, \a hist_max].
+ *
+ * \ingroup mi2Cvt
+ */
+int miget_volume_histogram(mihandle_t volume, int n_bins, misize_t counts[],
+                           double *hist_min, double *hist_max);
+
 /**
  * This function sets the world coordinates of the point (0,0,0) in voxel
  * coordinates.  This changes the constant offset of the two coordinate
@@ -1471,6 +1858,92 @@ int miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels);
 */
 int miget_label_value_by_index(mihandle_t volume, int idx, int *value);
 
+/** \defgroup mi2Index HEADER INDEX FUNCTIONS */
+
+/** Open the header index stored in \a index_path, or start an empty one
+ * if the file does not exist or cannot be read. A header index keeps
+ * the dimensions, voxel to world transform, data type and chosen
+ * attributes of a set of files, and answers queries about them without
+ * opening the files. An entry is read again from its file when the file
+ * has changed size or modification time since it was indexed.
+ * A header index must not be used by several threads at once.
+ * \ingroup mi2Index
+ */
+int miopen_header_index(const char *index_path, miheaderindex_t *index);
+
+/** Keep the attribute \a name of the group \a path, as given to
+ * miget_attr_values(), for each indexed file. Files indexed before the
+ * attribute is added are read again when next used.
+ * \ingroup mi2Index
+ */
+int miadd_header_index_attr(miheaderindex_t index, const char *path,
+                            const char *name);
+
+/** Bring the entries of \a n_files files up to date, reading the headers
+ * of the files that are new to the index or have changed on up to
+ * \a n_threads threads. If \a n_threads is zero, the number of threads
+ * is taken from the MINC_READ_THREADS configuration variable, or the
+ * number of online processors. Files are keyed by their path as given.
+ * Files that cannot be read are dropped from the index and the others
+ * still updated.
+ * \return The number of headers read, or MI_ERROR if any file could not
+ * be indexed.
+ * \ingroup mi2Index
+ */
+int miupdate_header_index(miheaderindex_t index, int n_files,
+                          const char *const files[], int n_threads);
+
+/** Write the index to its file if it has changed. The file is replaced
+ * as a whole, so that other readers never see it half written.
+ * \ingroup mi2Index
+ */
+int misave_header_index(miheaderindex_t index);
+
+/** Save the index if it has changed, and release it.
+ * \ingroup mi2Index
+ */
+int miclose_header_index(miheaderindex_t index);
+
+/** Get the sizes and, if \a names is not NULL, the names of the
+ * dimensions of \a file, in file order. Names must be freed with
+ * mifree_name(). A file missing from the index, or changed since it
+ * was indexed, is indexed first.
+ * \return The number of dimensions, or MI_ERROR.
+ * \ingroup mi2Index
+ */
+int miget_indexed_dimensions(miheaderindex_t index, const char *file,
+                             int array_length, misize_t sizes[], char *names[]);
+
+/** Get the voxel to world transform of \a file, as a 4 by 4 matrix
+ * mapping voxel coordinates in x, y, z order to world coordinates.
+ * \ingroup mi2Index
+ */
+int miget_indexed_voxel_to_world(miheaderindex_t index, const char *file,
+                                 double voxel_to_world[4][4]);
+
+/** Get the data type of the image of \a file.
+ * \ingroup mi2Index
+ */
+int miget_indexed_data_type(miheaderindex_t index, const char *file,
+                            mitype_t *data_type);
+
+/** Get the length of an attribute of \a file kept in the index, as
+ * miget_attr_length() does.
+ * \ingroup mi2Index
+ */
+int miget_indexed_attr_length(miheaderindex_t index, const char *file,
+                              const char *path, const char *name,
+                              size_t *length);
+
+/** Get the values of an attribute of \a file kept in the index, as
+ * miget_attr_values() does. Numeric attributes are kept as doubles and
+ * can be read as MI_TYPE_INT, MI_TYPE_FLOAT or MI_TYPE_DOUBLE.
+ * \ingroup mi2Index
+ */
+int miget_indexed_attr_values(miheaderindex_t index, const char *file,
+                              mitype_t data_type, const char *path,
+                              const char *name, size_t length, void *values);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus defined */
@@ -53,6 +53,32 @@ typedef long long mi_i64_t;
  */
 #define MI_FULLDIMENSIONS_PATH MI_ROOT_PATH "/dimensions"
 
+/** Direct chunk reads and writes are available since HDF5 1.10.3
+ */
+#if (H5_VERS_MAJOR > 1) || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR > 10) || \
+    (H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 3)
+#define MI2_DIRECT_CHUNK_IO 1
+#endif
+
+/** Instruction sets of the voxel scaling kernels.
+ */
+#define MI2_SIMD_NONE 0
+#define MI2_SIMD_SSE2 1
+#define MI2_SIMD_AVX2 2
+
+/** Longest filter pipeline handled by the direct chunk I/O functions.
+ */
+#define MI2_MAX_CHUNK_FILTERS 4
+
+/** Largest voxel type, in bytes, whose fill value is kept in a plan.
+ */
+#define MI2_MAX_FILL_BYTES 16
+
+/** Chunk length of the offsets, widths and slice ranges of an unlimited
+ * dimension.
+ */
+#define MI2_DIM_CHUNK_LENGTH 64
+
 /** \internal
  * Volume properties  
  */
@@ -60,7 +86,7 @@ struct mivolprops {
     miboolean_t enable_flag;    /* enable multi-res */
     int depth;                  /* multi-res depth */
     micompression_t compression_type;
-    int zlib_level; 
+    int zlib_level;             /* level of the selected codec */
     int edge_count;             /* how many chunks */
     int *edge_lengths;          /* size of each chunk */
     int max_lengths;
@@ -68,6 +94,11 @@ struct mivolprops {
     char *record_name;
     int  template_flag;
     int checksum;               /*FLETCHER32 checksum is enabled*/
+    int compression_threads;    /* threads compressing chunks on write */
+    int access_hint;            /* miaccess_hint_t flags */
+    misize_t chunk_bytes;       /* target chunk size for the access hint */
+    int stats_flags;            /* mistats_flags_t flags */
+    int stats_bins;             /* histogram bins of the statistics */
 }; 
 
 /** \internal
@@ -90,6 +121,8 @@ struct midimension {
   mihandle_t volume_handle;     /* Handle of associated volume */
   short world_index;            /* -1, MI2_X, MI2_Y, or MI2_Z */
   midimalign_t align;           /* MI_DIMALIGN_CENTRE, MI_DIMALIGN_START */
+  miboolean_t spacing_pending;  /* Offsets and widths not read yet */
+  miboolean_t unlimited;        /* Length grows as frames are appended */
 };
 
 /** \internal
@@ -109,6 +142,7 @@ struct mivolume {
   mi_lin_xfm_t v2w_transform;   /* Voxel-to-world transform */
   mi_lin_xfm_t w2v_transform;   /* World-to-voxel transform (inverse) */
   int selected_resolution;      /* The current resolution (0-N) */
+  int layout_generation;        /* Bumped when the apparent layout changes */
   int mode;                     /* Open mode */
   hid_t ftype_id;               /* File type ID of image. */
   hid_t mtype_id;               /* Memory type ID of image. */
@@ -119,6 +153,68 @@ struct mivolume {
   double scale_min;             /* Global minimum */
   double scale_max;             /* Global maximum */
   miboolean_t is_dirty;         /* TRUE if data has been modified. */
+  int read_threads;             /* Chunk decoding threads, 0 disables */
+  int write_threads;            /* Chunk encoding threads, 0 disables */
+  struct michunk_cache *chunk_cache; /* Chunk cache settings and counters */
+  struct miasync_queue *async;  /* Background reads, NULL until used */
+  miboolean_t concurrent_reads; /* TRUE if shared by reader threads */
+  struct mimapped_image *mapped; /* Mapped images, NULL until used */
+  struct mipyramid *pyramid;    /* Resolutions to rebuild, NULL until used */
+  struct mislice_range *slice_range; /* image-max/image-min, NULL until used */
+  struct mistats *stats;        /* Statistics of the writes, NULL until used */
+  miboolean_t image_pending;    /* Image datasets not opened yet */
+  miiostatistics_t *io_stats;   /* I/O counters, NULL until used */
+};
+
+/** \internal
+ * Prepared hyperslab plan
+ */
+struct mihyperplan {
+  mihandle_t volume;            /* Volume the plan belongs to */
+  mihyperslab_mode_t mode;      /* Value conversion performed */
+  mitype_t buffer_data_type;    /* Type of the user buffer */
+  int resolution;               /* Resolution selected when prepared */
+  int layout_generation;        /* Apparent layout when prepared */
+  int ndims;                    /* Number of dimensions */
+  misize_t count[MI2_MAX_VAR_DIMS];     /* Edge lengths, apparent order */
+  hsize_t hdf_count[MI2_MAX_VAR_DIMS];  /* Edge lengths, file order */
+  int dir[MI2_MAX_VAR_DIMS];    /* Direction vector in file order */
+  int n_different;              /* Non-zero if restructuring is needed */
+  int flip_only;                /* TRUE if restructuring only flips */
+  hsize_t hdf_start[MI2_MAX_VAR_DIMS];  /* Current origin, file order */
+  size_t icount[MI2_MAX_VAR_DIMS];      /* restructure_array() arguments */
+  int map[MI2_MAX_VAR_DIMS];            /* for reads */
+  size_t wcount[MI2_MAX_VAR_DIMS];      /* restructure_array() arguments */
+  int wmap[MI2_MAX_VAR_DIMS];           /* for writes */
+  int wdir[MI2_MAX_VAR_DIMS];
+  hid_t buffer_type_id;         /* HDF5 type of the user buffer */
+  size_t buffer_type_size;      /* Size of one buffer element */
+  hid_t fspc_id;                /* File dataspace of the image */
+  hid_t mspc_id;                /* Memory dataspace of the hyperslab */
+  misize_t buffer_size;         /* Bytes in the user buffer */
+  misize_t real_buffer_size;    /* Bytes in the buffer as doubles */
+  void *temp_buffer;            /* Scratch copy of the user buffer */
+  void *real_buffer;            /* Scratch buffer of doubles */
+  void *file_buffer;            /* Scratch buffer in the voxel type */
+  double data_min;              /* Normalization range */
+  double data_max;
+  miboolean_t slice_scaling;    /* TRUE if each slice has its own range */
+  int slice_ndims;              /* Dimensions of image-max/image-min */
+  hsize_t image_slice_count[MI2_MAX_VAR_DIMS];
+  hsize_t image_slice_length;   /* Voxels sharing one slice range */
+  hsize_t total_number_of_slices;
+  double *image_slice_max_buffer;
+  double *image_slice_min_buffer;
+  int chunk_io;                 /* TRUE if chunks can be accessed directly */
+  hsize_t chunk_dims[MI2_MAX_VAR_DIMS]; /* Chunk edge lengths */
+  hsize_t dset_dims[MI2_MAX_VAR_DIMS];  /* Image edge lengths */
+  hsize_t extent;               /* Slabs along the slowest dimension */
+  H5Z_filter_t chunk_filters[MI2_MAX_CHUNK_FILTERS]; /* Filter pipeline */
+  unsigned int chunk_filter_arg[MI2_MAX_CHUNK_FILTERS]; /* e.g. zlib level */
+  int n_chunk_filters;
+  hid_t file_type_id;           /* Type of the image in the file */
+  size_t file_type_size;
+  unsigned char fill_value[MI2_MAX_FILL_BYTES]; /* Value of unallocated chunks */
 };
 
 /**
@@ -137,6 +233,9 @@ int miget_attribute(mihandle_t volume, const char *varpath,
                            const char *attname, mitype_t data_type, 
                            size_t maxvals, void *values);
 
+int miget_attr_at_loc(hid_t hdf_loc, const char *attname,
+                      mitype_t data_type, size_t maxvals, void *values);
+
 int miset_attr_at_loc(hid_t hdf_loc, const char *attname, 
                              mitype_t data_type, 
                              size_t maxvals, const void *values);
@@ -164,12 +263,6 @@ void miinit_enum(hid_t);
 int miget_scalar(hid_t loc_id, hid_t type_id, const char *path, 
                         void *data);
 
-int minc_create_thumbnail(mihandle_t volume, int grp);
-
-int minc_update_thumbnail(mihandle_t volume, hid_t loc_id, int igrp, int ogrp);
-
-int minc_update_thumbnails(mihandle_t volume);
-
 
 int scaled_maximal_pivoting_gaussian_elimination(int   n,
                                                   int   row[],
@@ -201,8 +294,114 @@ int mitranslate_hyperslab_origin(mihandle_t volume,
                                 hsize_t* hdf_start,
                                 hsize_t* hdf_count,
                                 int* dir);
+/* From chunkio.c */
+typedef int (*michunk_task_t)(void *ctx, size_t index, void *scratch);
+
+int michunk_run(int n_threads, size_t n_tasks, size_t scratch_size,
+                michunk_task_t task, void *ctx);
+int michunk_default_threads(int cfg);
+int michunk_init_plan(mihyperplan_t plan);
+int miread_hyperslab_chunks(mihyperplan_t plan, hid_t mem_type_id, void *buffer,
+                            const int *dir);
+int miwrite_hyperslab_chunks(mihyperplan_t plan, hid_t mem_type_id, const void *buffer,
+                             const int *dir);
+
+/* From async.c */
+void miasync_close(mihandle_t volume);
+
+/* From concurrent.c */
+void mihdf_lock(mihandle_t volume);
+void mihdf_unlock(mihandle_t volume);
+void mihdf_lock_library(void);
+void mihdf_unlock_library(void);
+int micheck_not_concurrent(mihandle_t volume);
+
+/* From mapped.c */
+void mimapped_free(mihandle_t volume);
+
+/* From slice.c */
+int mislice_range_load(mihandle_t volume);
+int mislice_range_read(mihandle_t volume, const hsize_t start[],
+                       const hsize_t count[], double *slice_max,
+                       double *slice_min);
+int mislice_range_bounds(mihandle_t volume, double real_range[]);
+int mislice_range_flush(mihandle_t volume);
+void mislice_range_free(mihandle_t volume);
+int mislice_range_extend(mihandle_t volume, hsize_t n_slabs);
+
+/* From iostats.c */
+/** Stages of a transfer timed by the I/O statistics.
+ */
+typedef enum {
+  MIIO_READ,                    /* H5Dread() */
+  MIIO_WRITE,                   /* H5Dwrite() */
+  MIIO_CHUNK_READ,              /* Direct chunk reads, with decoding */
+  MIIO_CHUNK_WRITE,             /* Direct chunk writes, with encoding */
+  MIIO_SCALING,                 /* Conversion to or from real values */
+  MIIO_RESTRUCTURE,             /* Reordering to the apparent order */
+  MIIO_THUMBNAIL                /* Building reduced resolutions */
+} miio_timer_t;
+
+extern int miio_enabled;
+
+/** Start of a timed stage, 0.0 if the statistics are disabled.
+ */
+#define MIIO_START() (miio_enabled ? miio_clock() : 0.0)
+
+/** End of a timed stage started at \a start.
+ */
+#define MIIO_STOP(volume, timer, start) \
+  do { if (miio_enabled) miio_add_time((volume), (timer), (start)); } while (0)
+
+void miio_init(void);
+double miio_clock(void);
+void miio_add_time(mihandle_t volume, miio_timer_t timer, double start);
+void miio_count(mihyperplan_t plan, int write);
+void miio_close(mihandle_t volume);
+
+/* From stats.c */
+miboolean_t mistats_enabled(mihandle_t volume);
+void mistats_add(mihyperplan_t plan, mitype_t type, const void *values,
+                 miboolean_t voxel);
+void mistats_store(mihandle_t volume);
+void mistats_close(mihandle_t volume);
+int mistats_extend(mihandle_t volume, hsize_t n_slabs);
+
+/* From pyramid.c */
+int minc_create_thumbnail(mihandle_t volume, int grp);
+int minc_update_thumbnails(mihandle_t volume);
+void mipyramid_mark(mihandle_t volume, hsize_t first, hsize_t n_slabs,
+                    hsize_t slab_voxels);
+void mipyramid_free(mihandle_t volume);
+miboolean_t mipyramid_deferred(mihandle_t volume);
+
+/* From chunkcache.c */
+int michunk_cache_init(mihandle_t volume);
+int michunk_cache_fit(mihandle_t volume, const hsize_t count[]);
+void michunk_cache_free(mihandle_t volume);
+void michunk_cache_access(mihandle_t volume, const hsize_t start[], const hsize_t count[]);
+void michunk_cache_bypass(mihandle_t volume, size_t n_chunks);
+void michunk_cache_discard(mihandle_t volume, const hsize_t offset[]);
+void michunk_cache_extend(mihandle_t volume, hsize_t n_slabs);
+
+/* From scaling.c */
+int miset_scaling_simd(int level);
+int miapply_descaling(mitype_t type, void *buffer,
+                      hsize_t slice_length, hsize_t n_slices,
+                      const double *slice_min, const double *slice_max,
+                      double valid_min, double valid_max);
+int miapply_scaling(mitype_t type, void *buffer,
+                    hsize_t slice_length, hsize_t n_slices,
+                    const double *slice_min, const double *slice_max,
+                    double valid_min, double valid_max);
+
+/* From dimension.c */
+int miextend_dimension(midimhandle_t dimension, misize_t length);
+
 /* From volume.c */
 void misave_valid_range(mihandle_t volume);
+int miload_volume_image(mihandle_t volume);
+int miload_dimension_spacing(midimhandle_t hdim);
 
 /* From valid.c*/
 void miinit_default_range(mitype_t mitype, double *valid_max, double *valid_min);
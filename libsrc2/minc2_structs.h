@@ -14,6 +14,9 @@
 struct mivolprops;
 struct midimension;
 struct mivolume;
+struct mihyperplan;
+struct miasyncreq;
+struct mislabstream;
 
 /** \typedef mivolumeprops_t 
  * Opaque pointer to volume properties.
@@ -33,6 +36,30 @@ typedef struct midimension *midimhandle_t;
 typedef struct mivolume *mihandle_t;
 
 
+/** \typedef mihyperplan_t
+ * Opaque pointer to a prepared hyperslab transfer plan.
+ */
+typedef struct mihyperplan *mihyperplan_t;
+
+
+/** \typedef miasyncreq_t
+ * Opaque pointer to a hyperslab read started in the background.
+ */
+typedef struct miasyncreq *miasyncreq_t;
+
+
+/** \typedef mislabstream_t
+ * Opaque pointer to a stream of slabs read ahead in the background.
+ */
+typedef struct mislabstream *mislabstream_t;
+
+
+/** \typedef miheaderindex_t
+ * Opaque pointer to a persistent index of the headers of a set of files.
+ */
+typedef struct miheaderindex *miheaderindex_t;
+
+
 /** \typedef milisthandle_t 
  * The milisthandle_t is an opaque type that represents a handle 
  * to iterate through various properties of MINC file object.
@@ -149,9 +176,50 @@ typedef enum {
  */
 typedef enum {
   MI_COMPRESS_NONE = 0,         /**< No compression */
-  MI_COMPRESS_ZLIB = 1          /**< GZIP compression */
+  MI_COMPRESS_ZLIB = 1,         /**< GZIP compression */
+  MI_COMPRESS_SHUFFLE_ZLIB = 2, /**< Byte shuffle followed by GZIP */
+  MI_COMPRESS_LZ4 = 3,          /**< Byte shuffle followed by LZ4 (HDF5 plugin) */
+  MI_COMPRESS_ZSTD = 4          /**< Byte shuffle followed by Zstandard (HDF5 plugin) */
 } micompression_t;
 
+/** \typedef miaccess_hint_t
+ * Expected access patterns of a volume, combined with a bitwise or.
+ * Used to choose the chunk shape of volumes without explicit blocking.
+ */
+typedef enum {
+  MI_ACCESS_DEFAULT = 0,        /**< No hint, MINC 1.0 compatible chunks */
+  MI_ACCESS_SLICE = 1,          /**< Whole slices */
+  MI_ACCESS_BLOCK3D = 2,        /**< Compact 3D blocks */
+  MI_ACCESS_TIMESERIES = 4      /**< All time points of a few voxels */
+} miaccess_hint_t;
+
+/** \typedef mistats_flags_t
+ * Statistics kept of the values written to a volume, combined with a
+ * bitwise or. See miset_props_statistics().
+ */
+typedef enum {
+  MI_STATS_NONE = 0,            /**< No statistics */
+  MI_STATS_ACCUMULATE = 1,      /**< Accumulated as hyperslabs are written */
+  MI_STATS_STORE = 2            /**< Stored in the file when it is closed */
+} mistats_flags_t;
+
+/** \typedef mihyperslab_mode_t
+ * Kind of value conversion performed by a hyperslab plan
+ */
+typedef enum {
+  MI_HYPERSLAB_VOXEL = 0,       /**< Voxel values, no range conversion */
+  MI_HYPERSLAB_REAL = 1,        /**< Real values, using the volume scaling */
+  MI_HYPERSLAB_NORMALIZED = 2   /**< Real values mapped onto the buffer type range */
+} mihyperslab_mode_t;
+
+/** \typedef mihyperslab_op_t
+ * Direction of a hyperslab transfer
+ */
+typedef enum {
+  MI_HYPERSLAB_READ = 1,        /**< Read from the file */
+  MI_HYPERSLAB_WRITE = 2        /**< Write to the file */
+} mihyperslab_op_t;
+
 /** \typedef miboolean_t
  * Boolean value
  */
@@ -199,4 +267,36 @@ typedef struct {
   double imag;                  /**< Imaginary part */
 } midcomplex_t;
 
+/** \typedef mistatistics_t
+ * Statistics of the real values written to a volume or to one of its
+ * slices. See miget_volume_statistics().
+ */
+typedef struct {
+  misize_t count;               /**< Number of values */
+  double min;                   /**< Smallest value */
+  double max;                   /**< Largest value */
+  double sum;                   /**< Sum of the values */
+  double sum_squares;           /**< Sum of their squares */
+} mistatistics_t;
+
+/** \typedef miiostatistics_t
+ * Hyperslab transfers of a volume, or of the whole process, and the
+ * time spent in their stages. See miget_io_statistics().
+ */
+typedef struct {
+  misize_t hyperslab_reads;     /**< Hyperslabs read */
+  misize_t hyperslab_writes;    /**< Hyperslabs written */
+  misize_t bytes_read;          /**< Bytes of the buffers read */
+  misize_t bytes_written;       /**< Bytes of the buffers written */
+  misize_t chunks_read;         /**< Image chunks overlapped by the reads */
+  misize_t chunks_written;      /**< Image chunks overlapped by the writes */
+  double read_seconds;          /**< Time in H5Dread() */
+  double write_seconds;         /**< Time in H5Dwrite() */
+  double chunk_read_seconds;    /**< Time reading and decoding chunks directly */
+  double chunk_write_seconds;   /**< Time encoding and writing chunks directly */
+  double scaling_seconds;       /**< Time converting to or from real values */
+  double restructure_seconds;   /**< Time reordering to the apparent order */
+  double thumbnail_seconds;     /**< Time building reduced resolutions */
+} miiostatistics_t;
+
 #endif //MINC2_STRUCTS_H
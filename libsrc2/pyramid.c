@@ -0,0 +1,975 @@
+/** \file pyramid.c
+ * \brief MINC 2.0 multi-resolution images
+ *
+ * The reduced resolutions of a volume, image #1 (half resolution) down
+ * to image #N, are computed from the full resolution image in a single
+ * pass along the slowest-varying dimension. Each level is averaged from
+ * the level above it, two voxels along every dimension at a time, while
+ * the values stay in memory as doubles, so the full resolution image is
+ * read once and values are only rounded when they are written. The
+ * averaging is shared between worker threads.
+ *
+ * The full resolution image is divided into blocks of 2^N slabs, each
+ * averaged into one slab of the lowest resolution. Blocks are marked
+ * as they are written and only marked blocks are rebuilt. When
+ * incremental building is enabled, a block is rebuilt as soon as all
+ * of its voxels have been written, which leaves little to do when the
+ * volume is closed.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <hdf5.h>
+
+#include "minc_config.h"
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Upper bound on the memory used by a batch of full resolution slabs. */
+#define MI2_PYRAMID_BATCH_BYTES (32 * 1024 * 1024)
+
+/** Number of input voxels averaged by one task. */
+#define MI2_PYRAMID_TASK_VOXELS (64 * 1024)
+
+/** \internal
+ * Blocks of the full resolution image the reduced resolutions have to
+ * be rebuilt from.
+ */
+struct mipyramid {
+  int depth;                    /* Lowest resolution, 0 if there is none */
+  hsize_t n_slabs;              /* Slabs along the slowest dimension */
+  hsize_t slab_voxels;          /* Voxels in one slab */
+  hsize_t n_blocks;             /* Blocks of 2^depth slabs */
+  unsigned char *dirty;         /* Non-zero for blocks to rebuild */
+  hsize_t *written;             /* Voxels written to each block */
+  miboolean_t incremental;      /* TRUE to rebuild blocks once written */
+};
+
+/** \internal
+ * State of one rebuild. Levels down to batch_depth are computed for a
+ * whole batch of full resolution slabs at once, each deeper level
+ * accumulates one slab at a time.
+ */
+struct mipyramid_build {
+  int ndims;
+  int depth;                    /* Lowest resolution */
+  int batch_depth;              /* Levels computed a batch at a time */
+  hsize_t batch;                /* Full resolution slabs in a batch */
+  hsize_t dims[MI2_MAX_RESOLUTION_GROUP + 1][MI2_MAX_VAR_DIMS];
+  hsize_t slab_voxels[MI2_MAX_RESOLUTION_GROUP + 1];
+  double *data[MI2_MAX_RESOLUTION_GROUP + 1]; /* Slabs of each level */
+  hid_t image_id[MI2_MAX_RESOLUTION_GROUP + 1];
+  hid_t fspc_id[MI2_MAX_RESOLUTION_GROUP + 1];
+  hid_t imax_id[MI2_MAX_RESOLUTION_GROUP + 1];
+  hid_t imin_id[MI2_MAX_RESOLUTION_GROUP + 1];
+  miboolean_t own_image;        /* TRUE if image_id[0] was opened here */
+  miboolean_t integer;          /* TRUE if voxels are rounded */
+  miboolean_t slice_scaling;    /* TRUE if each slab has its own range */
+  double valid_min;             /* Voxel range */
+  double valid_max;
+  double volume_min;            /* Real range without slice scaling */
+  double volume_max;
+  double *range_max;            /* Full resolution image-max */
+  double *range_min;            /* Full resolution image-min */
+  hsize_t range_run;            /* Voxels sharing one real range */
+  hsize_t range_per_slab;       /* Real ranges in one slab */
+  double *slab_max;             /* Real range of the slabs written */
+  double *slab_min;
+  int n_threads;
+};
+
+/** \internal
+ * Averaging of slabs of one level into the next.
+ */
+struct mipyramid_reduce {
+  struct mipyramid_build *build;
+  int level;                    /* Level of the input slabs */
+  double *in;                   /* Input slabs */
+  hsize_t first;                /* Index of the first input slab */
+  hsize_t n_in;                 /* Number of input slabs */
+  double *out;                  /* Output slab of input slab first */
+  hsize_t rows;                 /* Output rows averaged by a task */
+  hsize_t n_row_blocks;         /* Tasks per output slab */
+};
+
+int minc_create_thumbnail ( mihandle_t volume, int grp )
+{
+  char path[MI2_MAX_PATH];
+  hid_t grp_id;
+
+  /* Don't handle negative or overly large numbers!
+  */
+  if ( grp <= 0 || grp > MI2_MAX_RESOLUTION_GROUP ) {
+    return ( MI_ERROR );
+  }
+
+  snprintf ( path, sizeof(path), MI_ROOT_PATH "/image/%d", grp );
+  grp_id = H5Gcreate2 ( volume->hdf_id, path, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+
+  if ( grp_id < 0 ) {
+    return ( MI_ERROR );
+  }
+
+  H5Gclose ( grp_id );
+  return ( MI_NOERROR );
+}
+
+/** Rows of a slab: its extent along the second slowest dimension.
+ */
+static hsize_t mipyramid_rows(const hsize_t dims[], int ndims)
+{
+  return (ndims > 1 ? dims[1] : 1);
+}
+
+/** Voxels in one row of a slab.
+ */
+static hsize_t mipyramid_row_voxels(const hsize_t dims[], int ndims)
+{
+  hsize_t n = 1;
+  int i;
+
+  for (i = 2; i < ndims; i++) {
+    n *= dims[i];
+  }
+  return n;
+}
+
+/** Sum neighbouring pairs along the middle dimension of \a in, an
+ * \a outer x \a n_in x \a inner array, into the \a outer x \a n_out x
+ * \a inner array \a out, adding to what \a out holds if \a add is set.
+ */
+static void mipyramid_pairs(const double *in, double *out, size_t outer,
+                            size_t n_in, size_t n_out, size_t inner, int add)
+{
+  size_t o, j, i;
+
+  for (o = 0; o < outer; o++) {
+    for (j = 0; j < n_out; j++) {
+      const double *p = in + (o * n_in + 2 * j) * inner;
+      const double *q = p + inner;
+      double *d = out + (o * n_out + j) * inner;
+
+      if (add) {
+        for (i = 0; i < inner; i++) {
+          d[i] += p[i] + q[i];
+        }
+      } else {
+        for (i = 0; i < inner; i++) {
+          d[i] = p[i] + q[i];
+        }
+      }
+    }
+  }
+}
+
+/** Sum the voxels of input slab \a in of \a level into rows [a, b) of
+ * output slab \a out, two voxels at a time along every dimension but
+ * the slowest one, one dimension after the other. The intermediate
+ * sums go to \a scratch.
+ */
+static void mipyramid_reduce_rows(const struct mipyramid_build *build, int level,
+                                  const double *in, double *out, hsize_t a, hsize_t b,
+                                  int add, double *scratch)
+{
+  const hsize_t *idims = build->dims[level];
+  const hsize_t *odims = build->dims[level + 1];
+  int ndims = build->ndims;
+  hsize_t shape[MI2_MAX_VAR_DIMS];
+  hsize_t half = (b - a) * mipyramid_row_voxels(idims, ndims);
+  const double *src;
+  double *dst;
+  hsize_t outer, inner, n_out;
+  int m, i;
+
+  if (ndims == 1) {
+    out[0] = add ? out[0] + in[0] : in[0];
+    return;
+  }
+
+  src = in + 2 * a * mipyramid_row_voxels(idims, ndims);
+  shape[1] = 2 * (b - a);
+  for (m = 2; m < ndims; m++) {
+    shape[m] = idims[m];
+  }
+
+  for (m = ndims - 1; m >= 1; m--) {
+    n_out = (m == 1) ? b - a : odims[m];
+    for (i = 1, outer = 1; i < m; i++) {
+      outer *= shape[i];
+    }
+    for (i = m + 1, inner = 1; i < ndims; i++) {
+      inner *= shape[i];
+    }
+    if (m == 1) {
+      mipyramid_pairs(src, out + a * inner, outer, shape[m], n_out, inner, add);
+    } else {
+      dst = (src == scratch) ? scratch + half : scratch;
+      mipyramid_pairs(src, dst, outer, shape[m], n_out, inner, FALSE);
+      src = dst;
+    }
+    shape[m] = n_out;
+  }
+}
+
+/** Convert voxels [begin, end) of full resolution slab \a slab from
+ * voxel to real values.
+ */
+static void mipyramid_to_real(const struct mipyramid_build *build, double *values,
+                              hsize_t slab, hsize_t begin, hsize_t end)
+{
+  double voxel_range = build->valid_max - build->valid_min;
+  hsize_t e = begin;
+
+  while (e < end) {
+    hsize_t run = e / build->range_run;
+    hsize_t stop = (run + 1) * build->range_run;
+    hsize_t k = slab * build->range_per_slab + run;
+    double scale = 0.0;
+    double offset;
+
+    if (voxel_range != 0.0) {
+      scale = (build->range_max[k] - build->range_min[k]) / voxel_range;
+    }
+    offset = build->range_min[k] - build->valid_min * scale;
+    if (stop > end) {
+      stop = end;
+    }
+    for (; e < stop; e++) {
+      values[e] = values[e] * scale + offset;
+    }
+  }
+}
+
+/** Average the input slabs of one output slab over a block of its rows.
+ */
+static int mipyramid_reduce_task(void *ctx, size_t index, void *scratch)
+{
+  struct mipyramid_reduce *reduce = (struct mipyramid_reduce *) ctx;
+  const struct mipyramid_build *build = reduce->build;
+  int level = reduce->level;
+  int ndims = build->ndims;
+  hsize_t p = index / reduce->n_row_blocks;
+  hsize_t a = (index % reduce->n_row_blocks) * reduce->rows;
+  hsize_t b = a + reduce->rows;
+  hsize_t g = reduce->first / 2 + p;
+  hsize_t row_voxels = mipyramid_row_voxels(build->dims[level + 1], ndims);
+  double *out = reduce->out + p * build->slab_voxels[level + 1];
+  double norm = ldexp(1.0, -ndims);
+  hsize_t i, e;
+
+  if (b > mipyramid_rows(build->dims[level + 1], ndims)) {
+    b = mipyramid_rows(build->dims[level + 1], ndims);
+  }
+
+  for (i = 2 * g; i < 2 * g + 2; i++) {
+    double *in;
+
+    if (i < reduce->first || i >= reduce->first + reduce->n_in) {
+      continue;
+    }
+    in = reduce->in + (i - reduce->first) * build->slab_voxels[level];
+
+    if (level == 0 && build->slice_scaling) {
+      if (ndims == 1) {
+        mipyramid_to_real(build, in, i, 0, 1);
+      } else {
+        hsize_t n = mipyramid_row_voxels(build->dims[0], ndims);
+        mipyramid_to_real(build, in, i, 2 * a * n, 2 * b * n);
+      }
+    }
+    mipyramid_reduce_rows(build, level, in, out, a, b, (i & 1) != 0, (double *) scratch);
+
+    /* The second slab completes the sums */
+    if ((i & 1) != 0) {
+      for (e = a * row_voxels; e < b * row_voxels; e++) {
+        out[e] *= norm;
+      }
+    }
+  }
+  return (MI_NOERROR);
+}
+
+/** Average \a n_in slabs of \a level, starting with slab \a first,
+ * into the slabs of the next level at \a out. Output slabs only get
+ * their final value once both of their input slabs have been added.
+ */
+static int mipyramid_reduce_slabs(struct mipyramid_build *build, int level, double *in,
+                                  hsize_t first, hsize_t n_in, double *out)
+{
+  struct mipyramid_reduce reduce;
+  int ndims = build->ndims;
+  hsize_t n_out = (first + n_in - 1) / 2 - first / 2 + 1;
+  hsize_t rows = mipyramid_rows(build->dims[level + 1], ndims);
+  hsize_t row_in = 4 * mipyramid_row_voxels(build->dims[level], ndims);
+  size_t scratch_size = 0;
+
+  if (n_in == 0 || first / 2 >= build->dims[level + 1][0]) {
+    return (MI_NOERROR);
+  }
+  if (first / 2 + n_out > build->dims[level + 1][0]) {
+    n_out = build->dims[level + 1][0] - first / 2;
+  }
+
+  reduce.build = build;
+  reduce.level = level;
+  reduce.in = in;
+  reduce.first = first;
+  reduce.n_in = n_in;
+  reduce.out = out;
+  reduce.rows = MI2_PYRAMID_TASK_VOXELS / row_in;
+  if (reduce.rows < 1) {
+    reduce.rows = 1;
+  }
+  if (reduce.rows > rows) {
+    reduce.rows = rows;
+  }
+  reduce.n_row_blocks = (rows + reduce.rows - 1) / reduce.rows;
+  if (ndims > 2) {
+    scratch_size = 2 * reduce.rows * mipyramid_row_voxels(build->dims[level], ndims) * sizeof(double);
+  }
+
+  return michunk_run(build->n_threads, n_out * reduce.n_row_blocks, scratch_size,
+                     mipyramid_reduce_task, &reduce);
+}
+
+/** Convert \a n slabs of \a level, starting with slab \a first, to voxel
+ * values and write them along with their real range.
+ */
+static int mipyramid_write(struct mipyramid_build *build, int level,
+                           hsize_t first, hsize_t n)
+{
+  hsize_t start[MI2_MAX_VAR_DIMS];
+  hsize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t sv = build->slab_voxels[level];
+  double voxel_range = build->valid_max - build->valid_min;
+  hid_t mspc_id;
+  hid_t tfspc_id;
+  hsize_t s, e;
+  int result;
+  int i;
+
+  if (n == 0) {
+    return (MI_NOERROR);
+  }
+
+  for (s = 0; s < n; s++) {
+    double *values = build->data[level] + s * sv;
+    double smin = build->volume_min;
+    double smax = build->volume_max;
+
+    if (build->slice_scaling) {
+      smin = smax = values[0];
+      for (e = 1; e < sv; e++) {
+        if (values[e] < smin) {
+          smin = values[e];
+        } else if (values[e] > smax) {
+          smax = values[e];
+        }
+      }
+      if (smax > smin) {
+        double scale = voxel_range / (smax - smin);
+        for (e = 0; e < sv; e++) {
+          values[e] = (values[e] - smin) * scale + build->valid_min;
+        }
+      } else {
+        for (e = 0; e < sv; e++) {
+          values[e] = build->valid_min;
+        }
+      }
+    }
+    if (build->integer) {
+      for (e = 0; e < sv; e++) {
+        values[e] = rint(values[e]);
+      }
+    }
+    build->slab_max[s] = smax;
+    build->slab_min[s] = smin;
+  }
+
+  start[0] = first;
+  count[0] = n;
+  for (i = 1; i < build->ndims; i++) {
+    start[i] = 0;
+    count[i] = build->dims[level][i];
+  }
+  MI_CHECK_HDF_CALL_RET(mspc_id = H5Screate_simple(build->ndims, count, NULL),"H5Screate_simple");
+  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(build->fspc_id[level], H5S_SELECT_SET,
+                                                 start, NULL, count, NULL),"H5Sselect_hyperslab");
+  if (result >= 0) {
+    MI_CHECK_HDF_CALL(result = H5Dwrite(build->image_id[level], H5T_NATIVE_DOUBLE, mspc_id,
+                                        build->fspc_id[level], H5P_DEFAULT,
+                                        build->data[level]),"H5Dwrite");
+  }
+  H5Sclose(mspc_id);
+  if (result < 0 || build->imax_id[level] < 0) {
+    return (result < 0 ? MI_ERROR : MI_NOERROR);
+  }
+
+  MI_CHECK_HDF_CALL_RET(mspc_id = H5Screate_simple(1, &n, NULL),"H5Screate_simple");
+  tfspc_id = H5Dget_space(build->imax_id[level]);
+  MI_CHECK_HDF_CALL(result = H5Sselect_hyperslab(tfspc_id, H5S_SELECT_SET, &first, NULL,
+                                                 &n, NULL),"H5Sselect_hyperslab");
+  if (result >= 0) {
+    MI_CHECK_HDF_CALL(result = H5Dwrite(build->imax_id[level], H5T_NATIVE_DOUBLE, mspc_id,
+                                        tfspc_id, H5P_DEFAULT, build->slab_max),"H5Dwrite");
+  }
+  if (result >= 0) {
+    MI_CHECK_HDF_CALL(result = H5Dwrite(build->imin_id[level], H5T_NATIVE_DOUBLE, mspc_id,
+                                        tfspc_id, H5P_DEFAULT, build->slab_min),"H5Dwrite");
+  }
+  H5Sclose(tfspc_id);
+  H5Sclose(mspc_id);
+  return (result < 0 ? MI_ERROR : MI_NOERROR);
+}
+
+/** Create dataset \a name in \a loc_id, or open it if it exists.
+ */
+static hid_t mipyramid_dataset(hid_t loc_id, const char *name, hid_t type_id,
+                               int ndims, const hsize_t dims[])
+{
+  hid_t dset_id;
+  hid_t fspc_id;
+
+  H5E_BEGIN_TRY {
+    dset_id = H5Dopen1(loc_id, name);
+  } H5E_END_TRY;
+  if (dset_id >= 0) {
+    return dset_id;
+  }
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Screate_simple(ndims, dims, NULL),"H5Screate_simple");
+  MI_CHECK_HDF_CALL(dset_id = H5Dcreate1(loc_id, name, type_id, fspc_id, H5P_DEFAULT),"H5Dcreate1");
+  H5Sclose(fspc_id);
+  return dset_id;
+}
+
+static void mipyramid_build_free(struct mipyramid_build *build)
+{
+  int level;
+
+  for (level = 0; level <= build->depth; level++) {
+    free(build->data[level]);
+    if (build->fspc_id[level] >= 0) {
+      H5Sclose(build->fspc_id[level]);
+    }
+    if (build->imax_id[level] >= 0) {
+      H5Dclose(build->imax_id[level]);
+    }
+    if (build->imin_id[level] >= 0) {
+      H5Dclose(build->imin_id[level]);
+    }
+    if (build->image_id[level] >= 0 && (level > 0 || build->own_image)) {
+      H5Dclose(build->image_id[level]);
+    }
+  }
+  free(build->range_max);
+  free(build->range_min);
+  free(build->slab_max);
+  free(build->slab_min);
+}
+
+/** Read the real range of every full resolution slice.
+ */
+static int mipyramid_load_ranges(struct mipyramid_build *build, hid_t grp_id)
+{
+  hid_t max_id, min_id, fspc_id;
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hsize_t n = 1;
+  int ndims;
+  int i;
+  int result;
+
+  MI_CHECK_HDF_CALL_RET(max_id = H5Dopen1(grp_id, "0/image-max"),"H5Dopen1");
+  MI_CHECK_HDF_CALL(min_id = H5Dopen1(grp_id, "0/image-min"),"H5Dopen1");
+  if (min_id < 0) {
+    H5Dclose(max_id);
+    return (MI_ERROR);
+  }
+  fspc_id = H5Dget_space(max_id);
+  ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  if (ndims > build->ndims) {
+    ndims = build->ndims;
+  }
+
+  build->slice_scaling = (ndims > 0);
+  if (build->slice_scaling) {
+    build->range_run = 1;
+    build->range_per_slab = 1;
+    for (i = 0; i < build->ndims; i++) {
+      if (i < ndims) {
+        n *= build->dims[0][i];
+        if (i > 0) {
+          build->range_per_slab *= build->dims[0][i];
+        }
+      } else {
+        build->range_run *= build->dims[0][i];
+      }
+    }
+    build->range_max = (double *) malloc(n * sizeof(double));
+    build->range_min = (double *) malloc(n * sizeof(double));
+    if (build->range_max == NULL || build->range_min == NULL) {
+      H5Dclose(max_id);
+      H5Dclose(min_id);
+      return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n * sizeof(double)));
+    }
+    MI_CHECK_HDF_CALL(result = H5Dread(max_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                                       H5P_DEFAULT, build->range_max),"H5Dread");
+    if (result >= 0) {
+      MI_CHECK_HDF_CALL(result = H5Dread(min_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                                         H5P_DEFAULT, build->range_min),"H5Dread");
+    }
+  } else {
+    result = 0;
+  }
+  H5Dclose(max_id);
+  H5Dclose(min_id);
+  return (result < 0 ? MI_ERROR : MI_NOERROR);
+}
+
+/** Open the levels of the rebuild of \a volume down to \a depth,
+ * creating the datasets of the reduced resolutions as needed.
+ */
+static int mipyramid_build_init(mihandle_t volume, struct mipyramid_build *build,
+                                int depth)
+{
+  hid_t grp_id;
+  hid_t type_id;
+  char path[MI2_MAX_PATH];
+  size_t slab_bytes;
+  int level;
+  int i;
+  int result = MI_NOERROR;
+
+  memset(build, 0, sizeof(*build));
+  for (level = 0; level <= MI2_MAX_RESOLUTION_GROUP; level++) {
+    build->image_id[level] = -1;
+    build->fspc_id[level] = -1;
+    build->imax_id[level] = -1;
+    build->imin_id[level] = -1;
+  }
+
+  MI_CHECK_HDF_CALL_RET(grp_id = H5Gopen1(volume->hdf_id, MI_ROOT_PATH "/image"),"H5Gopen1");
+
+  if (volume->selected_resolution == 0 && volume->image_id >= 0) {
+    build->image_id[0] = volume->image_id;
+  } else {
+    MI_CHECK_HDF_CALL(build->image_id[0] = H5Dopen1(grp_id, "0/image"),"H5Dopen1");
+    build->own_image = TRUE;
+  }
+  if (build->image_id[0] < 0) {
+    H5Gclose(grp_id);
+    return (MI_ERROR);
+  }
+  build->fspc_id[0] = H5Dget_space(build->image_id[0]);
+  build->ndims = H5Sget_simple_extent_dims(build->fspc_id[0], build->dims[0], NULL);
+  if (build->ndims <= 0) {
+    H5Gclose(grp_id);
+    return (MI_ERROR);
+  }
+  build->depth = depth;
+
+  type_id = H5Dget_type(build->image_id[0]);
+  build->integer = (H5Tget_class(type_id) == H5T_INTEGER);
+  build->valid_min = volume->valid_min;
+  build->valid_max = volume->valid_max;
+  build->volume_min = volume->scale_min;
+  build->volume_max = volume->scale_max;
+  build->n_threads = michunk_default_threads(MICFG_PYRAMID_THREADS);
+  if (build->n_threads < 1) {
+    build->n_threads = 1;
+  }
+
+  for (level = 0; level <= depth; level++) {
+    build->slab_voxels[level] = 1;
+    for (i = 0; i < build->ndims; i++) {
+      if (level > 0) {
+        build->dims[level][i] = build->dims[level - 1][i] / 2;
+      }
+      if (i > 0) {
+        build->slab_voxels[level] *= build->dims[level][i];
+      }
+    }
+  }
+
+  for (level = 1; level <= depth && result == MI_NOERROR; level++) {
+    snprintf(path, sizeof(path), "%d/image", level);
+    build->image_id[level] = mipyramid_dataset(grp_id, path, type_id, build->ndims,
+                                               build->dims[level]);
+    if (build->image_id[level] < 0) {
+      result = MI_ERROR;
+      break;
+    }
+    build->fspc_id[level] = H5Dget_space(build->image_id[level]);
+
+    if (volume->volume_class == MI_CLASS_REAL) {
+      snprintf(path, sizeof(path), "%d/image-max", level);
+      build->imax_id[level] = mipyramid_dataset(grp_id, path, H5T_IEEE_F64LE, 1,
+                                                build->dims[level]);
+      snprintf(path, sizeof(path), "%d/image-min", level);
+      build->imin_id[level] = mipyramid_dataset(grp_id, path, H5T_IEEE_F64LE, 1,
+                                                build->dims[level]);
+      if (build->imax_id[level] < 0 || build->imin_id[level] < 0) {
+        result = MI_ERROR;
+      }
+    }
+  }
+  H5Tclose(type_id);
+
+  if (result == MI_NOERROR && volume->volume_class == MI_CLASS_REAL &&
+      volume->has_slice_scaling) {
+    result = mipyramid_load_ranges(build, grp_id);
+  }
+  H5Gclose(grp_id);
+  if (result < 0) {
+    return (MI_ERROR);
+  }
+
+  /* As many levels as fit in memory are computed for a batch of slabs */
+  slab_bytes = build->slab_voxels[0] * sizeof(double);
+  build->batch_depth = 1;
+  while (build->batch_depth < depth &&
+         (slab_bytes << (build->batch_depth + 1)) <= MI2_PYRAMID_BATCH_BYTES) {
+    build->batch_depth++;
+  }
+  build->batch = (hsize_t) 1 << build->batch_depth;
+
+  for (level = 0; level <= depth; level++) {
+    hsize_t n = (level <= build->batch_depth) ? build->batch >> level : 1;
+    build->data[level] = (double *) malloc(n * build->slab_voxels[level] * sizeof(double));
+    if (build->data[level] == NULL) {
+      return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n * build->slab_voxels[level] * sizeof(double)));
+    }
+  }
+  build->slab_max = (double *) malloc(build->batch * sizeof(double));
+  build->slab_min = (double *) malloc(build->batch * sizeof(double));
+  if (build->slab_max == NULL || build->slab_min == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (build->batch * sizeof(double)));
+  }
+  return (MI_NOERROR);
+}
+
+/** Rebuild the reduced resolutions of full resolution slabs [begin, end),
+ * where \a begin is the first slab of a block.
+ */
+static int mipyramid_build_slabs(mihandle_t volume, int depth, hsize_t begin, hsize_t end)
+{
+  struct mipyramid_build build;
+  hsize_t first[MI2_MAX_RESOLUTION_GROUP + 1];
+  hsize_t n[MI2_MAX_RESOLUTION_GROUP + 1];
+  hsize_t start[MI2_MAX_VAR_DIMS];
+  hsize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t slab;
+  hid_t mspc_id;
+  int result;
+  int level;
+  int i;
+
+  /* The full resolution ranges are read from the file */
+  if (mislice_range_flush(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (mipyramid_build_init(volume, &build, depth) < 0) {
+    mipyramid_build_free(&build);
+    return (MI_ERROR);
+  }
+
+  for (i = 1; i < build.ndims; i++) {
+    start[i] = 0;
+    count[i] = build.dims[0][i];
+  }
+
+  result = MI_NOERROR;
+  for (slab = begin; slab < end && result == MI_NOERROR; slab += build.batch) {
+    start[0] = slab;
+    count[0] = (end - slab < build.batch) ? end - slab : build.batch;
+
+    MI_CHECK_HDF_CALL(mspc_id = H5Screate_simple(build.ndims, count, NULL),"H5Screate_simple");
+    if (mspc_id < 0) {
+      result = MI_ERROR;
+      break;
+    }
+    if (H5Sselect_hyperslab(build.fspc_id[0], H5S_SELECT_SET, start, NULL, count, NULL) < 0 ||
+        H5Dread(build.image_id[0], H5T_NATIVE_DOUBLE, mspc_id, build.fspc_id[0],
+                H5P_DEFAULT, build.data[0]) < 0) {
+      result = MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to read the full resolution image");
+    }
+    H5Sclose(mspc_id);
+
+    /* The levels computed for the whole batch, each of them from the
+     * complete slabs of the level above.
+     */
+    first[0] = slab;
+    n[0] = count[0];
+    for (level = 0; level < depth && result == MI_NOERROR; level++) {
+      double *out = build.data[level + 1];
+
+      first[level + 1] = first[level] / 2;
+      n[level + 1] = 0;
+      if (n[level] == 0) {
+        continue;
+      }
+      if (level >= build.batch_depth) {
+        /* A single slab added to the accumulated one */
+        if (mipyramid_reduce_slabs(&build, level, build.data[level], first[level], 1, out) < 0) {
+          result = MI_ERROR;
+        }
+        if ((first[level] & 1) != 0 && first[level + 1] < build.dims[level + 1][0]) {
+          n[level + 1] = 1;
+        }
+      } else {
+        if (mipyramid_reduce_slabs(&build, level, build.data[level], first[level],
+                                   n[level] & ~(hsize_t) 1, out) < 0) {
+          result = MI_ERROR;
+        }
+        n[level + 1] = n[level] / 2;
+        if (first[level + 1] + n[level + 1] > build.dims[level + 1][0]) {
+          n[level + 1] = first[level + 1] < build.dims[level + 1][0] ?
+                         build.dims[level + 1][0] - first[level + 1] : 0;
+        }
+      }
+    }
+
+    for (level = 1; level <= depth && result == MI_NOERROR; level++) {
+      result = mipyramid_write(&build, level, first[level], n[level]);
+    }
+  }
+
+  mipyramid_build_free(&build);
+  return (result);
+}
+
+/** Find the reduced resolutions of \a volume and mark all of its blocks
+ * for rebuilding.
+ */
+static int mipyramid_init(mihandle_t volume)
+{
+  struct mipyramid *pyramid;
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  char name[MI2_MAX_PATH];
+  hid_t grp_id, dset_id, fspc_id;
+  htri_t exists;
+  int ndims;
+  int i;
+
+  if (volume->pyramid != NULL) {
+    return (MI_NOERROR);
+  }
+
+  H5E_BEGIN_TRY {
+    grp_id = H5Gopen1(volume->hdf_id, MI_ROOT_PATH "/image");
+    dset_id = (grp_id >= 0) ? H5Dopen1(grp_id, "0/image") : -1;
+  } H5E_END_TRY;
+  if (dset_id < 0) {
+    if (grp_id >= 0) {
+      H5Gclose(grp_id);
+    }
+    return (MI_ERROR);
+  }
+  fspc_id = H5Dget_space(dset_id);
+  ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  H5Dclose(dset_id);
+
+  pyramid = (struct mipyramid *) calloc(1, sizeof(struct mipyramid));
+  if (pyramid == NULL) {
+    H5Gclose(grp_id);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) sizeof(struct mipyramid));
+  }
+
+  for (pyramid->depth = 0; pyramid->depth < MI2_MAX_RESOLUTION_GROUP; pyramid->depth++) {
+    snprintf(name, sizeof(name), "%d", pyramid->depth + 1);
+    H5E_BEGIN_TRY {
+      exists = H5Lexists(grp_id, name, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if (exists <= 0) {
+      break;
+    }
+  }
+  H5Gclose(grp_id);
+
+  /* Resolutions with no voxels left along some dimension are not built */
+  for (i = 0; i < ndims; i++) {
+    while (pyramid->depth > 0 && (dims[i] >> pyramid->depth) == 0) {
+      pyramid->depth--;
+    }
+  }
+  if (ndims <= 0) {
+    pyramid->depth = 0;
+  }
+
+  if (pyramid->depth > 0) {
+    pyramid->n_slabs = dims[0];
+    pyramid->slab_voxels = 1;
+    for (i = 1; i < ndims; i++) {
+      pyramid->slab_voxels *= dims[i];
+    }
+    pyramid->n_blocks = ((dims[0] - 1) >> pyramid->depth) + 1;
+    pyramid->dirty = (unsigned char *) malloc(pyramid->n_blocks);
+    pyramid->written = (hsize_t *) calloc(pyramid->n_blocks, sizeof(hsize_t));
+    if (pyramid->dirty == NULL || pyramid->written == NULL) {
+      size_t size = pyramid->n_blocks * sizeof(hsize_t);
+
+      free(pyramid->dirty);
+      free(pyramid->written);
+      free(pyramid);
+      return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) size);
+    }
+    memset(pyramid->dirty, 1, pyramid->n_blocks);
+  }
+  volume->pyramid = pyramid;
+  return (MI_NOERROR);
+}
+
+/** Rebuild blocks [b0, b1) of the reduced resolutions.
+ */
+static int mipyramid_build_blocks(mihandle_t volume, hsize_t b0, hsize_t b1)
+{
+  struct mipyramid *pyramid = volume->pyramid;
+  hsize_t end = b1 << pyramid->depth;
+  hsize_t b;
+  double t0 = MIIO_START();
+  int result;
+
+  if (end > pyramid->n_slabs) {
+    end = pyramid->n_slabs;
+  }
+  result = mipyramid_build_slabs(volume, pyramid->depth, b0 << pyramid->depth, end);
+  MIIO_STOP(volume, MIIO_THUMBNAIL, t0);
+  if (result < 0) {
+    return (MI_ERROR);
+  }
+  for (b = b0; b < b1; b++) {
+    pyramid->dirty[b] = 0;
+    pyramid->written[b] = 0;
+  }
+  return (MI_NOERROR);
+}
+
+/** Return TRUE if the reduced resolutions of \a volume can only be built
+ * when it is closed, because frames may still be appended to it.
+ */
+miboolean_t mipyramid_deferred(mihandle_t volume)
+{
+  return ((volume->mode & MI2_OPEN_RDWR) != 0 && volume->number_of_dims > 0 &&
+          volume->dim_handles != NULL && volume->dim_handles[0]->unlimited);
+}
+
+/** Record that \a n_slabs full resolution slabs starting with slab
+ * \a first changed, \a slab_voxels voxels of each of them written, so
+ * that their reduced resolutions get rebuilt.
+ */
+void mipyramid_mark(mihandle_t volume, hsize_t first, hsize_t n_slabs,
+                    hsize_t slab_voxels)
+{
+  struct mipyramid *pyramid;
+  hsize_t b, lo, hi, end;
+
+  volume->is_dirty = TRUE;
+  if (mipyramid_deferred(volume)) {
+    return;
+  }
+  if (volume->pyramid == NULL && mipyramid_init(volume) < 0) {
+    return;
+  }
+  pyramid = volume->pyramid;
+  if (pyramid->depth == 0 || n_slabs == 0) {
+    return;
+  }
+
+  for (b = first >> pyramid->depth;
+       b <= (first + n_slabs - 1) >> pyramid->depth && b < pyramid->n_blocks; b++) {
+    pyramid->dirty[b] = 1;
+    if (!pyramid->incremental || slab_voxels == 0) {
+      continue;
+    }
+    lo = b << pyramid->depth;
+    hi = (b + 1) << pyramid->depth;
+    end = (hi < pyramid->n_slabs) ? hi : pyramid->n_slabs;
+    pyramid->written[b] += ((first + n_slabs < hi ? first + n_slabs : hi) -
+                            (first > lo ? first : lo)) * slab_voxels;
+
+    /* Rebuilt as soon as every voxel has been written. If some were
+     * written twice this may happen too early, the block is then
+     * marked again by the remaining writes.
+     */
+    if (pyramid->written[b] >= (end - lo) * pyramid->slab_voxels) {
+      mipyramid_build_blocks(volume, b, b + 1);
+    }
+  }
+}
+
+/** Rebuild the reduced resolutions of every block of the full
+ * resolution image marked since they were last built.
+ */
+int minc_update_thumbnails ( mihandle_t volume )
+{
+  struct mipyramid *pyramid;
+  hsize_t b, e;
+  int result = MI_NOERROR;
+
+  if (volume->pyramid == NULL && mipyramid_init(volume) < 0) {
+    return (MI_ERROR);
+  }
+  pyramid = volume->pyramid;
+
+  for (b = 0; b < pyramid->n_blocks; b = e) {
+    for (e = b + 1; e < pyramid->n_blocks && pyramid->dirty[e] == pyramid->dirty[b]; e++)
+      ;
+    if (pyramid->dirty[b] && mipyramid_build_blocks(volume, b, e) < 0) {
+      result = MI_ERROR;
+    }
+  }
+  return (result);
+}
+
+void mipyramid_free(mihandle_t volume)
+{
+  if (volume->pyramid != NULL) {
+    free(volume->pyramid->dirty);
+    free(volume->pyramid->written);
+    free(volume->pyramid);
+    volume->pyramid = NULL;
+  }
+}
+
+/** Rebuild the reduced resolutions of \a volume while it is written,
+ * block by block as soon as every voxel of a block has been written,
+ * instead of all at once when it is closed or a reduced resolution is
+ * selected. The volume must be open for writing and its image created.
+ */
+int miset_volume_incremental_resolution(mihandle_t volume, miboolean_t enable)
+{
+  if (volume == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to set incremental resolutions of a null volume");
+  }
+  if ((volume->mode & MI2_OPEN_RDWR) == 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only volumes opened for writing can build resolutions incrementally");
+  }
+  if (mipyramid_deferred(volume)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Resolutions of a volume with an unlimited dimension are built when it is closed");
+  }
+  if (mipyramid_init(volume) < 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume image has to be created before building resolutions incrementally");
+  }
+  volume->pyramid->incremental = enable ? TRUE : FALSE;
+  return (MI_NOERROR);
+}
+
+/** Get whether the reduced resolutions of \a volume are rebuilt while
+ * it is written.
+ */
+int miget_volume_incremental_resolution(mihandle_t volume, miboolean_t *enabled)
+{
+  if (volume == NULL || enabled == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get incremental resolutions with null volume or null variables");
+  }
+  *enabled = (volume->pyramid != NULL && volume->pyramid->incremental);
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -31,6 +31,9 @@ int miget_record_length(mihandle_t volume,
     if (volume == NULL || length == NULL) {
         return (MI_ERROR);
     }
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
     if (volume->volume_class == MI_CLASS_UNIFORM_RECORD ||
         volume->volume_class == MI_CLASS_NON_UNIFORM_RECORD) {
         *length = H5Tget_nmembers(volume->ftype_id);
@@ -50,6 +53,9 @@ int miget_record_field_name(mihandle_t volume,
     if (volume == NULL || name == NULL) {
         return (MI_ERROR);
     }
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
     /* Get the field name.  The H5Tget_member_name() function allocates
      * the memory for the string using malloc(), so we can return the 
      * pointer directly without any further manipulations.
@@ -76,6 +82,9 @@ int miset_record_field_name(mihandle_t volume,
     if (volume == NULL || name == NULL) {
         return (MI_ERROR);
     }
+    if (miload_volume_image(volume) < 0) {
+        return (MI_ERROR);
+    }
     if (volume->volume_class != MI_CLASS_UNIFORM_RECORD &&
         volume->volume_class != MI_CLASS_NON_UNIFORM_RECORD) {
         return (MI_ERROR);
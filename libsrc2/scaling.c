@@ -0,0 +1,590 @@
+/** \file scaling.c
+ * \brief MINC 2.0 voxel scaling kernels
+ *
+ * Functions to map voxel values between the valid range of a volume and
+ * the real range of each slice, in place in a buffer of any numeric
+ * type. Every type has a scalar kernel and, on x86, SSE2 and AVX2
+ * kernels chosen at run time. The vector kernels perform the same
+ * double precision operations in the same order as the scalar ones,
+ * and convert back with the same rounding, so the results are
+ * identical.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
+#include "minc_config.h"
+#include "minc2.h"
+#include "minc2_private.h"
+
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MI2_SCALING_X86 1
+#include <immintrin.h>
+#define MI2_TARGET_SSE2 __attribute__((target("sse2")))
+#define MI2_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/** Scale \a n voxels of \a buffer in place with \a scale and \a offset.
+ */
+typedef void (*miscale_kernel_t)(void *buffer, size_t n, double scale, double offset);
+
+/** Kernel table entries, in the order of the kernel tables below.
+ */
+enum {
+  MI2_KERNEL_BYTE = 0,
+  MI2_KERNEL_UBYTE,
+  MI2_KERNEL_SHORT,
+  MI2_KERNEL_USHORT,
+  MI2_KERNEL_INT,
+  MI2_KERNEL_UINT,
+  MI2_KERNEL_FLOAT,
+  MI2_KERNEL_DOUBLE,
+  MI2_KERNEL_COUNT
+};
+
+/* Scalar kernels. Converting to the file range rounds to the nearest
+ * integer with rint(), converting from it truncates.
+ */
+#define MISCALE_SCALAR_KERNELS(name, type) \
+  static void midescale_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    size_t i; \
+    for (i = 0; i < n; i++) { \
+      p[i] = (type) ((double) p[i] * scale + offset); \
+    } \
+  } \
+  static void miscale_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    size_t i; \
+    for (i = 0; i < n; i++) { \
+      p[i] = (type) rint((double) p[i] * scale - offset); \
+    } \
+  }
+
+MISCALE_SCALAR_KERNELS(byte, signed char)
+MISCALE_SCALAR_KERNELS(ubyte, unsigned char)
+MISCALE_SCALAR_KERNELS(short, short)
+MISCALE_SCALAR_KERNELS(ushort, unsigned short)
+MISCALE_SCALAR_KERNELS(int, int)
+MISCALE_SCALAR_KERNELS(uint, unsigned int)
+MISCALE_SCALAR_KERNELS(float, float)
+MISCALE_SCALAR_KERNELS(double, double)
+
+static const miscale_kernel_t midescale_scalar[MI2_KERNEL_COUNT] = {
+  midescale_byte, midescale_ubyte, midescale_short, midescale_ushort,
+  midescale_int, midescale_uint, midescale_float, midescale_double
+};
+
+static const miscale_kernel_t miscale_scalar[MI2_KERNEL_COUNT] = {
+  miscale_byte, miscale_ubyte, miscale_short, miscale_ushort,
+  miscale_int, miscale_uint, miscale_float, miscale_double
+};
+
+#ifdef MI2_SCALING_X86
+
+/* Vector kernels process whole vectors and leave the remainder to the
+ * scalar kernel of the same type. Integers are converted back through
+ * 32 bit integers, truncated (cvtt) or rounded in the current rounding
+ * mode like rint() (cvt), then narrowed by dropping the high bits,
+ * which is what the C casts of the scalar kernels compile to. Unsigned
+ * int goes through 64 bit integers in C, and has no vector kernel.
+ */
+/* SSE2, four voxels at a time in two vectors */
+
+#define MISCALE_SSE2_KERNELS(name, type) \
+  static MI2_TARGET_SSE2 void midescale_sse2_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    const __m128d vs = _mm_set1_pd(scale); \
+    const __m128d vo = _mm_set1_pd(offset); \
+    __m128d lo, hi; \
+    size_t i; \
+    for (i = 0; i + 4 <= n; i += 4) { \
+      sse2_load_##name(p + i, &lo, &hi); \
+      sse2_cvtt_##name(p + i, _mm_add_pd(_mm_mul_pd(lo, vs), vo), \
+                       _mm_add_pd(_mm_mul_pd(hi, vs), vo)); \
+    } \
+    midescale_##name(p + i, n - i, scale, offset); \
+  } \
+  static MI2_TARGET_SSE2 void miscale_sse2_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    const __m128d vs = _mm_set1_pd(scale); \
+    const __m128d vo = _mm_set1_pd(offset); \
+    __m128d lo, hi; \
+    size_t i; \
+    for (i = 0; i + 4 <= n; i += 4) { \
+      sse2_load_##name(p + i, &lo, &hi); \
+      sse2_cvt_##name(p + i, _mm_sub_pd(_mm_mul_pd(lo, vs), vo), \
+                      _mm_sub_pd(_mm_mul_pd(hi, vs), vo)); \
+    } \
+    miscale_##name(p + i, n - i, scale, offset); \
+  }
+
+/* rint() for |x| < 2^52, where adding and removing 2^52 with the sign of
+ * x rounds to an integer in the current rounding mode. Larger values,
+ * infinities and NaN are left alone, and the sign is kept for -0.
+ */
+static inline MI2_TARGET_SSE2 __m128d sse2_rint(__m128d v)
+{
+  const __m128d sign = _mm_set1_pd(-0.0);
+  const __m128d big = _mm_set1_pd(4503599627370496.0);
+  __m128d s = _mm_and_pd(v, sign);
+  __m128d c = _mm_or_pd(big, s);
+  __m128d r = _mm_or_pd(_mm_sub_pd(_mm_add_pd(v, c), c), s);
+  __m128d small = _mm_cmplt_pd(_mm_andnot_pd(sign, v), big);
+  return _mm_or_pd(_mm_and_pd(small, r), _mm_andnot_pd(small, v));
+}
+
+static inline MI2_TARGET_SSE2 __m128i sse2_load4(const void *p)
+{
+  int x;
+  memcpy(&x, p, 4);
+  return _mm_cvtsi32_si128(x);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_widen(__m128i x, __m128d *lo, __m128d *hi)
+{
+  *lo = _mm_cvtepi32_pd(x);
+  *hi = _mm_cvtepi32_pd(_mm_srli_si128(x, 8));
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_byte(const signed char *p, __m128d *lo, __m128d *hi)
+{
+  __m128i x = sse2_load4(p);
+  x = _mm_unpacklo_epi8(x, x);
+  sse2_widen(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 24), lo, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_ubyte(const unsigned char *p, __m128d *lo, __m128d *hi)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i x = _mm_unpacklo_epi8(sse2_load4(p), zero);
+  sse2_widen(_mm_unpacklo_epi16(x, zero), lo, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_short(const short *p, __m128d *lo, __m128d *hi)
+{
+  __m128i x = _mm_loadl_epi64((const __m128i *) p);
+  sse2_widen(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16), lo, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_ushort(const unsigned short *p, __m128d *lo, __m128d *hi)
+{
+  __m128i x = _mm_loadl_epi64((const __m128i *) p);
+  sse2_widen(_mm_unpacklo_epi16(x, _mm_setzero_si128()), lo, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_int(const int *p, __m128d *lo, __m128d *hi)
+{
+  sse2_widen(_mm_loadu_si128((const __m128i *) p), lo, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_float(const float *p, __m128d *lo, __m128d *hi)
+{
+  __m128 x = _mm_loadu_ps(p);
+  *lo = _mm_cvtps_pd(x);
+  *hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+}
+
+static inline MI2_TARGET_SSE2 void sse2_load_double(const double *p, __m128d *lo, __m128d *hi)
+{
+  *lo = _mm_loadu_pd(p);
+  *hi = _mm_loadu_pd(p + 2);
+}
+
+/* Keeping the low bits of each 32 bit integer, sign extended, makes the
+ * saturating packs exact.
+ */
+static inline MI2_TARGET_SSE2 void sse2_store_bytes(void *p, __m128i x)
+{
+  int y;
+  x = _mm_srai_epi32(_mm_slli_epi32(x, 24), 24);
+  x = _mm_packs_epi32(x, x);
+  y = _mm_cvtsi128_si32(_mm_packs_epi16(x, x));
+  memcpy(p, &y, 4);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_store_shorts(void *p, __m128i x)
+{
+  x = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+  _mm_storel_epi64((__m128i *) p, _mm_packs_epi32(x, x));
+}
+
+#define sse2_store_ints(p, x) _mm_storeu_si128((__m128i *) (p), (x))
+
+#define MISCALE_SSE2_STORE(name, type, store) \
+  static inline MI2_TARGET_SSE2 void sse2_cvtt_##name(type *p, __m128d lo, __m128d hi) \
+  { \
+    store(p, _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi))); \
+  } \
+  static inline MI2_TARGET_SSE2 void sse2_cvt_##name(type *p, __m128d lo, __m128d hi) \
+  { \
+    store(p, _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo), _mm_cvtpd_epi32(hi))); \
+  }
+
+MISCALE_SSE2_STORE(byte, signed char, sse2_store_bytes)
+MISCALE_SSE2_STORE(ubyte, unsigned char, sse2_store_bytes)
+MISCALE_SSE2_STORE(short, short, sse2_store_shorts)
+MISCALE_SSE2_STORE(ushort, unsigned short, sse2_store_shorts)
+MISCALE_SSE2_STORE(int, int, sse2_store_ints)
+
+static inline MI2_TARGET_SSE2 void sse2_cvtt_float(float *p, __m128d lo, __m128d hi)
+{
+  _mm_storeu_ps(p, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+}
+
+static inline MI2_TARGET_SSE2 void sse2_cvt_float(float *p, __m128d lo, __m128d hi)
+{
+  sse2_cvtt_float(p, sse2_rint(lo), sse2_rint(hi));
+}
+
+static inline MI2_TARGET_SSE2 void sse2_cvtt_double(double *p, __m128d lo, __m128d hi)
+{
+  _mm_storeu_pd(p, lo);
+  _mm_storeu_pd(p + 2, hi);
+}
+
+static inline MI2_TARGET_SSE2 void sse2_cvt_double(double *p, __m128d lo, __m128d hi)
+{
+  sse2_cvtt_double(p, sse2_rint(lo), sse2_rint(hi));
+}
+
+MISCALE_SSE2_KERNELS(byte, signed char)
+MISCALE_SSE2_KERNELS(ubyte, unsigned char)
+MISCALE_SSE2_KERNELS(short, short)
+MISCALE_SSE2_KERNELS(ushort, unsigned short)
+MISCALE_SSE2_KERNELS(int, int)
+MISCALE_SSE2_KERNELS(float, float)
+MISCALE_SSE2_KERNELS(double, double)
+
+static const miscale_kernel_t midescale_sse2[MI2_KERNEL_COUNT] = {
+  midescale_sse2_byte, midescale_sse2_ubyte, midescale_sse2_short,
+  midescale_sse2_ushort, midescale_sse2_int, midescale_uint,
+  midescale_sse2_float, midescale_sse2_double
+};
+
+static const miscale_kernel_t miscale_sse2[MI2_KERNEL_COUNT] = {
+  miscale_sse2_byte, miscale_sse2_ubyte, miscale_sse2_short,
+  miscale_sse2_ushort, miscale_sse2_int, miscale_uint,
+  miscale_sse2_float, miscale_sse2_double
+};
+
+/* AVX2, four voxels at a time */
+
+#define MISCALE_AVX2_KERNELS(name, type) \
+  static MI2_TARGET_AVX2 void midescale_avx2_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    const __m256d vs = _mm256_set1_pd(scale); \
+    const __m256d vo = _mm256_set1_pd(offset); \
+    size_t i; \
+    for (i = 0; i + 4 <= n; i += 4) { \
+      avx2_cvtt_##name(p + i, _mm256_add_pd(_mm256_mul_pd(avx2_load_##name(p + i), vs), vo)); \
+    } \
+    midescale_##name(p + i, n - i, scale, offset); \
+  } \
+  static MI2_TARGET_AVX2 void miscale_avx2_##name(void *buffer, size_t n, double scale, double offset) \
+  { \
+    type *p = (type *) buffer; \
+    const __m256d vs = _mm256_set1_pd(scale); \
+    const __m256d vo = _mm256_set1_pd(offset); \
+    size_t i; \
+    for (i = 0; i + 4 <= n; i += 4) { \
+      avx2_cvt_##name(p + i, _mm256_sub_pd(_mm256_mul_pd(avx2_load_##name(p + i), vs), vo)); \
+    } \
+    miscale_##name(p + i, n - i, scale, offset); \
+  }
+
+static inline MI2_TARGET_AVX2 __m128i avx2_load4(const void *p)
+{
+  int x;
+  memcpy(&x, p, 4);
+  return _mm_cvtsi32_si128(x);
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_byte(const signed char *p)
+{
+  return _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(avx2_load4(p)));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_ubyte(const unsigned char *p)
+{
+  return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(avx2_load4(p)));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_short(const short *p)
+{
+  return _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *) p)));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_ushort(const unsigned short *p)
+{
+  return _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) p)));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_int(const int *p)
+{
+  return _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) p));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_float(const float *p)
+{
+  return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+static inline MI2_TARGET_AVX2 __m256d avx2_load_double(const double *p)
+{
+  return _mm256_loadu_pd(p);
+}
+
+static inline MI2_TARGET_AVX2 void avx2_store_bytes(void *p, __m128i x)
+{
+  int y = _mm_cvtsi128_si32(_mm_shuffle_epi8(x, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                                              -1, -1, -1, -1, -1, -1, -1, -1)));
+  memcpy(p, &y, 4);
+}
+
+static inline MI2_TARGET_AVX2 void avx2_store_shorts(void *p, __m128i x)
+{
+  _mm_storel_epi64((__m128i *) p,
+                   _mm_shuffle_epi8(x, _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+                                                     -1, -1, -1, -1, -1, -1, -1, -1)));
+}
+
+#define MISCALE_AVX2_STORE(name, type, store) \
+  static inline MI2_TARGET_AVX2 void avx2_cvtt_##name(type *p, __m256d v) \
+  { \
+    store(p, _mm256_cvttpd_epi32(v)); \
+  } \
+  static inline MI2_TARGET_AVX2 void avx2_cvt_##name(type *p, __m256d v) \
+  { \
+    store(p, _mm256_cvtpd_epi32(v)); \
+  }
+
+#define avx2_store_ints(p, x) _mm_storeu_si128((__m128i *) (p), (x))
+
+MISCALE_AVX2_STORE(byte, signed char, avx2_store_bytes)
+MISCALE_AVX2_STORE(ubyte, unsigned char, avx2_store_bytes)
+MISCALE_AVX2_STORE(short, short, avx2_store_shorts)
+MISCALE_AVX2_STORE(ushort, unsigned short, avx2_store_shorts)
+MISCALE_AVX2_STORE(int, int, avx2_store_ints)
+
+static inline MI2_TARGET_AVX2 void avx2_cvtt_float(float *p, __m256d v)
+{
+  _mm_storeu_ps(p, _mm256_cvtpd_ps(v));
+}
+
+static inline MI2_TARGET_AVX2 void avx2_cvt_float(float *p, __m256d v)
+{
+  _mm_storeu_ps(p, _mm256_cvtpd_ps(_mm256_round_pd(v, _MM_FROUND_CUR_DIRECTION)));
+}
+
+static inline MI2_TARGET_AVX2 void avx2_cvtt_double(double *p, __m256d v)
+{
+  _mm256_storeu_pd(p, v);
+}
+
+static inline MI2_TARGET_AVX2 void avx2_cvt_double(double *p, __m256d v)
+{
+  _mm256_storeu_pd(p, _mm256_round_pd(v, _MM_FROUND_CUR_DIRECTION));
+}
+
+MISCALE_AVX2_KERNELS(byte, signed char)
+MISCALE_AVX2_KERNELS(ubyte, unsigned char)
+MISCALE_AVX2_KERNELS(short, short)
+MISCALE_AVX2_KERNELS(ushort, unsigned short)
+MISCALE_AVX2_KERNELS(int, int)
+MISCALE_AVX2_KERNELS(float, float)
+MISCALE_AVX2_KERNELS(double, double)
+
+static const miscale_kernel_t midescale_avx2[MI2_KERNEL_COUNT] = {
+  midescale_avx2_byte, midescale_avx2_ubyte, midescale_avx2_short,
+  midescale_avx2_ushort, midescale_avx2_int, midescale_uint,
+  midescale_avx2_float, midescale_avx2_double
+};
+
+static const miscale_kernel_t miscale_avx2[MI2_KERNEL_COUNT] = {
+  miscale_avx2_byte, miscale_avx2_ubyte, miscale_avx2_short,
+  miscale_avx2_ushort, miscale_avx2_int, miscale_uint,
+  miscale_avx2_float, miscale_avx2_double
+};
+
+#endif /*MI2_SCALING_X86*/
+
+/** Instruction set of the kernels in use, -1 until first used. */
+static int miscale_level = -1;
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t miscale_once = PTHREAD_ONCE_INIT;
+#endif /*HAVE_PTHREAD*/
+
+/** Returns the best instruction set of the processor.
+ */
+static int miscale_detect(void)
+{
+#ifdef MI2_SCALING_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return MI2_SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return MI2_SIMD_SSE2;
+  }
+#endif /*MI2_SCALING_X86*/
+  return MI2_SIMD_NONE;
+}
+
+/** Limit the scaling kernels to the instruction set \a level, or to
+ * the best one available if \a level is negative. Returns the level
+ * actually used, which is never above what the processor supports.
+ */
+int miset_scaling_simd(int level)
+{
+  int best = miscale_detect();
+
+  if (level < 0) {
+    level = best;
+    if (miget_cfg_present(MICFG_SIMD)) {
+      const char *name = miget_cfg_str(MICFG_SIMD);
+
+      if (!strcasecmp(name, "none")) {
+        level = MI2_SIMD_NONE;
+      } else if (!strcasecmp(name, "sse2")) {
+        level = MI2_SIMD_SSE2;
+      }
+    }
+  }
+  miscale_level = level < best ? level : best;
+  return miscale_level;
+}
+
+/** Pick the default instruction set unless one was already chosen.
+ */
+static void miscale_init(void)
+{
+  if (miscale_level < 0) {
+    miset_scaling_simd(-1);
+  }
+}
+
+static int miscale_kernel_index(mitype_t type)
+{
+  switch (type) {
+  case MI_TYPE_BYTE:
+    return MI2_KERNEL_BYTE;
+  case MI_TYPE_UBYTE:
+    return MI2_KERNEL_UBYTE;
+  case MI_TYPE_SHORT:
+    return MI2_KERNEL_SHORT;
+  case MI_TYPE_USHORT:
+    return MI2_KERNEL_USHORT;
+  case MI_TYPE_INT:
+    return MI2_KERNEL_INT;
+  case MI_TYPE_UINT:
+    return MI2_KERNEL_UINT;
+  case MI_TYPE_FLOAT:
+    return MI2_KERNEL_FLOAT;
+  case MI_TYPE_DOUBLE:
+    return MI2_KERNEL_DOUBLE;
+  default:
+    return -1;
+  }
+}
+
+/** Returns the kernel for \a type, converting to the file range if
+ * \a to_file is TRUE, from it otherwise.
+ */
+static miscale_kernel_t miscale_kernel(mitype_t type, int to_file)
+{
+  int index = miscale_kernel_index(type);
+
+  if (index < 0) {
+    return NULL;
+  }
+#ifdef HAVE_PTHREAD
+  pthread_once(&miscale_once, miscale_init);
+#else
+  miscale_init();
+#endif /*HAVE_PTHREAD*/
+#ifdef MI2_SCALING_X86
+  if (miscale_level == MI2_SIMD_AVX2) {
+    return to_file ? miscale_avx2[index] : midescale_avx2[index];
+  }
+  if (miscale_level == MI2_SIMD_SSE2) {
+    return to_file ? miscale_sse2[index] : midescale_sse2[index];
+  }
+#endif /*MI2_SCALING_X86*/
+  return to_file ? miscale_scalar[index] : midescale_scalar[index];
+}
+
+/** Map the voxels of \a buffer, \a n_slices slices of \a slice_length
+ * voxels of \a type read from the file, from the valid range of the
+ * volume to the real range of their slice, given by \a slice_min and
+ * \a slice_max.
+ */
+int miapply_descaling(mitype_t type, void *buffer,
+                      hsize_t slice_length, hsize_t n_slices,
+                      const double *slice_min, const double *slice_max,
+                      double valid_min, double valid_max)
+{
+  miscale_kernel_t kernel = miscale_kernel(type, FALSE);
+  unsigned char *p = (unsigned char *) buffer;
+  size_t size;
+  hsize_t i;
+
+  if (kernel == NULL) {
+    return (MI_ERROR);
+  }
+  size = (size_t) mitype_len(type);
+  for (i = 0; i < n_slices; i++) {
+    double scale = (slice_max[i] - slice_min[i]) / (valid_max - valid_min);
+    double offset = slice_min[i] - valid_min * scale;
+
+    kernel(p, (size_t) slice_length, scale, offset);
+    p += slice_length * size;
+  }
+  return (MI_NOERROR);
+}
+
+/** Map the voxels of \a buffer, \a n_slices slices of \a slice_length
+ * voxels of \a type, from the real range of their slice to the valid
+ * range of the volume, rounding to the nearest integer, before they are
+ * written to the file.
+ */
+int miapply_scaling(mitype_t type, void *buffer,
+                    hsize_t slice_length, hsize_t n_slices,
+                    const double *slice_min, const double *slice_max,
+                    double valid_min, double valid_max)
+{
+  miscale_kernel_t kernel = miscale_kernel(type, TRUE);
+  unsigned char *p = (unsigned char *) buffer;
+  size_t size;
+  hsize_t i;
+
+  if (kernel == NULL) {
+    return (MI_ERROR);
+  }
+  size = (size_t) mitype_len(type);
+  for (i = 0; i < n_slices; i++) {
+    double scale = (valid_max - valid_min) / (slice_max[i] - slice_min[i]);
+    double offset = slice_min[i] * scale - valid_min;
+
+    kernel(p, (size_t) slice_length, scale, offset);
+    p += slice_length * size;
+  }
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -13,12 +13,19 @@
  *
  * If slice scaling is not enabled, the slice scaling functions will
  * use the appropriate global volume scale value.
+ *
+ * The image-max and image-min tables of the selected resolution are
+ * read whole the first time they are needed and kept with the volume.
+ * Slice ranges are then read and set in memory, and the tables are
+ * written back to the file before the volume is closed or another
+ * resolution is selected.
  ************************************************************************/
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif /*HAVE_CONFIG_H*/
 
 #include <stdlib.h>
+#include <float.h>
 #include <hdf5.h>
 #include "minc2.h"
 #include "minc2_private.h"
@@ -29,28 +36,253 @@
 #define MIRW_SCALE_MIN 0x0002
 #define MIRW_SCALE_MAX 0x0000
 
+/** \internal
+ * The image-max and image-min tables of the selected resolution.
+ */
+struct mislice_range {
+  int ndims;                    /* Dimensions of the tables */
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hsize_t n;                    /* Number of slices */
+  double *max;
+  double *min;
+  miboolean_t is_dirty;         /* TRUE if ranges were set since read */
+};
+
 /* Forward declaration
  */
 static int mirw_volume_minmax ( int opcode, mihandle_t volume, double *value );
 
+/** Read the image-max and image-min tables of a volume using slice
+ * scaling, unless they already are in memory. Returns the number of
+ * dimensions of the tables, which are the leading dimensions of the
+ * image in file order.
+ */
+int mislice_range_load ( mihandle_t volume )
+{
+  struct mislice_range *range;
+  hid_t fspc_id;
+  int result;
+  int i;
+
+  if ( volume->slice_range != NULL ) {
+    return ( volume->slice_range->ndims );
+  }
+  if ( miload_volume_image ( volume ) < 0 ) {
+    return ( MI_ERROR );
+  }
+  if ( !volume->has_slice_scaling || volume->imax_id < 0 || volume->imin_id < 0 ) {
+    return MI_LOG_ERROR ( MI2_MSG_GENERIC, "Volume has no slice scaling tables" );
+  }
+
+  range = ( struct mislice_range * ) calloc ( 1, sizeof ( struct mislice_range ) );
+  if ( range == NULL ) {
+    return MI_LOG_ERROR ( MI2_MSG_OUTOFMEM, ( int ) sizeof ( struct mislice_range ) );
+  }
+  MI_CHECK_HDF_CALL ( fspc_id = H5Dget_space ( volume->imax_id ), "H5Dget_space" );
+  if ( fspc_id < 0 ) {
+    free ( range );
+    return ( MI_ERROR );
+  }
+  range->ndims = H5Sget_simple_extent_dims ( fspc_id, range->dims, NULL );
+  H5Sclose ( fspc_id );
+  if ( range->ndims < 0 ) {
+    free ( range );
+    return ( MI_ERROR );
+  }
+  if ( range->ndims > volume->number_of_dims ) {
+    range->ndims = volume->number_of_dims;
+  }
+  range->n = 1;
+  for ( i = 0; i < range->ndims; i++ ) {
+    range->n *= range->dims[i];
+  }
+
+  range->max = ( double * ) malloc ( range->n * sizeof ( double ) );
+  range->min = ( double * ) malloc ( range->n * sizeof ( double ) );
+  if ( range->max == NULL || range->min == NULL ) {
+    int size = ( int ) ( range->n * sizeof ( double ) );
+
+    free ( range->max );
+    free ( range->min );
+    free ( range );
+    return MI_LOG_ERROR ( MI2_MSG_OUTOFMEM, size );
+  }
+  MI_CHECK_HDF_CALL ( result = H5Dread ( volume->imax_id, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                         H5S_ALL, H5P_DEFAULT, range->max ), "H5Dread" );
+  if ( result >= 0 ) {
+    MI_CHECK_HDF_CALL ( result = H5Dread ( volume->imin_id, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                           H5S_ALL, H5P_DEFAULT, range->min ), "H5Dread" );
+  }
+  if ( result < 0 ) {
+    free ( range->max );
+    free ( range->min );
+    free ( range );
+    return ( MI_ERROR );
+  }
+  volume->slice_range = range;
+  return ( range->ndims );
+}
+
+/** Copy the real range of the slices in the box \a start, \a count of
+ * the slice scaling tables (file order) to \a slice_max and
+ * \a slice_min, the last dimension varying fastest.
+ */
+int mislice_range_read ( mihandle_t volume, const hsize_t start[],
+                         const hsize_t count[], double *slice_max,
+                         double *slice_min )
+{
+  struct mislice_range *range;
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  hsize_t n = 1;
+  hsize_t j;
+  int i;
+
+  if ( mislice_range_load ( volume ) < 0 ) {
+    return ( MI_ERROR );
+  }
+  range = volume->slice_range;
+  for ( i = 0; i < range->ndims; i++ ) {
+    if ( start[i] + count[i] > range->dims[i] ) {
+      return MI_LOG_ERROR ( MI2_MSG_GENERIC, "Slice position out of range" );
+    }
+    index[i] = 0;
+    n *= count[i];
+  }
+  for ( j = 0; j < n; j++ ) {
+    hsize_t k = 0;
+
+    for ( i = 0; i < range->ndims; i++ ) {
+      k = k * range->dims[i] + start[i] + index[i];
+    }
+    slice_max[j] = range->max[k];
+    slice_min[j] = range->min[k];
+    for ( i = range->ndims - 1; i >= 0; i-- ) {
+      if ( ++index[i] < count[i] ) {
+        break;
+      }
+      index[i] = 0;
+    }
+  }
+  return ( MI_NOERROR );
+}
+
+/** Get the lowest slice minimum and the highest slice maximum of a
+ * volume using slice scaling in \a real_range[0] and \a real_range[1].
+ */
+int mislice_range_bounds ( mihandle_t volume, double real_range[] )
+{
+  struct mislice_range *range;
+  hsize_t k;
+
+  if ( mislice_range_load ( volume ) < 0 ) {
+    return ( MI_ERROR );
+  }
+  range = volume->slice_range;
+  real_range[0] = DBL_MAX;
+  real_range[1] = -DBL_MAX;
+  for ( k = 0; k < range->n; k++ ) {
+    if ( range->min[k] < real_range[0] ) {
+      real_range[0] = range->min[k];
+    }
+    if ( range->max[k] > real_range[1] ) {
+      real_range[1] = range->max[k];
+    }
+  }
+  return ( MI_NOERROR );
+}
+
+/** Write the slice scaling tables of a volume back to the file if
+ * ranges were set since they were read.
+ */
+int mislice_range_flush ( mihandle_t volume )
+{
+  struct mislice_range *range = volume->slice_range;
+  int result;
+
+  if ( range == NULL || !range->is_dirty ) {
+    return ( MI_NOERROR );
+  }
+  MI_CHECK_HDF_CALL ( result = H5Dwrite ( volume->imax_id, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                          H5S_ALL, H5P_DEFAULT, range->max ), "H5Dwrite" );
+  if ( result >= 0 ) {
+    MI_CHECK_HDF_CALL ( result = H5Dwrite ( volume->imin_id, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                            H5S_ALL, H5P_DEFAULT, range->min ), "H5Dwrite" );
+  }
+  if ( result < 0 ) {
+    return ( MI_ERROR );
+  }
+  range->is_dirty = FALSE;
+  return ( MI_NOERROR );
+}
+
+/** Grow the slice scaling tables in memory after frames were appended
+ * to \a volume, to \a n_slabs along the slowest dimension. The ranges of
+ * the new slices are those the datasets are filled with.
+ */
+int mislice_range_extend ( mihandle_t volume, hsize_t n_slabs )
+{
+  struct mislice_range *range = volume->slice_range;
+  double *max, *min;
+  hsize_t n = 1;
+  hsize_t k;
+  int i;
+
+  if ( range == NULL || range->ndims == 0 || n_slabs <= range->dims[0] ) {
+    return ( MI_NOERROR );
+  }
+  n = n_slabs;
+  for ( i = 1; i < range->ndims; i++ ) {
+    n *= range->dims[i];
+  }
+  max = ( double * ) realloc ( range->max, n * sizeof ( double ) );
+  if ( max != NULL ) {
+    range->max = max;
+  }
+  min = ( double * ) realloc ( range->min, n * sizeof ( double ) );
+  if ( min != NULL ) {
+    range->min = min;
+  }
+  if ( max == NULL || min == NULL ) {
+    return MI_LOG_ERROR ( MI2_MSG_OUTOFMEM, ( int ) ( n * sizeof ( double ) ) );
+  }
+  for ( k = range->n; k < n; k++ ) {
+    range->max[k] = 1.0;
+    range->min[k] = 0.0;
+  }
+  range->dims[0] = n_slabs;
+  range->n = n;
+  return ( MI_NOERROR );
+}
+
+/** Release the slice scaling tables of a volume, without writing them.
+ */
+void mislice_range_free ( mihandle_t volume )
+{
+  if ( volume->slice_range != NULL ) {
+    free ( volume->slice_range->max );
+    free ( volume->slice_range->min );
+    free ( volume->slice_range );
+    volume->slice_range = NULL;
+  }
+}
+
 /** Get the minimum or maximum value for the slice containing the given point.
  */
 static int mirw_slice_minmax ( int opcode, mihandle_t volume,
                     const misize_t start_positions[],
                     misize_t array_length, double *value )
 {
-  hid_t dset_id;
-  hid_t fspc_id;
-  hid_t mspc_id;
+  struct mislice_range *range;
   hsize_t hdf_start[MI2_MAX_VAR_DIMS];//VF: should it be hssize_t ?
   hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+  misize_t start[MI2_MAX_VAR_DIMS];
   misize_t count[MI2_MAX_VAR_DIMS];
   int dir[MI2_MAX_VAR_DIMS];
-  misize_t ndims;
-  misize_t i;
-  int result;
+  hsize_t k = 0;
+  int i;
 
-  if ( volume == NULL || value == NULL ) {
+  if ( volume == NULL || value == NULL ||
+       miload_volume_image ( volume ) < 0 ) {
     return ( MI_ERROR );    /* Bad parameters */
   }
 
@@ -58,56 +290,49 @@ static int mirw_slice_minmax ( int opcode, mihandle_t volume,
     return mirw_volume_minmax ( opcode, volume, value );
   }
 
-  if ( opcode & MIRW_SCALE_MIN ) {
-    dset_id = volume->imin_id;
-  } else {
-    dset_id = volume->imax_id;
-  }
-
-  fspc_id = H5Dget_space ( dset_id );
-  if ( fspc_id < 0 ) {
+  if ( ( opcode & MIRW_SCALE_SET ) && ( volume->mode & MI2_OPEN_RDWR ) == 0 ) {
     return ( MI_ERROR );
   }
 
-  ndims = H5Sget_simple_extent_ndims ( fspc_id );
-  if ( ndims > array_length ) {
-    ndims = array_length;
+  if ( mislice_range_load ( volume ) < 0 ) {
+    return ( MI_ERROR );
   }
+  range = volume->slice_range;
 
-  for ( i = 0; i < ndims; i++ ) {
+  for ( i = 0; i < volume->number_of_dims; i++ ) {
+    start[i] = ( ( misize_t ) i < array_length ) ? start_positions[i] : 0;
     count[i] = 1;
   }
 
   mitranslate_hyperslab_origin ( volume,
-                                 start_positions,
+                                 start,
                                  count,
                                  hdf_start,
                                  hdf_count,
                                  dir );
 
-  result = H5Sselect_elements ( fspc_id, H5S_SELECT_SET, 1, hdf_start );
-  if ( result < 0 ) {
-    return ( MI_ERROR );
+  for ( i = 0; i < range->ndims; i++ ) {
+    if ( hdf_start[i] >= range->dims[i] ) {
+      return ( MI_ERROR );
+    }
+    k = k * range->dims[i] + hdf_start[i];
   }
 
-  /* Create a trivial scalar space to read the single value.
-   */
-  mspc_id = H5Screate ( H5S_SCALAR );
-
   if ( opcode & MIRW_SCALE_SET ) {
-    result = H5Dwrite ( dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id,
-                        H5P_DEFAULT, value );
+    if ( opcode & MIRW_SCALE_MIN ) {
+      range->min[k] = *value;
+    } else {
+      range->max[k] = *value;
+    }
+    range->is_dirty = TRUE;
   } else {
-    result = H5Dread ( dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id,
-                       H5P_DEFAULT, value );
+    *value = ( opcode & MIRW_SCALE_MIN ) ? range->min[k] : range->max[k];
   }
 
-  if ( result < 0 ) {
-    return ( MI_ERROR );
+  /* The reduced resolutions of the slice follow its new range */
+  if ( ( opcode & MIRW_SCALE_SET ) && volume->selected_resolution == 0 ) {
+    mipyramid_mark ( volume, hdf_start[0], 1, 0 );
   }
-
-  H5Sclose ( fspc_id );
-  H5Sclose ( mspc_id );
   return ( MI_NOERROR );
 }
 
@@ -248,7 +473,8 @@ static int mirw_volume_minmax ( int opcode, mihandle_t volume, double *value )
   hid_t mspc_id;
   int result;
 
-  if ( volume == NULL || value == NULL ) {
+  if ( volume == NULL || value == NULL ||
+       miload_volume_image ( volume ) < 0 ) {
     return ( MI_ERROR );
   }
   if ( volume->has_slice_scaling ) {
@@ -401,7 +627,8 @@ int miset_volume_range ( mihandle_t volume, double vol_max, double vol_min )
  */
 int miget_slice_scaling_flag ( mihandle_t volume, miboolean_t *slice_scaling_flag )
 {
-  if ( volume == NULL || slice_scaling_flag == NULL ) {
+  if ( volume == NULL || slice_scaling_flag == NULL ||
+       miload_volume_image ( volume ) < 0 ) {
     return ( MI_ERROR );
   }
   *slice_scaling_flag = volume->has_slice_scaling;
@@ -412,7 +639,7 @@ int miget_slice_scaling_flag ( mihandle_t volume, miboolean_t *slice_scaling_fla
  */
 int miset_slice_scaling_flag ( mihandle_t volume, miboolean_t slice_scaling_flag )
 {
-  if ( volume == NULL ) {
+  if ( volume == NULL || miload_volume_image ( volume ) < 0 ) {
     return ( MI_ERROR );
   }
   volume->has_slice_scaling = slice_scaling_flag;
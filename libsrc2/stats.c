@@ -0,0 +1,575 @@
+/** \file stats.c
+ * \brief MINC 2.0 statistics of the values written to a volume
+ *
+ * When enabled in the properties of a new volume, the real values
+ * written by the hyperslab functions are accumulated as they go by:
+ * their count, minimum, maximum, sum and sum of squares for every slice
+ * and for the whole volume, and a histogram. Tools can then get them
+ * without reading the volume again.
+ *
+ * Slices are the positions along the leading dimensions of the image in
+ * file order, all but the two fastest varying ones, as for slice
+ * scaling. Voxel values are converted to real values with the slice
+ * ranges in effect when they are written. The histogram counts voxel
+ * values, in bins of equal width over the valid range of the volume at
+ * the time of the first write.
+ *
+ * The statistics can be stored as attributes of the info group when
+ * the volume is closed, and are then read back from there by the
+ * functions below when the file is opened again.
+ ************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+#include <float.h>
+#include <hdf5.h>
+
+#include "minc2.h"
+#include "minc2_private.h"
+
+/* Values converted at a time */
+#define MISTATS_BLOCK 256
+
+/* Number of doubles stored per slice in the "slice_statistics" attribute */
+#define MISTATS_FIELDS 5
+
+/** \internal
+ * Statistics of a volume.
+ */
+struct mistats {
+  miboolean_t accumulate;       /* FALSE if read from the file */
+  int slice_ndims;              /* Dimensions indexing the slices */
+  hsize_t slice_dims[MI2_MAX_VAR_DIMS];
+  hsize_t n_slices;
+  mistatistics_t *slices;
+  int n_bins;
+  double hist_min;              /* Voxel range of the histogram */
+  double hist_max;
+  misize_t *histogram;
+};
+
+static void mistats_clear(mistatistics_t *stats)
+{
+  stats->count = 0;
+  stats->min = DBL_MAX;
+  stats->max = -DBL_MAX;
+  stats->sum = 0.0;
+  stats->sum_squares = 0.0;
+}
+
+static void mistats_free(struct mistats *stats)
+{
+  if (stats != NULL) {
+    free(stats->slices);
+    free(stats->histogram);
+    free(stats);
+  }
+}
+
+/** Allocate empty statistics with \a n_slices slices and \a n_bins
+ * histogram bins.
+ */
+static struct mistats *mistats_alloc(hsize_t n_slices, int n_bins)
+{
+  struct mistats *stats;
+  hsize_t i;
+
+  stats = (struct mistats *) calloc(1, sizeof(struct mistats));
+  if (stats == NULL) {
+    return NULL;
+  }
+  stats->n_slices = n_slices;
+  stats->n_bins = n_bins;
+  stats->slices = (mistatistics_t *) malloc(n_slices * sizeof(mistatistics_t));
+  stats->histogram = (misize_t *) calloc(n_bins, sizeof(misize_t));
+  if (stats->slices == NULL || stats->histogram == NULL) {
+    mistats_free(stats);
+    return NULL;
+  }
+  for (i = 0; i < n_slices; i++) {
+    mistats_clear(&stats->slices[i]);
+  }
+  return stats;
+}
+
+/** Set up the statistics of a volume created with statistics enabled.
+ */
+static struct mistats *mistats_init(mihandle_t volume)
+{
+  struct mistats *stats;
+  int slice_ndims = (volume->number_of_dims > 2) ? volume->number_of_dims - 2 : 0;
+  hsize_t n_slices = 1;
+  int i;
+
+  for (i = 0; i < slice_ndims; i++) {
+    n_slices *= volume->dim_handles[i]->length;
+  }
+  stats = mistats_alloc(n_slices, volume->create_props->stats_bins);
+  if (stats == NULL) {
+    MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n_slices * sizeof(mistatistics_t)));
+    return NULL;
+  }
+  stats->accumulate = TRUE;
+  stats->slice_ndims = slice_ndims;
+  for (i = 0; i < slice_ndims; i++) {
+    stats->slice_dims[i] = volume->dim_handles[i]->length;
+  }
+  stats->hist_min = volume->valid_min;
+  stats->hist_max = volume->valid_max;
+  if (!(stats->hist_max > stats->hist_min)) {
+    stats->hist_max = stats->hist_min + 1.0;
+  }
+  return stats;
+}
+
+/** Make room for the slices of the frames appended to \a volume, which
+ * now has \a n_slabs along the slowest dimension.
+ */
+int mistats_extend(mihandle_t volume, hsize_t n_slabs)
+{
+  struct mistats *stats = volume->stats;
+  mistatistics_t *slices;
+  hsize_t n_slices = n_slabs;
+  hsize_t s;
+  int i;
+
+  if (stats == NULL || !stats->accumulate || stats->slice_ndims == 0 ||
+      n_slabs <= stats->slice_dims[0]) {
+    return (MI_NOERROR);
+  }
+  for (i = 1; i < stats->slice_ndims; i++) {
+    n_slices *= stats->slice_dims[i];
+  }
+  slices = (mistatistics_t *) realloc(stats->slices, n_slices * sizeof(mistatistics_t));
+  if (slices == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n_slices * sizeof(mistatistics_t)));
+  }
+  stats->slices = slices;
+  for (s = stats->n_slices; s < n_slices; s++) {
+    mistats_clear(&stats->slices[s]);
+  }
+  stats->slice_dims[0] = n_slabs;
+  stats->n_slices = n_slices;
+  return (MI_NOERROR);
+}
+
+/** Get \a n values of \a type, starting \a offset values into \a in,
+ * as doubles.
+ */
+#define MISTATS_LOAD(ctype) \
+  { \
+    const ctype *_in = (const ctype *) in + offset; \
+    for (i = 0; i < n; i++) \
+      out[i] = (double) _in[i]; \
+  }
+
+static void mistats_load(mitype_t type, const void *in, hsize_t offset,
+                         size_t n, double *out)
+{
+  size_t i;
+
+  switch (type) {
+  case MI_TYPE_BYTE:   MISTATS_LOAD(signed char);    break;
+  case MI_TYPE_UBYTE:  MISTATS_LOAD(unsigned char);  break;
+  case MI_TYPE_SHORT:  MISTATS_LOAD(short);          break;
+  case MI_TYPE_USHORT: MISTATS_LOAD(unsigned short); break;
+  case MI_TYPE_INT:    MISTATS_LOAD(int);            break;
+  case MI_TYPE_UINT:   MISTATS_LOAD(unsigned int);   break;
+  case MI_TYPE_FLOAT:  MISTATS_LOAD(float);          break;
+  default:             MISTATS_LOAD(double);         break;
+  }
+}
+
+/** Get the voxel to real conversion real = scale * voxel + offset of
+ * the slice at file position \a pos.
+ */
+static void mistats_slice_scale(mihandle_t volume, const hsize_t pos[],
+                                const hsize_t ones[], double *scale,
+                                double *offset)
+{
+  double slice_max = volume->scale_max;
+  double slice_min = volume->scale_min;
+
+  if (volume->volume_type == MI_TYPE_FLOAT || volume->volume_type == MI_TYPE_DOUBLE ||
+      volume->valid_max == volume->valid_min) {
+    *scale = 1.0;
+    *offset = 0.0;
+    return;
+  }
+  if (volume->has_slice_scaling) {
+    mislice_range_read(volume, pos, ones, &slice_max, &slice_min);
+  }
+  *scale = (slice_max - slice_min) / (volume->valid_max - volume->valid_min);
+  *offset = slice_min - *scale * volume->valid_min;
+}
+
+/** Add \a n values of one slice, voxel values if \a voxel is set and
+ * real values otherwise.
+ */
+static void mistats_add_values(struct mistats *stats, mistatistics_t *slice,
+                               const double *values, size_t n, miboolean_t voxel,
+                               double scale, double offset)
+{
+  double bin_scale = stats->n_bins / (stats->hist_max - stats->hist_min);
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    double v = values[i];
+    double real = voxel ? scale * v + offset : v;
+    double bin;
+
+    if (real != real) {
+      continue;                 /* NaN */
+    }
+    if (!voxel) {
+      v = (scale != 0.0) ? (real - offset) / scale : stats->hist_min;
+    }
+    slice->count++;
+    slice->sum += real;
+    slice->sum_squares += real * real;
+    if (real < slice->min) {
+      slice->min = real;
+    }
+    if (real > slice->max) {
+      slice->max = real;
+    }
+    bin = (v - stats->hist_min) * bin_scale;
+    if (!(bin > 0.0)) {
+      stats->histogram[0]++;
+    } else if (bin >= stats->n_bins) {
+      stats->histogram[stats->n_bins - 1]++;
+    } else {
+      stats->histogram[(int) bin]++;
+    }
+  }
+}
+
+/** Whether the values written to \a volume are accumulated.
+ */
+miboolean_t mistats_enabled(mihandle_t volume)
+{
+  return (volume->create_props != NULL &&
+          (volume->create_props->stats_flags & MI_STATS_ACCUMULATE) != 0);
+}
+
+/** Accumulate the values of a hyperslab written with \a plan. The
+ * values are in file order, of type \a type, and are voxel values if
+ * \a voxel is set or real values otherwise.
+ */
+void mistats_add(mihyperplan_t plan, mitype_t type, const void *values,
+                 miboolean_t voxel)
+{
+  mihandle_t volume = plan->volume;
+  struct mistats *stats = volume->stats;
+  double block[MISTATS_BLOCK];
+  hsize_t index[MI2_MAX_VAR_DIMS];
+  hsize_t pos[MI2_MAX_VAR_DIMS];
+  hsize_t ones[MI2_MAX_VAR_DIMS];
+  hsize_t slice_length = 1;
+  hsize_t n_slices = 1;
+  hsize_t offset = 0;
+  hsize_t s;
+  int k;
+  int i;
+
+  if (stats == NULL) {
+    if (!mistats_enabled(volume)) {
+      return;
+    }
+    stats = volume->stats = mistats_init(volume);
+    if (stats == NULL) {
+      return;
+    }
+  }
+  if (!stats->accumulate || type >= MI_TYPE_SCOMPLEX) {
+    return;
+  }
+
+  k = stats->slice_ndims;
+  for (i = 0; i < plan->ndims; i++) {
+    if (i < k) {
+      n_slices *= plan->hdf_count[i];
+    } else {
+      slice_length *= plan->hdf_count[i];
+    }
+    index[i] = 0;
+    ones[i] = 1;
+  }
+
+  for (s = 0; s < n_slices; s++) {
+    hsize_t slice = 0;
+    hsize_t done;
+    double scale, value_offset;
+
+    for (i = 0; i < k; i++) {
+      pos[i] = plan->hdf_start[i] + index[i];
+      slice = slice * stats->slice_dims[i] + pos[i];
+    }
+    mistats_slice_scale(volume, pos, ones, &scale, &value_offset);
+    for (done = 0; done < slice_length; done += MISTATS_BLOCK) {
+      size_t n = (slice_length - done < MISTATS_BLOCK) ?
+                 (size_t) (slice_length - done) : MISTATS_BLOCK;
+
+      mistats_load(type, values, offset + done, n, block);
+      mistats_add_values(stats, &stats->slices[slice], block, n, voxel,
+                         scale, value_offset);
+    }
+    offset += slice_length;
+    for (i = k - 1; i >= 0; i--) {
+      if (++index[i] < plan->hdf_count[i]) {
+        break;
+      }
+      index[i] = 0;
+    }
+  }
+}
+
+/** Store the statistics of \a volume in its info group, if they were
+ * asked for.
+ */
+void mistats_store(mihandle_t volume)
+{
+  struct mistats *stats = volume->stats;
+  mistatistics_t total;
+  double *buffer;
+  hsize_t s;
+  int i;
+
+  if (stats == NULL) {
+    return;
+  }
+  if (stats->accumulate && (volume->mode & MI2_OPEN_RDWR) != 0 &&
+      (volume->create_props->stats_flags & MI_STATS_STORE) != 0) {
+    size_t n = (size_t) stats->n_slices * MISTATS_FIELDS;
+
+    if ((size_t) stats->n_bins > n) {
+      n = stats->n_bins;
+    }
+    buffer = (double *) malloc(n * sizeof(double));
+    if (buffer == NULL) {
+      MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n * sizeof(double)));
+    } else {
+      miget_volume_statistics(volume, &total);
+      buffer[0] = (double) total.count;
+      buffer[1] = total.min;
+      buffer[2] = total.max;
+      buffer[3] = total.sum;
+      buffer[4] = total.sum_squares;
+      miset_attr_values(volume, MI_TYPE_DOUBLE, "", "statistics",
+                      MISTATS_FIELDS, buffer);
+      for (s = 0; s < stats->n_slices; s++) {
+        buffer[s * MISTATS_FIELDS] = (double) stats->slices[s].count;
+        buffer[s * MISTATS_FIELDS + 1] = stats->slices[s].min;
+        buffer[s * MISTATS_FIELDS + 2] = stats->slices[s].max;
+        buffer[s * MISTATS_FIELDS + 3] = stats->slices[s].sum;
+        buffer[s * MISTATS_FIELDS + 4] = stats->slices[s].sum_squares;
+      }
+      miset_attr_values(volume, MI_TYPE_DOUBLE, "", "slice_statistics",
+                      stats->n_slices * MISTATS_FIELDS, buffer);
+      for (i = 0; i < stats->n_bins; i++) {
+        buffer[i] = (double) stats->histogram[i];
+      }
+      miset_attr_values(volume, MI_TYPE_DOUBLE, "", "histogram",
+                      stats->n_bins, buffer);
+      buffer[0] = stats->hist_min;
+      buffer[1] = stats->hist_max;
+      miset_attr_values(volume, MI_TYPE_DOUBLE, "", "histogram_range",
+                      2, buffer);
+      free(buffer);
+    }
+  }
+}
+
+/** Store the statistics of \a volume in its info group, if they were
+ * asked for, and release them.
+ */
+void mistats_close(mihandle_t volume)
+{
+  if (volume->stats == NULL) {
+    return;
+  }
+  mistats_store(volume);
+  mistats_free(volume->stats);
+  volume->stats = NULL;
+}
+
+/** Read the statistics stored in the info group of \a volume.
+ */
+static int mistats_read(mihandle_t volume)
+{
+  struct mistats *stats;
+  double *buffer;
+  size_t n_fields;
+  size_t n_bins;
+  double range[2];
+  hsize_t s;
+  size_t i;
+
+  if (miget_attr_length(volume, "", "slice_statistics", &n_fields) < 0 ||
+      miget_attr_length(volume, "", "histogram", &n_bins) < 0 ||
+      n_fields < MISTATS_FIELDS || n_fields % MISTATS_FIELDS != 0 || n_bins == 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume has no statistics");
+  }
+  stats = mistats_alloc(n_fields / MISTATS_FIELDS, (int) n_bins);
+  buffer = (double *) malloc((n_fields > n_bins ? n_fields : n_bins) * sizeof(double));
+  if (stats == NULL || buffer == NULL) {
+    mistats_free(stats);
+    free(buffer);
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM, (int) (n_fields * sizeof(double)));
+  }
+  stats->slice_ndims = (volume->number_of_dims > 2) ? volume->number_of_dims - 2 : 0;
+  for (i = 0; i < (size_t) stats->slice_ndims; i++) {
+    stats->slice_dims[i] = volume->dim_handles[i]->length;
+  }
+
+  if (miget_attr_values(volume, MI_TYPE_DOUBLE, "", "slice_statistics",
+                      n_fields, buffer) < 0 ||
+      miget_attr_values(volume, MI_TYPE_DOUBLE, "", "histogram_range",
+                      2, range) < 0) {
+    mistats_free(stats);
+    free(buffer);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to read volume statistics");
+  }
+  for (s = 0; s < stats->n_slices; s++) {
+    stats->slices[s].count = (misize_t) buffer[s * MISTATS_FIELDS];
+    stats->slices[s].min = buffer[s * MISTATS_FIELDS + 1];
+    stats->slices[s].max = buffer[s * MISTATS_FIELDS + 2];
+    stats->slices[s].sum = buffer[s * MISTATS_FIELDS + 3];
+    stats->slices[s].sum_squares = buffer[s * MISTATS_FIELDS + 4];
+  }
+  if (miget_attr_values(volume, MI_TYPE_DOUBLE, "", "histogram",
+                      n_bins, buffer) < 0) {
+    mistats_free(stats);
+    free(buffer);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to read volume statistics");
+  }
+  for (i = 0; i < n_bins; i++) {
+    stats->histogram[i] = (misize_t) buffer[i];
+  }
+  stats->hist_min = range[0];
+  stats->hist_max = range[1];
+  free(buffer);
+  volume->stats = stats;
+  return (MI_NOERROR);
+}
+
+/** The statistics of \a volume, accumulated or read from the file.
+ */
+static struct mistats *mistats_get(mihandle_t volume)
+{
+  if (volume->stats == NULL) {
+    if (mistats_enabled(volume)) {
+      volume->stats = mistats_init(volume);
+    } else if (mistats_read(volume) < 0) {
+      return NULL;
+    }
+  }
+  return volume->stats;
+}
+
+/** Get the statistics of all the real values written to \a volume.
+ * Values written more than once are counted every time.
+ */
+int miget_volume_statistics(mihandle_t volume, mistatistics_t *stats)
+{
+  struct mistats *all;
+  hsize_t s;
+
+  if (volume == NULL || stats == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get statistics with null volume or null variables");
+  }
+  if ((all = mistats_get(volume)) == NULL) {
+    return (MI_ERROR);
+  }
+  mistats_clear(stats);
+  for (s = 0; s < all->n_slices; s++) {
+    const mistatistics_t *slice = &all->slices[s];
+
+    if (slice->count == 0) {
+      continue;
+    }
+    stats->count += slice->count;
+    stats->sum += slice->sum;
+    stats->sum_squares += slice->sum_squares;
+    if (slice->min < stats->min) {
+      stats->min = slice->min;
+    }
+    if (slice->max > stats->max) {
+      stats->max = slice->max;
+    }
+  }
+  return (MI_NOERROR);
+}
+
+/** Get the statistics of the real values written to the slice of
+ * \a volume containing the voxel at \a start_positions, given in the
+ * apparent dimension order. Extra coordinates are ignored.
+ */
+int miget_slice_statistics(mihandle_t volume, const misize_t start_positions[],
+                           size_t array_length, mistatistics_t *stats)
+{
+  struct mistats *all;
+  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+  misize_t start[MI2_MAX_VAR_DIMS];
+  misize_t count[MI2_MAX_VAR_DIMS];
+  int dir[MI2_MAX_VAR_DIMS];
+  hsize_t slice = 0;
+  int i;
+
+  if (volume == NULL || start_positions == NULL || stats == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get statistics with null volume or null variables");
+  }
+  if ((all = mistats_get(volume)) == NULL) {
+    return (MI_ERROR);
+  }
+  for (i = 0; i < volume->number_of_dims; i++) {
+    start[i] = ((size_t) i < array_length) ? start_positions[i] : 0;
+    count[i] = 1;
+  }
+  mitranslate_hyperslab_origin(volume, start, count, hdf_start, hdf_count, dir);
+  for (i = 0; i < all->slice_ndims; i++) {
+    if (hdf_start[i] >= all->slice_dims[i]) {
+      return MI_LOG_ERROR(MI2_MSG_GENERIC,"Slice position out of range");
+    }
+    slice = slice * all->slice_dims[i] + hdf_start[i];
+  }
+  if (slice >= all->n_slices) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Slice position out of range");
+  }
+  *stats = all->slices[slice];
+  return (MI_NOERROR);
+}
+
+/** Get the histogram of the voxel values written to \a volume. The
+ * \a n_bins counts are returned in \a counts, where \a n_bins is the
+ * number of bins set with miset_props_statistics(). The bins have equal
+ * widths and together cover the voxel range [\a hist_min, \a hist_max];
+ * values outside of it are counted in the first or the last bin.
+ */
+int miget_volume_histogram(mihandle_t volume, int n_bins, misize_t counts[],
+                           double *hist_min, double *hist_max)
+{
+  struct mistats *all;
+  int i;
+
+  if (volume == NULL || counts == NULL || hist_min == NULL || hist_max == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to get histogram with null volume or null variables");
+  }
+  if ((all = mistats_get(volume)) == NULL) {
+    return (MI_ERROR);
+  }
+  if (n_bins != all->n_bins) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Histogram has a different number of bins");
+  }
+  for (i = 0; i < n_bins; i++) {
+    counts[i] = all->histogram[i];
+  }
+  *hist_min = all->hist_min;
+  *hist_max = all->hist_max;
+  return (MI_NOERROR);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -19,6 +19,7 @@
 
 #define _GNU_SOURCE 1
 #include <stdlib.h>
+#include <string.h>
 #include <hdf5.h>
 #include "minc2.h"
 #include "minc2_private.h"
@@ -31,6 +32,31 @@
 /** Maximum number of elements in a filter parameter list. */
 #define MI2_MAX_CD_ELEMENTS 100
 
+/** Apply the MINC_COMPRESS configuration, parsed by
+ * miget_cfg_compression(), to a new property list.
+ */
+static void miinit_props_compression(mivolumeprops_t props)
+{
+  static const micompression_t types[] = {
+    MI_COMPRESS_NONE,           /* MICFG_CODEC_NONE */
+    MI_COMPRESS_ZLIB,           /* MICFG_CODEC_ZLIB */
+    MI_COMPRESS_SHUFFLE_ZLIB,   /* MICFG_CODEC_SHUFFLE_ZLIB */
+    MI_COMPRESS_LZ4,            /* MICFG_CODEC_LZ4 */
+    MI_COMPRESS_ZSTD            /* MICFG_CODEC_ZSTD */
+  };
+  int codec;
+  int level;
+
+  if (!miget_cfg_compression(&codec, &level) || codec == MICFG_CODEC_NONE) {
+    return;
+  }
+  /* Codecs whose filter is not available leave the list unchanged */
+  if (miset_props_compression_type(props, types[codec]) == MI_NOERROR &&
+      level >= 0) {
+    miset_props_compression_level(props, level);
+  }
+}
+
 /** Create a volume property list.  The new list will be returned in the
  * \a props parameter.    When the program is finished
  * using the property list it should call  mifree_volume_props() to free the
@@ -60,6 +86,12 @@ int minew_volume_props(mivolumeprops_t  *props)
   handle->record_name = NULL;
   handle->template_flag = 0;
   handle->checksum = miget_cfg_bool(MICFG_MINC_CHECKSUM);
+  handle->compression_threads = michunk_default_threads(MICFG_COMPRESS_THREADS);
+  handle->access_hint = MI_ACCESS_DEFAULT;
+  handle->chunk_bytes = MI2_DEFAULT_CHUNK_BYTES;
+  handle->stats_flags = MI_STATS_NONE;
+  handle->stats_bins = MI2_DEFAULT_STATS_BINS;
+  miinit_props_compression(handle);
   
   *props = handle;
   
@@ -119,6 +151,8 @@ int miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
   if (handle == NULL) {
     return (MI_ERROR);
   }
+  memset(handle, 0, sizeof(struct mivolprops));
+  handle->compression_threads = volume->write_threads;
   /* Get the layout of the raw data for a dataset.
    */
   if (H5Pget_layout(hdf_plist) == H5D_CHUNKED) {
@@ -146,16 +180,29 @@ int miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
       handle->checksum = 0;
     }
     else {
+      int shuffle = FALSE;
+
+      handle->zlib_level = 0;
+      handle->compression_type = MI_COMPRESS_NONE;
+      handle->checksum = 0;
       for (i = 0; i < nfilters; i++) {
         cd_nelmts = MI2_MAX_CD_ELEMENTS;
         fcode = H5Pget_filter1(hdf_plist, i, &flags, &cd_nelmts,
                                cd_values, sizeof(fname), fname);
         switch (fcode) {
           case H5Z_FILTER_DEFLATE:
-            handle->compression_type = MI_COMPRESS_ZLIB;
+            handle->compression_type = shuffle ? MI_COMPRESS_SHUFFLE_ZLIB : MI_COMPRESS_ZLIB;
             handle->zlib_level = cd_values[0];
             break;
           case H5Z_FILTER_SHUFFLE:
+            shuffle = TRUE;
+            break;
+          case MI2_H5Z_FILTER_LZ4:
+            handle->compression_type = MI_COMPRESS_LZ4;
+            break;
+          case MI2_H5Z_FILTER_ZSTD:
+            handle->compression_type = MI_COMPRESS_ZSTD;
+            handle->zlib_level = cd_nelmts > 0 ? cd_values[0] : MI2_DEFAULT_ZSTD_LEVEL;
             break;
           case H5Z_FILTER_FLETCHER32:
             handle->checksum=1;
@@ -242,11 +289,24 @@ int miget_props_multi_resolution(mivolumeprops_t props, miboolean_t *enable_flag
 int miselect_resolution(mihandle_t volume, int depth)
 {
   hid_t grp_id;
+  hid_t image_id;
+  htri_t exists;
   char path[MI2_MAX_PATH];
   
   if ( volume->hdf_id < 0 || depth > MI2_MAX_RESOLUTION_GROUP || depth < 0) {
     return (MI_ERROR);
   }
+  if (micheck_not_concurrent(volume) < 0 || miload_volume_image(volume) < 0) {
+    return (MI_ERROR);
+  }
+  if (depth != 0 && mipyramid_deferred(volume)) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Resolutions of a volume with an unlimited dimension are built when it is closed");
+  }
+  /* The slice scaling tables belong to the resolution being left */
+  if (mislice_range_flush(volume) < 0) {
+    return (MI_ERROR);
+  }
+  mislice_range_free(volume);
   
   grp_id = H5Gopen1(volume->hdf_id, MI_ROOT_PATH "/image");
   if (grp_id < 0) {
@@ -255,22 +315,46 @@ int miselect_resolution(mihandle_t volume, int depth)
   /* Check given depth with the available depth in file.
    Make sure the selected resolution does exist.
    */
-  if (depth > volume->create_props->depth) {
+  snprintf(path, sizeof(path), "%d", depth);
+  H5E_BEGIN_TRY {
+    exists = H5Lexists(grp_id, path, H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (exists <= 0) {
+    H5Gclose(grp_id);
     return (MI_ERROR);
   }
   else if (depth != 0) {
-    if (minc_update_thumbnail(volume, grp_id, 0, depth) < 0) {
-      return (MI_ERROR);
+    /* The reduced resolutions are only rebuilt if the image changed
+     * since they were last built, or if they were never built.
+     */
+    snprintf(path, sizeof(path), "%d/image", depth);
+    H5E_BEGIN_TRY {
+      exists = H5Lexists(grp_id, path, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if (volume->is_dirty || exists <= 0) {
+      if (minc_update_thumbnails(volume) < 0) {
+        H5Gclose(grp_id);
+        return (MI_ERROR);
+      }
+      volume->is_dirty = FALSE;
     }
   }
   
+  snprintf(path, sizeof(path), "%d/image", depth);
+  MI_CHECK_HDF_CALL(image_id = H5Dopen1(grp_id, path),"H5Dopen1");
+  if (image_id < 0) {
+    H5Gclose(grp_id);
+    return (MI_ERROR);
+  }
   volume->selected_resolution = depth;
   
   if (volume->image_id >= 0) {
     H5Dclose(volume->image_id);
   }
-  snprintf(path, sizeof(path), "%d/image", depth);
-  volume->image_id = H5Dopen1(grp_id, path);
+  volume->image_id = image_id;
+  if (michunk_cache_init(volume) < 0) {
+    return (MI_ERROR);
+  }
   
   if (volume->volume_class == MI_CLASS_REAL) {
     if (volume->imax_id >= 0) {
@@ -285,6 +369,7 @@ int miselect_resolution(mihandle_t volume, int depth)
     snprintf(path, sizeof(path), "%d/image-min", depth);
     volume->imin_id = H5Dopen1(grp_id, path);
   }
+  H5Gclose(grp_id);
   return (MI_NOERROR);
 }
 
@@ -298,7 +383,7 @@ int miflush_from_resolution(mihandle_t volume, int depth)
     return (MI_ERROR);
   }
   
-  if (depth > volume->create_props->depth) {
+  if (depth > volume->create_props->depth || mipyramid_deferred(volume)) {
     return (MI_ERROR);
   }
   else {
@@ -314,9 +399,12 @@ int miflush_from_resolution(mihandle_t volume, int depth)
 /** Set compression type for a volume property list
  * Note that enabling compression will automatically
  * enable blocking with default parameters.
+ * MI_COMPRESS_LZ4 and MI_COMPRESS_ZSTD need the corresponding HDF5
+ * filter plugin, MI_ERROR is returned if it cannot be loaded.
  * \param props A volume properties list
- * \param compression_type The type of compression to use (MI_COMPRESS_NONE
- * or MI_COMPRESS_ZLIB)
+ * \param compression_type The type of compression to use (MI_COMPRESS_NONE,
+ * MI_COMPRESS_ZLIB, MI_COMPRESS_SHUFFLE_ZLIB, MI_COMPRESS_LZ4 or
+ * MI_COMPRESS_ZSTD)
  * \ingroup mi2VPrp
  */
 int miset_props_compression_type(mivolumeprops_t props,
@@ -348,6 +436,24 @@ int miset_props_compression_type(mivolumeprops_t props,
       miset_props_blocking(props, MI2_MAX_VAR_DIMS, edge_lengths);
       */
       
+      break;
+    case MI_COMPRESS_SHUFFLE_ZLIB:
+      props->compression_type = MI_COMPRESS_SHUFFLE_ZLIB;
+      props->zlib_level = MI2_DEFAULT_ZLIB_LEVEL;
+      break;
+    case MI_COMPRESS_LZ4:
+      if (H5Zfilter_avail(MI2_H5Z_FILTER_LZ4) <= 0) {
+        return MI_LOG_ERROR(MI2_MSG_GENERIC,"LZ4 filter plugin is not available");
+      }
+      props->compression_type = MI_COMPRESS_LZ4;
+      props->zlib_level = 0;
+      break;
+    case MI_COMPRESS_ZSTD:
+      if (H5Zfilter_avail(MI2_H5Z_FILTER_ZSTD) <= 0) {
+        return MI_LOG_ERROR(MI2_MSG_GENERIC,"Zstandard filter plugin is not available");
+      }
+      props->compression_type = MI_COMPRESS_ZSTD;
+      props->zlib_level = MI2_DEFAULT_ZSTD_LEVEL;
       break;
     default:
       return (MI_ERROR);
@@ -408,6 +514,53 @@ int miget_props_zlib_compression(mivolumeprops_t props, int *zlib_level)
   return (MI_NOERROR);
 }
 
+/** Set the level of the compression type selected in a volume property
+ * list: 1 to 9 for the zlib based types, 1 to 22 for Zstandard. LZ4
+ * has no level and ignores it.
+ * \param props A volume property list handle
+ * \param level The compression level
+ * \ingroup mi2VPrp
+ */
+int miset_props_compression_level(mivolumeprops_t props, int level)
+{
+  int max_level;
+
+  if (props == NULL || level < 0) {
+    return (MI_ERROR);
+  }
+  switch (props->compression_type) {
+    case MI_COMPRESS_ZSTD:
+      max_level = MI2_MAX_ZSTD_LEVEL;
+      break;
+    case MI_COMPRESS_LZ4:
+      return (MI_NOERROR);
+    default:
+      max_level = MI2_MAX_ZLIB_LEVEL;
+      break;
+  }
+  if (level > max_level) {
+    return (MI_ERROR);
+  }
+  props->zlib_level = level;
+  return (MI_NOERROR);
+}
+
+/** Get the level of the compression type selected in a volume property
+ * list.
+ * \param props A volume property list handle
+ * \param level Pointer to an integer variable that will receive the
+ * current compression level.
+ * \ingroup mi2VPrp
+ */
+int miget_props_compression_level(mivolumeprops_t props, int *level)
+{
+  if (props == NULL || level == NULL) {
+    return (MI_ERROR);
+  }
+  *level = props->zlib_level;
+  return (MI_NOERROR);
+}
+
 /** Set blocking structure properties for the volume
  * \param props A volume property list handle
  * \param edge_count
@@ -441,6 +594,60 @@ int miset_props_blocking(mivolumeprops_t props, int edge_count, const int *edge_
   return (MI_NOERROR);
 }
 
+/** Set the access pattern hint for the volume. Unless blocking is set
+ * explicitly with miset_props_blocking(), the chunk shape is chosen to
+ * suit the hinted accesses, with chunks of about the size given to
+ * miset_props_chunk_bytes().
+ * \param props A volume property list handle
+ * \param access_hint A combination of miaccess_hint_t flags
+ * \ingroup mi2VPrp
+ */
+int miset_props_access_hint(mivolumeprops_t props, int access_hint)
+{
+  if (props == NULL ||
+      (access_hint & ~(MI_ACCESS_SLICE | MI_ACCESS_BLOCK3D | MI_ACCESS_TIMESERIES)) != 0) {
+    return (MI_ERROR);
+  }
+  props->access_hint = access_hint;
+  return (MI_NOERROR);
+}
+
+/** Get the access pattern hint for the volume
+ * \ingroup mi2VPrp
+ */
+int miget_props_access_hint(mivolumeprops_t props, int *access_hint)
+{
+  if (props == NULL || access_hint == NULL) {
+    return (MI_ERROR);
+  }
+  *access_hint = props->access_hint;
+  return (MI_NOERROR);
+}
+
+/** Set the target size in bytes of the chunks chosen for an access hint
+ * \ingroup mi2VPrp
+ */
+int miset_props_chunk_bytes(mivolumeprops_t props, misize_t chunk_bytes)
+{
+  if (props == NULL || chunk_bytes == 0) {
+    return (MI_ERROR);
+  }
+  props->chunk_bytes = chunk_bytes;
+  return (MI_NOERROR);
+}
+
+/** Get the target size in bytes of the chunks chosen for an access hint
+ * \ingroup mi2VPrp
+ */
+int miget_props_chunk_bytes(mivolumeprops_t props, misize_t *chunk_bytes)
+{
+  if (props == NULL || chunk_bytes == NULL) {
+    return (MI_ERROR);
+  }
+  *chunk_bytes = props->chunk_bytes;
+  return (MI_NOERROR);
+}
+
 /** Get blocking structure properties for the volume
  * \param props The properties structure from which to get the information
  * \param edge_count Returns the number of edges (dimensions) in a block
@@ -527,6 +734,62 @@ int miget_props_checksum(mivolumeprops_t props,int *on)
   return (MI_NOERROR);
 }
 
+/** Set the number of threads compressing complete chunks when writing
+ * to a volume created with these properties. Zero leaves all of the
+ * compression to HDF5.
+ * \ingroup mi2VPrp
+ */
+int miset_props_compression_threads(mivolumeprops_t props, int threads)
+{
+  if (props == NULL || threads < 0) {
+    return (MI_ERROR);
+  }
+  props->compression_threads = threads;
+  return (MI_NOERROR);
+}
+
+/** Get the number of threads compressing chunks on write.
+ * \ingroup mi2VPrp
+ */
+int miget_props_compression_threads(mivolumeprops_t props, int *threads)
+{
+  if (props == NULL || threads == NULL) {
+    return (MI_ERROR);
+  }
+  *threads = props->compression_threads;
+  return (MI_NOERROR);
+}
+
+/** Set the statistics (mistats_flags_t flags) kept of the values
+ * written to a volume created with these properties, and the number of
+ * bins of their histogram.
+ * \ingroup mi2VPrp
+ */
+int miset_props_statistics(mivolumeprops_t props, int flags, int n_bins)
+{
+  if (props == NULL || n_bins <= 0 ||
+      (flags & ~(MI_STATS_ACCUMULATE | MI_STATS_STORE)) != 0) {
+    return (MI_ERROR);
+  }
+  props->stats_flags = flags;
+  props->stats_bins = n_bins;
+  return (MI_NOERROR);
+}
+
+/** Get the statistics kept of the values written, and the number of
+ * bins of their histogram.
+ * \ingroup mi2VPrp
+ */
+int miget_props_statistics(mivolumeprops_t props, int *flags, int *n_bins)
+{
+  if (props == NULL || flags == NULL || n_bins == NULL) {
+    return (MI_ERROR);
+  }
+  *flags = props->stats_flags;
+  *n_bins = props->stats_bins;
+  return (MI_NOERROR);
+}
+
 
 
 
@@ -19,6 +19,10 @@
 #include <unistd.h>
 #endif //HAVE_UNISTD_H
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /*HAVE_PTHREAD*/
+
 #ifdef HAVE_MINC1
 #include "minc.h"
 #endif //HAVE_MINC1
@@ -27,8 +31,11 @@
 #include <float.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "minc_config.h"
+#include "minc_decompress.h"
 #include "minc2.h"
 #include "minc2_private.h"
 
@@ -43,6 +50,12 @@
 /*Used to optimize chunking size for faster MINC1 API access*/
 #define _MI1_MAX_VAR_BUFFER_SIZE 1000000
 
+/*Growth step of the memory holding a volume created or opened in memory*/
+#define _MI2_CORE_INCREMENT (1024 * 1024)
+
+/*Largest compressed volume decompressed in memory, in MB, by default*/
+#define _MI2_DECOMPRESS_MEMORY 1024
+
 
 /**
 * \defgroup mi2Vol MINC 2.0 Volume Functions
@@ -109,9 +122,44 @@ static int _generate_ident( char * id_str, size_t length )
 }
 
 /**
- * open HDF5 file 
+ * Generate the name of a file held in memory, unique in this process.
+ */
+static void _generate_memory_name(char *name, size_t length)
+{
+  static unsigned int memoryx = 0;
+  unsigned int index;
+#ifdef HAVE_PTHREAD
+  static pthread_mutex_t memoryx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+  pthread_mutex_lock(&memoryx_mutex);
+  index = memoryx++;
+  pthread_mutex_unlock(&memoryx_mutex);
+#else
+  index = memoryx++;
+#endif /*HAVE_PTHREAD*/
+
+  snprintf(name, length, "minc2-memory-%u-%u", (unsigned int) getpid(), index);
+}
+
+/**
+ * Keep the file opened or created with the access properties \a prp_id
+ * in memory, never written to disk. A file opened this way starts as a
+ * copy of the file image \a image of \a length bytes.
+ */
+static int _hdf_set_memory(hid_t prp_id, const void *image, size_t length)
+{
+  MI_CHECK_HDF_CALL_RET(H5Pset_fapl_core(prp_id, _MI2_CORE_INCREMENT, 0),"H5Pset_fapl_core")
+  if (image != NULL) {
+    MI_CHECK_HDF_CALL_RET(H5Pset_file_image(prp_id, (void *) image, length),"H5Pset_file_image")
+  }
+  return MI_NOERROR;
+}
+
+/**
+ * open HDF5 file, or the file image \a image of \a length bytes if it
+ * is not NULL
  */
-static hid_t _hdf_open(const char *path, int mode)
+static hid_t _hdf_open(const char *path, int mode, const void *image, size_t length)
 {
   hid_t fd;
   hid_t prp_id;
@@ -122,6 +170,10 @@ static hid_t _hdf_open(const char *path, int mode)
   prp_id = H5Pcreate(H5P_FILE_ACCESS);
   H5Pset_libver_bounds(prp_id, H5F_LIBVER_V18, H5F_LIBVER_V18);
   H5Pset_cache(prp_id, 0, 2503, miget_cfg_present(MICFG_MINC_FILE_CACHE)?miget_cfg_int(MICFG_MINC_FILE_CACHE)*100000:_MI1_MAX_VAR_BUFFER_SIZE*10, 1.0);
+  if (image != NULL && _hdf_set_memory(prp_id, image, length) < 0) {
+    H5Pclose(prp_id);
+    return MI_ERROR;
+  }
   
   H5E_BEGIN_TRY {
 #ifdef HDF5_MMAP_TEST
@@ -209,10 +261,48 @@ static hid_t _hdf_open(const char *path, int mode)
 }
 
 
+/**
+ * Open the gzip or bzip2 compressed HDF5 file \a path read-only. It is
+ * decompressed in memory if it takes no more than MINC_DECOMPRESS_MEMORY_MB
+ * megabytes, in a temporary file deleted once open otherwise.
+ */
+static hid_t _hdf_open_compressed(const char *path)
+{
+  size_t limit = (size_t) _MI2_DECOMPRESS_MEMORY;
+  char name[64];
+  char *temp_file;
+  void *image;
+  size_t length;
+  hid_t fd;
+  int r;
+
+  if (midecompress_type(path) == MIDECOMPRESS_NONE) {
+    return MI_ERROR;
+  }
+  if (miget_cfg_present(MICFG_DECOMPRESS_MEMORY)) {
+    r = miget_cfg_int(MICFG_DECOMPRESS_MEMORY);
+    limit = (r > 0) ? (size_t) r : 0;
+  }
+  r = midecompress_to_memory(path, limit * 1024 * 1024, &image, &length);
+  if (r == 0) {
+    _generate_memory_name(name, sizeof(name));
+    fd = _hdf_open(name, H5F_ACC_RDONLY, image, length);
+    free(image);
+    return fd;
+  }
+  if (r < 0 || (temp_file = midecompress_to_tempfile(path)) == NULL) {
+    return MI_ERROR;
+  }
+  fd = _hdf_open(temp_file, H5F_ACC_RDONLY, NULL, 0);
+  unlink(temp_file);            /*file will be deleted immediately after closing*/
+  free(temp_file);
+  return fd;
+}
+
 /** 
- * Create an HDF5 file. 
+ * Create an HDF5 file, kept in memory if \a in_memory is TRUE.
  */
-static hid_t _hdf_create(const char *path, int cmode)
+static hid_t _hdf_create(const char *path, int cmode, int in_memory)
 {
   hid_t grp_id;
   hid_t fd;
@@ -226,10 +316,15 @@ static hid_t _hdf_create(const char *path, int cmode)
   H5Pset_libver_bounds(fpid, H5F_LIBVER_V18, H5F_LIBVER_V18);
   
   H5Pset_cache(fpid, 0, 2503, miget_cfg_present(MICFG_MINC_FILE_CACHE)?miget_cfg_int(MICFG_MINC_FILE_CACHE)*100000:_MI1_MAX_VAR_BUFFER_SIZE*100, 1.0);
+  if (in_memory && _hdf_set_memory(fpid, NULL, 0) < 0) {
+    H5Pclose(fpid);
+    return MI_ERROR;
+  }
   
   H5E_BEGIN_TRY {
     fd = H5Fcreate(path, cmode, H5P_DEFAULT, fpid);
   } H5E_END_TRY;
+  H5Pclose(fpid);
   
   if (fd < 0) {
     /*TODO: report error properly*/
@@ -285,6 +380,8 @@ int micreate_volume_image(mihandle_t volume)
   hid_t dataspace_id;
   hid_t dset_id;
   hsize_t hdf_size[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_maxsize[MI2_MAX_VAR_DIMS];
+  int extendable = (volume->number_of_dims > 0 && volume->dim_handles[0]->unlimited);
 
   /* Try creating IMAGE dataset i.e. /minc-2.0/image/0/image
   */
@@ -293,6 +390,7 @@ int micreate_volume_image(mihandle_t volume)
 
   for (i = 0; i < volume->number_of_dims; i++) {
     hdf_size[i] = volume->dim_handles[i]->length;
+    hdf_maxsize[i] = (i == 0 && extendable) ? H5S_UNLIMITED : hdf_size[i];
 
     /* Create the dimorder string, ordered comma-separated
       list of dimension names.
@@ -305,7 +403,7 @@ int micreate_volume_image(mihandle_t volume)
 
 
   /* Create a SIMPLE dataspace  */
-  dataspace_id = H5Screate_simple(volume->number_of_dims, hdf_size, NULL);
+  dataspace_id = H5Screate_simple(volume->number_of_dims, hdf_size, hdf_maxsize);
   if (dataspace_id < 0) {
     return MI_ERROR;
   }
@@ -327,6 +425,10 @@ int micreate_volume_image(mihandle_t volume)
 
   H5Sclose(dataspace_id);
 
+  if (michunk_cache_init(volume) < 0) {
+    return (MI_ERROR);
+  }
+
   if (volume->volume_class == MI_CLASS_REAL) {
     int ndims;
     hid_t dcpl_id;
@@ -340,7 +442,18 @@ int micreate_volume_image(mihandle_t volume)
       * now this is an oversimplification!
       */
       ndims = volume->number_of_dims - 2;
-      MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate_simple(ndims, hdf_size, NULL),"H5Screate_simple")
+      MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate_simple(ndims, hdf_size, hdf_maxsize),"H5Screate_simple")
+
+      /* The slice ranges grow with the frames appended */
+      if (extendable) {
+        hsize_t chunk[MI2_MAX_VAR_DIMS];
+
+        chunk[0] = MI2_DIM_CHUNK_LENGTH;
+        for (i = 1; i < ndims; i++) {
+          chunk[i] = (hdf_size[i] > 0) ? hdf_size[i] : 1;
+        }
+        MI_CHECK_HDF_CALL_RET(H5Pset_chunk(dcpl_id, ndims, chunk),"H5Pset_chunk")
+      }
     } else {
       ndims = 0;
       MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate(H5S_SCALAR),"H5Screate")
@@ -393,6 +506,112 @@ int micreate_volume_image(mihandle_t volume)
   return (MI_NOERROR);
 }
 
+/** Grow the image of \a volume, with its slice ranges and the offsets of
+ * its unlimited dimension, to \a n_slabs along that dimension.
+ */
+static int miextend_volume_image(mihandle_t volume, hsize_t n_slabs)
+{
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  hid_t fspc_id;
+  int ndims;
+
+  MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->image_id),"H5Dget_space");
+  ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+  H5Sclose(fspc_id);
+  if (ndims != volume->number_of_dims) {
+    return (MI_ERROR);
+  }
+  dims[0] = n_slabs;
+  MI_CHECK_HDF_CALL_RET(H5Dset_extent(volume->image_id, dims),"H5Dset_extent");
+
+  if (volume->has_slice_scaling && volume->imax_id >= 0 && volume->imin_id >= 0) {
+    MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(volume->imax_id),"H5Dget_space");
+    ndims = H5Sget_simple_extent_dims(fspc_id, dims, NULL);
+    H5Sclose(fspc_id);
+    if (ndims > 0) {
+      dims[0] = n_slabs;
+      MI_CHECK_HDF_CALL_RET(H5Dset_extent(volume->imax_id, dims),"H5Dset_extent");
+      MI_CHECK_HDF_CALL_RET(H5Dset_extent(volume->imin_id, dims),"H5Dset_extent");
+    }
+  }
+
+  if (miextend_dimension(volume->dim_handles[0], n_slabs) < 0 ||
+      mislice_range_extend(volume, n_slabs) < 0 ||
+      mistats_extend(volume, n_slabs) < 0) {
+    return (MI_ERROR);
+  }
+  michunk_cache_extend(volume, n_slabs);
+  volume->is_dirty = TRUE;
+  return (MI_NOERROR);
+}
+
+/** Append a frame to a volume whose first dimension in file order is
+  * unlimited, see miset_dimension_unlimited(). The image grows by one
+  * position along that dimension, and so do the image-max and image-min
+  * tables and the offsets and widths of an irregular dimension. If
+  * \a buffer is not NULL, the voxels of the new frame are written from it
+  * as miset_voxel_value_hyperslab() would, in the apparent order of the
+  * other dimensions; otherwise the frame reads as the fill value until it
+  * is written. The reduced resolutions of the volume are only built when
+  * it is closed.
+  * \ingroup mi2Vol
+*/
+int miappend_volume_frame(mihandle_t volume, mitype_t buffer_data_type,
+                          const void *buffer)
+{
+  midimhandle_t hdim;
+  misize_t start[MI2_MAX_VAR_DIMS];
+  misize_t count[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+  int dir[MI2_MAX_VAR_DIMS];
+  hsize_t frame;
+  int frame_i = 0;
+  int result;
+  int i;
+
+  if (volume == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to append a frame to a null volume");
+  }
+  if ((volume->mode & MI2_OPEN_RDWR) == 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Only volumes opened for writing can be appended to");
+  }
+  if (volume->number_of_dims == 0 || !volume->dim_handles[0]->unlimited) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Volume has no unlimited dimension");
+  }
+  if (volume->image_id < 0 || volume->selected_resolution != 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Frames are appended to the full resolution image");
+  }
+  hdim = volume->dim_handles[0];
+  frame = hdim->length;
+
+  mihdf_lock(volume);
+  result = miextend_volume_image(volume, frame + 1);
+  mihdf_unlock(volume);
+  if (result < 0 || buffer == NULL) {
+    return (result);
+  }
+
+  /* The new frame in apparent order, counted from the other end if the
+   * unlimited dimension is flipped.
+   */
+  for (i = 0; i < volume->number_of_dims; i++) {
+    int file_i = (volume->dim_indices != NULL) ? volume->dim_indices[i] : i;
+
+    if (file_i == 0) {
+      frame_i = i;
+    }
+    start[i] = (file_i == 0) ? frame : 0;
+    count[i] = (file_i == 0) ? 1 : volume->dim_handles[file_i]->length;
+  }
+  mitranslate_hyperslab_origin(volume, start, count, hdf_start, hdf_count, dir);
+  if (hdf_start[0] != frame) {
+    start[frame_i] = 0;
+  }
+  return miset_voxel_value_hyperslab(volume, buffer_data_type, start, count,
+                                     (void *) buffer);
+}
+
 /** Set up the array of conversions from voxel to world coordinate order.
 */
 static int miset_volume_world_indices(mihandle_t hvol)
@@ -445,15 +664,124 @@ static mihandle_t mialloc_volume_handle(void)
     handle->is_dirty = FALSE;
     handle->dim_indices = NULL;
     handle->selected_resolution = 0;
+    handle->read_threads = michunk_default_threads(MICFG_READ_THREADS);
+    handle->write_threads = michunk_default_threads(MICFG_COMPRESS_THREADS);
   }
   return (handle);
 }
 
-/** Create a volume with the specified name, dimensions,
-    type, class, volume properties and retrieve the volume handle.
-    \ingroup mi2Vol
+/** Give the \a n dimensions listed in \a which roughly equal chunk
+ * edges, no longer than the dimensions, whose product does not exceed
+ * \a budget elements. Returns what is left of the budget.
+ */
+static hsize_t miplan_chunk_block(midimhandle_t dimensions[], const int which[],
+                                  int n, hsize_t budget, hsize_t chunk[])
+{
+  int done[MI2_MAX_VAR_DIMS];
+  int remaining = n;
+  int changed = TRUE;
+  hsize_t edge;
+  int k;
+
+  for (k = 0; k < n; k++) {
+    done[k] = FALSE;
+  }
+  /* Dimensions shorter than the ideal edge are taken whole, and their
+     share of the budget is passed on to the others. */
+  while (changed && remaining > 0) {
+    double ideal = pow((double) budget, 1.0 / remaining);
+
+    changed = FALSE;
+    for (k = 0; k < n; k++) {
+      if (!done[k] && (double) dimensions[which[k]]->length <= ideal) {
+        chunk[which[k]] = dimensions[which[k]]->length;
+        budget /= chunk[which[k]];
+        if (budget < 1) {
+          budget = 1;
+        }
+        done[k] = TRUE;
+        remaining--;
+        changed = TRUE;
+      }
+    }
+  }
+  if (remaining > 0) {
+    edge = (hsize_t) floor(pow((double) budget, 1.0 / remaining) + 1e-6);
+    if (edge < 1) {
+      edge = 1;
+    }
+    for (k = 0; k < n; k++) {
+      if (!done[k]) {
+        chunk[which[k]] = edge;
+        budget /= edge;
+      }
+    }
+  }
+  return (budget < 1 ? 1 : budget);
+}
+
+/** Choose the chunk shape of a new image from the access hint of
+ * \a props, aiming at chunks of props->chunk_bytes bytes.
+ * Time series keep every time point in one chunk, unless frames are
+ * appended along an unlimited time dimension. Slices span the two
+ * fastest varying spatial dimensions and stack as many slices as fit
+ * along the others. 3D blocks are about as long along every spatial
+ * dimension. Other dimensions, vector components for example, are
+ * never split.
+ */
+static void miplan_chunk_shape(int ndims, midimhandle_t dimensions[],
+                               size_t unit_size, mivolumeprops_t props,
+                               hsize_t chunk[])
+{
+  int spatial[MI2_MAX_VAR_DIMS];
+  int n_spatial = 0;
+  int hint = props->access_hint;
+  hsize_t budget = props->chunk_bytes / unit_size;
+  int i;
+
+  for (i = 0; i < ndims; i++) {
+    switch (dimensions[i]->dim_class) {
+    case MI_DIMCLASS_SPATIAL:
+    case MI_DIMCLASS_SFREQUENCY:
+      spatial[n_spatial++] = i;
+      chunk[i] = 1;
+      continue;
+    case MI_DIMCLASS_TIME:
+    case MI_DIMCLASS_TFREQUENCY:
+      chunk[i] = ((hint & MI_ACCESS_TIMESERIES) && !dimensions[i]->unlimited) ?
+                 dimensions[i]->length : 1;
+      break;
+    default:
+      chunk[i] = dimensions[i]->length;
+      break;
+    }
+    budget /= chunk[i];
+  }
+  if (budget < 1) {
+    budget = 1;
+  }
+
+  if ((hint & MI_ACCESS_BLOCK3D) || !(hint & MI_ACCESS_SLICE)) {
+    miplan_chunk_block(dimensions, spatial, n_spatial, budget, chunk);
+  } else {
+    int n_plane = n_spatial < 2 ? n_spatial : 2;
+
+    budget = miplan_chunk_block(dimensions, spatial + n_spatial - n_plane,
+                                n_plane, budget, chunk);
+    for (i = n_spatial - n_plane - 1; i >= 0; i--) {
+      hsize_t length = dimensions[spatial[i]]->length;
+
+      chunk[spatial[i]] = budget < length ? budget : length;
+      budget /= chunk[spatial[i]];
+    }
+  }
+}
+
+/** Create a volume in the file \a filename, or in memory under that
+    name if \a in_memory is TRUE.
 */
-int micreate_volume(const char *filename, int number_of_dimensions,
+static int micreate_volume_file(const char *filename, int in_memory,
+                int number_of_dimensions,
                 midimhandle_t dimensions[], mitype_t volume_type,
                 miclass_t volume_class, mivolumeprops_t create_props,
                 mihandle_t *volume)
@@ -465,6 +793,9 @@ int micreate_volume(const char *filename, int number_of_dimensions,
   hid_t hdf_plist;
   hid_t fspc_id;
   hsize_t dim[1];
+  hsize_t maxdim[1];
+  hsize_t chunk_dim[1];
+  hid_t dim_plist;
   hid_t grp_id;
   herr_t status;
   hid_t dataset_id = -1;
@@ -478,6 +809,8 @@ int micreate_volume(const char *filename, int number_of_dimensions,
   char ident_str[128];
   hid_t tmp_type;
   int   dimension_is_vector = 0;
+  int   chunked;
+  int   extendable = FALSE;
 
   /* Initialization.
     For the actual body of this function look at m2utils.c
@@ -494,6 +827,17 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     return MI_LOG_ERROR(MI2_MSG_GENERIC," Can't create volume with undefined dimensions");
   }
 
+  /* Only the slowest varying dimension can grow
+  */
+  for (i = 0; i < number_of_dimensions; i++) {
+    if (dimensions[i]->unlimited) {
+      if (i != 0 || dimensions[i]->dim_class != MI_DIMCLASS_TIME) {
+        return MI_LOG_ERROR(MI2_MSG_GENERIC," Only the first dimension, of class time, can be unlimited");
+      }
+      extendable = TRUE;
+    }
+  }
+
   /* Allocate space for the volume handle
   */
   handle = mialloc_volume_handle();
@@ -585,7 +929,7 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     and create ID and ID access as default.
   */
 
-  file_id = _hdf_create(filename, H5F_ACC_TRUNC);
+  file_id = _hdf_create(filename, H5F_ACC_TRUNC, in_memory);
   if (file_id < 0) {
     free(handle);
     return (MI_ERROR);
@@ -622,16 +966,19 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     raw data for a dataset.
   */
 
-  if (create_props != NULL  &&
-      ( create_props->compression_type == MI_COMPRESS_ZLIB ||
-        create_props->edge_count != 0 )
-      )
+  chunked = (create_props != NULL  &&
+             ( create_props->compression_type != MI_COMPRESS_NONE ||
+               create_props->edge_count != 0 ||
+               create_props->access_hint != MI_ACCESS_DEFAULT ));
+
+  /* An image extended along an unlimited dimension has to be chunked */
+  if (chunked || extendable)
   {
     /* Set the storage to CHUNKED */
     MI_CHECK_HDF_CALL_RET( stat = H5Pset_layout(hdf_plist, H5D_CHUNKED),"H5Pset_layout")
     
 
-    if(create_props->edge_count != 0) {
+    if(create_props != NULL && create_props->edge_count != 0) {
       /* Create an array, hdf_size, containing the size of each chunk
       */
       for ( i=0; i < number_of_dimensions; i++) {
@@ -644,6 +991,9 @@ int micreate_volume(const char *filename, int number_of_dimensions,
             hdf_size[i] = dimensions[i]->length;
         }
       }
+    } else if (create_props != NULL && create_props->access_hint != MI_ACCESS_DEFAULT) {
+      miplan_chunk_shape(number_of_dimensions, dimensions,
+                         H5Tget_size(handle->ftype_id), create_props, hdf_size);
     } else {
       hsize_t val = 1;
       size_t unit_size = H5Tget_size(handle->ftype_id);
@@ -661,19 +1011,60 @@ int micreate_volume(const char *filename, int number_of_dimensions,
       }
     }
 
+    /* Frames are appended one at a time */
+    if (extendable) {
+      hdf_size[0] = 1;
+    }
+
     /* Sets the size of the chunks used to store a chunked layout dataset */
     MI_CHECK_HDF_CALL_RET(stat = H5Pset_chunk(hdf_plist, number_of_dimensions, hdf_size),"H5Pset_chunk")
-    
-    /* Sets compression method and compression level */
-    MI_CHECK_HDF_CALL_RET(stat = H5Pset_deflate(hdf_plist, create_props->zlib_level),"H5Pset_deflate")
 
+    /* Chunks get storage only once they are written, chunks never
+      written read as the fill value without any I/O.
+    */
+    MI_CHECK_HDF_CALL_RET(stat = H5Pset_alloc_time(hdf_plist, H5D_ALLOC_TIME_INCR),"H5Pset_alloc_time")
     
-    if (create_props->checksum )
-    {
-      MI_CHECK_HDF_CALL_RET(H5Pset_fletcher32(hdf_plist),"H5Pset_fletcher32")
+    if (chunked) {
+      /* Sets compression method and compression level, the fast codecs
+        are preceded by a byte shuffle which groups the bytes of equal
+        significance together.
+      */
+      switch (create_props->compression_type) {
+      case MI_COMPRESS_SHUFFLE_ZLIB:
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_shuffle(hdf_plist),"H5Pset_shuffle")
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_deflate(hdf_plist, create_props->zlib_level),"H5Pset_deflate")
+        break;
+      case MI_COMPRESS_LZ4:
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_shuffle(hdf_plist),"H5Pset_shuffle")
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_filter(hdf_plist, MI2_H5Z_FILTER_LZ4, H5Z_FLAG_MANDATORY, 0, NULL),"H5Pset_filter")
+        break;
+      case MI_COMPRESS_ZSTD:
+        {
+          unsigned int level = (unsigned int) create_props->zlib_level;
+
+          MI_CHECK_HDF_CALL_RET(stat = H5Pset_shuffle(hdf_plist),"H5Pset_shuffle")
+          MI_CHECK_HDF_CALL_RET(stat = H5Pset_filter(hdf_plist, MI2_H5Z_FILTER_ZSTD, H5Z_FLAG_MANDATORY, 1, &level),"H5Pset_filter")
+        }
+        break;
+      case MI_COMPRESS_NONE:
+        /* Chunked only to follow the access hint, stored unfiltered */
+        if (create_props->edge_count == 0) {
+          break;
+        }
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_deflate(hdf_plist, create_props->zlib_level),"H5Pset_deflate")
+        break;
+      default:
+        MI_CHECK_HDF_CALL_RET(stat = H5Pset_deflate(hdf_plist, create_props->zlib_level),"H5Pset_deflate")
+        break;
+      }
+
+
+      if (create_props->checksum )
+      {
+        MI_CHECK_HDF_CALL_RET(H5Pset_fletcher32(hdf_plist),"H5Pset_fletcher32")
+      }
     }
 
-    
   } else { /* No COMPRESSION or CHUNKING is enabled */
     
     MI_CHECK_HDF_CALL_RET(stat = H5Pset_layout(hdf_plist, H5D_CONTIGUOUS),"H5Pset_layout") /*  CONTIGUOUS data */
@@ -704,9 +1095,19 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     /* First create the dataspace required to create a
       dimension variable (dataset)
     */
+    dim_plist = H5P_DEFAULT;
     if (dimensions[i]->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED) {
       dim[0] = dimensions[i]->length;
-      MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate_simple(1, dim, NULL),"H5Screate_simple")
+      if (dimensions[i]->unlimited) {
+        /* The offsets and widths grow with the frames appended */
+        maxdim[0] = H5S_UNLIMITED;
+        chunk_dim[0] = MI2_DIM_CHUNK_LENGTH;
+        MI_CHECK_HDF_CALL_RET(dim_plist = H5Pcreate(H5P_DATASET_CREATE),"H5Pcreate")
+        MI_CHECK_HDF_CALL_RET(H5Pset_chunk(dim_plist, 1, chunk_dim),"H5Pset_chunk")
+      } else {
+        maxdim[0] = dim[0];
+      }
+      MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate_simple(1, dim, maxdim),"H5Screate_simple")
     } else {
       MI_CHECK_HDF_CALL_RET(dataspace_id = H5Screate(H5S_SCALAR),"H5Screate")
     }
@@ -721,7 +1122,7 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     
     /* Create a dataset(dimension variable name) in DIMENSIONS GROUP */
     MI_CHECK_HDF_CALL_RET(dataset_id = H5Dcreate2(grp_id, dimensions[i]->name,
-                            H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT,  H5P_DEFAULT, H5P_DEFAULT),"H5Dcreate2")
+                            H5T_IEEE_F64LE, dataspace_id, H5P_DEFAULT,  dim_plist, H5P_DEFAULT),"H5Dcreate2")
 
     /* Dimension variable for a regular dimension contains
       no meaningful data. Whereas, Dimension variable for
@@ -739,7 +1140,8 @@ int micreate_volume(const char *filename, int number_of_dimensions,
       offset values are provided for this dimension
     */
     if (dimensions[i]->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED) {
-      if (dimensions[i]->offsets == NULL) {
+      miload_dimension_spacing(dimensions[i]);
+      if (dimensions[i]->offsets == NULL && dimensions[i]->length != 0) {
         free(handle);
         return (MI_ERROR);
       } else {
@@ -750,8 +1152,10 @@ int micreate_volume(const char *filename, int number_of_dimensions,
         /* Write the raw data from buffer (dimensions[i]->offsets)
           to the dataset.
         */
-        MI_CHECK_HDF_CALL_RET(status = H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, dataspace_id,
-                          fspc_id, H5P_DEFAULT, dimensions[i]->offsets),"H5Dwrite")
+        if (dimensions[i]->length != 0) {
+          MI_CHECK_HDF_CALL_RET(status = H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, dataspace_id,
+                            fspc_id, H5P_DEFAULT, dimensions[i]->offsets),"H5Dwrite")
+        }
         
         /* Write the raw data from buffer (dimensions[i]->offsets)
           to the dataset.
@@ -763,14 +1167,16 @@ int micreate_volume(const char *filename, int number_of_dimensions,
 
         /* Create dataset dimension_name-width */
         dataset_width = H5Dcreate2(grp_id, name, H5T_IEEE_F64LE,
-                                   dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                                   dataspace_id, H5P_DEFAULT, dim_plist, H5P_DEFAULT);
         /* Return an Id for the dataspace of the dataset dataset_width */
         MI_CHECK_HDF_CALL_RET(fspc_id = H5Dget_space(dataset_width),"H5Dget_space")
         
         /* Write the raw data from buffer (dimensions[i]->widths)
           to the dataset.
         */
-        MI_CHECK_HDF_CALL_RET(status = H5Dwrite(dataset_width, H5T_NATIVE_DOUBLE, dataspace_id, fspc_id, H5P_DEFAULT, dimensions[i]->widths),"H5Dwrite")
+        if (dimensions[i]->length != 0) {
+          MI_CHECK_HDF_CALL_RET(status = H5Dwrite(dataset_width, H5T_NATIVE_DOUBLE, dataspace_id, fspc_id, H5P_DEFAULT, dimensions[i]->widths),"H5Dwrite")
+        }
         
         miset_attr_at_loc(dataset_id, "dimorder", MI_TYPE_STRING,
                           strlen(dimensions[i]->name), dimensions[i]->name);
@@ -885,6 +1291,9 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     /* Close the dataset with the specified Id
     */
     H5Dclose(dataset_id);
+    if (dim_plist != H5P_DEFAULT) {
+      H5Pclose(dim_plist);
+    }
 
 
   } //for (i=0; i < number_of_dimensions ; i++)
@@ -966,15 +1375,18 @@ int micreate_volume(const char *filename, int number_of_dimensions,
     levels of resolution is specified maximum is 16.
     */
     props_handle->depth = create_props->depth;
-    /* Set compression type, currently two values
-    either no compression or zlib is applicable.
+    /* Set compression type, either no compression, zlib with or
+    without byte shuffle, LZ4 or Zstandard.
     */
     switch (create_props->compression_type) {
     case MI_COMPRESS_NONE:
       props_handle->compression_type = MI_COMPRESS_NONE;
       break;
     case MI_COMPRESS_ZLIB:
-      props_handle->compression_type = MI_COMPRESS_ZLIB;
+    case MI_COMPRESS_SHUFFLE_ZLIB:
+    case MI_COMPRESS_LZ4:
+    case MI_COMPRESS_ZSTD:
+      props_handle->compression_type = create_props->compression_type;
       break;
     default:
       free(props_handle);
@@ -1004,6 +1416,14 @@ int micreate_volume(const char *filename, int number_of_dimensions,
       strcpy(props_handle->record_name, create_props->record_name);
     }
     props_handle->template_flag = create_props->template_flag;
+    props_handle->compression_threads = create_props->compression_threads;
+    props_handle->access_hint = create_props->access_hint;
+    props_handle->chunk_bytes = create_props->chunk_bytes;
+    props_handle->stats_flags = create_props->stats_flags;
+    props_handle->stats_bins = create_props->stats_bins;
+    handle->write_threads = create_props->compression_threads;
+  } else {
+    props_handle->compression_threads = handle->write_threads;
   }
   /* Set the handle to volume properties */
   handle->create_props = props_handle;
@@ -1013,6 +1433,37 @@ int micreate_volume(const char *filename, int number_of_dimensions,
   return (MI_NOERROR);
 }
 
+/** Create a volume with the specified name, dimensions,
+    type, class, volume properties and retrieve the volume handle.
+    \ingroup mi2Vol
+*/
+int micreate_volume(const char *filename, int number_of_dimensions,
+                midimhandle_t dimensions[], mitype_t volume_type,
+                miclass_t volume_class, mivolumeprops_t create_props,
+                mihandle_t *volume)
+{
+  return micreate_volume_file(filename, FALSE, number_of_dimensions,
+                              dimensions, volume_type, volume_class,
+                              create_props, volume);
+}
+
+/** Create a volume held in memory, with the specified dimensions,
+    type, class, volume properties and retrieve the volume handle.
+    \ingroup mi2Vol
+*/
+int micreate_volume_in_memory(int number_of_dimensions,
+                midimhandle_t dimensions[], mitype_t volume_type,
+                miclass_t volume_class, mivolumeprops_t create_props,
+                mihandle_t *volume)
+{
+  char name[64];
+
+  _generate_memory_name(name, sizeof(name));
+  return micreate_volume_file(name, TRUE, number_of_dimensions,
+                              dimensions, volume_type, volume_class,
+                              create_props, volume);
+}
+
 /** Return the number of dimensions associated with this volume.
   * \ingroup mi2Vol
 */
@@ -1207,6 +1658,23 @@ static int _miget_irregular_spacing(mihandle_t hvol, midimhandle_t hdim)
   return 0;
 }
 
+/** Read the offsets and widths of an irregular dimension of a volume
+ * opened with MI2_OPEN_HEADER_ONLY, when they are first used.
+ */
+int miload_dimension_spacing(midimhandle_t hdim)
+{
+  int result;
+
+  if (!hdim->spacing_pending) {
+    return (MI_NOERROR);
+  }
+  hdim->spacing_pending = FALSE;
+  H5E_BEGIN_TRY {
+    result = _miget_irregular_spacing(hdim->volume_handle, hdim);
+  } H5E_END_TRY;
+  return (result);
+}
+
 /* Get dimension variable attributes for the given dimension name */
 static int _miget_file_dimension(mihandle_t volume, const char *dimname,
                       midimhandle_t *hdim_ptr)
@@ -1215,6 +1683,7 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
   char temp[MI2_CHAR_LENGTH];
   midimhandle_t hdim;
   unsigned int len;
+  hid_t dset_id;
 
   /* Create a path with the dimension name */
   snprintf(path, sizeof(path), MI_ROOT_PATH "/dimensions/%s", dimname);
@@ -1225,21 +1694,28 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
 
   hdim->name = strdup(dimname);
 
+  /* The attributes are all read from the dimension variable */
+  dset_id = midescend_path(volume->hdf_id, path);
+
   /* hdf5 macro can temporarily disable the automatic error printing */
   H5E_BEGIN_TRY {
     int r;
     /* Get the attribute (spacing) from a minc file */
-    r = miget_attribute(volume, path, "spacing", MI_TYPE_STRING, MI2_CHAR_LENGTH, temp);
+    r = miget_attr_at_loc(dset_id, "spacing", MI_TYPE_STRING, MI2_CHAR_LENGTH, temp);
     
     if (r==MI_NOERROR && !strcmp(temp, "irregular")) {
       hdim->attr |= MI_DIMATTR_NOT_REGULARLY_SAMPLED;
-      _miget_irregular_spacing(volume, hdim);
+      if ((volume->mode & MI2_OPEN_HEADER_ONLY) != 0) {
+        hdim->spacing_pending = TRUE;
+      } else {
+        _miget_irregular_spacing(volume, hdim);
+      }
     } else {
       hdim->attr |= MI_DIMATTR_REGULARLY_SAMPLED;
     }
 
     /* Get the attribute (class) from a minc file */
-    r = miget_attribute(volume, path, "class", MI_TYPE_STRING,  MI2_CHAR_LENGTH, temp);
+    r = miget_attr_at_loc(dset_id, "class", MI_TYPE_STRING,  MI2_CHAR_LENGTH, temp);
     if (r < 0) {
       /* Get the default class. */
       if (!strcmp(dimname, MItime)) {
@@ -1273,7 +1749,7 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
      * the right type, then assign it to the structure member, to guarantee 
      * proper promotion.
      */
-    r = miget_attribute(volume, path, "length", MI_TYPE_UINT, 1, &len);
+    r = miget_attr_at_loc(dset_id, "length", MI_TYPE_UINT, 1, &len);
     if (r < 0) {
       MI_LOG_ERROR(MI2_MSG_GENERIC,"Can't determine dimension length");
     }
@@ -1281,18 +1757,18 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
 
     /* Get the attribute (start) from a minc file for NON vector_dimension only */
     if (strcmp(dimname, "vector_dimension")) {
-      r = miget_attribute(volume, path, MIstart, MI_TYPE_DOUBLE, 1, &hdim->start);
+      r = miget_attr_at_loc(dset_id, MIstart, MI_TYPE_DOUBLE, 1, &hdim->start);
       if (r < 0) {
         hdim->start = 0.0;
       }
       /* Get the attribute (step) from a minc file */
-      r = miget_attribute(volume, path, MIstep, MI_TYPE_DOUBLE, 1, &hdim->step);
+      r = miget_attr_at_loc(dset_id, MIstep, MI_TYPE_DOUBLE, 1, &hdim->step);
       if (r < 0) {
         hdim->step = 1.0;
       }
     }
     /* Get the attribute (direction_cosines) from a minc file */
-    r = miget_attribute(volume, path, MIdirection_cosines, MI_TYPE_DOUBLE, 3,
+    r = miget_attr_at_loc(dset_id, MIdirection_cosines, MI_TYPE_DOUBLE, 3,
                         hdim->direction_cosines);
     if (r < 0) {
       hdim->direction_cosines[MI2_X] = 0.0;
@@ -1307,7 +1783,7 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
       }
     }
 
-    r = miget_attribute(volume, path, "units", MI_TYPE_STRING,
+    r = miget_attr_at_loc(dset_id, "units", MI_TYPE_STRING,
                         MI2_CHAR_LENGTH, temp);
     if (r < 0) {
       hdim->units = strdup("");
@@ -1316,6 +1792,13 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
     }
 
   } H5E_END_TRY;
+  if (dset_id >= 0) {
+    if (H5Iget_type(dset_id) == H5I_GROUP) {
+      H5Gclose(dset_id);
+    } else {
+      H5Dclose(dset_id);
+    }
+  }
   /* Return the dimension handle */
   *hdim_ptr = hdim;
   hdim->volume_handle = volume;
@@ -1323,59 +1806,236 @@ static int _miget_file_dimension(mihandle_t volume, const char *dimname,
 }
 
 
-/** Opens an existing MINC volume for read-only access if mode argument is
-  * MI2_OPEN_READ, or read-write access if mode argument is MI2_OPEN_RDWR.
-  * \ingroup mi2Vol
-*/
-int miopen_volume(const char *filename, int mode, mihandle_t *volume)
+/** \internal
+ * Open the image dataset of a volume and its scaling datasets, and read
+ * the data type, valid range and scaling they define.
+ */
+static int miopen_volume_image(mihandle_t handle)
 {
-  hid_t file_id;
   hid_t dset_id;
   hid_t space_id;
-  mihandle_t handle;
-  int hdf_mode;
-  char dimorder[MI2_CHAR_LENGTH];
-  int i,r;
-  char *p1, *p2;
+  hsize_t hdf_dims[MI2_MAX_VAR_DIMS];
+  hsize_t hdf_maxdims[MI2_MAX_VAR_DIMS];
   H5T_class_t hdf_class;
   size_t nbytes;
   int is_signed;
-  int n_dimensions;
+  int i;
 
-  /* Initialization.
-    For the actual body of this function look at m2utils.c
+  /* SEE IF SLICE SCALING IS ENABLED
   */
-  miinit();
-  /* Convert the specified mode to hdf mode */
-  if (mode == MI2_OPEN_READ) {
-    hdf_mode = H5F_ACC_RDONLY;
-  } else if (mode == MI2_OPEN_RDWR) {
-    hdf_mode = H5F_ACC_RDWR;
-  } else {
-    return (MI_ERROR);
+  handle->has_slice_scaling = FALSE;
+  /* hdf5 macro can temporarily disable the automatic error printing */
+  H5E_BEGIN_TRY {
+    /* Open the dataset image-max at the specified path*/
+    dset_id = H5Dopen1(handle->hdf_id, MI_ROOT_PATH "/image/0/image-max");
+  } H5E_END_TRY;
+  
+  if (dset_id >= 0) {
+    /* Get the Id of the copy of the dataspace of the dataset */
+    space_id = H5Dget_space(dset_id);
+    if (space_id >= 0) {
+      
+      /* If the dimensionality of the image-max variable is one or
+      * greater, we consider this volume to have slice-scaling enabled.
+      */
+      if ( H5Sget_simple_extent_ndims(space_id) >= 1) {
+        handle->has_slice_scaling = TRUE;
+      }
+      H5Sclose(space_id);	/* Close the dataspace handle */
+    }
+    H5Dclose(dset_id);	/* Close the dataset handle */
   }
-  /* Allocate space for the volume handle */
-  handle = mialloc_volume_handle();
-  if (handle == NULL) {
-    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM,sizeof(struct mivolume));
+
+  if (!handle->has_slice_scaling) {
+    /* Read the minimum scalar of the given type at the specified path */
+    miget_scalar(handle->hdf_id, H5T_NATIVE_DOUBLE,
+                 MI_ROOT_PATH "/image/0/image-min", &handle->scale_min);
+    /* Read the maximum scalar of the given type at the specified path */
+    miget_scalar(handle->hdf_id, H5T_NATIVE_DOUBLE,
+                 MI_ROOT_PATH "/image/0/image-max", &handle->scale_max);
   }
-  
-  /* Open the hdf file using the given filename and mode */
-  file_id = _hdf_open(filename, hdf_mode);
- 
-  if (file_id < 0) {
-    /*try to convert MINC1 file*/
-#ifdef HAVE_MINC1
-    char * temp_file=NULL;
 
-    if ( mode == MI2_OPEN_READ )
-    {
-      if( (temp_file=micreate_tempfile()))
-      {
-         if( minc_format_convert(filename,temp_file) == MI_NOERROR )
-         {
-           if( (file_id = _hdf_open(temp_file, hdf_mode) ) >0)
-           {
+  /* Open the image dataset */
+  MI_CHECK_HDF_CALL_RET(handle->image_id = H5Dopen1(handle->hdf_id, MI_ROOT_PATH "/image/0/image"),"H5Dopen1");
+
+  /* Frames can be appended to an image with an unlimited first
+  * dimension, which holds as many frames as the image.
+  */
+  MI_CHECK_HDF_CALL_RET(space_id = H5Dget_space(handle->image_id),"H5Dget_space");
+  if (H5Sget_simple_extent_dims(space_id, hdf_dims, hdf_maxdims) == handle->number_of_dims &&
+      handle->number_of_dims > 0 && hdf_maxdims[0] == H5S_UNLIMITED) {
+    midimhandle_t hdim = handle->dim_handles[0];
+
+    hdim->unlimited = TRUE;
+    if (miload_dimension_spacing(hdim) < 0 ||
+        miextend_dimension(hdim, hdf_dims[0]) < 0) {
+      H5Sclose(space_id);
+      return (MI_ERROR);
+    }
+  }
+  H5Sclose(space_id);
+
+  if (michunk_cache_init(handle) < 0) {
+    return (MI_ERROR);
+  }
+  /* Get the Id for the copy of the datatype for the dataset */
+  MI_CHECK_HDF_CALL_RET(handle->ftype_id = H5Dget_type(handle->image_id),"H5Dget_type");
+
+  switch (H5Tget_class(handle->ftype_id)) {
+  case H5T_INTEGER:
+  case H5T_FLOAT:
+    handle->mtype_id = H5Tget_native_type(handle->ftype_id,
+                                          H5T_DIR_ASCEND);
+    break;
+
+  case H5T_COMPOUND:
+    handle->mtype_id = H5Tcreate(H5T_COMPOUND,
+                                 H5Tget_size(handle->ftype_id));
+    for (i = 0; i < H5Tget_nmembers(handle->ftype_id); i++) {
+      hid_t tmp_id = H5Tget_member_type(handle->ftype_id, i);
+      size_t tmp_off = H5Tget_member_offset(handle->ftype_id, i);
+      char *tmp_nm = H5Tget_member_name(handle->ftype_id, i);
+      hid_t tmp2_id = H5Tget_native_type(tmp_id, H5T_DIR_ASCEND);
+      H5Tinsert(handle->mtype_id, tmp_nm, tmp_off, tmp2_id);
+
+      free(tmp_nm);
+      H5Tclose(tmp_id);
+      H5Tclose(tmp2_id);
+    }
+    break;
+
+  case H5T_ENUM:
+    handle->mtype_id = H5Tget_native_type(handle->ftype_id, H5T_DIR_ASCEND);
+    miinit_enum(handle->ftype_id);
+    miinit_enum(handle->mtype_id);
+    break;
+
+  default:
+    return (MI_ERROR);
+  }
+
+  /* hdf5 macro can temporarily disable the automatic error printing */
+  H5E_BEGIN_TRY {
+    /* Open both image-min and image-max datasets */
+    handle->imax_id = H5Dopen1(handle->hdf_id, MI_ROOT_PATH "/image/0/image-max");
+    handle->imin_id = H5Dopen1(handle->hdf_id, MI_ROOT_PATH "/image/0/image-min");
+  } H5E_END_TRY;
+
+  /* Convert the type to a MINC type.
+  */
+  /* Get the class Id for the datatype */
+  hdf_class = H5Tget_class(handle->ftype_id);
+  /* Get the size of the datatype */
+  nbytes = H5Tget_size(handle->ftype_id);
+
+  switch (hdf_class) {
+  case H5T_INTEGER:
+  case H5T_ENUM:              /* label images */
+    is_signed = (H5Tget_sign(handle->ftype_id) == H5T_SGN_2);
+
+    switch (nbytes) {
+    case 1:
+      handle->volume_type = (is_signed ? MI_TYPE_BYTE : MI_TYPE_UBYTE);
+      break;
+    case 2:
+      handle->volume_type = (is_signed ? MI_TYPE_SHORT : MI_TYPE_USHORT);
+      break;
+    case 4:
+      handle->volume_type = (is_signed ? MI_TYPE_INT : MI_TYPE_UINT);
+      break;
+    default:
+      return MI_LOG_ERROR(MI2_MSG_BADTYPE,hdf_class);
+    }
+    break;
+  case H5T_FLOAT:
+    handle->volume_type = (nbytes == 4) ? MI_TYPE_FLOAT : MI_TYPE_DOUBLE;
+    break;
+  case H5T_STRING:
+    handle->volume_type = MI_TYPE_STRING;
+    break;
+  case H5T_ARRAY:
+    /* TODO: handle this case for uniform records (arrays)? */
+    break;
+  case H5T_COMPOUND:
+    /* TODO: handle this case for non-uniform records? */
+    break;
+  default:
+    return MI_LOG_ERROR(MI2_MSG_BADTYPE,hdf_class);
+  }
+
+  /* Read the current settings for valid-range */
+  miread_valid_range(handle, &handle->valid_max, &handle->valid_min);
+
+  return (MI_NOERROR);
+}
+
+/** Open the image datasets of a volume opened with MI2_OPEN_HEADER_ONLY,
+ * on the first call that needs them.
+ */
+int miload_volume_image(mihandle_t volume)
+{
+  if (!volume->image_pending) {
+    return (MI_NOERROR);
+  }
+  volume->image_pending = FALSE;
+  return miopen_volume_image(volume);
+}
+
+/** Open the volume in the file \a filename, or in a copy of the file
+  * image \a image of \a length bytes held in memory under that name if
+  * \a image is not NULL.
+*/
+static int miopen_volume_file(const char *filename, int mode,
+                              const void *image, size_t length,
+                              mihandle_t *volume)
+{
+  hid_t file_id;
+  mihandle_t handle;
+  int hdf_mode;
+  char dimorder[MI2_CHAR_LENGTH];
+  int i,r;
+  char *p1, *p2;
+  int n_dimensions;
+
+  /* Initialization.
+    For the actual body of this function look at m2utils.c
+  */
+  miinit();
+  /* Convert the specified mode to hdf mode */
+  if (mode == MI2_OPEN_READ || mode == (MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY)) {
+    hdf_mode = H5F_ACC_RDONLY;
+  } else if (mode == MI2_OPEN_RDWR) {
+    hdf_mode = H5F_ACC_RDWR;
+  } else {
+    return (MI_ERROR);
+  }
+  /* Allocate space for the volume handle */
+  handle = mialloc_volume_handle();
+  if (handle == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM,sizeof(struct mivolume));
+  }
+  
+  /* Open the hdf file using the given filename and mode */
+  file_id = _hdf_open(filename, hdf_mode, image, length);
+
+  if (file_id < 0 && hdf_mode == H5F_ACC_RDONLY && image == NULL) {
+    /*try to decompress a gzip or bzip2 compressed file*/
+    file_id = _hdf_open_compressed(filename);
+  }
+ 
+  if (file_id < 0) {
+    /*try to convert MINC1 file*/
+#ifdef HAVE_MINC1
+    char * temp_file=NULL;
+
+    if ( hdf_mode == H5F_ACC_RDONLY && image == NULL )
+    {
+      if( (temp_file=micreate_tempfile()))
+      {
+         if( minc_format_convert(filename,temp_file) == MI_NOERROR )
+         {
+           if( (file_id = _hdf_open(temp_file, hdf_mode, NULL, 0) ) >0)
+           {
             unlink( temp_file ); /*file will be deleted immediately after closing...*/
             free( temp_file );
            } else {
@@ -1456,138 +2116,105 @@ int miopen_volume(const char *filename, int mode, mihandle_t *volume)
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Can't determine world indices");
   }
 
-  /* SEE IF SLICE SCALING IS ENABLED
-  */
-  handle->has_slice_scaling = FALSE;
-  /* hdf5 macro can temporarily disable the automatic error printing */
-  H5E_BEGIN_TRY {
-    /* Open the dataset image-max at the specified path*/
-    dset_id = H5Dopen1(file_id, MI_ROOT_PATH "/image/0/image-max");
-  } H5E_END_TRY;
-  
-  if (dset_id >= 0) {
-    /* Get the Id of the copy of the dataspace of the dataset */
-    space_id = H5Dget_space(dset_id);
-    if (space_id >= 0) {
-      
-      /* If the dimensionality of the image-max variable is one or
-      * greater, we consider this volume to have slice-scaling enabled.
-      */
-      if ( H5Sget_simple_extent_ndims(space_id) >= 1) {
-        handle->has_slice_scaling = TRUE;
-      }
-      H5Sclose(space_id);	/* Close the dataspace handle */
-    }
-    H5Dclose(dset_id);	/* Close the dataset handle */
-  }
-
-  if (!handle->has_slice_scaling) {
-    /* Read the minimum scalar of the given type at the specified path */
-    miget_scalar(handle->hdf_id, H5T_NATIVE_DOUBLE,
-                 MI_ROOT_PATH "/image/0/image-min", &handle->scale_min);
-    /* Read the maximum scalar of the given type at the specified path */
-    miget_scalar(handle->hdf_id, H5T_NATIVE_DOUBLE,
-                 MI_ROOT_PATH "/image/0/image-max", &handle->scale_max);
-  }
-
   /* Read the current voxel-to-world transform */
   miget_voxel_to_world(handle, handle->v2w_transform);
 
   /* Calculate the inverse transform */
   miinvert_transform(handle->v2w_transform, handle->w2v_transform);
 
-  /* Open the image dataset */
-  MI_CHECK_HDF_CALL_RET(handle->image_id = H5Dopen1(file_id, MI_ROOT_PATH "/image/0/image"),"H5Dopen1");
-  /* Get the Id for the copy of the datatype for the dataset */
-  MI_CHECK_HDF_CALL_RET(handle->ftype_id = H5Dget_type(handle->image_id),"H5Dget_type");
-
-  switch (H5Tget_class(handle->ftype_id)) {
-  case H5T_INTEGER:
-  case H5T_FLOAT:
-    handle->mtype_id = H5Tget_native_type(handle->ftype_id,
-                                          H5T_DIR_ASCEND);
-    break;
+  if ((mode & MI2_OPEN_HEADER_ONLY) != 0) {
+    handle->image_pending = TRUE;
+  } else if (miopen_volume_image(handle) < 0) {
+    return (MI_ERROR);
+  }
 
-  case H5T_COMPOUND:
-    handle->mtype_id = H5Tcreate(H5T_COMPOUND,
-                                 H5Tget_size(handle->ftype_id));
-    for (i = 0; i < H5Tget_nmembers(handle->ftype_id); i++) {
-      hid_t tmp_id = H5Tget_member_type(handle->ftype_id, i);
-      size_t tmp_off = H5Tget_member_offset(handle->ftype_id, i);
-      char *tmp_nm = H5Tget_member_name(handle->ftype_id, i);
-      hid_t tmp2_id = H5Tget_native_type(tmp_id, H5T_DIR_ASCEND);
-      H5Tinsert(handle->mtype_id, tmp_nm, tmp_off, tmp2_id);
+  *volume = handle;
+  return (MI_NOERROR);
+}
 
-      free(tmp_nm);
-      H5Tclose(tmp_id);
-      H5Tclose(tmp2_id);
-    }
-    break;
+/** Opens an existing MINC volume for read-only access if mode argument is
+  * MI2_OPEN_READ, or read-write access if mode argument is MI2_OPEN_RDWR.
+  * With MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY the image datasets are only
+  * opened by the first call that needs them.
+  * \ingroup mi2Vol
+*/
+int miopen_volume(const char *filename, int mode, mihandle_t *volume)
+{
+  return miopen_volume_file(filename, mode, NULL, 0, volume);
+}
 
-  case H5T_ENUM:
-    handle->mtype_id = H5Tget_native_type(handle->ftype_id, H5T_DIR_ASCEND);
-    miinit_enum(handle->ftype_id);
-    miinit_enum(handle->mtype_id);
-    break;
+/** Opens the MINC volume held in the \a length bytes of \a buffer, with
+  * the same modes as miopen_volume(). The volume works on its own copy of
+  * the buffer, changes are never written back to it.
+  * \ingroup mi2Vol
+*/
+int miopen_volume_from_memory(const void *buffer, size_t length, int mode,
+                              mihandle_t *volume)
+{
+  char name[64];
 
-  default:
-    return (MI_ERROR);
+  if (buffer == NULL || length == 0) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to open volume from empty buffer");
   }
+  _generate_memory_name(name, sizeof(name));
+  return miopen_volume_file(name, mode, buffer, length, volume);
+}
 
-  /* hdf5 macro can temporarily disable the automatic error printing */
-  H5E_BEGIN_TRY {
-    /* Open both image-min and image-max datasets */
-    handle->imax_id = H5Dopen1(file_id, MI_ROOT_PATH "/image/0/image-max");
-    handle->imin_id = H5Dopen1(file_id, MI_ROOT_PATH "/image/0/image-min");
-  } H5E_END_TRY;
+/** Resize the dimension variable \a name of \a volume to \a length
+ * values and write them.
+ */
+static int misave_dimension_values(mihandle_t volume, const char *name,
+                                   hsize_t length, const double *values)
+{
+  char path[MI2_CHAR_LENGTH];
+  int len = (int) length;
+  hid_t dset_id;
+  int result;
 
-  /* Convert the type to a MINC type.
-  */
-  /* Get the class Id for the datatype */
-  hdf_class = H5Tget_class(handle->ftype_id);
-  /* Get the size of the datatype */
-  nbytes = H5Tget_size(handle->ftype_id);
+  snprintf(path, sizeof(path), MI_ROOT_PATH "/dimensions/%s", name);
+  MI_CHECK_HDF_CALL_RET(dset_id = H5Dopen1(volume->hdf_id, path),"H5Dopen1");
+  MI_CHECK_HDF_CALL(result = H5Dset_extent(dset_id, &length),"H5Dset_extent");
+  if (result >= 0 && length != 0) {
+    MI_CHECK_HDF_CALL(result = H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                        H5S_ALL, H5P_DEFAULT, values),"H5Dwrite");
+  }
+  if (result >= 0) {
+    result = miset_attr_at_loc(dset_id, "length", MI_TYPE_INT, 1, &len);
+  }
+  H5Dclose(dset_id);
+  return (result < 0 ? MI_ERROR : MI_NOERROR);
+}
 
-  switch (hdf_class) {
-  case H5T_INTEGER:
-  case H5T_ENUM:              /* label images */
-    is_signed = (H5Tget_sign(handle->ftype_id) == H5T_SGN_2);
+/** Write the length the unlimited dimension of \a volume has grown
+ * to, with its offsets and widths if it is irregularly sampled.
+ */
+static int misave_unlimited_dimension(mihandle_t volume)
+{
+  midimhandle_t hdim;
+  char path[MI2_CHAR_LENGTH];
+  int len;
+  hid_t dset_id;
+  int result;
 
-    switch (nbytes) {
-    case 1:
-      handle->volume_type = (is_signed ? MI_TYPE_BYTE : MI_TYPE_UBYTE);
-      break;
-    case 2:
-      handle->volume_type = (is_signed ? MI_TYPE_SHORT : MI_TYPE_USHORT);
-      break;
-    case 4:
-      handle->volume_type = (is_signed ? MI_TYPE_INT : MI_TYPE_UINT);
-      break;
-    default:
-      return MI_LOG_ERROR(MI2_MSG_BADTYPE,hdf_class);
+  if (volume->number_of_dims == 0 || volume->dim_handles == NULL ||
+      !volume->dim_handles[0]->unlimited) {
+    return (MI_NOERROR);
+  }
+  hdim = volume->dim_handles[0];
+  if ((hdim->attr & MI_DIMATTR_NOT_REGULARLY_SAMPLED) != 0) {
+    snprintf(path, sizeof(path), "%s-width", hdim->name);
+    if (misave_dimension_values(volume, hdim->name, hdim->length, hdim->offsets) < 0 ||
+        misave_dimension_values(volume, path, hdim->length, hdim->widths) < 0) {
+      return (MI_ERROR);
     }
-    break;
-  case H5T_FLOAT:
-    handle->volume_type = (nbytes == 4) ? MI_TYPE_FLOAT : MI_TYPE_DOUBLE;
-    break;
-  case H5T_STRING:
-    handle->volume_type = MI_TYPE_STRING;
-    break;
-  case H5T_ARRAY:
-    /* TODO: handle this case for uniform records (arrays)? */
-    break;
-  case H5T_COMPOUND:
-    /* TODO: handle this case for non-uniform records? */
-    break;
-  default:
-    return MI_LOG_ERROR(MI2_MSG_BADTYPE,hdf_class);
+    return (MI_NOERROR);
   }
-
-  /* Read the current settings for valid-range */
-  miread_valid_range(handle, &handle->valid_max, &handle->valid_min);
-
-  *volume = handle;
-  return (MI_NOERROR);
+  snprintf(path, sizeof(path), MI_ROOT_PATH "/dimensions/%s", hdim->name);
+  MI_CHECK_HDF_CALL_RET(dset_id = H5Dopen1(volume->hdf_id, path),"H5Dopen1");
+  len = (int) hdim->length;
+  result = miset_attr_at_loc(dset_id, "length", MI_TYPE_INT, 1, &len);
+  H5Dclose(dset_id);
+  return (result);
 }
 
 /** Writes any changes associated with the volume to disk.
@@ -1596,12 +2223,126 @@ int miopen_volume(const char *filename, int mode, mihandle_t *volume)
 static int miflush_volume(mihandle_t volume)
 {
   if ((volume->mode & MI2_OPEN_RDWR) != 0) {
+    misave_unlimited_dimension(volume);
     H5Fflush(volume->hdf_id, H5F_SCOPE_GLOBAL);
     misave_valid_range(volume);
   }
   return (MI_NOERROR);
 }
 
+#define _MI2_ROT(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+
+/** The lookup3 hash of Bob Jenkins, which HDF5 uses as the checksum of
+ * its metadata.
+ */
+static uint32_t _hdf_checksum(const unsigned char *k, size_t length)
+{
+  uint32_t a, b, c;
+
+  a = b = c = 0xdeadbeef + (uint32_t) length;
+  while (length > 12) {
+    a += k[0] + ((uint32_t) k[1] << 8) + ((uint32_t) k[2] << 16) + ((uint32_t) k[3] << 24);
+    b += k[4] + ((uint32_t) k[5] << 8) + ((uint32_t) k[6] << 16) + ((uint32_t) k[7] << 24);
+    c += k[8] + ((uint32_t) k[9] << 8) + ((uint32_t) k[10] << 16) + ((uint32_t) k[11] << 24);
+    a -= c; a ^= _MI2_ROT(c, 4);  c += b;
+    b -= a; b ^= _MI2_ROT(a, 6);  a += c;
+    c -= b; c ^= _MI2_ROT(b, 8);  b += a;
+    a -= c; a ^= _MI2_ROT(c, 16); c += b;
+    b -= a; b ^= _MI2_ROT(a, 19); a += c;
+    c -= b; c ^= _MI2_ROT(b, 4);  b += a;
+    length -= 12;
+    k += 12;
+  }
+  switch (length) {
+  case 12: c += (uint32_t) k[11] << 24; /* fall through */
+  case 11: c += (uint32_t) k[10] << 16; /* fall through */
+  case 10: c += (uint32_t) k[9] << 8;   /* fall through */
+  case 9:  c += k[8];                   /* fall through */
+  case 8:  b += (uint32_t) k[7] << 24;  /* fall through */
+  case 7:  b += (uint32_t) k[6] << 16;  /* fall through */
+  case 6:  b += (uint32_t) k[5] << 8;   /* fall through */
+  case 5:  b += k[4];                   /* fall through */
+  case 4:  a += (uint32_t) k[3] << 24;  /* fall through */
+  case 3:  a += (uint32_t) k[2] << 16;  /* fall through */
+  case 2:  a += (uint32_t) k[1] << 8;   /* fall through */
+  case 1:  a += k[0];
+    break;
+  case 0:
+    return c;
+  }
+  c ^= b; c -= _MI2_ROT(b, 14);
+  a ^= c; a -= _MI2_ROT(c, 11);
+  b ^= a; b -= _MI2_ROT(a, 25);
+  c ^= b; c -= _MI2_ROT(b, 16);
+  a ^= c; a -= _MI2_ROT(c, 4);
+  b ^= a; b -= _MI2_ROT(a, 14);
+  c ^= b; c -= _MI2_ROT(b, 24);
+  return c;
+}
+
+/** Give the superblock of the file image \a image of \a length bytes a
+ * valid checksum. The image of a file open for writing has the status
+ * flags of its superblock cleared by HDF5 without the checksum being
+ * updated, which keeps the image from being opened again.
+ */
+static void _hdf_fix_image_superblock(unsigned char *image, size_t length)
+{
+  static const unsigned char signature[8] = { 0x89, 'H', 'D', 'F', '\r', '\n', 0x1a, '\n' };
+  size_t n;
+  uint32_t checksum;
+
+  if (length < 12 || memcmp(image, signature, sizeof(signature)) != 0 ||
+      image[8] < 2) {
+    return;                     /* No checksum before version 2 */
+  }
+  n = 12 + 4 * (size_t) image[9];
+  if (n + 4 > length) {
+    return;
+  }
+  checksum = _hdf_checksum(image, n);
+  image[n] = (unsigned char) checksum;
+  image[n + 1] = (unsigned char) (checksum >> 8);
+  image[n + 2] = (unsigned char) (checksum >> 16);
+  image[n + 3] = (unsigned char) (checksum >> 24);
+}
+
+/** Copy the whole file of \a volume, with any changes made so far, into
+  * a buffer allocated with malloc() that the caller must free().
+  * \ingroup mi2Vol
+*/
+int miserialize_volume_to_buffer(mihandle_t volume, void **buffer,
+                                 size_t *length)
+{
+  ssize_t size;
+  void *image;
+
+  if (volume == NULL || buffer == NULL || length == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Invalid arguments");
+  }
+  if ((volume->mode & MI2_OPEN_RDWR) != 0) {
+    mislice_range_flush(volume);
+    mistats_store(volume);
+    if (volume->is_dirty && !mipyramid_deferred(volume)) {
+      minc_update_thumbnails(volume);
+      volume->is_dirty = FALSE;
+    }
+    miflush_volume(volume);
+  }
+  MI_CHECK_HDF_CALL_RET(size = H5Fget_file_image(volume->hdf_id, NULL, 0),"H5Fget_file_image");
+  image = malloc((size_t) size);
+  if (image == NULL) {
+    return MI_LOG_ERROR(MI2_MSG_OUTOFMEM,(int) size);
+  }
+  if (H5Fget_file_image(volume->hdf_id, image, (size_t) size) < 0) {
+    free(image);
+    return MI_LOG_ERROR(MI2_MSG_GENERIC,"Unable to copy file image");
+  }
+  _hdf_fix_image_superblock((unsigned char *) image, (size_t) size);
+  *buffer = image;
+  *length = (size_t) size;
+  return (MI_NOERROR);
+}
+
 /** Close an existing MINC volume. If the volume was newly created,
   *  all changes will be written to disk. In all cases this function closes
   *  the open volume and frees memory associated with the volume handle.
@@ -1615,16 +2356,24 @@ int miclose_volume(mihandle_t volume)
     return MI_LOG_ERROR(MI2_MSG_GENERIC,"Trying to close null volume");
   }
 
+  miasync_close(volume);
+  mimapped_free(volume);
+  mislice_range_flush(volume);
+  mislice_range_free(volume);
+  mistats_close(volume);
+
   if (volume->is_dirty) {
     minc_update_thumbnails(volume);
     volume->is_dirty = FALSE;
   }
+  mipyramid_free(volume);
 
   miflush_volume(volume);
 
   if (volume->image_id > 0) {
     H5Dclose(volume->image_id);
   }
+  michunk_cache_free(volume);
   if (volume->imax_id > 0) {
     H5Dclose(volume->imax_id);
   }
@@ -1640,6 +2389,7 @@ int miclose_volume(mihandle_t volume)
   if (volume->plist_id > 0) {
     H5Pclose(volume->plist_id);
   }
+  miio_close(volume);
   if (_hdf_close(volume->hdf_id) < 0) {
     return (MI_ERROR);
   }
@@ -1764,7 +2514,8 @@ int miget_slice_dimension_count(mihandle_t volume, midimclass_t dimclass,
   hid_t image_max_fspc_id;
   int slice_ndims;
   int result=-1;
-  if( miget_volume_dimension_count(volume,dimclass,attr, &number_of_volume_dimensions) <0 )
+  if( miget_volume_dimension_count(volume,dimclass,attr, &number_of_volume_dimensions) <0 ||
+      miload_volume_image(volume) < 0 )
   {
     return -1;
   }
@@ -0,0 +1,190 @@
+/* Read throughput of slice, 3D block and voxel time series accesses on
+ * a compressed 4D volume, for the chunk shapes chosen by each access
+ * hint.
+ *
+ * usage: minc2-access-benchmark [chunk_bytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#define NDIMS 4
+#define CT 16
+#define CZ 64
+#define CY 128
+#define CX 128
+#define BLOCK 32
+#define N_SERIES 2000
+
+static const struct {
+  const char *name;
+  int hint;
+} layouts[] = {
+  { "default", MI_ACCESS_DEFAULT },
+  { "slice", MI_ACCESS_SLICE },
+  { "block3d", MI_ACCESS_BLOCK3D },
+  { "timeseries", MI_ACCESS_TIMESERIES }
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int
+create_volume(const char *name, int hint, misize_t chunk_bytes, int edges[NDIMS])
+{
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { CT, CZ, CY, CX };
+  unsigned short *buffer;
+  int edge_count;
+  size_t i;
+
+  micreate_dimension("time", MI_DIMCLASS_TIME,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CT, &hdims[0]);
+  micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[1]);
+  micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdims[2]);
+  micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdims[3]);
+
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_compression_level(props, 1);
+  miset_props_access_hint(props, hint);
+  miset_props_chunk_bytes(props, chunk_bytes);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0 || micreate_volume_image(hvol) < 0) {
+    mifree_volume_props(props);
+    return 1;
+  }
+  mifree_volume_props(props);
+
+  buffer = malloc(CT * CZ * CY * CX * sizeof(unsigned short));
+  for (i = 0; i < CT * CZ * CY * CX; i++) {
+    buffer[i] = (unsigned short)((i % CX) * 17 + ((i / CX) % CY) * 5 + (i % 7));
+  }
+  miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer);
+  free(buffer);
+  miclose_volume(hvol);
+
+  miopen_volume(name, MI2_OPEN_READ, &hvol);
+  miget_volume_props(hvol, &props);
+  miget_props_blocking(props, &edge_count, edges, NDIMS);
+  mifree_volume_props(props);
+  miclose_volume(hvol);
+  return 0;
+}
+
+/* Returns the read throughput in MB/s, or in series/s for time series */
+static double
+read_pattern(const char *name, int pattern)
+{
+  mihandle_t hvol;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  unsigned short *buffer;
+  size_t bytes = 0;
+  double t0;
+  int i;
+
+  buffer = malloc(CZ * CY * CX * sizeof(unsigned short));
+  miopen_volume(name, MI2_OPEN_READ, &hvol);
+  srand(1234);
+  t0 = now();
+  switch (pattern) {
+  case 0:                       /* Every slice */
+    count[0] = count[1] = 1;
+    count[2] = CY;
+    count[3] = CX;
+    start[2] = start[3] = 0;
+    for (start[0] = 0; start[0] < CT; start[0]++) {
+      for (start[1] = 0; start[1] < CZ; start[1]++) {
+        miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer);
+        bytes += CY * CX * sizeof(unsigned short);
+      }
+    }
+    break;
+  case 1:                       /* Every 3D block */
+    count[0] = 1;
+    count[1] = count[2] = count[3] = BLOCK;
+    for (start[0] = 0; start[0] < CT; start[0]++) {
+      for (start[1] = 0; start[1] < CZ; start[1] += BLOCK) {
+        for (start[2] = 0; start[2] < CY; start[2] += BLOCK) {
+          for (start[3] = 0; start[3] < CX; start[3] += BLOCK) {
+            miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer);
+            bytes += BLOCK * BLOCK * BLOCK * sizeof(unsigned short);
+          }
+        }
+      }
+    }
+    break;
+  default:                      /* Random voxel time series */
+    count[0] = CT;
+    count[1] = count[2] = count[3] = 1;
+    start[0] = 0;
+    for (i = 0; i < N_SERIES; i++) {
+      start[1] = rand() % CZ;
+      start[2] = rand() % CY;
+      start[3] = rand() % CX;
+      miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer);
+      bytes += CT * sizeof(unsigned short);
+    }
+    break;
+  }
+  t0 = now() - t0;
+  miclose_volume(hvol);
+  free(buffer);
+  return pattern == 2 ? N_SERIES / t0 : bytes / t0 / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+  char filename[128];
+  misize_t chunk_bytes = MI2_DEFAULT_CHUNK_BYTES;
+  size_t l;
+
+  if (argc > 1) {
+    chunk_bytes = (misize_t) atol(argv[1]);
+  }
+  snprintf(filename, sizeof(filename), "minc2-access-benchmark-%d.mnc", getpid());
+
+  printf("%dx%dx%dx%d ushort, zlib level 1, chunk target %lu bytes\n",
+         CT, CZ, CY, CX, (unsigned long) chunk_bytes);
+  printf("%-11s %-18s %12s %12s %12s\n", "hint", "chunk", "slice MB/s",
+         "block MB/s", "series/s");
+  for (l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+    int edges[NDIMS];
+    char shape[64];
+
+    if (create_volume(filename, layouts[l].hint, chunk_bytes, edges) != 0) {
+      fprintf(stderr, "Unable to create %s\n", filename);
+      return 1;
+    }
+    snprintf(shape, sizeof(shape), "%dx%dx%dx%d",
+             edges[0], edges[1], edges[2], edges[3]);
+    printf("%-11s %-18s %12.1f %12.1f %12.0f\n", layouts[l].name, shape,
+           read_pattern(filename, 0), read_pattern(filename, 1),
+           read_pattern(filename, 2));
+    unlink(filename);
+  }
+  return 0;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 10
+#define CZ 40
+#define CY 64
+#define CX 64
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+/* Create an uncompressed volume with the access hint and check the
+ * chunk shape that was chosen for it, and that no filter was added.
+ */
+static int
+check_hint(const char *name, int hint, misize_t chunk_bytes,
+           const int expected[NDIMS])
+{
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  int edge_lengths[NDIMS];
+  int edge_count;
+  micompression_t compression;
+  int value;
+  int i;
+  int error_cnt = 0;
+
+  micreate_dimension("time", MI_DIMCLASS_TIME,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CT, &hdims[0]);
+  micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[1]);
+  micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdims[2]);
+  micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdims[3]);
+
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_NONE);
+  if (miset_props_access_hint(props, hint) < 0) {
+    TESTRPT("Unable to set access hint", hint);
+  }
+  miget_props_access_hint(props, &value);
+  if (value != hint) {
+    TESTRPT("Bad access hint", value);
+  }
+  miset_props_chunk_bytes(props, chunk_bytes);
+
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                      MI_CLASS_REAL, props, &hvol) < 0) {
+    TESTRPT("Unable to create volume", hint);
+    mifree_volume_props(props);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  micreate_volume_image(hvol);
+
+  if (miget_volume_props(hvol, &props) < 0) {
+    TESTRPT("Unable to get volume properties", hint);
+  } else {
+    miget_props_blocking(props, &edge_count, edge_lengths, NDIMS);
+    if (edge_count != NDIMS) {
+      TESTRPT("Volume is not chunked", edge_count);
+    } else {
+      for (i = 0; i < NDIMS; i++) {
+        if (edge_lengths[i] != expected[i]) {
+          TESTRPT("Unexpected chunk length", edge_lengths[i]);
+        }
+      }
+    }
+    mifree_volume_props(props);
+  }
+  miclose_volume(hvol);
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", hint);
+  } else {
+    if (miget_volume_props(hvol, &props) < 0) {
+      TESTRPT("Unable to get volume properties", hint);
+    } else {
+      if (miget_props_compression_type(props, &compression) < 0 ||
+          compression != MI_COMPRESS_NONE) {
+        TESTRPT("Uncompressed volume reopened compressed", (int) compression);
+      }
+      mifree_volume_props(props);
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const int slice[NDIMS] = { 1, 8, 64, 64 };
+  static const int block[NDIMS] = { 1, 32, 32, 32 };
+  static const int timeseries[NDIMS] = { 10, 14, 14, 14 };
+  static const int slice_time[NDIMS] = { 10, 1, 57, 57 };
+  static const int big_block[NDIMS] = { 1, 40, 64, 64 };
+  mivolumeprops_t props;
+  char filename[128];
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-access-hint-%d.mnc", getpid());
+
+  /* 64 KiB of unsigned short, 32768 voxels per chunk */
+  error_cnt += check_hint(filename, MI_ACCESS_SLICE, 65536, slice);
+  error_cnt += check_hint(filename, MI_ACCESS_BLOCK3D, 65536, block);
+  error_cnt += check_hint(filename, MI_ACCESS_TIMESERIES, 65536, timeseries);
+  error_cnt += check_hint(filename, MI_ACCESS_SLICE | MI_ACCESS_TIMESERIES,
+                          65536, slice_time);
+  /* Chunks never grow beyond the dimensions */
+  error_cnt += check_hint(filename, MI_ACCESS_BLOCK3D, 64 * 1024 * 1024, big_block);
+
+  minew_volume_props(&props);
+  if (miset_props_access_hint(props, 8) >= 0) {
+    TESTRPT("Accepted an unknown access hint", 8);
+  }
+  mifree_volume_props(props);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
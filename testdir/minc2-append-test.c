@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define NT 5
+#define CZ 4
+#define CY 8
+#define CX 8
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+
+static unsigned short voxel(int t, int z, int y, int x)
+{
+  return (unsigned short) (t * 1000 + z * 100 + y * 10 + x);
+}
+
+static void fill_frame(int t, unsigned short frame[CZ][CY][CX])
+{
+  int z, y, x;
+
+  for (z = 0; z < CZ; z++) {
+    for (y = 0; y < CY; y++) {
+      for (x = 0; x < CX; x++) {
+        frame[z][y][x] = voxel(t, z, y, x);
+      }
+    }
+  }
+}
+
+/* Check the length, offsets, slice ranges and voxels of the \a n_frames
+ * frames of \a hvol.
+ */
+static int check_volume(mihandle_t hvol, int n_frames)
+{
+  static unsigned short frame[CZ][CY][CX];
+  static unsigned short values[CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, CZ, CY, CX };
+  miboolean_t unlimited;
+  misize_t length;
+  double offsets[NT + 1];
+  double smax, smin;
+  int error_cnt = 0;
+  int t;
+
+  if (miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                              MI_DIMORDER_FILE, NDIMS, hdims) != NDIMS) {
+    TESTRPT("Unable to get dimensions", 0);
+    return error_cnt;
+  }
+  if (miget_dimension_size(hdims[0], &length) < 0 || length != (misize_t) n_frames) {
+    TESTRPT("Bad number of frames", (int) length);
+  }
+  if (miget_dimension_unlimited(hdims[0], &unlimited) < 0 || !unlimited) {
+    TESTRPT("Time dimension not unlimited", 0);
+  }
+  if (miget_dimension_unlimited(hdims[1], &unlimited) < 0 || unlimited) {
+    TESTRPT("Spatial dimension unlimited", 0);
+  }
+  if (miget_dimension_offsets(hdims[0], n_frames, 0, offsets) < 0) {
+    TESTRPT("Unable to get offsets", 0);
+  } else {
+    for (t = 0; t < n_frames; t++) {
+      if (offsets[t] != 1.5 * t * t) {
+        TESTRPT("Bad offset", t);
+      }
+    }
+  }
+
+  for (t = 0; t < n_frames; t++) {
+    start[0] = t;
+    start[1] = CZ - 1;
+    if (miget_slice_range(hvol, start, NDIMS, &smax, &smin) < 0 ||
+        smax != 10.0 + t || smin != -1.0 * t) {
+      TESTRPT("Bad slice range", t);
+    }
+    start[1] = 0;
+    fill_frame(t, frame);
+    if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, values) < 0) {
+      TESTRPT("Unable to read frame", t);
+    } else if (memcmp(values, frame, sizeof(values))) {
+      TESTRPT("Bad frame", t);
+    }
+  }
+  return error_cnt;
+}
+
+/* Append frame \a t to \a hvol, with its offset and slice ranges.
+ */
+static int append_frame(mihandle_t hvol, midimhandle_t htime, int t)
+{
+  static unsigned short frame[CZ][CY][CX];
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  double offset = 1.5 * t * t;
+  int z;
+
+  fill_frame(t, frame);
+  if (miappend_volume_frame(hvol, MI_TYPE_USHORT, frame) < 0 ||
+      miset_dimension_offsets(htime, 1, t, &offset) < 0) {
+    return -1;
+  }
+  start[0] = t;
+  for (z = 0; z < CZ; z++) {
+    start[1] = z;
+    if (miset_slice_range(hvol, start, NDIMS, 10.0 + t, -1.0 * t) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int
+main(void)
+{
+  static unsigned short frame[CZ][CY][CX];
+  static unsigned short values[CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  midimhandle_t hspatial;
+  mivolumeprops_t props;
+  mihyperplan_t plan;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, CZ, CY, CX };
+  misize_t length;
+  char name[256];
+  int error_cnt = 0;
+  int i, t;
+
+  snprintf(name, sizeof(name), "minc2-append-test-%d.mnc", getpid());
+
+  /* Only the first dimension, of class time, can be unlimited */
+  micreate_dimension(dimnames[1], MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hspatial);
+  if (miset_dimension_unlimited(hspatial, TRUE) >= 0) {
+    TESTRPT("Spatial dimension made unlimited", 0);
+  }
+  mifree_dimension_handle(hspatial);
+  micreate_dimension(dimnames[1], MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[0]);
+  micreate_dimension(dimnames[0], MI_DIMCLASS_TIME,
+                     MI_DIMATTR_NOT_REGULARLY_SAMPLED, 0, &hdims[1]);
+  miset_dimension_unlimited(hdims[1], TRUE);
+  if (micreate_volume(name, 2, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      NULL, &hvol) >= 0) {
+    TESTRPT("Volume created with an unlimited second dimension", 0);
+    miclose_volume(hvol);
+  }
+  mifree_dimension_handle(hdims[0]);
+  mifree_dimension_handle(hdims[1]);
+
+  /* A compressed volume with slice scaling and reduced resolutions,
+   * created without any frame.
+   */
+  micreate_dimension(dimnames[0], MI_DIMCLASS_TIME,
+                     MI_DIMATTR_NOT_REGULARLY_SAMPLED, 0, &hdims[0]);
+  miset_dimension_unlimited(hdims[0], TRUE);
+  micreate_dimension(dimnames[1], MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[1]);
+  micreate_dimension(dimnames[2], MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdims[2]);
+  micreate_dimension(dimnames[3], MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdims[3]);
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_multi_resolution(props, TRUE, 1);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test image", 0);
+    return error_cnt;
+  }
+  error_cnt += check_volume(hvol, 0);
+
+  /* A plan prepared before frames are appended sees them */
+  if (miprepare_hyperslab(hvol, MI_HYPERSLAB_VOXEL, MI_TYPE_USHORT, count, &plan) < 0) {
+    TESTRPT("Unable to prepare hyperslab", 0);
+    return error_cnt;
+  }
+  for (t = 0; t < NT - 1; t++) {
+    if (append_frame(hvol, hdims[0], t) < 0) {
+      TESTRPT("Unable to append frame", t);
+    }
+    start[0] = t;
+    fill_frame(t, frame);
+    if (miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, values) < 0 ||
+        memcmp(values, frame, sizeof(values))) {
+      TESTRPT("Bad frame read back", t);
+    }
+  }
+  mifree_hyperslab(plan);
+  error_cnt += check_volume(hvol, NT - 1);
+
+  /* The reduced resolutions wait until the volume is closed */
+  if (miselect_resolution(hvol, 1) >= 0) {
+    TESTRPT("Resolution selected while frames are appended", 0);
+    miselect_resolution(hvol, 0);
+  }
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+
+  /* Frames are appended again once the volume is opened for writing */
+  if (miopen_volume(name, MI2_OPEN_RDWR, &hvol) < 0) {
+    TESTRPT("Unable to open volume for writing", 0);
+  } else {
+    error_cnt += check_volume(hvol, NT - 1);
+    miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                            MI_DIMORDER_FILE, NDIMS, hdims);
+    if (append_frame(hvol, hdims[0], NT - 1) < 0) {
+      TESTRPT("Unable to append frame", NT - 1);
+    }
+    error_cnt += check_volume(hvol, NT);
+    miclose_volume(hvol);
+  }
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    error_cnt += check_volume(hvol, NT);
+    if (miappend_volume_frame(hvol, MI_TYPE_USHORT, frame) >= 0) {
+      TESTRPT("Frame appended to a read-only volume", 0);
+    }
+    if (miselect_resolution(hvol, 1) < 0) {
+      TESTRPT("Unable to select reduced resolution", 0);
+    } else {
+      miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                              MI_DIMORDER_FILE, NDIMS, hdims);
+      count[0] = NT / 2;
+      count[1] = CZ / 2;
+      count[2] = CY / 2;
+      count[3] = CX / 2;
+      start[0] = 0;
+      if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, values) < 0) {
+        TESTRPT("Unable to read reduced resolution", 0);
+      }
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  /* A regularly sampled time dimension in a contiguous volume, created
+   * with some frames and extended with frames written later.
+   */
+  micreate_dimension(dimnames[0], MI_DIMCLASS_TIME,
+                     MI_DIMATTR_REGULARLY_SAMPLED, 2, &hdims[0]);
+  miset_dimension_unlimited(hdims[0], TRUE);
+  for (i = 1; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, i == 1 ? CZ : i == 2 ? CY : CX,
+                       &hdims[i]);
+  }
+  count[0] = 1;
+  count[1] = CZ;
+  count[2] = CY;
+  count[3] = CX;
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_INT,
+                      NULL, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 1);
+  } else {
+    for (t = 0; t < 3; t++) {
+      if (miappend_volume_frame(hvol, MI_TYPE_USHORT, NULL) < 0) {
+        TESTRPT("Unable to append empty frame", t);
+      }
+    }
+    fill_frame(3, frame);
+    start[0] = 3;
+    miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, frame);
+    miclose_volume(hvol);
+  }
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 1);
+  } else {
+    miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                            MI_DIMORDER_FILE, NDIMS, hdims);
+    if (miget_dimension_size(hdims[0], &length) < 0 || length != 5) {
+      TESTRPT("Bad number of frames", (int) length);
+    }
+    for (t = 2; t < 5; t++) {
+      start[0] = t;
+      if (t == 3) {
+        fill_frame(3, frame);
+      } else {
+        memset(frame, 0, sizeof(frame));
+      }
+      if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, values) < 0 ||
+          memcmp(values, frame, sizeof(values))) {
+        TESTRPT("Bad appended frame", t);
+      }
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 12
+#define CY 40
+#define CX 50
+#define N_REQUESTS 8
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+
+static int
+create_test_image(const char *name)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static const int blocking[NDIMS] = { 2, 10, 25 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  unsigned short *buffer;
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, blocking);
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+
+  buffer = malloc(CZ * CY * CX * sizeof(unsigned short));
+  for (i = 0; i < CZ * CY * CX; i++) {
+    buffer[i] = (unsigned short)((i * 7919) % 65521);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, buffer) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  free(buffer);
+  for (start[0] = 0; start[0] < CZ; start[0]++) {
+    miset_slice_range(hvol, start, NDIMS, 100.0 + start[0], -1.0 * start[0]);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+/* Several requests in flight at once, compared with the same reads
+ * done synchronously.
+ */
+static int
+test_requests(mihandle_t hvol)
+{
+  static const misize_t count[NDIMS] = { 3, 25, 33 };
+  miasyncreq_t requests[N_REQUESTS];
+  double *async_buf = malloc(N_REQUESTS * 3 * 25 * 33 * sizeof(double));
+  double *sync_buf = malloc(3 * 25 * 33 * sizeof(double));
+  misize_t start[NDIMS];
+  int i;
+  int error_cnt = 0;
+
+  for (i = 0; i < N_REQUESTS; i++) {
+    start[0] = i;
+    start[1] = (i * 5) % 15;
+    start[2] = (i * 7) % 17;
+    if (miget_real_value_hyperslab_async(hvol, MI_TYPE_DOUBLE, start, count,
+                                         async_buf + i * 3 * 25 * 33, &requests[i]) < 0) {
+      TESTRPT("Unable to start asynchronous read", i);
+      requests[i] = NULL;
+    }
+  }
+  for (i = 0; i < N_REQUESTS; i++) {
+    if (requests[i] == NULL) {
+      continue;
+    }
+    if (miwait_hyperslab_async(requests[i]) < 0) {
+      TESTRPT("Asynchronous read failed", i);
+      continue;
+    }
+    start[0] = i;
+    start[1] = (i * 5) % 15;
+    start[2] = (i * 7) % 17;
+    if (miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, sync_buf) < 0) {
+      TESTRPT("Unable to read hyperslab", i);
+    } else if (memcmp(sync_buf, async_buf + i * 3 * 25 * 33,
+                      3 * 25 * 33 * sizeof(double)) != 0) {
+      TESTRPT("Asynchronous read differs", i);
+    }
+  }
+  free(async_buf);
+  free(sync_buf);
+  return error_cnt;
+}
+
+/* Every slab of a stream along \a dimension, compared with the same
+ * slab read synchronously.
+ */
+static int
+test_stream(mihandle_t hvol, mihyperslab_mode_t mode, int dimension, int n_prefetch)
+{
+  mislabstream_t stream;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS];
+  misize_t slab, expected_slab = 0;
+  size_t n = 1;
+  double *sync_buf;
+  void *buffer;
+  int i;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    count[i] = (i == dimension) ? 1 : lengths[i];
+    n *= count[i];
+  }
+  sync_buf = malloc(n * sizeof(double));
+
+  if (micreate_slab_stream(hvol, mode, MI_TYPE_DOUBLE, dimension, n_prefetch, &stream) < 0) {
+    TESTRPT("Unable to create slab stream", dimension);
+    free(sync_buf);
+    return error_cnt;
+  }
+  while (miread_slab_stream(stream, &buffer, &slab) == MI_NOERROR && buffer != NULL) {
+    int result;
+
+    if (slab != expected_slab++) {
+      TESTRPT("Slabs out of order", (int) slab);
+      break;
+    }
+    start[dimension] = slab;
+    if (mode == MI_HYPERSLAB_REAL) {
+      result = miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, sync_buf);
+    } else {
+      result = miget_voxel_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, sync_buf);
+    }
+    if (result < 0) {
+      TESTRPT("Unable to read hyperslab", (int) slab);
+    } else if (memcmp(sync_buf, buffer, n * sizeof(double)) != 0) {
+      TESTRPT("Slab differs", (int) slab);
+    }
+  }
+  if (expected_slab != lengths[dimension]) {
+    TESTRPT("Stream ended early", (int) expected_slab);
+  }
+  mifree_slab_stream(stream);
+  free(sync_buf);
+  return error_cnt;
+}
+
+/* Close the volume with reads still queued.
+ */
+static int
+test_close(const char *filename)
+{
+  static const misize_t start[NDIMS] = { 0, 0, 0 };
+  mislabstream_t stream;
+  miasyncreq_t request;
+  mihandle_t hvol;
+  double *buffer = malloc(CZ * CY * CX * sizeof(double));
+  void *slab;
+  int error_cnt = 0;
+
+  if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    free(buffer);
+    return error_cnt;
+  }
+  if (micreate_slab_stream(hvol, MI_HYPERSLAB_REAL, MI_TYPE_DOUBLE, 0, 4, &stream) < 0 ||
+      miread_slab_stream(stream, &slab, NULL) < 0 || slab == NULL) {
+    TESTRPT("Unable to read slab stream", 0);
+    free(buffer);
+    return error_cnt;
+  }
+  if (miget_real_value_hyperslab_async(hvol, MI_TYPE_DOUBLE, start, lengths,
+                                       buffer, &request) < 0) {
+    TESTRPT("Unable to start asynchronous read", 0);
+    request = NULL;
+  }
+  miclose_volume(hvol);
+
+  /* The read may or may not have happened before the close */
+  if (request != NULL) {
+    miwait_hyperslab_async(request);
+  }
+  if (miread_slab_stream(stream, &slab, NULL) != MI_ERROR) {
+    TESTRPT("Stream of a closed volume still readable", 0);
+  }
+  mifree_slab_stream(stream);
+  free(buffer);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char filename[128];
+  mihandle_t hvol;
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-async-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename);
+  if (error_cnt != 0) {
+    return error_cnt;
+  }
+  if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    int dimension;
+
+    error_cnt += test_requests(hvol);
+    for (dimension = 0; dimension < NDIMS; dimension++) {
+      error_cnt += test_stream(hvol, MI_HYPERSLAB_REAL, dimension, 1);
+      error_cnt += test_stream(hvol, MI_HYPERSLAB_VOXEL, dimension, 3);
+    }
+    /* More buffers than slabs */
+    error_cnt += test_stream(hvol, MI_HYPERSLAB_REAL, 0, 100);
+    miclose_volume(hvol);
+  }
+  error_cnt += test_close(filename);
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
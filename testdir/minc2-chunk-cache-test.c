@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 2
+#define CZ 8
+#define CY 64
+#define CX 64
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static int
+create_volume(const char *name, const misize_t lengths[NDIMS],
+              const int blocking[NDIMS], mihandle_t *hvol_ptr)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  int result;
+  int i;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], i == 0 ? MI_DIMCLASS_TIME : MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, blocking);
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, hvol_ptr);
+  mifree_volume_props(props);
+  if (result < 0) {
+    return result;
+  }
+  return micreate_volume_image(*hvol_ptr);
+}
+
+/* Read every slice of the volume and check the values.
+ */
+static int
+read_slices(mihandle_t hvol)
+{
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, 1, CY, CX };
+  unsigned short buffer[CY * CX];
+  int error_cnt = 0;
+  int i;
+
+  for (start[0] = 0; start[0] < CT; start[0]++) {
+    for (start[1] = 0; start[1] < CZ; start[1]++) {
+      if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer) < 0) {
+        TESTRPT("Unable to read slice", (int) start[1]);
+        continue;
+      }
+      for (i = 0; i < CY * CX; i++) {
+        if (buffer[i] != (unsigned short)(start[0] * 1000 + start[1] * 100 + i % 97)) {
+          TESTRPT("Bad voxel value", buffer[i]);
+          break;
+        }
+      }
+    }
+  }
+  return error_cnt;
+}
+
+static int
+check_stats(mihandle_t hvol, misize_t hits, misize_t misses, misize_t evictions)
+{
+  misize_t h, m, e;
+  int error_cnt = 0;
+
+  if (miget_volume_chunk_cache_stats(hvol, &h, &m, &e) < 0) {
+    TESTRPT("Unable to get chunk cache statistics", 0);
+    return error_cnt;
+  }
+  if (h != hits) {
+    TESTRPT("Unexpected chunk cache hits", (int) h);
+  }
+  if (m != misses) {
+    TESTRPT("Unexpected chunk cache misses", (int) m);
+  }
+  if (e != evictions) {
+    TESTRPT("Unexpected chunk cache evictions", (int) e);
+  }
+  return error_cnt;
+}
+
+/* Slices of 4 chunks read one after the other, each chunk holding four
+ * slices.
+ */
+static int
+test_counters(const char *name)
+{
+  static const misize_t lengths[NDIMS] = { CT, CZ, CY, CX };
+  static const int blocking[NDIMS] = { 1, 4, 32, 32 };
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { CT, CZ, CY, CX };
+  misize_t nbytes, nslots;
+  unsigned short *buffer;
+  mihandle_t hvol;
+  size_t i;
+  int error_cnt = 0;
+
+  if (create_volume(name, lengths, blocking, &hvol) < 0) {
+    TESTRPT("Unable to create volume", 0);
+    return error_cnt;
+  }
+  buffer = malloc(CT * CZ * CY * CX * sizeof(unsigned short));
+  for (i = 0; i < CT * CZ * CY * CX; i++) {
+    buffer[i] = (unsigned short)((i / (CY * CX * CZ)) * 1000 +
+                                 ((i / (CY * CX)) % CZ) * 100 + (i % (CY * CX)) % 97);
+  }
+  miset_volume_valid_range(hvol, 65535.0, 0.0);
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  free(buffer);
+  miclose_volume(hvol);
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  miset_volume_read_threads(hvol, 0);
+  if (miget_volume_chunk_cache(hvol, &nbytes, &nslots) < 0 ||
+      nbytes < 4 * 32 * 32 * 4 * sizeof(unsigned short) || nslots == 0) {
+    TESTRPT("Chunk cache too small for a slice", (int) nbytes);
+  }
+
+  /* Each chunk is decoded once and found in the cache three times */
+  error_cnt += check_stats(hvol, 0, 0, 0);
+  error_cnt += read_slices(hvol);
+  error_cnt += check_stats(hvol, 48, 16, 0);
+
+  /* Room for two chunks only, every chunk is evicted before it is
+   * needed again.
+   */
+  if (miset_volume_chunk_cache(hvol, 2 * 4 * 32 * 32 * sizeof(unsigned short)) < 0) {
+    TESTRPT("Unable to set chunk cache", 0);
+  }
+  miget_volume_chunk_cache(hvol, &nbytes, &nslots);
+  if (nbytes != 2 * 4 * 32 * 32 * sizeof(unsigned short)) {
+    TESTRPT("Chunk cache size not set", (int) nbytes);
+  }
+  mireset_volume_chunk_cache_stats(hvol);
+  error_cnt += read_slices(hvol);
+  error_cnt += check_stats(hvol, 0, 64, 62);
+  miclose_volume(hvol);
+  unlink(name);
+  return error_cnt;
+}
+
+/* Large slices of chunks that do not fit in the file-wide cache.
+ */
+static int
+test_sizing(const char *name)
+{
+  static const misize_t lengths[NDIMS] = { 2, 2, 2048, 2048 };
+  static const int blocking[NDIMS] = { 1, 2, 256, 256 };
+  static const misize_t count[NDIMS] = { 2, 1, 2048, 2048 };
+  const misize_t chunk_bytes = 2 * 256 * 256 * sizeof(unsigned short);
+  misize_t nbytes, nslots;
+  mihyperplan_t plan;
+  mihandle_t hvol;
+  int error_cnt = 0;
+
+  if (create_volume(name, lengths, blocking, &hvol) < 0) {
+    TESTRPT("Unable to create volume", 0);
+    return error_cnt;
+  }
+  miclose_volume(hvol);
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  miget_volume_chunk_cache(hvol, &nbytes, &nslots);
+  if (nbytes < 64 * chunk_bytes) {
+    TESTRPT("Chunk cache too small for a slice", (int) nbytes);
+  }
+  if (nslots < 64) {
+    TESTRPT("Too few chunk cache slots", (int) nslots);
+  }
+
+  /* A selection two chunks deep along time */
+  if (miprepare_hyperslab(hvol, MI_HYPERSLAB_VOXEL, MI_TYPE_USHORT, count, &plan) < 0) {
+    TESTRPT("Unable to prepare hyperslab", 0);
+  } else {
+    miget_volume_chunk_cache(hvol, &nbytes, &nslots);
+    if (nbytes < 128 * chunk_bytes) {
+      TESTRPT("Chunk cache too small for the selection", (int) nbytes);
+    }
+    mifree_hyperslab(plan);
+  }
+  miclose_volume(hvol);
+  unlink(name);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char filename[128];
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-chunk-cache-%d.mnc", getpid());
+
+  error_cnt += test_counters(filename);
+  error_cnt += test_sizing(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 3
+#define CZ 13
+#define CY 21
+#define CX 17
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static int
+create_test_image(const char *name, mihandle_t *hvol_ptr)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  static const misize_t lengths[NDIMS] = { CT, CZ, CY, CX };
+  static const int blocking[NDIMS] = { 1, 5, 8, 6 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  unsigned short *buffer;
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], i == 0 ? MI_DIMCLASS_TIME : MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_zlib_compression(props, 4);
+  miset_props_blocking(props, NDIMS, blocking);
+
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  result = micreate_volume_image(hvol);
+  if (result < 0) {
+    TESTRPT("Unable to create volume image", result);
+    return error_cnt;
+  }
+
+  buffer = malloc(CT * CZ * CY * CX * sizeof(unsigned short));
+  for (i = 0; i < CT * CZ * CY * CX; i++) {
+    buffer[i] = (unsigned short)((i * 7919) % 4099 + (i / 97));
+  }
+  for (i = 0; i < NDIMS; i++) {
+    start[i] = 0;
+    count[i] = lengths[i];
+  }
+  result = miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, buffer);
+  if (result < 0) {
+    TESTRPT("Unable to write volume", result);
+  }
+  free(buffer);
+
+  count[2] = count[3] = 1;
+  for (start[0] = 0; start[0] < CT; start[0]++) {
+    for (start[1] = 0; start[1] < CZ; start[1]++) {
+      miset_slice_range(hvol, start, NDIMS, 100.0 + start[0] * 10 + start[1],
+                        -1.0 * start[1]);
+    }
+  }
+  *hvol_ptr = hvol;
+  return error_cnt;
+}
+
+/* Read the same selection with the direct chunk reader and with
+ * H5Dread and compare the buffers byte for byte.
+ */
+static int
+compare_paths(mihandle_t hvol, mitype_t type, int real,
+              const misize_t start[], const misize_t count[])
+{
+  size_t n = 1;
+  size_t size;
+  void *direct;
+  void *plain;
+  int r1, r2;
+  int i;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    n *= count[i];
+  }
+  size = n * 8;                 /* Large enough for any type used here */
+  direct = calloc(1, size);
+  plain = calloc(1, size);
+
+  miset_volume_read_threads(hvol, 4);
+  if (real) {
+    r1 = miget_real_value_hyperslab(hvol, type, start, count, direct);
+  } else {
+    r1 = miget_voxel_value_hyperslab(hvol, type, start, count, direct);
+  }
+  miset_volume_read_threads(hvol, 0);
+  if (real) {
+    r2 = miget_real_value_hyperslab(hvol, type, start, count, plain);
+  } else {
+    r2 = miget_voxel_value_hyperslab(hvol, type, start, count, plain);
+  }
+  if (r1 < 0 || r2 < 0) {
+    TESTRPT("Unable to read hyperslab", type);
+  } else if (memcmp(direct, plain, size) != 0) {
+    TESTRPT("Direct chunk read differs from H5Dread", type);
+  }
+  free(direct);
+  free(plain);
+  return error_cnt;
+}
+
+static int
+test_selections(mihandle_t hvol)
+{
+  static const misize_t full[NDIMS] = { CT, CZ, CY, CX };
+  static const mitype_t types[] = {
+    MI_TYPE_USHORT, MI_TYPE_UBYTE, MI_TYPE_SHORT, MI_TYPE_INT,
+    MI_TYPE_FLOAT, MI_TYPE_DOUBLE
+  };
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  size_t t;
+  int i;
+  int error_cnt = 0;
+
+  for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    /* Whole volume */
+    for (i = 0; i < NDIMS; i++) {
+      start[i] = 0;
+      count[i] = full[i];
+    }
+    error_cnt += compare_paths(hvol, types[t], 0, start, count);
+    error_cnt += compare_paths(hvol, types[t], 1, start, count);
+
+    /* A slab that straddles chunk boundaries */
+    start[0] = 1; count[0] = 2;
+    start[1] = 3; count[1] = 7;
+    start[2] = 5; count[2] = 13;
+    start[3] = 4; count[3] = 9;
+    error_cnt += compare_paths(hvol, types[t], 0, start, count);
+    error_cnt += compare_paths(hvol, types[t], 1, start, count);
+
+    /* A single partial edge chunk */
+    start[0] = 2; count[0] = 1;
+    start[1] = 10; count[1] = 3;
+    start[2] = 16; count[2] = 5;
+    start[3] = 12; count[3] = 5;
+    error_cnt += compare_paths(hvol, types[t], 0, start, count);
+    error_cnt += compare_paths(hvol, types[t], 1, start, count);
+  }
+  return error_cnt;
+}
+
+static int
+test_apparent_order(mihandle_t hvol)
+{
+  static char *dimorder[NDIMS] = { "xspace", "zspace", "time", "yspace" };
+  midimhandle_t hdims[NDIMS];
+  misize_t start[NDIMS] = { 2, 1, 0, 3 };
+  misize_t count[NDIMS] = { 11, 9, 3, 15 };
+  int error_cnt = 0;
+
+  miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                          MI_DIMORDER_FILE, NDIMS, hdims);
+  miset_dimension_apparent_voxel_order(hdims[2], MI_COUNTER_FILE_ORDER);
+  if (miset_apparent_dimension_order_by_name(hvol, NDIMS, dimorder) < 0) {
+    TESTRPT("Unable to set apparent dimension order", 0);
+    return error_cnt;
+  }
+  error_cnt += compare_paths(hvol, MI_TYPE_FLOAT, 1, start, count);
+  error_cnt += compare_paths(hvol, MI_TYPE_USHORT, 0, start, count);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  mihandle_t hvol;
+  int error_cnt = 0;
+  char filename[128];
+
+  snprintf(filename, sizeof(filename), "minc2-chunk-read-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename, &hvol);
+  if (error_cnt == 0) {
+    /* Chunks still held in the HDF5 chunk cache of the writer */
+    error_cnt += test_selections(hvol);
+    miclose_volume(hvol);
+
+    if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+      TESTRPT("Unable to reopen volume", 0);
+    } else {
+      error_cnt += test_selections(hvol);
+      error_cnt += test_apparent_order(hvol);
+      miclose_volume(hvol);
+    }
+  }
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 14
+#define CY 23
+#define CX 19
+#define NVOXELS (CZ * CY * CX)
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+/* Write the same data to a compressed volume, with the given codec and
+ * number of compression threads.
+ */
+static int
+write_test_image(const char *name, micompression_t codec, int threads)
+{
+  static const int blocking[NDIMS] = { 4, 8, 6 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  unsigned short *voxels;
+  double *reals;
+  size_t i;
+  int value;
+  int result;
+  int error_cnt = 0;
+
+  micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[0]);
+  micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdims[1]);
+  micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdims[2]);
+
+  minew_volume_props(&props);
+  miset_props_compression_type(props, codec);
+  miset_props_compression_level(props, 3);
+  miset_props_blocking(props, NDIMS, blocking);
+  miset_props_compression_threads(props, threads);
+  miget_props_compression_threads(props, &value);
+  if (value != threads) {
+    TESTRPT("Bad compression threads", value);
+  }
+
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  result = micreate_volume_image(hvol);
+  if (result < 0) {
+    TESTRPT("Unable to create volume image", result);
+    return error_cnt;
+  }
+  miset_volume_range(hvol, 500.0, -20.0);
+
+  voxels = malloc(NVOXELS * sizeof(unsigned short));
+  reals = malloc(NVOXELS * sizeof(double));
+  for (i = 0; i < NVOXELS; i++) {
+    voxels[i] = (unsigned short)((i * 2654435761u) >> 20);
+    reals[i] = (double)(i % 509) - 8.25;
+  }
+
+  /* The whole volume, in voxel values */
+  start[0] = start[1] = start[2] = 0;
+  count[0] = CZ;
+  count[1] = CY;
+  count[2] = CX;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, voxels) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+
+  /* A block of complete chunks with partial chunks all around */
+  start[0] = 2; count[0] = 11;
+  start[1] = 3; count[1] = 18;
+  start[2] = 5; count[2] = 13;
+  if (miset_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, reals) < 0) {
+    TESTRPT("Unable to write real values", 0);
+  }
+
+  /* Exactly one chunk, converted from float */
+  start[0] = 4; count[0] = 4;
+  start[1] = 8; count[1] = 8;
+  start[2] = 6; count[2] = 6;
+  for (i = 0; i < 4 * 8 * 6; i++) {
+    ((float *) reals)[i] = (float)(i * 3);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_FLOAT, start, count, reals) < 0) {
+    TESTRPT("Unable to write float chunk", 0);
+  }
+
+  free(voxels);
+  free(reals);
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+static int
+read_test_image(const char *name, micompression_t codec, int threads,
+                unsigned short *voxels)
+{
+  mihandle_t hvol;
+  mivolumeprops_t props;
+  micompression_t compression_type;
+  int level;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { CZ, CY, CX };
+  int error_cnt = 0;
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  if (miget_volume_props(hvol, &props) < 0) {
+    TESTRPT("Unable to get volume properties", 0);
+  } else {
+    miget_props_compression_type(props, &compression_type);
+    miget_props_compression_level(props, &level);
+    if (compression_type != codec) {
+      TESTRPT("Bad compression type on reopen", compression_type);
+    }
+    if (level != 3) {
+      TESTRPT("Bad compression level on reopen", level);
+    }
+    mifree_volume_props(props);
+  }
+  miset_volume_read_threads(hvol, threads);
+  if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, voxels) < 0) {
+    TESTRPT("Unable to read volume", 0);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+static int
+test_codec(micompression_t codec)
+{
+  char serial_name[128];
+  char threaded_name[128];
+  unsigned short *serial;
+  unsigned short *threaded;
+  unsigned short *decoded;
+  int error_cnt = 0;
+
+  snprintf(serial_name, sizeof(serial_name), "minc2-chunk-write-0-%d.mnc", getpid());
+  snprintf(threaded_name, sizeof(threaded_name), "minc2-chunk-write-4-%d.mnc", getpid());
+
+  serial = calloc(NVOXELS, sizeof(unsigned short));
+  threaded = calloc(NVOXELS, sizeof(unsigned short));
+  decoded = calloc(NVOXELS, sizeof(unsigned short));
+
+  error_cnt += write_test_image(serial_name, codec, 0);
+  error_cnt += write_test_image(threaded_name, codec, 4);
+  if (error_cnt == 0) {
+    error_cnt += read_test_image(serial_name, codec, 0, serial);
+    error_cnt += read_test_image(threaded_name, codec, 0, threaded);
+    error_cnt += read_test_image(threaded_name, codec, 4, decoded);
+    if (error_cnt == 0 &&
+        memcmp(serial, threaded, NVOXELS * sizeof(unsigned short)) != 0) {
+      TESTRPT("Threaded chunk writes differ from H5Dwrite", codec);
+    }
+    if (error_cnt == 0 &&
+        memcmp(serial, decoded, NVOXELS * sizeof(unsigned short)) != 0) {
+      TESTRPT("Threaded chunk reads differ from H5Dread", codec);
+    }
+  }
+  free(serial);
+  free(threaded);
+  free(decoded);
+  unlink(serial_name);
+  unlink(threaded_name);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  int error_cnt = 0;
+
+  error_cnt += test_codec(MI_COMPRESS_ZLIB);
+  error_cnt += test_codec(MI_COMPRESS_SHUFFLE_ZLIB);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,159 @@
+/* Compare the compression codecs of MINC 2.0 volumes: file size, write
+ * time and read time, on copies of the given input volumes (for example
+ * the images written by minc2-create-test-images).
+ *
+ * usage: minc2-compress-benchmark <input.mnc> [...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#define N_READS 5
+
+static const struct {
+  const char *name;
+  micompression_t type;
+  int level;
+} codecs[] = {
+  { "none", MI_COMPRESS_NONE, 0 },
+  { "zlib:1", MI_COMPRESS_ZLIB, 1 },
+  { "zlib:4", MI_COMPRESS_ZLIB, 4 },
+  { "shuffle-zlib:1", MI_COMPRESS_SHUFFLE_ZLIB, 1 },
+  { "shuffle-zlib:4", MI_COMPRESS_SHUFFLE_ZLIB, 4 },
+  { "lz4", MI_COMPRESS_LZ4, 0 },
+  { "zstd:1", MI_COMPRESS_ZSTD, 1 },
+  { "zstd:3", MI_COMPRESS_ZSTD, 3 }
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int
+benchmark_volume(const char *input)
+{
+  mihandle_t hvol;
+  mihandle_t hinput;
+  midimhandle_t hdims[MI2_MAX_VAR_DIMS];
+  midimhandle_t copies[MI2_MAX_VAR_DIMS];
+  misize_t start[MI2_MAX_VAR_DIMS];
+  misize_t count[MI2_MAX_VAR_DIMS];
+  char output[256];
+  mitype_t type;
+  double valid_min, valid_max;
+  size_t n_voxels = 1;
+  void *buffer;
+  int ndims;
+  size_t c;
+  int i;
+
+  if (miopen_volume(input, MI2_OPEN_READ, &hinput) < 0) {
+    fprintf(stderr, "Unable to open %s\n", input);
+    return 1;
+  }
+  miget_volume_dimension_count(hinput, MI_DIMCLASS_ANY, MI_DIMATTR_ALL, &ndims);
+  miget_volume_dimensions(hinput, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                          MI_DIMORDER_FILE, ndims, hdims);
+  miget_dimension_sizes(hdims, ndims, count);
+  miget_data_type(hinput, &type);
+  miget_volume_valid_range(hinput, &valid_max, &valid_min);
+  for (i = 0; i < ndims; i++) {
+    start[i] = 0;
+    n_voxels *= count[i];
+  }
+  buffer = malloc(n_voxels * sizeof(double));
+  if (buffer == NULL ||
+      miget_voxel_value_hyperslab(hinput, type, start, count, buffer) < 0) {
+    fprintf(stderr, "Unable to read %s\n", input);
+    miclose_volume(hinput);
+    free(buffer);
+    return 1;
+  }
+
+  printf("%s: %lu voxels\n", input, (unsigned long) n_voxels);
+  printf("  %-16s %12s %10s %10s\n", "codec", "bytes", "write s", "read s");
+
+  snprintf(output, sizeof(output), "minc2-compress-benchmark-%d.mnc", getpid());
+  for (c = 0; c < sizeof(codecs) / sizeof(codecs[0]); c++) {
+    mivolumeprops_t props;
+    struct stat st;
+    double t0, t_write, t_read;
+    int r;
+
+    minew_volume_props(&props);
+    if (miset_props_compression_type(props, codecs[c].type) < 0) {
+      printf("  %-16s %12s\n", codecs[c].name, "unavailable");
+      mifree_volume_props(props);
+      continue;
+    }
+    if (codecs[c].level != 0) {
+      miset_props_compression_level(props, codecs[c].level);
+    }
+
+    /* The new volume takes ownership of its dimensions */
+    for (i = 0; i < ndims; i++) {
+      micopy_dimension(hdims[i], &copies[i]);
+    }
+    t0 = now();
+    r = micreate_volume(output, ndims, copies, type, MI_CLASS_REAL, props, &hvol);
+    mifree_volume_props(props);
+    if (r < 0 || micreate_volume_image(hvol) < 0) {
+      printf("  %-16s %12s\n", codecs[c].name, "failed");
+      continue;
+    }
+    miset_volume_valid_range(hvol, valid_max, valid_min);
+    miset_voxel_value_hyperslab(hvol, type, start, count, buffer);
+    miclose_volume(hvol);
+    t_write = now() - t0;
+
+    t0 = now();
+    for (i = 0; i < N_READS; i++) {
+      miopen_volume(output, MI2_OPEN_READ, &hvol);
+      miget_voxel_value_hyperslab(hvol, type, start, count, buffer);
+      miclose_volume(hvol);
+    }
+    t_read = (now() - t0) / N_READS;
+
+    stat(output, &st);
+    printf("  %-16s %12ld %10.4f %10.4f\n", codecs[c].name, (long) st.st_size,
+           t_write, t_read);
+    unlink(output);
+  }
+
+  miclose_volume(hinput);
+  free(buffer);
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int errors = 0;
+  int i;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <input.mnc> [...]\n", argv[0]);
+    return 1;
+  }
+  for (i = 1; i < argc; i++) {
+    errors += benchmark_volume(argv[i]);
+  }
+  return errors;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_BZIP2
+#include <bzlib.h>
+#endif
+
+#define NDIMS 3
+#define CZ 10
+#define CY 40
+#define CX 50
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static short voxels[CZ][CY][CX];
+
+/* Read the whole file \a name into a new buffer.
+ */
+static unsigned char *
+read_file(const char *name, size_t *length)
+{
+  unsigned char *data;
+  FILE *fp;
+
+  if ((fp = fopen(name, "rb")) == NULL) {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  *length = (size_t) ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  data = (unsigned char *) malloc(*length);
+  if (data != NULL && fread(data, 1, *length, fp) != *length) {
+    free(data);
+    data = NULL;
+  }
+  fclose(fp);
+  return data;
+}
+
+/* Write the \a length bytes of \a data to \a name compressed with gzip,
+ * keeping only the first \a keep bytes of the compressed file if it is
+ * not zero.
+ */
+static int
+write_gzip(const char *name, const unsigned char *data, size_t length, size_t keep)
+{
+  gzFile gz;
+  size_t n;
+
+  if ((gz = gzopen(name, "wb")) == NULL) {
+    return -1;
+  }
+  if (gzwrite(gz, data, (unsigned int) length) != (int) length) {
+    gzclose(gz);
+    return -1;
+  }
+  gzclose(gz);
+  if (keep != 0) {
+    unsigned char *compressed = read_file(name, &n);
+    FILE *fp;
+
+    if (compressed == NULL || (fp = fopen(name, "wb")) == NULL) {
+      free(compressed);
+      return -1;
+    }
+    fwrite(compressed, 1, keep < n ? keep : n, fp);
+    fclose(fp);
+    free(compressed);
+  }
+  return 0;
+}
+
+#ifdef HAVE_BZIP2
+/* Write the \a length bytes of \a data to \a name compressed with bzip2,
+ * as two streams one after the other.
+ */
+static int
+write_bzip2(const char *name, const unsigned char *data, size_t length)
+{
+  size_t half = length / 2;
+  BZFILE *bz;
+  FILE *fp;
+  int error;
+  int i;
+
+  if ((fp = fopen(name, "wb")) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    bz = BZ2_bzWriteOpen(&error, fp, 9, 0, 0);
+    if (i == 0) {
+      BZ2_bzWrite(&error, bz, (void *) data, (int) half);
+    } else {
+      BZ2_bzWrite(&error, bz, (void *) (data + half), (int) (length - half));
+    }
+    BZ2_bzWriteClose(&error, bz, 0, NULL, NULL);
+  }
+  fclose(fp);
+  return error == BZ_OK ? 0 : -1;
+}
+#endif
+
+/* Check that the compressed file \a name opens with the voxels of the
+ * test volume.
+ */
+static int
+check_volume(const char *name)
+{
+  static short values[CZ][CY][CX];
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t size;
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  int error_cnt = 0;
+  int i;
+
+  if (miopen_volume(name, MI2_OPEN_RDWR, &hvol) >= 0) {
+    TESTRPT("Compressed volume opened for writing", 0);
+    miclose_volume(hvol);
+  }
+  if (miopen_volume(name, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY, &hvol) < 0) {
+    TESTRPT("Unable to open header of compressed volume", 0);
+  } else {
+    miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                            MI_DIMORDER_FILE, NDIMS, hdims);
+    for (i = 0; i < NDIMS; i++) {
+      if (miget_dimension_size(hdims[i], &size) < 0 || size != lengths[i]) {
+        TESTRPT("Bad dimension size", i);
+      }
+    }
+    miclose_volume(hvol);
+  }
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open compressed volume", 0);
+    return error_cnt;
+  }
+  if (miget_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, lengths, values) < 0) {
+    TESTRPT("Unable to read voxels", 0);
+  } else if (memcmp(values, voxels, sizeof(values))) {
+    TESTRPT("Bad voxels", 0);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  unsigned char *data;
+  size_t length;
+  char name[256];
+  char gz_name[sizeof(name) + 5];
+  char bz2_name[sizeof(name) + 5];
+  int error_cnt = 0;
+  int z, y, x;
+
+  snprintf(name, sizeof(name), "minc2-compressed-test-%d.mnc", getpid());
+  snprintf(gz_name, sizeof(gz_name), "%s.gz", name);
+  snprintf(bz2_name, sizeof(bz2_name), "%s.bz2", name);
+  for (z = 0; z < CZ; z++) {
+    for (y = 0; y < CY; y++) {
+      for (x = 0; x < CX; x++) {
+        voxels[z][y][x] = (short) (z * 1000 + y * 20 - x);
+      }
+    }
+  }
+  for (z = 0; z < NDIMS; z++) {
+    micreate_dimension(dimnames[z], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[z], &hdims[z]);
+  }
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_SHORT, MI_CLASS_REAL,
+                      NULL, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, lengths, voxels);
+  miclose_volume(hvol);
+  if ((data = read_file(name, &length)) == NULL) {
+    TESTRPT("Unable to read test volume", 0);
+    return error_cnt;
+  }
+
+  if (write_gzip(gz_name, data, length, 0) < 0) {
+    TESTRPT("Unable to write gzip file", 0);
+  } else {
+    error_cnt += check_volume(gz_name);
+  }
+#ifdef HAVE_BZIP2
+  if (write_bzip2(bz2_name, data, length) < 0) {
+    TESTRPT("Unable to write bzip2 file", 0);
+  } else {
+    error_cnt += check_volume(bz2_name);
+  }
+  unlink(bz2_name);
+#endif
+
+  /* A truncated compressed file does not open */
+  if (write_gzip(gz_name, data, length, 100) < 0) {
+    TESTRPT("Unable to write gzip file", 1);
+  } else if (miopen_volume(gz_name, MI2_OPEN_READ, &hvol) >= 0) {
+    TESTRPT("Truncated gzip file opened", 0);
+    miclose_volume(hvol);
+  }
+
+  free(data);
+  unlink(gz_name);
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
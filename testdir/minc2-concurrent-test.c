@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define NDIMS 3
+#define CZ 16
+#define CY 48
+#define CX 60
+#define N_THREADS 8
+#define N_READS 150
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+
+/* The whole volume read before the threads start */
+static unsigned short voxels[CZ][CY][CX];
+static double reals[CZ][CY][CX];
+
+struct reader {
+  mihandle_t hvol;
+  unsigned int seed;
+  int error_cnt;
+};
+
+static int
+create_test_image(const char *name)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static const int blocking[NDIMS] = { 4, 16, 20 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, blocking);
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < CZ * CY * CX; i++) {
+    (&voxels[0][0][0])[i] = (unsigned short)((i * 7919) % 65521);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  for (start[0] = 0; start[0] < CZ; start[0]++) {
+    miset_slice_range(hvol, start, NDIMS, 100.0 + start[0], -1.0 * start[0]);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+/* Random hyperslab reads, voxel and real, compared with the whole
+ * volume read beforehand.
+ */
+static void *
+read_randomly(void *arg)
+{
+  struct reader *reader = (struct reader *) arg;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  double *buffer = malloc(CZ * CY * CX * sizeof(double));
+  int n, i;
+  int error_cnt = 0;
+
+  for (n = 0; n < N_READS && error_cnt == 0; n++) {
+    int real = rand_r(&reader->seed) & 1;
+    size_t k = 0;
+    misize_t z, y, x;
+    int result;
+
+    for (i = 0; i < NDIMS; i++) {
+      count[i] = 1 + rand_r(&reader->seed) % lengths[i];
+      start[i] = rand_r(&reader->seed) % (lengths[i] - count[i] + 1);
+    }
+    if (real) {
+      result = miget_real_value_hyperslab(reader->hvol, MI_TYPE_DOUBLE, start, count, buffer);
+    } else {
+      result = miget_voxel_value_hyperslab(reader->hvol, MI_TYPE_USHORT, start, count, buffer);
+    }
+    if (result < 0) {
+      TESTRPT("Unable to read hyperslab", n);
+      break;
+    }
+    for (z = start[0]; z < start[0] + count[0]; z++)
+      for (y = start[1]; y < start[1] + count[1]; y++)
+        for (x = start[2]; x < start[2] + count[2]; x++, k++) {
+          if (real ? buffer[k] != reals[z][y][x] :
+              ((unsigned short *) buffer)[k] != voxels[z][y][x]) {
+            TESTRPT("Hyperslab differs", n);
+            z = start[0] + count[0];
+            y = start[1] + count[1];
+            break;
+          }
+        }
+  }
+  free(buffer);
+  reader->error_cnt = error_cnt;
+  return NULL;
+}
+
+int
+main(void)
+{
+  static const misize_t start[NDIMS] = { 0, 0, 0 };
+  struct reader readers[N_THREADS];
+#ifdef HAVE_PTHREAD
+  pthread_t threads[N_THREADS];
+#endif
+  char filename[128];
+  mihandle_t hvol;
+  miboolean_t enabled;
+  int i;
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-concurrent-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename);
+  if (error_cnt != 0) {
+    return error_cnt;
+  }
+  if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0 ||
+      miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, lengths, reals) < 0) {
+    TESTRPT("Unable to read volume", 0);
+  }
+
+  if (miset_volume_concurrent_reads(hvol, TRUE) < 0 ||
+      miget_volume_concurrent_reads(hvol, &enabled) < 0 || !enabled) {
+    TESTRPT("Unable to enable concurrent reads", 0);
+  }
+  /* The state reads depend on is frozen */
+  if (miselect_resolution(hvol, 0) != MI_ERROR ||
+      miset_apparent_dimension_order_by_name(hvol, 0, NULL) != MI_ERROR ||
+      miset_volume_chunk_cache(hvol, 1024 * 1024) != MI_ERROR) {
+    TESTRPT("Volume state changed while shared", 0);
+  }
+
+  for (i = 0; i < N_THREADS; i++) {
+    readers[i].hvol = hvol;
+    readers[i].seed = 1234567u * (i + 1);
+    readers[i].error_cnt = 0;
+  }
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < N_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, read_randomly, &readers[i]) != 0) {
+      TESTRPT("Unable to start reader thread", i);
+      read_randomly(&readers[i]);
+      threads[i] = pthread_self();
+    }
+  }
+  for (i = 0; i < N_THREADS; i++) {
+    if (!pthread_equal(threads[i], pthread_self())) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+#else
+  for (i = 0; i < N_THREADS; i++) {
+    read_randomly(&readers[i]);
+  }
+#endif
+  for (i = 0; i < N_THREADS; i++) {
+    error_cnt += readers[i].error_cnt;
+  }
+  miclose_volume(hvol);
+
+  /* Volumes open for writing cannot be shared */
+  if (miopen_volume(filename, MI2_OPEN_RDWR, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    if (miset_volume_concurrent_reads(hvol, TRUE) != MI_ERROR) {
+      TESTRPT("Writable volume shared", 0);
+    }
+    miclose_volume(hvol);
+  }
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 3
+#define CZ 10
+#define CY 24
+#define CX 36
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CT, CZ, CY, CX };
+
+static int
+create_test_image(const char *name, mihandle_t *hvol_ptr)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  static const int blocking[NDIMS] = { 1, 5, 8, 12 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  unsigned short *buffer;
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], i == 0 ? MI_DIMCLASS_TIME : MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, blocking);
+  miset_props_compression_threads(props, 4);
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, hvol_ptr);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(*hvol_ptr, TRUE);
+  if (micreate_volume_image(*hvol_ptr) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+
+  buffer = malloc(CT * CZ * CY * CX * sizeof(unsigned short));
+  for (i = 0; i < CT * CZ * CY * CX; i++) {
+    buffer[i] = (unsigned short)((i * 7919) % 65521);
+  }
+  if (miset_voxel_value_hyperslab(*hvol_ptr, MI_TYPE_USHORT, start, lengths, buffer) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  free(buffer);
+  for (start[0] = 0; start[0] < CT; start[0]++) {
+    for (start[1] = 0; start[1] < CZ; start[1]++) {
+      miset_slice_range(*hvol_ptr, start, NDIMS, 100.0 + start[0] * 10 + start[1],
+                        -1.0 * start[1]);
+    }
+  }
+  return error_cnt;
+}
+
+/* Set the dimensions whose bit is set in \a flips to counter file order.
+ */
+static void
+set_flips(mihandle_t hvol, unsigned int flips)
+{
+  midimhandle_t hdims[NDIMS];
+  int i;
+
+  miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL, MI_DIMORDER_FILE,
+                          NDIMS, hdims);
+  for (i = 0; i < NDIMS; i++) {
+    miset_dimension_apparent_voxel_order(hdims[i], (flips & (1U << i)) ?
+                                         MI_COUNTER_FILE_ORDER : MI_FILE_ORDER);
+  }
+}
+
+/* Offset in a selection of \a count, read in file order, of the voxel
+ * at \a idx in the same selection read with \a flips.
+ */
+static size_t
+mirror_offset(const misize_t count[], const misize_t idx[], unsigned int flips)
+{
+  size_t offset = 0;
+  int i;
+
+  for (i = 0; i < NDIMS; i++) {
+    misize_t j = (flips & (1U << i)) ? count[i] - 1 - idx[i] : idx[i];
+    offset = offset * count[i] + j;
+  }
+  return offset;
+}
+
+/* Read the same selection, in file order and flipped, and check that
+ * one is the mirror image of the other.
+ */
+static int
+compare_flipped(mihandle_t hvol, unsigned int flips, int real, int threads,
+                const misize_t start[], const misize_t count[])
+{
+  misize_t flipped_start[NDIMS];
+  misize_t idx[NDIMS];
+  size_t el_size = real ? sizeof(double) : sizeof(unsigned short);
+  size_t n = 1;
+  size_t k;
+  unsigned char *file_order;
+  unsigned char *flipped;
+  int i, r1, r2;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    n *= count[i];
+    /* The same voxels seen from the other end */
+    flipped_start[i] = (flips & (1U << i)) ? lengths[i] - start[i] - count[i] : start[i];
+  }
+  file_order = malloc(n * el_size);
+  flipped = malloc(n * el_size);
+
+  miset_volume_read_threads(hvol, threads);
+  set_flips(hvol, 0);
+  if (real) {
+    r1 = miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, file_order);
+  } else {
+    r1 = miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, file_order);
+  }
+  set_flips(hvol, flips);
+  if (real) {
+    r2 = miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, flipped_start, count, flipped);
+  } else {
+    r2 = miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, flipped_start, count, flipped);
+  }
+  set_flips(hvol, 0);
+
+  if (r1 < 0 || r2 < 0) {
+    TESTRPT("Unable to read hyperslab", (int) flips);
+  } else {
+    for (i = 0; i < NDIMS; i++) {
+      idx[i] = 0;
+    }
+    for (k = 0; k < n; k++) {
+      if (memcmp(flipped + k * el_size,
+                 file_order + mirror_offset(count, idx, flips) * el_size, el_size) != 0) {
+        TESTRPT("Flipped voxel differs", (int) flips);
+        break;
+      }
+      for (i = NDIMS - 1; i >= 0; i--) {
+        if (++idx[i] < count[i]) {
+          break;
+        }
+        idx[i] = 0;
+      }
+    }
+  }
+  free(file_order);
+  free(flipped);
+  return error_cnt;
+}
+
+/* Write a flipped selection and read it back in file order.
+ */
+static int
+write_flipped(mihandle_t hvol, unsigned int flips,
+              const misize_t start[], const misize_t count[])
+{
+  misize_t flipped_start[NDIMS];
+  misize_t idx[NDIMS];
+  unsigned short *flipped;
+  unsigned short *file_order;
+  size_t n = 1;
+  size_t k;
+  int i;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    n *= count[i];
+    flipped_start[i] = (flips & (1U << i)) ? lengths[i] - start[i] - count[i] : start[i];
+    idx[i] = 0;
+  }
+  flipped = malloc(n * sizeof(unsigned short));
+  file_order = malloc(n * sizeof(unsigned short));
+  for (k = 0; k < n; k++) {
+    flipped[k] = (unsigned short)(k * 31 + flips);
+  }
+
+  set_flips(hvol, flips);
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, flipped_start, count, flipped) < 0) {
+    TESTRPT("Unable to write flipped hyperslab", (int) flips);
+  }
+  set_flips(hvol, 0);
+  if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, file_order) < 0) {
+    TESTRPT("Unable to read hyperslab", (int) flips);
+  } else {
+    for (k = 0; k < n; k++) {
+      if (flipped[k] != file_order[mirror_offset(count, idx, flips)]) {
+        TESTRPT("Written voxel differs", (int) flips);
+        break;
+      }
+      for (i = NDIMS - 1; i >= 0; i--) {
+        if (++idx[i] < count[i]) {
+          break;
+        }
+        idx[i] = 0;
+      }
+    }
+  }
+  free(flipped);
+  free(file_order);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const misize_t full_start[NDIMS] = { 0, 0, 0, 0 };
+  static const misize_t part_start[NDIMS] = { 1, 2, 3, 5 };
+  static const misize_t part_count[NDIMS] = { 2, 7, 19, 30 };
+  static const misize_t chunk_start[NDIMS] = { 1, 5, 8, 12 };
+  static const misize_t chunk_count[NDIMS] = { 2, 5, 16, 24 };
+  char filename[128];
+  mihandle_t hvol;
+  unsigned int flips;
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-flip-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename, &hvol);
+  if (error_cnt != 0) {
+    return error_cnt;
+  }
+
+  for (flips = 1; flips < (1U << NDIMS); flips++) {
+    int threads;
+
+    for (threads = 0; threads <= 4; threads += 4) {
+      error_cnt += compare_flipped(hvol, flips, FALSE, threads, full_start, lengths);
+      error_cnt += compare_flipped(hvol, flips, FALSE, threads, part_start, part_count);
+      error_cnt += compare_flipped(hvol, flips, TRUE, threads, full_start, lengths);
+      error_cnt += compare_flipped(hvol, flips, TRUE, threads, part_start, part_count);
+    }
+  }
+  /* Selections of complete chunks are flipped as the chunks are
+   * encoded, the others go through H5Dwrite().
+   */
+  for (flips = 1; flips < (1U << NDIMS); flips++) {
+    error_cnt += write_flipped(hvol, flips, chunk_start, chunk_count);
+    error_cnt += write_flipped(hvol, flips, part_start, part_count);
+  }
+  miclose_volume(hvol);
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 5
+#define CZ 3
+#define CY 6
+#define CX 7
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CT, CZ, CY, CX };
+
+static int
+create_volume(const char *name)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  static unsigned short voxels[CT][CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  int error_cnt = 0;
+  int i, t, z;
+
+  micreate_dimension(dimnames[0], MI_DIMCLASS_TIME,
+                     MI_DIMATTR_NOT_REGULARLY_SAMPLED, CT, &hdims[0]);
+  for (t = 0; t < CT; t++) {
+    double offset = t * t + 100.0;
+    double width = t + 1.0;
+
+    miset_dimension_offsets(hdims[0], 1, t, &offset);
+    miset_dimension_widths(hdims[0], 1, t, &width);
+  }
+  for (i = 1; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      NULL, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  miset_volume_valid_range(hvol, 4000.0, 0.0);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+  for (t = 0; t < CT; t++) {
+    for (z = 0; z < CZ; z++) {
+      for (i = 0; i < CY * CX; i++) {
+        voxels[t][z][i / CX][i % CX] = (unsigned short) (t * 1000 + z * 100 + i);
+      }
+      start[0] = t;
+      start[1] = z;
+      miset_slice_range(hvol, start, NDIMS, 10.0 * (t + 1), -1.0 * z);
+    }
+  }
+  start[0] = start[1] = 0;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+/* Compare what the header-only \a hvol gives with what the volume
+ * \a href opened the usual way gives.
+ */
+static int
+compare_volumes(mihandle_t hvol, mihandle_t href)
+{
+  static double values[CT][CZ][CY][CX];
+  static double expected[CT][CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  midimhandle_t rdims[NDIMS];
+  misize_t sizes[NDIMS];
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  double offsets[CT], widths[CT];
+  double range[2], ref_range[2];
+  mitype_t type;
+  miboolean_t flag;
+  int error_cnt = 0;
+  int i;
+
+  if (miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                              MI_DIMORDER_FILE, NDIMS, hdims) != NDIMS ||
+      miget_volume_dimensions(href, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                              MI_DIMORDER_FILE, NDIMS, rdims) != NDIMS) {
+    TESTRPT("Unable to get dimensions", 0);
+    return error_cnt;
+  }
+  miget_dimension_sizes(hdims, NDIMS, sizes);
+  for (i = 0; i < NDIMS; i++) {
+    if (sizes[i] != lengths[i]) {
+      TESTRPT("Bad dimension size", i);
+    }
+  }
+
+  if (miget_dimension_offsets(hdims[0], CT, 0, offsets) < 0 ||
+      miget_dimension_widths(hdims[0], MI_ORDER_FILE, CT, 0, widths) < 0) {
+    TESTRPT("Unable to get irregular spacing", 0);
+  } else {
+    for (i = 0; i < CT; i++) {
+      if (offsets[i] != i * i + 100.0 || widths[i] != i + 1.0) {
+        TESTRPT("Bad irregular spacing", i);
+      }
+    }
+  }
+
+  if (miget_data_type(hvol, &type) < 0 || type != MI_TYPE_USHORT) {
+    TESTRPT("Bad data type", (int) type);
+  }
+  if (miget_slice_scaling_flag(hvol, &flag) < 0 || !flag) {
+    TESTRPT("Slice scaling not seen", 0);
+  }
+  if (miget_volume_valid_range(hvol, &range[1], &range[0]) < 0 ||
+      range[0] != 0.0 || range[1] != 4000.0) {
+    TESTRPT("Bad valid range", 0);
+  }
+  if (miget_volume_real_range(hvol, range) < 0 ||
+      miget_volume_real_range(href, ref_range) < 0 ||
+      range[0] != ref_range[0] || range[1] != ref_range[1]) {
+    TESTRPT("Bad real range", 0);
+  }
+
+  if (miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, lengths, values) < 0 ||
+      miget_real_value_hyperslab(href, MI_TYPE_DOUBLE, start, lengths, expected) < 0) {
+    TESTRPT("Unable to read real values", 0);
+  } else {
+    for (i = 0; i < CT * CZ * CY * CX; i++) {
+      if ((&values[0][0][0][0])[i] != (&expected[0][0][0][0])[i]) {
+        TESTRPT("Bad real value", i);
+        break;
+      }
+    }
+  }
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  mihandle_t hvol, href;
+  midimhandle_t hdims[NDIMS];
+  char name[256];
+  double value;
+  misize_t coords[NDIMS] = { CT - 1, CZ - 1, CY - 1, CX - 1 };
+  int error_cnt = 0;
+
+  snprintf(name, sizeof(name), "minc2-header-only-test-%d.mnc", getpid());
+  error_cnt += create_volume(name);
+
+  if (miopen_volume(name, MI2_OPEN_RDWR | MI2_OPEN_HEADER_ONLY, &hvol) >= 0) {
+    TESTRPT("Opened for writing without the image", 0);
+    miclose_volume(hvol);
+  }
+
+  if (miopen_volume(name, MI2_OPEN_READ, &href) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+
+  /* The image is opened by whatever needs it first */
+  if (miopen_volume(name, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY, &hvol) < 0) {
+    TESTRPT("Unable to open the header of a volume", 0);
+  } else {
+    error_cnt += compare_volumes(hvol, href);
+    miclose_volume(hvol);
+  }
+  if (miopen_volume(name, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY, &hvol) < 0) {
+    TESTRPT("Unable to open the header of a volume", 0);
+  } else {
+    if (miget_real_value(hvol, coords, NDIMS, &value) < 0) {
+      TESTRPT("Unable to read a real value", 0);
+    }
+    error_cnt += compare_volumes(hvol, href);
+    miclose_volume(hvol);
+  }
+
+  /* Dimensions copied before the spacing is read get it */
+  if (miopen_volume(name, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY, &hvol) < 0) {
+    TESTRPT("Unable to open the header of a volume", 0);
+  } else {
+    midimhandle_t copy;
+    double offset;
+
+    miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                            MI_DIMORDER_FILE, NDIMS, hdims);
+    if (micopy_dimension(hdims[0], &copy) < 0) {
+      TESTRPT("Unable to copy a dimension", 0);
+    } else {
+      if (miget_dimension_offsets(copy, 1, CT - 1, &offset) < 0 ||
+          offset != (CT - 1) * (CT - 1) + 100.0) {
+        TESTRPT("Bad offset of a copied dimension", 0);
+      }
+      mifree_dimension_handle(copy);
+    }
+    miclose_volume(hvol);
+  }
+  miclose_volume(href);
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
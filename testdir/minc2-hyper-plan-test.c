@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CX 11
+#define CY 12
+#define CZ 9
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static int
+create_test_image(const char *name, mihandle_t *hvol_ptr)
+{
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  mihyperplan_t plan;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  unsigned short slice[CY][CX];
+  int i, j, k;
+  int result;
+  int error_cnt = 0;
+
+  micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdims[0]);
+  micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdims[1]);
+  micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdims[2]);
+
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, NULL, &hvol);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  result = micreate_volume_image(hvol);
+  if (result < 0) {
+    TESTRPT("Unable to create volume image", result);
+    return error_cnt;
+  }
+
+  count[0] = 1;
+  count[1] = CY;
+  count[2] = CX;
+  result = miprepare_hyperslab(hvol, MI_HYPERSLAB_VOXEL, MI_TYPE_USHORT,
+                               count, &plan);
+  if (result < 0) {
+    TESTRPT("Unable to prepare voxel plan", result);
+    return error_cnt;
+  }
+
+  start[1] = start[2] = 0;
+  for (k = 0; k < CZ; k++) {
+    for (j = 0; j < CY; j++) {
+      for (i = 0; i < CX; i++) {
+        slice[j][i] = (unsigned short)(k * 1000 + j * 50 + i);
+      }
+    }
+    start[0] = k;
+    result = miexecute_hyperslab(plan, MI_HYPERSLAB_WRITE, start, slice);
+    if (result < 0) {
+      TESTRPT("Unable to write slice through plan", k);
+    }
+    result = miset_slice_range(hvol, start, NDIMS, 10.0 * (k + 1), -1.0 * k);
+    if (result < 0) {
+      TESTRPT("Unable to set slice range", k);
+    }
+  }
+  mifree_hyperslab(plan);
+  *hvol_ptr = hvol;
+  return error_cnt;
+}
+
+static int
+compare_plan_reads(mihandle_t hvol)
+{
+  mihyperplan_t plan;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  double planned[CY][CX];
+  double oneshot[CY][CX];
+  unsigned short voxels[CY][CX];
+  int i, j, k;
+  int result;
+  int error_cnt = 0;
+
+  count[0] = 1;
+  count[1] = CY;
+  count[2] = CX;
+  start[1] = start[2] = 0;
+
+  /* Real values through a plan must match the one-shot function. */
+  result = miprepare_hyperslab(hvol, MI_HYPERSLAB_REAL, MI_TYPE_DOUBLE,
+                               count, &plan);
+  if (result < 0) {
+    TESTRPT("Unable to prepare real plan", result);
+    return error_cnt;
+  }
+  for (k = 0; k < CZ; k++) {
+    start[0] = k;
+    result = miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, planned);
+    if (result < 0) {
+      TESTRPT("Unable to read slice through plan", k);
+      continue;
+    }
+    result = miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count,
+                                        oneshot);
+    if (result < 0) {
+      TESTRPT("Unable to read slice", k);
+      continue;
+    }
+    if (memcmp(planned, oneshot, sizeof(planned)) != 0) {
+      TESTRPT("Planned real read differs", k);
+    }
+  }
+  mifree_hyperslab(plan);
+
+  /* Voxel values round trip unchanged. */
+  result = miprepare_hyperslab(hvol, MI_HYPERSLAB_VOXEL, MI_TYPE_USHORT,
+                               count, &plan);
+  if (result < 0) {
+    TESTRPT("Unable to prepare voxel plan", result);
+    return error_cnt;
+  }
+  for (k = 0; k < CZ; k++) {
+    start[0] = k;
+    result = miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, voxels);
+    if (result < 0) {
+      TESTRPT("Unable to read slice through plan", k);
+      continue;
+    }
+    for (j = 0; j < CY; j++) {
+      for (i = 0; i < CX; i++) {
+        if (voxels[j][i] != (unsigned short)(k * 1000 + j * 50 + i)) {
+          TESTRPT("Bad voxel value", voxels[j][i]);
+        }
+      }
+    }
+  }
+  mifree_hyperslab(plan);
+  return error_cnt;
+}
+
+static int
+compare_flipped_reads(mihandle_t hvol)
+{
+  static char *dimorder[NDIMS] = { "xspace", "zspace", "yspace" };
+  midimhandle_t hdims[NDIMS];
+  mihyperplan_t plan;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  double planned[CX][CZ][2];
+  double oneshot[CX][CZ][2];
+  int j;
+  int result;
+  int error_cnt = 0;
+
+  miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                          MI_DIMORDER_FILE, NDIMS, hdims);
+  miset_dimension_apparent_voxel_order(hdims[1], MI_COUNTER_FILE_ORDER);
+  result = miset_apparent_dimension_order_by_name(hvol, NDIMS, dimorder);
+  if (result < 0) {
+    TESTRPT("Unable to set apparent dimension order", result);
+    return error_cnt;
+  }
+
+  count[0] = CX;
+  count[1] = CZ;
+  count[2] = 2;
+  start[0] = start[1] = 0;
+  result = miprepare_hyperslab(hvol, MI_HYPERSLAB_REAL, MI_TYPE_DOUBLE,
+                               count, &plan);
+  if (result < 0) {
+    TESTRPT("Unable to prepare plan", result);
+    return error_cnt;
+  }
+  for (j = 0; j + 2 <= CY; j += 2) {
+    start[2] = j;
+    result = miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, planned);
+    if (result < 0) {
+      TESTRPT("Unable to read through plan", j);
+      continue;
+    }
+    miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, oneshot);
+    if (memcmp(planned, oneshot, sizeof(planned)) != 0) {
+      TESTRPT("Planned read with apparent order differs", j);
+    }
+  }
+
+  /* A plan is not used once the voxel or dimension order changes */
+  start[2] = 0;
+  miset_dimension_apparent_voxel_order(hdims[1], MI_FILE_ORDER);
+  if (miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, planned) >= 0) {
+    TESTRPT("Plan used after the voxel order changed", 0);
+  }
+  mifree_hyperslab(plan);
+  result = miprepare_hyperslab(hvol, MI_HYPERSLAB_REAL, MI_TYPE_DOUBLE,
+                               count, &plan);
+  if (result < 0) {
+    TESTRPT("Unable to prepare plan", result);
+    return error_cnt;
+  }
+  if (miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, planned) < 0) {
+    TESTRPT("Unable to read through new plan", 0);
+  }
+  miset_apparent_dimension_order_by_name(hvol, NDIMS, dimorder);
+  if (miexecute_hyperslab(plan, MI_HYPERSLAB_READ, start, planned) >= 0) {
+    TESTRPT("Plan used after the dimension order changed", 0);
+  }
+  mifree_hyperslab(plan);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  mihandle_t hvol;
+  int error_cnt = 0;
+  char filename[128];
+
+  snprintf(filename, sizeof(filename), "minc2-hyper-plan-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename, &hvol);
+  if (error_cnt == 0) {
+    error_cnt += compare_plan_reads(hvol);
+    miclose_volume(hvol);
+
+    if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+      TESTRPT("Unable to reopen volume", 0);
+    } else {
+      error_cnt += compare_plan_reads(hvol);
+      error_cnt += compare_flipped_reads(hvol);
+      miclose_volume(hvol);
+    }
+  }
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <utime.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define NFILES 3
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+
+/* Create a volume whose dimension sizes, steps and attributes depend on
+ * \a k, last modified \a age seconds ago.
+ */
+static int
+create_volume(const char *name, int k, int age)
+{
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  struct utimbuf times;
+  char full_name[32];
+  double echo_time = 0.5 * k;
+  int i;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, 4 + k + i, &hdims[i]);
+    miset_dimension_separation(hdims[i], 1.0 + k);
+    miset_dimension_start(hdims[i], -10.0 * i);
+  }
+  if (micreate_volume(name, NDIMS, hdims, k == 1 ? MI_TYPE_FLOAT : MI_TYPE_SHORT,
+                      MI_CLASS_REAL, NULL, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    return -1;
+  }
+  snprintf(full_name, sizeof(full_name), "Subject %d", k);
+  miset_attr_values(hvol, MI_TYPE_STRING, "patient", "full_name",
+                    strlen(full_name), full_name);
+  miset_attr_values(hvol, MI_TYPE_DOUBLE, "acquisition", "echo_time", 1, &echo_time);
+  if (miclose_volume(hvol) < 0) {
+    return -1;
+  }
+  times.actime = times.modtime = time(NULL) - age;
+  return utime(name, &times);
+}
+
+/* Check what the index gives for the file \a name created with \a k.
+ */
+static int
+check_file(miheaderindex_t index, const char *name, int k)
+{
+  misize_t sizes[MI2_MAX_VAR_DIMS];
+  char *names[MI2_MAX_VAR_DIMS];
+  double v2w[4][4];
+  mitype_t type;
+  char full_name[32];
+  char expected[32];
+  double echo_time;
+  int ivalue;
+  size_t length;
+  int error_cnt = 0;
+  int i;
+
+  if (miget_indexed_dimensions(index, name, MI2_MAX_VAR_DIMS, sizes, names) != NDIMS) {
+    TESTRPT("Bad number of dimensions", k);
+    return error_cnt;
+  }
+  for (i = 0; i < NDIMS; i++) {
+    if (sizes[i] != (misize_t) (4 + k + i) || strcmp(names[i], dimnames[i])) {
+      TESTRPT("Bad dimension", i);
+    }
+    mifree_name(names[i]);
+  }
+  if (miget_indexed_dimensions(index, name, NDIMS - 1, sizes, NULL) >= 0) {
+    TESTRPT("Dimensions returned in a short array", k);
+  }
+
+  /* xspace, yspace and zspace are the world axes 0, 1 and 2 */
+  if (miget_indexed_voxel_to_world(index, name, v2w) < 0) {
+    TESTRPT("Unable to get voxel to world transform", k);
+  } else {
+    for (i = 0; i < NDIMS; i++) {
+      if (v2w[i][i] != 1.0 + k || v2w[i][3] != -10.0 * (NDIMS - 1 - i)) {
+        TESTRPT("Bad voxel to world transform", i);
+      }
+    }
+  }
+
+  if (miget_indexed_data_type(index, name, &type) < 0 ||
+      type != (k == 1 ? MI_TYPE_FLOAT : MI_TYPE_SHORT)) {
+    TESTRPT("Bad data type", k);
+  }
+
+  snprintf(expected, sizeof(expected), "Subject %d", k);
+  if (miget_indexed_attr_length(index, name, "patient", "full_name", &length) < 0 ||
+      length != strlen(expected)) {
+    TESTRPT("Bad string attribute length", k);
+  }
+  if (miget_indexed_attr_values(index, name, MI_TYPE_STRING, "patient",
+                                "full_name", sizeof(full_name), full_name) < 0 ||
+      strcmp(full_name, expected)) {
+    TESTRPT("Bad string attribute", k);
+  }
+  if (miget_indexed_attr_values(index, name, MI_TYPE_DOUBLE, "acquisition",
+                                "echo_time", 1, &echo_time) < 0 ||
+      echo_time != 0.5 * k) {
+    TESTRPT("Bad double attribute", k);
+  }
+  if (miget_indexed_attr_values(index, name, MI_TYPE_INT, "acquisition",
+                                "echo_time", 1, &ivalue) < 0 ||
+      ivalue != (int) (0.5 * k)) {
+    TESTRPT("Bad attribute read as int", k);
+  }
+  if (miget_indexed_attr_values(index, name, MI_TYPE_DOUBLE, "acquisition",
+                                "repetition_time", 1, &echo_time) >= 0) {
+    TESTRPT("Value of a missing attribute", k);
+  }
+  if (miget_indexed_attr_values(index, name, MI_TYPE_DOUBLE, "patient",
+                                "age", 1, &echo_time) >= 0) {
+    TESTRPT("Value of an attribute not kept", k);
+  }
+  return error_cnt;
+}
+
+/* Index the \a n_files files given on the command line on several
+ * threads, before anything else in the process has used the library.
+ */
+static int
+index_fresh(int n_files, char *argv[])
+{
+  const char **files = (const char **) argv;
+  char index_path[64];
+  miheaderindex_t index;
+  misize_t sizes[MI2_MAX_VAR_DIMS];
+  mihandle_t hvol;
+  int ndims;
+  int error_cnt = 0;
+  int i, n;
+
+  snprintf(index_path, sizeof(index_path), "minc2-index-test-%d.idx", getpid());
+  if (miopen_header_index(index_path, &index) < 0) {
+    TESTRPT("Unable to open header index", 0);
+    return error_cnt;
+  }
+  if ((n = miupdate_header_index(index, n_files, files, 4)) != n_files) {
+    TESTRPT("Bad number of headers read", n);
+  }
+  for (i = 0; i < n_files; i++) {
+    n = miget_indexed_dimensions(index, files[i], MI2_MAX_VAR_DIMS, sizes, NULL);
+    if (miopen_volume(files[i], MI2_OPEN_READ, &hvol) < 0) {
+      TESTRPT("Unable to open volume", i);
+      continue;
+    }
+    miget_volume_dimension_count(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL, &ndims);
+    if (n < 1 || n != ndims) {
+      TESTRPT("Bad number of indexed dimensions", n);
+    }
+    miclose_volume(hvol);
+  }
+  miclose_header_index(index);
+  unlink(index_path);
+  return error_cnt;
+}
+
+/* Index volumes created for the test, and check that the index follows
+ * their changes.
+ */
+static int
+index_created(void)
+{
+  char names[NFILES][64];
+  const char *files[NFILES + 1];
+  char index_path[64];
+  char missing[64];
+  miheaderindex_t index;
+  misize_t sizes[NDIMS];
+  FILE *fp;
+  int error_cnt = 0;
+  int i, n;
+
+  snprintf(index_path, sizeof(index_path), "minc2-index-test-%d.idx", getpid());
+  snprintf(missing, sizeof(missing), "minc2-index-test-%d-missing.mnc", getpid());
+  for (i = 0; i < NFILES; i++) {
+    snprintf(names[i], sizeof(names[i]), "minc2-index-test-%d-%d.mnc", getpid(), i);
+    files[i] = names[i];
+    if (create_volume(names[i], i, 100) < 0) {
+      TESTRPT("Unable to create test volume", i);
+      return error_cnt;
+    }
+  }
+
+  /* Build a new index on several threads */
+  if (miopen_header_index(index_path, &index) < 0) {
+    TESTRPT("Unable to open header index", 0);
+    return error_cnt;
+  }
+  miadd_header_index_attr(index, "patient", "full_name");
+  miadd_header_index_attr(index, "acquisition", "echo_time");
+  miadd_header_index_attr(index, "acquisition", "repetition_time");
+  if ((n = miupdate_header_index(index, NFILES, files, 2)) != NFILES) {
+    TESTRPT("Bad number of headers read", n);
+  }
+  for (i = 0; i < NFILES; i++) {
+    error_cnt += check_file(index, names[i], i);
+  }
+  if ((n = miupdate_header_index(index, NFILES, files, 2)) != 0) {
+    TESTRPT("Unchanged headers read again", n);
+  }
+  if (miclose_header_index(index) < 0) {
+    TESTRPT("Unable to close header index", 0);
+  }
+
+  /* The saved index is used as it is */
+  if (miopen_header_index(index_path, &index) < 0) {
+    TESTRPT("Unable to open header index", 0);
+    return error_cnt;
+  }
+  if ((n = miupdate_header_index(index, NFILES, files, 0)) != 0) {
+    TESTRPT("Saved headers read again", n);
+  }
+  for (i = 0; i < NFILES; i++) {
+    error_cnt += check_file(index, names[i], i);
+  }
+
+  /* Changed files are read again, by queries too */
+  create_volume(names[1], 4, 50);
+  create_volume(names[2], 5, 50);
+  error_cnt += check_file(index, names[1], 4);
+  if ((n = miupdate_header_index(index, NFILES, files, 2)) != 1) {
+    TESTRPT("Bad number of changed headers read", n);
+  }
+  error_cnt += check_file(index, names[2], 5);
+
+  /* Files that cannot be read are dropped, the others still indexed */
+  files[NFILES] = missing;
+  unlink(names[0]);
+  create_volume(names[0], 6, 50);
+  if (miupdate_header_index(index, NFILES + 1, files, 2) >= 0) {
+    TESTRPT("Missing file indexed", 0);
+  }
+  error_cnt += check_file(index, names[0], 6);
+  unlink(names[2]);
+  if (miget_indexed_dimensions(index, names[2], NDIMS, sizes, NULL) >= 0) {
+    TESTRPT("Dimensions of a deleted file", 0);
+  }
+  miclose_header_index(index);
+
+  /* A damaged index is started again */
+  if ((fp = fopen(index_path, "r+b")) != NULL) {
+    fputs("garbage", fp);
+    fclose(fp);
+  }
+  if (miopen_header_index(index_path, &index) < 0) {
+    TESTRPT("Unable to open damaged header index", 0);
+  } else {
+    miadd_header_index_attr(index, "patient", "full_name");
+    miadd_header_index_attr(index, "acquisition", "echo_time");
+    if ((n = miupdate_header_index(index, 2, files, 1)) != 2) {
+      TESTRPT("Bad number of headers read into damaged index", n);
+    }
+    error_cnt += check_file(index, names[1], 4);
+    miclose_header_index(index);
+  }
+
+  for (i = 0; i < NFILES; i++) {
+    unlink(names[i]);
+  }
+  unlink(index_path);
+  return error_cnt;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int error_cnt;
+
+  if (argc > 1) {
+    error_cnt = index_fresh(argc - 1, argv + 1);
+  } else {
+    error_cnt = index_created();
+  }
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
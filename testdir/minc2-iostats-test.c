@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 8
+#define CY 30
+#define CX 40
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static double voxels[CZ][CY][CX];
+static double values[CX][CY][CZ];
+
+int
+main(void)
+{
+  static char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static char *reversed[NDIMS] = { "xspace", "yspace", "zspace" };
+  misize_t lengths[NDIMS] = { CZ, CY, CX };
+  misize_t slab[NDIMS] = { 1, CY, CX };
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t chunk_lengths[NDIMS];
+  misize_t chunk_counts[NDIMS];
+  misize_t n_chunks;
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  miiostatistics_t total, before, stats, after;
+  char name[256];
+  int error_cnt = 0;
+  int z, y, x;
+
+  snprintf(name, sizeof(name), "minc2-iostats-test-%d.mnc", getpid());
+  for (z = 0; z < CZ; z++) {
+    for (y = 0; y < CY; y++) {
+      for (x = 0; x < CX; x++) {
+        voxels[z][y][x] = z * 100.0 + y * 10.0 + x * 0.1;
+      }
+    }
+  }
+
+  if (miget_io_statistics(NULL, NULL) >= 0) {
+    TESTRPT("Statistics returned into a null pointer", 0);
+  }
+  miset_io_statistics(TRUE);
+  miget_io_statistics(NULL, &before);
+
+  /* A compressed, scaled volume written one slice at a time */
+  for (z = 0; z < NDIMS; z++) {
+    micreate_dimension(dimnames[z], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[z], &hdims[z]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  miset_volume_valid_range(hvol, 65535.0, 0.0);
+  miset_volume_range(hvol, 1000.0, 0.0);
+  for (z = 0; z < CZ; z++) {
+    start[0] = z;
+    if (miset_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, slab, voxels[z]) < 0) {
+      TESTRPT("Unable to write slice", z);
+    }
+  }
+  start[0] = 0;
+  miget_io_statistics(hvol, &stats);
+  if (stats.hyperslab_writes != CZ || stats.hyperslab_reads != 0 ||
+      stats.bytes_written != sizeof(voxels) || stats.bytes_read != 0) {
+    TESTRPT("Bad write counts", (int) stats.hyperslab_writes);
+  }
+  if (stats.chunks_written < CZ || stats.scaling_seconds < 0.0 ||
+      stats.write_seconds + stats.chunk_write_seconds <= 0.0) {
+    TESTRPT("Bad write statistics", (int) stats.chunks_written);
+  }
+  miclose_volume(hvol);
+
+  /* Read back whole in the reverse dimension order */
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open test volume", 0);
+    return error_cnt;
+  }
+  miset_apparent_dimension_order_by_name(hvol, NDIMS, reversed);
+  miget_volume_chunk_grid(hvol, NDIMS, chunk_lengths, chunk_counts);
+  n_chunks = chunk_counts[0] * chunk_counts[1] * chunk_counts[2];
+  lengths[0] = CX;
+  lengths[2] = CZ;
+  if (miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, lengths, values) < 0) {
+    TESTRPT("Unable to read volume", 0);
+  }
+  for (z = 0; z < CZ; z++) {
+    for (y = 0; y < CY; y++) {
+      for (x = 0; x < CX; x++) {
+        if (fabs(values[x][y][z] - voxels[z][y][x]) > 0.05) {
+          TESTRPT("Bad value", z);
+          z = CZ;
+          y = CY;
+          break;
+        }
+      }
+    }
+  }
+  miget_io_statistics(hvol, &stats);
+  if (stats.hyperslab_reads != 1 || stats.hyperslab_writes != 0 ||
+      stats.bytes_read != sizeof(values) || stats.bytes_written != 0) {
+    TESTRPT("Bad read counts", (int) stats.hyperslab_reads);
+  }
+  if (stats.chunks_read != n_chunks) {
+    TESTRPT("Bad number of chunks read", (int) stats.chunks_read);
+  }
+  if (stats.read_seconds + stats.chunk_read_seconds <= 0.0 ||
+      stats.scaling_seconds < 0.0 || stats.restructure_seconds < 0.0 ||
+      stats.thumbnail_seconds != 0.0) {
+    TESTRPT("Bad read timers", 0);
+  }
+
+  /* The totals include both volumes */
+  miget_io_statistics(NULL, &total);
+  if (total.hyperslab_writes - before.hyperslab_writes != CZ ||
+      total.hyperslab_reads - before.hyperslab_reads != 1 ||
+      total.bytes_read - before.bytes_read != sizeof(values) ||
+      total.read_seconds < stats.read_seconds ||
+      total.scaling_seconds < stats.scaling_seconds) {
+    TESTRPT("Bad total statistics", (int) total.hyperslab_reads);
+  }
+
+  /* Nothing is counted once disabled */
+  miset_io_statistics(FALSE);
+  miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, lengths, values);
+  miget_io_statistics(hvol, &after);
+  if (memcmp(&after, &stats, sizeof(stats))) {
+    TESTRPT("Statistics collected while disabled", 0);
+  }
+  miclose_volume(hvol);
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,140 @@
+/* Time taken to read the real values at random positions of a chunked,
+ * compressed volume with slice scaling, one miget_real_value() call per
+ * position and with a single miget_real_values_at() call.
+ *
+ * usage: minc2-lookup-benchmark [edge [positions]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#define NDIMS 3
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int
+create_volume(const char *name, misize_t edge)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  unsigned short *slice;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, 0, 0 };
+  misize_t i, z;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, edge, &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0) {
+    return -1;
+  }
+  mifree_volume_props(props);
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    return -1;
+  }
+  slice = malloc(edge * edge * sizeof(unsigned short));
+  count[1] = count[2] = edge;
+  for (z = 0; z < edge; z++) {
+    for (i = 0; i < edge * edge; i++) {
+      slice[i] = (unsigned short) (rand() & 0xffff);
+    }
+    start[0] = z;
+    miset_slice_range(hvol, start, NDIMS, 100.0 + z, -1.0 * z);
+    miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, slice);
+  }
+  free(slice);
+  return miclose_volume(hvol);
+}
+
+int
+main(int argc, char **argv)
+{
+  misize_t edge = 256;
+  misize_t n = 200000;
+  misize_t *coords;
+  double *values;
+  char name[256];
+  mihandle_t hvol;
+  double t0, t_loop, t_batch;
+  misize_t i;
+  int mismatches = 0;
+
+  if (argc > 1) {
+    edge = (misize_t) atol(argv[1]);
+  }
+  if (argc > 2) {
+    n = (misize_t) atol(argv[2]);
+  }
+  snprintf(name, sizeof(name), "minc2-lookup-benchmark-%d.mnc", getpid());
+  if (create_volume(name, edge) < 0 ||
+      miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    fprintf(stderr, "Unable to create %s\n", name);
+    unlink(name);
+    return 1;
+  }
+
+  coords = malloc(n * NDIMS * sizeof(misize_t));
+  values = malloc(n * sizeof(double));
+  for (i = 0; i < n * NDIMS; i++) {
+    coords[i] = (misize_t) rand() % edge;
+  }
+
+  t0 = now();
+  for (i = 0; i < n; i++) {
+    miget_real_value(hvol, coords + i * NDIMS, NDIMS, &values[i]);
+  }
+  t_loop = now() - t0;
+
+  /* Reuse the values of the loop to check the batched call */
+  {
+    double *batch = malloc(n * sizeof(double));
+
+    t0 = now();
+    miget_real_values_at(hvol, n, coords, batch);
+    t_batch = now() - t0;
+    for (i = 0; i < n; i++) {
+      if (batch[i] != values[i]) {
+        mismatches++;
+      }
+    }
+    free(batch);
+  }
+
+  printf("%lu^3 voxels, %lu positions\n", (unsigned long) edge, (unsigned long) n);
+  printf("%-24s %10s %12s\n", "method", "seconds", "us/position");
+  printf("%-24s %10.3f %12.3f\n", "miget_real_value", t_loop, t_loop * 1e6 / n);
+  printf("%-24s %10.3f %12.3f\n", "miget_real_values_at", t_batch, t_batch * 1e6 / n);
+  if (mismatches != 0) {
+    printf("%d values differ\n", mismatches);
+  }
+
+  miclose_volume(hvol);
+  unlink(name);
+  free(coords);
+  free(values);
+  return 0;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
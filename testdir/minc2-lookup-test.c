@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 23
+#define CY 41
+#define CX 37
+#define N_POINTS 5000
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+
+/* Create a volume of type \a type, chunked and compressed if \a
+ * compress is set, with a real range per slice if \a slice_scaling is
+ * set, and fill it with pseudo random values.
+ */
+static int
+create_volume(const char *name, mitype_t type, miboolean_t compress,
+              miboolean_t slice_scaling)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  double *slice;
+  misize_t start[NDIMS];
+  misize_t count[NDIMS];
+  int error_cnt = 0;
+  int i, z;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  if (compress) {
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  } else {
+    miset_props_compression_type(props, MI_COMPRESS_NONE);
+  }
+  if (micreate_volume(name, NDIMS, hdims, type, MI_CLASS_REAL, props, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    mifree_volume_props(props);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  if (slice_scaling) {
+    miset_slice_scaling_flag(hvol, TRUE);
+  }
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+  if (!slice_scaling) {
+    miset_volume_range(hvol, 100.0, -50.0);
+  }
+
+  slice = malloc(CY * CX * sizeof(double));
+  start[1] = start[2] = 0;
+  count[0] = 1;
+  count[1] = CY;
+  count[2] = CX;
+  for (z = 0; z < CZ; z++) {
+    double smin = slice_scaling ? -z * 3.0 : -50.0;
+    double smax = slice_scaling ? 10.0 + z * 7.0 : 100.0;
+
+    for (i = 0; i < CY * CX; i++) {
+      slice[i] = smin + (smax - smin) * ((rand() % 1000) / 999.0);
+    }
+    start[0] = z;
+    if (slice_scaling) {
+      miset_slice_range(hvol, start, NDIMS, smax, smin);
+    }
+    if (miset_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, slice) < 0) {
+      TESTRPT("Unable to write slice", z);
+      break;
+    }
+  }
+  free(slice);
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+  return error_cnt;
+}
+
+/* Compare miget_real_values_at() with miget_real_value() for random
+ * positions, some of them repeated, within the \a apparent sizes.
+ */
+static int
+check_values(mihandle_t hvol, const char *what, const misize_t apparent[])
+{
+  misize_t *coords = malloc(N_POINTS * NDIMS * sizeof(misize_t));
+  double *values = malloc(N_POINTS * sizeof(double));
+  int error_cnt = 0;
+  int i, j;
+
+  for (i = 0; i < N_POINTS; i++) {
+    for (j = 0; j < NDIMS; j++) {
+      coords[i * NDIMS + j] = (i % 10 == 9) ? coords[(i - 1) * NDIMS + j] :
+                              (misize_t) (rand() % apparent[j]);
+    }
+  }
+  if (miget_real_values_at(hvol, N_POINTS, coords, values) < 0) {
+    TESTRPT("miget_real_values_at failed", 0);
+  } else {
+    for (i = 0; i < N_POINTS; i++) {
+      double expected;
+
+      miget_real_value(hvol, coords + i * NDIMS, NDIMS, &expected);
+      if (values[i] != expected) {
+        printf("%s: (%d,%d,%d) is %g, expected %g\n", what,
+               (int) coords[i * NDIMS], (int) coords[i * NDIMS + 1],
+               (int) coords[i * NDIMS + 2], values[i], expected);
+        TESTRPT("Bad value", i);
+        break;
+      }
+    }
+  }
+
+  /* Positions out of the volume are refused */
+  coords[NDIMS * (N_POINTS / 2) + 1] = apparent[1];
+  if (miget_real_values_at(hvol, N_POINTS, coords, values) >= 0) {
+    TESTRPT("Position out of range was accepted", 0);
+  }
+  free(coords);
+  free(values);
+  return error_cnt;
+}
+
+static int
+test_file(const char *name, const char *what)
+{
+  static char *reversed[NDIMS] = { "xspace", "yspace", "zspace" };
+  static const misize_t reversed_lengths[NDIMS] = { CX, CY, CZ };
+  midimhandle_t hdims[NDIMS];
+  mihandle_t hvol;
+  int error_cnt = 0;
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  error_cnt += check_values(hvol, what, lengths);
+
+  /* Reordered and flipped dimensions */
+  miset_apparent_dimension_order_by_name(hvol, NDIMS, reversed);
+  miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                          MI_DIMORDER_FILE, NDIMS, hdims);
+  miset_dimension_apparent_voxel_order(hdims[1], MI_COUNTER_FILE_ORDER);
+  error_cnt += check_values(hvol, what, reversed_lengths);
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+/* With an empty valid range every voxel is the minimum of its slice.
+ */
+static int
+test_empty_range(const char *name)
+{
+  misize_t coords[NDIMS] = { CZ / 2, CY / 2, CX / 2 };
+  mihandle_t hvol;
+  double value;
+  int error_cnt = 0;
+
+  if (miopen_volume(name, MI2_OPEN_RDWR, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  miset_volume_valid_range(hvol, 7.0, 7.0);
+  if (miget_real_values_at(hvol, 1, coords, &value) < 0 || value != -50.0) {
+    TESTRPT("Bad value with an empty valid range", (int) value);
+  }
+  error_cnt += check_values(hvol, "empty valid range", lengths);
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const struct {
+    const char *what;
+    mitype_t type;
+    miboolean_t compress;
+    miboolean_t slice_scaling;
+  } cases[] = {
+    { "chunked, slice scaling", MI_TYPE_USHORT, TRUE, TRUE },
+    { "chunked, volume scaling", MI_TYPE_SHORT, TRUE, FALSE },
+    { "contiguous, slice scaling", MI_TYPE_UBYTE, FALSE, TRUE },
+    { "contiguous, float", MI_TYPE_FLOAT, FALSE, FALSE }
+  };
+  char name[256];
+  size_t c;
+  int error_cnt = 0;
+
+  snprintf(name, sizeof(name), "minc2-lookup-test-%d.mnc", getpid());
+  for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    int errors = create_volume(name, cases[c].type, cases[c].compress,
+                               cases[c].slice_scaling);
+
+    if (errors == 0) {
+      errors = test_file(name, cases[c].what);
+    }
+    error_cnt += errors;
+    unlink(name);
+  }
+
+  error_cnt += create_volume(name, MI_TYPE_SHORT, TRUE, FALSE);
+  error_cnt += test_empty_range(name);
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 9
+#define CY 31
+#define CX 47
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static short voxels[CZ][CY][CX];
+
+/* Create a volume of shorts, contiguous and uncompressed unless
+ * \a compress is set.
+ */
+static int
+create_test_image(const char *name, int compress)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props = NULL;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  if (compress) {
+    minew_volume_props(&props);
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  }
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_SHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  if (props != NULL) {
+    mifree_volume_props(props);
+  }
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < CZ * CY * CX; i++) {
+    (&voxels[0][0][0])[i] = (short)((i * 7919) % 65521 - 32000);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+static int
+test_mapped(const char *name)
+{
+  mihandle_t hvol;
+  const void *data;
+  const void *again;
+  misize_t strides[NDIMS];
+  mitype_t type;
+  int z, y, x;
+  int error_cnt = 0;
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  if (miget_volume_mapped_pointer(hvol, &data, strides, &type) < 0) {
+    TESTRPT("Unable to map image", 0);
+  } else {
+    if (type != MI_TYPE_SHORT) {
+      TESTRPT("Bad mapped type", type);
+    }
+    if (strides[0] != CY * CX * sizeof(short) || strides[1] != CX * sizeof(short) ||
+        strides[2] != sizeof(short)) {
+      TESTRPT("Bad mapped strides", (int) strides[1]);
+    }
+    for (z = 0; z < CZ; z++)
+      for (y = 0; y < CY; y++)
+        for (x = 0; x < CX; x++) {
+          short v = *(const short *) ((const char *) data + z * strides[0] +
+                                      y * strides[1] + x * strides[2]);
+          if (v != voxels[z][y][x]) {
+            TESTRPT("Mapped voxel differs", x);
+            z = CZ;
+            y = CY;
+            break;
+          }
+        }
+    if (miget_volume_mapped_pointer(hvol, &again, NULL, NULL) < 0 || again != data) {
+      TESTRPT("Image mapped twice", 0);
+    }
+  }
+  miclose_volume(hvol);
+
+  /* Volumes open for writing cannot be mapped */
+  if (miopen_volume(name, MI2_OPEN_RDWR, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    if (miget_volume_mapped_pointer(hvol, &data, strides, &type) != MI_ERROR) {
+      TESTRPT("Writable volume mapped", 0);
+    }
+    miclose_volume(hvol);
+  }
+  return error_cnt;
+}
+
+static int
+test_compressed(const char *name)
+{
+  mihandle_t hvol;
+  const void *data;
+  misize_t strides[NDIMS];
+  int error_cnt = 0;
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  if (miget_volume_mapped_pointer(hvol, &data, strides, NULL) != MI_ERROR) {
+    TESTRPT("Compressed image mapped", 0);
+  }
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char filename[128];
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-mapped-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename, FALSE);
+  if (error_cnt == 0) {
+    error_cnt += test_mapped(filename);
+  }
+  unlink(filename);
+
+  error_cnt += create_test_image(filename, TRUE);
+  if (error_cnt == 0) {
+    error_cnt += test_compressed(filename);
+  }
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 6
+#define CY 20
+#define CX 24
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static unsigned short voxels[CZ][CY][CX];
+
+/* Create the test volume, in the file \a name or in memory if \a name is
+ * NULL, and write its voxels, slice ranges and attributes.
+ */
+static int
+create_volume(const char *name, mihandle_t *hvol)
+{
+  static const char full_name[] = "Subject in memory";
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  double echo_time = 2.5;
+  int r;
+  int i;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+    miset_dimension_separation(hdims[i], 0.5 + i);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_multi_resolution(props, TRUE, 1);
+  if (name == NULL) {
+    r = micreate_volume_in_memory(NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                                  props, hvol);
+  } else {
+    r = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                        props, hvol);
+  }
+  mifree_volume_props(props);
+  if (r < 0) {
+    return -1;
+  }
+  miset_slice_scaling_flag(*hvol, TRUE);
+  if (micreate_volume_image(*hvol) < 0) {
+    return -1;
+  }
+  for (i = 0; i < CZ; i++) {
+    start[0] = i;
+    miset_slice_range(*hvol, start, NDIMS, 10.0 * (i + 1), -1.0 * i);
+  }
+  start[0] = 0;
+  miset_attr_values(*hvol, MI_TYPE_STRING, "patient", "full_name",
+                    strlen(full_name), full_name);
+  miset_attr_values(*hvol, MI_TYPE_DOUBLE, "acquisition", "echo_time", 1, &echo_time);
+  return miset_voxel_value_hyperslab(*hvol, MI_TYPE_USHORT, start, lengths, voxels);
+}
+
+/* Check the dimensions, voxels, slice ranges and attributes of \a hvol
+ * against those of the test volume, with the first voxel set to \a first.
+ */
+static int
+check_volume(mihandle_t hvol, unsigned short first)
+{
+  static unsigned short values[CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t size;
+  double separation;
+  double slice_max, slice_min;
+  double echo_time;
+  char full_name[64];
+  int error_cnt = 0;
+  int i;
+
+  if (miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                              MI_DIMORDER_FILE, NDIMS, hdims) != NDIMS) {
+    TESTRPT("Bad number of dimensions", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < NDIMS; i++) {
+    miget_dimension_size(hdims[i], &size);
+    miget_dimension_separation(hdims[i], MI_ORDER_FILE, &separation);
+    if (size != lengths[i] || separation != 0.5 + i) {
+      TESTRPT("Bad dimension", i);
+    }
+  }
+
+  memset(values, 0xff, sizeof(values));
+  if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, values) < 0) {
+    TESTRPT("Unable to read voxels", 0);
+  } else if (values[0][0][0] != first ||
+             memcmp(&values[0][0][1], &voxels[0][0][1],
+                    sizeof(values) - sizeof(values[0][0][0]))) {
+    TESTRPT("Bad voxels", 0);
+  }
+
+  for (i = 0; i < CZ; i++) {
+    start[0] = i;
+    if (miget_slice_range(hvol, start, NDIMS, &slice_max, &slice_min) < 0 ||
+        slice_max != 10.0 * (i + 1) || slice_min != -1.0 * i) {
+      TESTRPT("Bad slice range", i);
+    }
+  }
+
+  memset(full_name, 0, sizeof(full_name));
+  if (miget_attr_values(hvol, MI_TYPE_STRING, "patient", "full_name",
+                        sizeof(full_name), full_name) < 0 ||
+      strcmp(full_name, "Subject in memory")) {
+    TESTRPT("Bad string attribute", 0);
+  }
+  if (miget_attr_values(hvol, MI_TYPE_DOUBLE, "acquisition", "echo_time",
+                        1, &echo_time) < 0 || echo_time != 2.5) {
+    TESTRPT("Bad double attribute", 0);
+  }
+  return error_cnt;
+}
+
+/* Check a volume opened from the \a length bytes of \a buffer.
+ */
+static int
+check_buffer(const void *buffer, size_t length, unsigned short first)
+{
+  mihandle_t hvol;
+  int error_cnt = 0;
+
+  if (miopen_volume_from_memory(buffer, length, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume from memory", 0);
+    return error_cnt;
+  }
+  error_cnt += check_volume(hvol, first);
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume opened from memory", 0);
+  }
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char name[256];
+  char copy_name[256];
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t one[NDIMS] = { 1, 1, 1 };
+  unsigned short changed = 4321;
+  void *memory_image = NULL;
+  void *disk_image = NULL;
+  void *image = NULL;
+  size_t memory_length = 0;
+  size_t disk_length = 0;
+  size_t length;
+  char garbage[4096];
+  FILE *fp;
+  int error_cnt = 0;
+  int z, y, x;
+
+  snprintf(name, sizeof(name), "minc2-memory-test-%d.mnc", getpid());
+  snprintf(copy_name, sizeof(copy_name), "minc2-memory-test-%d-copy.mnc", getpid());
+  for (z = 0; z < CZ; z++) {
+    for (y = 0; y < CY; y++) {
+      for (x = 0; x < CX; x++) {
+        voxels[z][y][x] = (unsigned short) ((z * 7919 + y * 131 + x * 17) & 0xffff);
+      }
+    }
+  }
+
+  /* The same volume created on disk and in memory */
+  if (create_volume(name, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+  if (create_volume(NULL, &hvol) < 0) {
+    TESTRPT("Unable to create volume in memory", 0);
+    return error_cnt;
+  }
+  error_cnt += check_volume(hvol, voxels[0][0][0]);
+  if (miserialize_volume_to_buffer(hvol, &memory_image, &memory_length) < 0) {
+    TESTRPT("Unable to serialize volume created in memory", 0);
+  }
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume created in memory", 0);
+  }
+
+  /* Both read back the same, through memory and through disk */
+  if (memory_image != NULL) {
+    error_cnt += check_buffer(memory_image, memory_length, voxels[0][0][0]);
+  }
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    error_cnt += check_volume(hvol, voxels[0][0][0]);
+    if (miserialize_volume_to_buffer(hvol, &image, &length) < 0) {
+      TESTRPT("Unable to serialize volume opened from disk", 0);
+    } else {
+      error_cnt += check_buffer(image, length, voxels[0][0][0]);
+      free(image);
+    }
+    miclose_volume(hvol);
+  }
+  if ((fp = fopen(name, "rb")) == NULL) {
+    TESTRPT("Unable to read volume file", 0);
+  } else {
+    fseek(fp, 0, SEEK_END);
+    disk_length = (size_t) ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    disk_image = malloc(disk_length);
+    if (fread(disk_image, 1, disk_length, fp) != disk_length) {
+      TESTRPT("Unable to read volume file", 1);
+    } else {
+      error_cnt += check_buffer(disk_image, disk_length, voxels[0][0][0]);
+    }
+    fclose(fp);
+  }
+
+  /* Changes to a volume opened from memory go to its serialized copy
+   * only, which reads the same once written to disk
+   */
+  if (memory_image != NULL &&
+      miopen_volume_from_memory(memory_image, memory_length, MI2_OPEN_RDWR, &hvol) >= 0) {
+    if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, one, &changed) < 0) {
+      TESTRPT("Unable to write volume opened from memory", 0);
+    }
+    error_cnt += check_volume(hvol, changed);
+    if (miserialize_volume_to_buffer(hvol, &image, &length) < 0) {
+      TESTRPT("Unable to serialize changed volume", 0);
+    } else {
+      if ((fp = fopen(copy_name, "wb")) == NULL ||
+          fwrite(image, 1, length, fp) != length) {
+        TESTRPT("Unable to write volume file", 0);
+      }
+      if (fp != NULL) {
+        fclose(fp);
+      }
+      free(image);
+    }
+    miclose_volume(hvol);
+    if (miopen_volume(copy_name, MI2_OPEN_READ, &hvol) < 0) {
+      TESTRPT("Unable to open serialized volume", 0);
+    } else {
+      error_cnt += check_volume(hvol, changed);
+      miclose_volume(hvol);
+    }
+    error_cnt += check_buffer(memory_image, memory_length, voxels[0][0][0]);
+  } else {
+    TESTRPT("Unable to open volume from memory for writing", 0);
+  }
+
+  /* Buffers that do not hold a volume */
+  memset(garbage, 0x5a, sizeof(garbage));
+  if (miopen_volume_from_memory(garbage, sizeof(garbage), MI2_OPEN_READ, &hvol) >= 0) {
+    TESTRPT("Garbage opened as a volume", 0);
+    miclose_volume(hvol);
+  }
+  if (miopen_volume_from_memory(NULL, 0, MI2_OPEN_READ, &hvol) >= 0) {
+    TESTRPT("Empty buffer opened as a volume", 0);
+    miclose_volume(hvol);
+  }
+
+  free(memory_image);
+  free(disk_image);
+  unlink(name);
+  unlink(copy_name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
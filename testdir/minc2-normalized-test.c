@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 4
+#define CT 3
+#define CZ 11
+#define CY 19
+#define CX 300                  /* More than one block of voxels */
+
+#define DATA_MIN -5.0
+#define DATA_MAX 120.0
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const struct {
+  mitype_t type;
+  double norm_min;
+  double norm_max;
+} types[] = {
+  { MI_TYPE_BYTE, SCHAR_MIN, SCHAR_MAX },
+  { MI_TYPE_UBYTE, 0, UCHAR_MAX },
+  { MI_TYPE_SHORT, SHRT_MIN, SHRT_MAX },
+  { MI_TYPE_USHORT, 0, USHRT_MAX },
+  { MI_TYPE_INT, INT_MIN, INT_MAX },
+  { MI_TYPE_UINT, 0, UINT_MAX },
+  { MI_TYPE_FLOAT, 0.0, 1.0 },
+  { MI_TYPE_DOUBLE, 0.0, 1.0 }
+};
+
+static unsigned short voxels[CT][CZ][CY][CX];
+
+static double
+slice_max(int t, int z)
+{
+  return 100.0 + t * 10 + z;
+}
+
+static double
+slice_min(int t, int z)
+{
+  return -1.0 * z;
+}
+
+/* Element \a i of \a buffer, or \a value after conversion to \a type
+ * when \a buffer is NULL.
+ */
+static double
+typed_value(mitype_t type, const void *buffer, size_t i, double value)
+{
+  switch (type) {
+  case MI_TYPE_BYTE:
+    return buffer ? ((const signed char *) buffer)[i] : (signed char) value;
+  case MI_TYPE_UBYTE:
+    return buffer ? ((const unsigned char *) buffer)[i] : (unsigned char) value;
+  case MI_TYPE_SHORT:
+    return buffer ? ((const short *) buffer)[i] : (short) value;
+  case MI_TYPE_USHORT:
+    return buffer ? ((const unsigned short *) buffer)[i] : (unsigned short) value;
+  case MI_TYPE_INT:
+    return buffer ? ((const int *) buffer)[i] : (int) value;
+  case MI_TYPE_UINT:
+    return buffer ? ((const unsigned int *) buffer)[i] : (unsigned int) value;
+  case MI_TYPE_FLOAT:
+    return buffer ? ((const float *) buffer)[i] : (float) value;
+  default:
+    return buffer ? ((const double *) buffer)[i] : value;
+  }
+}
+
+/* The normalized value of the voxel at the file coordinates (t,z,y,x).
+ */
+static double
+expected_value(size_t k, int t, int z, int y, int x,
+               double valid_min, double valid_max)
+{
+  double smin = slice_min(t, z);
+  double smax = slice_max(t, z);
+  double r = ((voxels[t][z][y][x] - valid_min) / (valid_max - valid_min)) * (smax - smin) + smin;
+
+  r = (r - DATA_MIN) / (DATA_MAX - DATA_MIN);
+  r = (r < 0.0) ? types[k].norm_min : (r >= 1.0) ? types[k].norm_max :
+      (rint(r * (types[k].norm_max - types[k].norm_min)) + types[k].norm_min);
+  return typed_value(types[k].type, NULL, 0, r);
+}
+
+static int
+create_test_image(const char *name, mihandle_t *hvol_ptr)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  static const misize_t lengths[NDIMS] = { CT, CZ, CY, CX };
+  static const int blocking[NDIMS] = { 1, 4, 8, 64 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { CT, CZ, CY, CX };
+  size_t i;
+  int result;
+  int error_cnt = 0;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], i == 0 ? MI_DIMCLASS_TIME : MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, blocking);
+  result = micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT,
+                           MI_CLASS_REAL, props, &hvol);
+  mifree_volume_props(props);
+  if (result < 0) {
+    TESTRPT("Unable to create test volume", result);
+    return error_cnt;
+  }
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < CT * CZ * CY * CX; i++) {
+    (&voxels[0][0][0][0])[i] = (unsigned short)((i * 7919) % 65536);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, voxels) < 0) {
+    TESTRPT("Unable to write volume", 0);
+  }
+  for (start[0] = 0; start[0] < CT; start[0]++) {
+    for (start[1] = 0; start[1] < CZ; start[1]++) {
+      miset_slice_range(hvol, start, NDIMS, slice_max((int) start[0], (int) start[1]),
+                        slice_min((int) start[0], (int) start[1]));
+    }
+  }
+  *hvol_ptr = hvol;
+  return error_cnt;
+}
+
+/* Whole volume in file order.
+ */
+static int
+test_file_order(mihandle_t hvol, double valid_min, double valid_max)
+{
+  static const misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  static const misize_t count[NDIMS] = { CT, CZ, CY, CX };
+  void *buffer = malloc(CT * CZ * CY * CX * sizeof(double));
+  size_t k;
+  int error_cnt = 0;
+
+  for (k = 0; k < sizeof(types) / sizeof(types[0]); k++) {
+    int t, z, y, x;
+    size_t i = 0;
+
+    if (miget_hyperslab_normalized(hvol, types[k].type, start, count,
+                                   DATA_MIN, DATA_MAX, buffer) < 0) {
+      TESTRPT("Unable to read normalized hyperslab", types[k].type);
+      continue;
+    }
+    for (t = 0; t < CT; t++)
+      for (z = 0; z < CZ; z++)
+        for (y = 0; y < CY; y++)
+          for (x = 0; x < CX; x++, i++) {
+            if (typed_value(types[k].type, buffer, i, 0.0) !=
+                expected_value(k, t, z, y, x, valid_min, valid_max)) {
+              TESTRPT("Bad normalized value", types[k].type);
+              t = CT; z = CZ; y = CY;
+              break;
+            }
+          }
+  }
+  free(buffer);
+  return error_cnt;
+}
+
+/* Part of the volume in (x,t,y,z) order with x flipped.
+ */
+static int
+test_apparent_order(mihandle_t hvol, double valid_min, double valid_max)
+{
+  static const char *dimnames[NDIMS] = { "xspace", "time", "yspace", "zspace" };
+  static const misize_t start[NDIMS] = { 7, 1, 3, 2 };
+  static const misize_t count[NDIMS] = { 280, 2, 15, 9 };
+  midimhandle_t hdims[NDIMS];
+  void *buffer = malloc(CT * CZ * CY * CX * sizeof(double));
+  size_t k;
+  int error_cnt = 0;
+
+  if (miset_apparent_dimension_order_by_name(hvol, NDIMS, (char **) dimnames) < 0 ||
+      miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL, MI_DIMORDER_APPARENT,
+                              NDIMS, hdims) < 0 ||
+      miset_dimension_apparent_voxel_order(hdims[0], MI_COUNTER_FILE_ORDER) < 0) {
+    TESTRPT("Unable to set apparent order", 0);
+    free(buffer);
+    return error_cnt;
+  }
+
+  for (k = 0; k < sizeof(types) / sizeof(types[0]); k++) {
+    int t, z, y, x;
+    size_t i = 0;
+
+    if (miget_hyperslab_normalized(hvol, types[k].type, start, count,
+                                   DATA_MIN, DATA_MAX, buffer) < 0) {
+      TESTRPT("Unable to read normalized hyperslab", types[k].type);
+      continue;
+    }
+    for (x = 0; x < (int) count[0]; x++)
+      for (t = 0; t < (int) count[1]; t++)
+        for (y = 0; y < (int) count[2]; y++)
+          for (z = 0; z < (int) count[3]; z++, i++) {
+            if (typed_value(types[k].type, buffer, i, 0.0) !=
+                expected_value(k, t + (int) start[1], z + (int) start[3],
+                               y + (int) start[2], CX - 1 - (x + (int) start[0]),
+                               valid_min, valid_max)) {
+              TESTRPT("Bad normalized value", types[k].type);
+              x = (int) count[0]; t = (int) count[1]; y = (int) count[2];
+              break;
+            }
+          }
+  }
+  miset_dimension_apparent_voxel_order(hdims[0], MI_FILE_ORDER);
+  miset_apparent_dimension_order_by_name(hvol, 0, NULL);
+  free(buffer);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char filename[128];
+  mihandle_t hvol;
+  double valid_min, valid_max;
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-normalized-%d.mnc", getpid());
+
+  error_cnt += create_test_image(filename, &hvol);
+  if (error_cnt == 0) {
+    miclose_volume(hvol);
+    if (miopen_volume(filename, MI2_OPEN_READ, &hvol) < 0) {
+      TESTRPT("Unable to open volume", 0);
+    } else {
+      miget_volume_valid_range(hvol, &valid_max, &valid_min);
+      error_cnt += test_file_order(hvol, valid_min, valid_max);
+      error_cnt += test_apparent_order(hvol, valid_min, valid_max);
+      miclose_volume(hvol);
+    }
+  }
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,149 @@
+/* Time taken to open a file, get its dimension sizes and close it, as a
+ * crawler scanning headers does, with MI2_OPEN_READ and with
+ * MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY. The files have slice scaling
+ * and an irregularly sampled time dimension.
+ *
+ * usage: minc2-open-benchmark [files [frames]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#define NDIMS 4
+#define EDGE 32
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int
+create_volume(const char *name, misize_t frames)
+{
+  static const char *dimnames[NDIMS] = { "time", "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  unsigned short *slice;
+  misize_t start[NDIMS] = { 0, 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, 1, EDGE, EDGE };
+  misize_t i, t, z;
+
+  micreate_dimension(dimnames[0], MI_DIMCLASS_TIME,
+                     MI_DIMATTR_NOT_REGULARLY_SAMPLED, frames, &hdims[0]);
+  for (t = 0; t < frames; t++) {
+    double offset = 2.5 * t * t;
+
+    miset_dimension_offsets(hdims[0], 1, t, &offset);
+  }
+  for (i = 1; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, EDGE, &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0) {
+    return -1;
+  }
+  mifree_volume_props(props);
+  miset_slice_scaling_flag(hvol, TRUE);
+  if (micreate_volume_image(hvol) < 0) {
+    return -1;
+  }
+  slice = malloc(EDGE * EDGE * sizeof(unsigned short));
+  for (i = 0; i < EDGE * EDGE; i++) {
+    slice[i] = (unsigned short) (rand() & 0xffff);
+  }
+  for (t = 0; t < frames; t++) {
+    for (z = 0; z < EDGE; z++) {
+      start[0] = t;
+      start[1] = z;
+      miset_slice_range(hvol, start, NDIMS, 100.0 + z, -1.0 * t);
+      miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, slice);
+    }
+  }
+  free(slice);
+  return miclose_volume(hvol);
+}
+
+/* Scan the headers of the \a n files, returns the time taken.
+ */
+static double
+scan(char names[][64], int n, int mode)
+{
+  midimhandle_t hdims[NDIMS];
+  misize_t sizes[NDIMS];
+  mihandle_t hvol;
+  double t0 = now();
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (miopen_volume(names[i], mode, &hvol) < 0) {
+      fprintf(stderr, "Unable to open %s\n", names[i]);
+      continue;
+    }
+    miget_volume_dimensions(hvol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                            MI_DIMORDER_FILE, NDIMS, hdims);
+    miget_dimension_sizes(hdims, NDIMS, sizes);
+    miclose_volume(hvol);
+  }
+  return now() - t0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int n = 200;
+  misize_t frames = 60;
+  char (*names)[64];
+  double t_read, t_header;
+  int i, pass;
+
+  if (argc > 1) {
+    n = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    frames = (misize_t) atol(argv[2]);
+  }
+  names = malloc(n * sizeof(*names));
+  for (i = 0; i < n; i++) {
+    snprintf(names[i], sizeof(names[i]), "minc2-open-benchmark-%d-%d.mnc", getpid(), i);
+    if (create_volume(names[i], frames) < 0) {
+      fprintf(stderr, "Unable to create %s\n", names[i]);
+      return 1;
+    }
+  }
+
+  /* The first pass warms the page cache */
+  for (pass = 0; pass < 2; pass++) {
+    t_read = scan(names, n, MI2_OPEN_READ);
+    t_header = scan(names, n, MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY);
+  }
+
+  printf("%d files, %lu frames of %d^3 voxels\n", n, (unsigned long) frames, EDGE);
+  printf("%-36s %10s %10s\n", "mode", "seconds", "us/file");
+  printf("%-36s %10.3f %10.1f\n", "MI2_OPEN_READ", t_read, t_read * 1e6 / n);
+  printf("%-36s %10.3f %10.1f\n", "MI2_OPEN_READ | MI2_OPEN_HEADER_ONLY",
+         t_header, t_header * 1e6 / n);
+
+  for (i = 0; i < n; i++) {
+    unlink(names[i]);
+  }
+  free(names);
+  return 0;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
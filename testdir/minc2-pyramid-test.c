@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 37
+#define CY 26
+#define CX 45
+#define DEPTH 3
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static unsigned short voxels[CZ][CY][CX];
+static double reals[CZ][CY][CX];
+
+/* The value of level \a level at (z, y, x), averaged from the full
+ * resolution \a values.
+ */
+static double
+reference_value(const double *values, int level, int z, int y, int x)
+{
+  int n = 1 << level;
+  int i, j, k;
+  double sum = 0.0;
+
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      for (k = 0; k < n; k++)
+        sum += values[((z * n + i) * CY + y * n + j) * CX + x * n + k];
+  return sum / ((double) n * n * n);
+}
+
+static int
+create_volume(const char *name, miboolean_t slice_scaling, int depth, mihandle_t *hvol)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  int error_cnt = 0;
+  int i;
+
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_multi_resolution(props, TRUE, depth);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    mifree_volume_props(props);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  if (slice_scaling) {
+    miset_slice_scaling_flag(*hvol, TRUE);
+  }
+  if (micreate_volume_image(*hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+  }
+  return error_cnt;
+}
+
+/* Write full resolution slice \a z, with a real range of its own if
+ * \a slice_scaling is set.
+ */
+static int
+write_slice(mihandle_t hvol, int z, unsigned int seed, miboolean_t slice_scaling)
+{
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, CY, CX };
+  double smin = z * 10.0 - 5.0;
+  double smax = z * 10.0 + 100.0 + z * z;
+  int error_cnt = 0;
+  int y, x;
+
+  start[0] = z;
+  for (y = 0; y < CY; y++) {
+    for (x = 0; x < CX; x++) {
+      seed = seed * 1103515245 + 12345;
+      voxels[z][y][x] = (unsigned short) (seed >> 16);
+      reals[z][y][x] = slice_scaling ?
+                       smin + (smax - smin) * voxels[z][y][x] / 65535.0 : voxels[z][y][x];
+    }
+  }
+  if (slice_scaling && miset_slice_range(hvol, start, NDIMS, smax, smin) < 0) {
+    TESTRPT("Unable to set slice range", z);
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, voxels[z]) < 0) {
+    TESTRPT("Unable to write slice", z);
+  }
+  return error_cnt;
+}
+
+/* Compare every reduced resolution of \a hvol with the average of the
+ * full resolution voxels. Voxel values are compared exactly, real
+ * values to the precision of the slice ranges.
+ */
+static int
+check_levels(mihandle_t hvol, int depth, miboolean_t slice_scaling)
+{
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS];
+  double *buffer = malloc(CZ * CY * CX * sizeof(double));
+  unsigned short *vbuffer = malloc(CZ * CY * CX * sizeof(unsigned short));
+  int error_cnt = 0;
+  int level;
+  int z, y, x;
+
+  for (level = 1; level <= depth; level++) {
+    count[0] = CZ >> level;
+    count[1] = CY >> level;
+    count[2] = CX >> level;
+
+    if (miselect_resolution(hvol, level) < 0) {
+      TESTRPT("Unable to select resolution", level);
+      continue;
+    }
+    if (slice_scaling) {
+      if (miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, buffer) < 0) {
+        TESTRPT("Unable to read reduced resolution", level);
+        continue;
+      }
+    } else if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, vbuffer) < 0) {
+      TESTRPT("Unable to read reduced resolution", level);
+      continue;
+    }
+
+    for (z = 0; z < (int) count[0]; z++) {
+      double lo = HUGE_VAL, hi = -HUGE_VAL;
+
+      for (y = 0; y < (int) count[1]; y++) {
+        for (x = 0; x < (int) count[2]; x++) {
+          double v = reference_value(&reals[0][0][0], level, z, y, x);
+          if (v < lo) lo = v;
+          if (v > hi) hi = v;
+        }
+      }
+      for (y = 0; y < (int) count[1]; y++) {
+        for (x = 0; x < (int) count[2]; x++) {
+          size_t i = (z * count[1] + y) * count[2] + x;
+          double expected = reference_value(&reals[0][0][0], level, z, y, x);
+
+          if (slice_scaling ? fabs(buffer[i] - expected) > (hi - lo) / 65535.0 + 1e-9 :
+              vbuffer[i] != rint(expected)) {
+            printf("level %d (%d,%d,%d): %g expected %g\n", level, z, y, x,
+                   slice_scaling ? buffer[i] : vbuffer[i], expected);
+            TESTRPT("Bad reduced resolution value", level);
+            z = (int) count[0];
+            y = (int) count[1];
+            break;
+          }
+        }
+      }
+    }
+  }
+  if (miselect_resolution(hvol, 0) < 0) {
+    TESTRPT("Unable to select full resolution", 0);
+  }
+  free(buffer);
+  free(vbuffer);
+  return error_cnt;
+}
+
+/* The resolutions are built when the volume is closed.
+ */
+static int
+test_on_close(const char *name)
+{
+  mihandle_t hvol;
+  int error_cnt = 0;
+  int z;
+
+  error_cnt += create_volume(name, FALSE, DEPTH, &hvol);
+  if (error_cnt != 0) {
+    return error_cnt;
+  }
+  for (z = 0; z < CZ; z++) {
+    error_cnt += write_slice(hvol, z, 17 + z, FALSE);
+  }
+  miclose_volume(hvol);
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  error_cnt += check_levels(hvol, DEPTH, FALSE);
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+/* The resolutions are built while slices are written, and the blocks
+ * of slices written again are rebuilt.
+ */
+static int
+test_incremental(const char *name)
+{
+  mihandle_t hvol;
+  miboolean_t enabled = FALSE;
+  int error_cnt = 0;
+  int z;
+
+  error_cnt += create_volume(name, TRUE, 2, &hvol);
+  if (error_cnt != 0) {
+    return error_cnt;
+  }
+  if (miset_volume_incremental_resolution(hvol, TRUE) < 0 ||
+      miget_volume_incremental_resolution(hvol, &enabled) < 0 || !enabled) {
+    TESTRPT("Unable to enable incremental resolutions", 0);
+  }
+  for (z = 0; z < CZ; z++) {
+    error_cnt += write_slice(hvol, z, 101 + z, TRUE);
+  }
+  error_cnt += check_levels(hvol, 2, TRUE);
+
+  /* Overwritten slices invalidate their block */
+  error_cnt += write_slice(hvol, 5, 9999, TRUE);
+  error_cnt += write_slice(hvol, 30, 4242, TRUE);
+  error_cnt += check_levels(hvol, 2, TRUE);
+  error_cnt += write_slice(hvol, 13, 777, TRUE);
+  miclose_volume(hvol);
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+    return error_cnt;
+  }
+  if (miset_volume_incremental_resolution(hvol, TRUE) != MI_ERROR) {
+    TESTRPT("Incremental resolutions of a read-only volume", 0);
+  }
+  error_cnt += check_levels(hvol, 2, TRUE);
+  miclose_volume(hvol);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  char filename[128];
+  int error_cnt = 0;
+
+  snprintf(filename, sizeof(filename), "minc2-pyramid-%d.mnc", getpid());
+
+  error_cnt += test_on_close(filename);
+  unlink(filename);
+
+  error_cnt += test_incremental(filename);
+  unlink(filename);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
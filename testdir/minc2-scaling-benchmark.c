@@ -0,0 +1,109 @@
+/* Throughput of the slice scaling kernels, in voxels per second, for
+ * every voxel type and every instruction set the processor supports.
+ *
+ * usage: minc2-scaling-benchmark [voxels]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "minc2_private.h"
+#include "config.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#define SLICE_LENGTH (256 * 256)
+#define N_REPEATS 10
+
+static const struct {
+  const char *name;
+  mitype_t type;
+  double valid_min;
+  double valid_max;
+} types[] = {
+  { "byte", MI_TYPE_BYTE, -128.0, 127.0 },
+  { "ubyte", MI_TYPE_UBYTE, 0.0, 255.0 },
+  { "short", MI_TYPE_SHORT, -32768.0, 32767.0 },
+  { "ushort", MI_TYPE_USHORT, 0.0, 65535.0 },
+  { "int", MI_TYPE_INT, -2147483648.0, 2147483647.0 },
+  { "uint", MI_TYPE_UINT, 0.0, 4294967295.0 },
+  { "float", MI_TYPE_FLOAT, -1.0, 1.0 },
+  { "double", MI_TYPE_DOUBLE, -1.0, 1.0 }
+};
+
+static const char *levels[] = { "scalar", "sse2", "avx2" };
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t n_voxels = 16 * 1024 * 1024;
+  hsize_t n_slices;
+  double *slice_min;
+  double *slice_max;
+  void *buffer;
+  size_t t;
+  hsize_t i;
+  int best;
+  int level;
+  int r;
+
+  if (argc > 1) {
+    n_voxels = (size_t) atol(argv[1]);
+  }
+  n_slices = (n_voxels + SLICE_LENGTH - 1) / SLICE_LENGTH;
+  n_voxels = n_slices * SLICE_LENGTH;
+
+  buffer = malloc(n_voxels * sizeof(double));
+  slice_min = malloc(n_slices * sizeof(double));
+  slice_max = malloc(n_slices * sizeof(double));
+  for (i = 0; i < n_slices; i++) {
+    slice_min[i] = -10.0 - (double) i;
+    slice_max[i] = 1000.0 + 3.0 * i;
+  }
+  best = miset_scaling_simd(MI2_SIMD_AVX2);
+
+  printf("%lu voxels in slices of %d, Mvoxels/s\n", (unsigned long) n_voxels, SLICE_LENGTH);
+  printf("%-8s %-8s %12s %12s\n", "type", "kernels", "from file", "to file");
+  for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    for (level = MI2_SIMD_NONE; level <= best; level++) {
+      double t_descale, t_scale;
+
+      miset_scaling_simd(level);
+      memset(buffer, 0, n_voxels * sizeof(double));
+
+      t_descale = now();
+      for (r = 0; r < N_REPEATS; r++) {
+        miapply_descaling(types[t].type, buffer, SLICE_LENGTH, n_slices, slice_min,
+                          slice_max, types[t].valid_min, types[t].valid_max);
+      }
+      t_descale = now() - t_descale;
+
+      t_scale = now();
+      for (r = 0; r < N_REPEATS; r++) {
+        miapply_scaling(types[t].type, buffer, SLICE_LENGTH, n_slices, slice_min,
+                        slice_max, types[t].valid_min, types[t].valid_max);
+      }
+      t_scale = now() - t_scale;
+
+      printf("%-8s %-8s %12.1f %12.1f\n", types[t].name, levels[level],
+             N_REPEATS * n_voxels / t_descale / 1e6,
+             N_REPEATS * n_voxels / t_scale / 1e6);
+    }
+  }
+  free(buffer);
+  free(slice_min);
+  free(slice_max);
+  return 0;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
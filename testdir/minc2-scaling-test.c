@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+#define NSLICES 3
+#define SLICE_LENGTH 37         /* Not a multiple of any vector width */
+#define NVOXELS (NSLICES * SLICE_LENGTH)
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const struct {
+  mitype_t type;
+  double valid_min;
+  double valid_max;
+} types[] = {
+  { MI_TYPE_BYTE, -128.0, 127.0 },
+  { MI_TYPE_UBYTE, 0.0, 255.0 },
+  { MI_TYPE_SHORT, -32768.0, 32767.0 },
+  { MI_TYPE_USHORT, 0.0, 65535.0 },
+  { MI_TYPE_INT, -2147483648.0, 2147483647.0 },
+  { MI_TYPE_UINT, 0.0, 4294967295.0 },
+  { MI_TYPE_FLOAT, -1.0, 1.0 },
+  { MI_TYPE_DOUBLE, -1.0, 1.0 }
+};
+
+/* Fill the buffer with values spread over the valid range, including
+ * values that land halfway between two integers once scaled.
+ */
+static void
+fill_buffer(mitype_t type, void *buffer, double valid_min, double valid_max)
+{
+  int i;
+
+  for (i = 0; i < NVOXELS; i++) {
+    double x = valid_min + (valid_max - valid_min) * ((i * 37) % NVOXELS) / (NVOXELS - 1);
+    switch (type) {
+    case MI_TYPE_BYTE:
+      ((signed char *) buffer)[i] = (signed char) x;
+      break;
+    case MI_TYPE_UBYTE:
+      ((unsigned char *) buffer)[i] = (unsigned char) x;
+      break;
+    case MI_TYPE_SHORT:
+      ((short *) buffer)[i] = (short) x;
+      break;
+    case MI_TYPE_USHORT:
+      ((unsigned short *) buffer)[i] = (unsigned short) x;
+      break;
+    case MI_TYPE_INT:
+      ((int *) buffer)[i] = (int) x;
+      break;
+    case MI_TYPE_UINT:
+      ((unsigned int *) buffer)[i] = (unsigned int) x;
+      break;
+    case MI_TYPE_FLOAT:
+      ((float *) buffer)[i] = (float) (x + 0.5 * (i % 3));
+      break;
+    default:
+      ((double *) buffer)[i] = x - 0.5 * (i % 5);
+      break;
+    }
+  }
+}
+
+/* Scale and descale the same data with the scalar kernels and with the
+ * kernels of \a level, and compare the results byte for byte.
+ */
+static int
+compare_kernels(int level)
+{
+  static const double slice_min[NSLICES] = { -3.0, 0.0, -1000.5 };
+  static const double slice_max[NSLICES] = { 7.25, 1.0, 25000.0 };
+  double scalar[NVOXELS];
+  double vector[NVOXELS];
+  size_t size;
+  size_t t;
+  int op;
+  int error_cnt = 0;
+
+  for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    size = (size_t) mitype_len(types[t].type);
+    for (op = 0; op < 2; op++) {
+      int (*apply)(mitype_t, void *, hsize_t, hsize_t, const double *,
+                   const double *, double, double);
+
+      apply = op ? miapply_scaling : miapply_descaling;
+      if (op) {
+        /* Real values, some well outside the slice ranges */
+        fill_buffer(types[t].type, scalar, types[t].valid_min < 0.0 ? -3.0 : 0.0, 120.0);
+      } else {
+        fill_buffer(types[t].type, scalar, types[t].valid_min, types[t].valid_max);
+      }
+      memcpy(vector, scalar, NVOXELS * size);
+
+      miset_scaling_simd(MI2_SIMD_NONE);
+      if (apply(types[t].type, scalar, SLICE_LENGTH, NSLICES, slice_min,
+                slice_max, types[t].valid_min, types[t].valid_max) < 0) {
+        TESTRPT("Scalar kernel failed", types[t].type);
+      }
+      miset_scaling_simd(level);
+      if (apply(types[t].type, vector, SLICE_LENGTH, NSLICES, slice_min,
+                slice_max, types[t].valid_min, types[t].valid_max) < 0) {
+        TESTRPT("Vector kernel failed", types[t].type);
+      }
+      if (memcmp(scalar, vector, NVOXELS * size) != 0) {
+        TESTRPT(op ? "Scaling differs from scalar kernel"
+                   : "Descaling differs from scalar kernel", types[t].type);
+      }
+    }
+  }
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  double buffer[1] = { 0.0 };
+  double range[1] = { 1.0 };
+  int best;
+  int level;
+  int error_cnt = 0;
+
+  best = miset_scaling_simd(MI2_SIMD_AVX2);
+  for (level = MI2_SIMD_SSE2; level <= best; level++) {
+    error_cnt += compare_kernels(level);
+  }
+
+  if (miapply_scaling(MI_TYPE_STRING, buffer, 1, 1, buffer, range, 0.0, 1.0) >= 0) {
+    TESTRPT("Scaled an unsupported type", MI_TYPE_STRING);
+  }
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 10
+#define CY 16
+#define CX 12
+#define VOXEL 30000
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static double slice_max[CZ];
+static double slice_min[CZ];
+
+/* Check that the real values of every slice and the slice ranges of
+ * \a hvol follow slice_max[] and slice_min[].
+ */
+static int
+check_volume(mihandle_t hvol)
+{
+  static double reals[CZ][CY][CX];
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  double range[2];
+  double lo = slice_min[0];
+  double hi = slice_max[0];
+  int error_cnt = 0;
+  int z;
+
+  if (miget_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, lengths, reals) < 0) {
+    TESTRPT("Unable to read real values", 0);
+    return error_cnt;
+  }
+  for (z = 0; z < CZ; z++) {
+    double expected = VOXEL / 65535.0 * (slice_max[z] - slice_min[z]) + slice_min[z];
+    double smax, smin;
+
+    if (fabs(reals[z][CY - 1][CX - 1] - expected) > 1e-9) {
+      printf("slice %d: %g, expected %g\n", z, reals[z][CY - 1][CX - 1], expected);
+      TESTRPT("Bad real value", z);
+    }
+    start[0] = z;
+    miget_slice_range(hvol, start, NDIMS, &smax, &smin);
+    if (smax != slice_max[z] || smin != slice_min[z]) {
+      TESTRPT("Bad slice range", z);
+    }
+    if (slice_min[z] < lo) {
+      lo = slice_min[z];
+    }
+    if (slice_max[z] > hi) {
+      hi = slice_max[z];
+    }
+  }
+  if (miget_volume_real_range(hvol, range) < 0 || range[0] != lo || range[1] != hi) {
+    TESTRPT("Bad volume real range", 0);
+  }
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static unsigned short voxels[CZ][CY][CX];
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  char name[256];
+  int error_cnt = 0;
+  int i, z;
+
+  snprintf(name, sizeof(name), "minc2-slice-range-test-%d.mnc", getpid());
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_NONE);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  miset_slice_scaling_flag(hvol, TRUE);
+  miset_volume_valid_range(hvol, 65535.0, 0.0);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+
+  for (z = 0; z < CZ; z++) {
+    for (i = 0; i < CY * CX; i++) {
+      voxels[z][i / CX][i % CX] = VOXEL;
+    }
+    slice_max[z] = 100.0 + z;
+    slice_min[z] = -1.0 * z;
+    start[0] = z;
+    miset_slice_range(hvol, start, NDIMS, slice_max[z], slice_min[z]);
+  }
+  start[0] = 0;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  error_cnt += check_volume(hvol);
+
+  /* Ranges set on an open volume are seen by the following reads */
+  slice_max[3] = 5000.0;
+  slice_min[3] = -200.0;
+  start[0] = 3;
+  miset_slice_range(hvol, start, NDIMS, slice_max[3], slice_min[3]);
+  error_cnt += check_volume(hvol);
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+
+  /* and are written to the file when it is closed */
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    error_cnt += check_volume(hvol);
+    if (miset_slice_range(hvol, start, NDIMS, 1.0, 0.0) >= 0) {
+      TESTRPT("Slice range set on a read-only volume", 0);
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 8
+#define CY 32
+#define CX 32
+#define NCHUNKS 8               /* Chunks of 4 x 16 x 16 voxels */
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static unsigned short voxels[CZ][CY][CX];
+
+/* Check that the chunks of \a hvol with storage are those in \a expected.
+ */
+static int
+check_mask(mihandle_t hvol, const unsigned char expected[NCHUNKS])
+{
+  misize_t chunk_lengths[NDIMS];
+  misize_t chunk_counts[NDIMS];
+  unsigned char mask[NCHUNKS];
+  misize_t n_allocated, n_expected = 0;
+  int error_cnt = 0;
+  int i;
+
+  if (miget_volume_chunk_grid(hvol, NDIMS, chunk_lengths, chunk_counts) < 0) {
+    TESTRPT("Unable to get chunk grid", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < NDIMS; i++) {
+    if (chunk_lengths[i] != lengths[i] / 2 || chunk_counts[i] != 2) {
+      TESTRPT("Bad chunk grid", i);
+    }
+  }
+  if (miget_allocated_region_mask(hvol, NCHUNKS - 1, mask, &n_allocated) >= 0) {
+    TESTRPT("Mask returned in a short array", 0);
+  }
+  if (miget_allocated_region_mask(hvol, NCHUNKS, mask, &n_allocated) < 0) {
+    TESTRPT("Unable to get allocated region mask", 0);
+    return error_cnt;
+  }
+  for (i = 0; i < NCHUNKS; i++) {
+    if (!mask[i] != !expected[i]) {
+      TESTRPT("Bad allocated region mask", i);
+    }
+    n_expected += expected[i] != 0;
+  }
+  if (n_allocated != n_expected) {
+    TESTRPT("Bad number of allocated chunks", (int) n_allocated);
+  }
+  return error_cnt;
+}
+
+/* Check that the voxels read from \a hvol, with and without the chunk
+ * reader, are those in voxels[].
+ */
+static int
+check_voxels(mihandle_t hvol)
+{
+  static unsigned short values[CZ][CY][CX];
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { CZ / 2, CY, CX / 2 + 3 };
+  int error_cnt = 0;
+  int threads, pass, z, y, x;
+
+  miget_volume_read_threads(hvol, &threads);
+  for (pass = 0; pass < 2; pass++) {
+    miset_volume_read_threads(hvol, pass == 0 ? 2 : 0);
+    memset(values, 0xff, sizeof(values));
+    if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, values) < 0) {
+      TESTRPT("Unable to read voxels", pass);
+    } else if (memcmp(values, voxels, sizeof(values))) {
+      TESTRPT("Bad voxels", pass);
+    }
+
+    /* and a selection across allocated and empty chunks */
+    start[0] = 2;
+    start[2] = 8;
+    if (miget_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, values) < 0) {
+      TESTRPT("Unable to read voxels", pass);
+    } else {
+      for (z = 0; z < (int) count[0]; z++) {
+        for (y = 0; y < (int) count[1]; y++) {
+          for (x = 0; x < (int) count[2]; x++) {
+            unsigned short v = ((unsigned short *) values)[(z * count[1] + y) * count[2] + x];
+            if (v != voxels[z + 2][y][x + 8]) {
+              TESTRPT("Bad voxel in selection", pass);
+              z = y = CZ * CY;
+              break;
+            }
+          }
+        }
+      }
+    }
+    start[0] = start[2] = 0;
+  }
+  miset_volume_read_threads(hvol, threads);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static const int edges[NDIMS] = { CZ / 2, CY / 2, CX / 2 };
+  static const unsigned char none[NCHUNKS] = { 0 };
+  static const unsigned char first[NCHUNKS] = { 1 };
+  static const unsigned char first_last[NCHUNKS] = { 1, 0, 0, 0, 0, 0, 0, 1 };
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { 1, 2, 2 };
+  unsigned short patch[2][2] = { { 7, 7 }, { 7, 7 } };
+  unsigned char mask[1];
+  misize_t n_allocated;
+  char name[256];
+  int error_cnt = 0;
+  int i;
+
+  snprintf(name, sizeof(name), "minc2-sparse-test-%d.mnc", getpid());
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  miset_props_blocking(props, NDIMS, edges);
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  error_cnt += check_mask(hvol, none);
+
+  /* A mask in the first chunk, the chunks left empty are not stored */
+  for (i = 0; i < CY / 2; i++) {
+    voxels[1][i][i % 5] = 1;
+  }
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  error_cnt += check_mask(hvol, first);
+  error_cnt += check_voxels(hvol);
+
+  /* A part of the last chunk written, then cleared with the rest */
+  start[0] = CZ - 1;
+  start[1] = start[2] = CX - 2;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, patch) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  start[0] = start[1] = start[2] = 0;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  error_cnt += check_mask(hvol, first_last);
+  error_cnt += check_voxels(hvol);
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    error_cnt += check_mask(hvol, first_last);
+    error_cnt += check_voxels(hvol);
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  /* A contiguous image is a single chunk */
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      NULL, &hvol) < 0 ||
+      micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+  } else {
+    if (miget_allocated_region_mask(hvol, 1, mask, &n_allocated) < 0 ||
+        n_allocated != 0 || mask[0]) {
+      TESTRPT("Bad mask of an unwritten contiguous image", 0);
+    }
+    miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, lengths, voxels);
+    if (miget_allocated_region_mask(hvol, 1, mask, &n_allocated) < 0 ||
+        n_allocated != 1 || !mask[0]) {
+      TESTRPT("Bad mask of a contiguous image", 0);
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
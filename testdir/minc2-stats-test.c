@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define NDIMS 3
+#define CZ 4
+#define CY 8
+#define CX 10
+#define NBINS 16
+#define VOXEL 13107             /* 65535 / 5 */
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const misize_t lengths[NDIMS] = { CZ, CY, CX };
+static mistatistics_t expected[CZ];
+
+static void
+add_value(mistatistics_t *stats, double value)
+{
+  if (stats->count == 0 || value < stats->min) {
+    stats->min = value;
+  }
+  if (stats->count == 0 || value > stats->max) {
+    stats->max = value;
+  }
+  stats->count++;
+  stats->sum += value;
+  stats->sum_squares += value * value;
+}
+
+static int
+same_stats(const mistatistics_t *a, const mistatistics_t *b)
+{
+  return (a->count == b->count && fabs(a->min - b->min) < 1e-6 &&
+          fabs(a->max - b->max) < 1e-6 && fabs(a->sum - b->sum) < 1e-6 &&
+          fabs(a->sum_squares - b->sum_squares) < 1e-3);
+}
+
+/* Check the statistics of \a hvol against expected[].
+ */
+static int
+check_volume(mihandle_t hvol)
+{
+  mistatistics_t total;
+  mistatistics_t stats;
+  misize_t start[NDIMS] = { 0, CY - 1, 0 };
+  misize_t counts[NBINS];
+  misize_t n = 0;
+  double hist_min, hist_max;
+  int error_cnt = 0;
+  int z, i;
+
+  memset(&total, 0, sizeof(total));
+  for (z = 0; z < CZ; z++) {
+    if (expected[z].count == 0) {
+      continue;
+    }
+    if (total.count == 0 || expected[z].min < total.min) {
+      total.min = expected[z].min;
+    }
+    if (total.count == 0 || expected[z].max > total.max) {
+      total.max = expected[z].max;
+    }
+    total.count += expected[z].count;
+    total.sum += expected[z].sum;
+    total.sum_squares += expected[z].sum_squares;
+
+    start[0] = z;
+    if (miget_slice_statistics(hvol, start, NDIMS, &stats) < 0) {
+      TESTRPT("Unable to get slice statistics", z);
+    } else if (!same_stats(&stats, &expected[z])) {
+      printf("slice %d: %lu %g %g %g %g\n", z, (unsigned long) stats.count,
+             stats.min, stats.max, stats.sum, stats.sum_squares);
+      TESTRPT("Bad slice statistics", z);
+    }
+  }
+  if (miget_volume_statistics(hvol, &stats) < 0) {
+    TESTRPT("Unable to get volume statistics", 0);
+  } else if (!same_stats(&stats, &total)) {
+    TESTRPT("Bad volume statistics", (int) stats.count);
+  }
+
+  if (miget_volume_histogram(hvol, NBINS - 1, counts, &hist_min, &hist_max) >= 0) {
+    TESTRPT("Histogram with the wrong number of bins", 0);
+  }
+  if (miget_volume_histogram(hvol, NBINS, counts, &hist_min, &hist_max) < 0) {
+    TESTRPT("Unable to get volume histogram", 0);
+  } else {
+    for (i = 0; i < NBINS; i++) {
+      n += counts[i];
+    }
+    if (n != total.count) {
+      TESTRPT("Bad histogram count", (int) n);
+    }
+    if (hist_min != 0.0 || hist_max != 65535.0) {
+      TESTRPT("Bad histogram range", 0);
+    }
+    /* Slice 3 only holds VOXEL, in bin 16 * 13107 / 65535 = 3 */
+    if (counts[3] < (misize_t) (CY * CX)) {
+      TESTRPT("Bad histogram bin", (int) counts[3]);
+    }
+  }
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const char *dimnames[NDIMS] = { "zspace", "yspace", "xspace" };
+  static double reals[CZ - 1][CY][CX];
+  static unsigned short voxels[CY][CX];
+  midimhandle_t hdims[NDIMS];
+  mivolumeprops_t props;
+  mihandle_t hvol;
+  mistatistics_t stats;
+  misize_t start[NDIMS] = { 0, 0, 0 };
+  misize_t count[NDIMS] = { CZ - 1, CY, CX };
+  char name[256];
+  int error_cnt = 0;
+  int flags, n_bins;
+  int i, z;
+
+  snprintf(name, sizeof(name), "minc2-stats-test-%d.mnc", getpid());
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  minew_volume_props(&props);
+  miset_props_statistics(props, MI_STATS_ACCUMULATE | MI_STATS_STORE, NBINS);
+  miget_props_statistics(props, &flags, &n_bins);
+  if (flags != (MI_STATS_ACCUMULATE | MI_STATS_STORE) || n_bins != NBINS) {
+    TESTRPT("Bad statistics properties", flags);
+  }
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      props, &hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+    return error_cnt;
+  }
+  mifree_volume_props(props);
+  miset_slice_scaling_flag(hvol, TRUE);
+  miset_volume_valid_range(hvol, 65535.0, 0.0);
+  if (micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create volume image", 0);
+    return error_cnt;
+  }
+
+  /* Real values of the first slices */
+  for (z = 0; z < CZ; z++) {
+    start[0] = z;
+    miset_slice_range(hvol, start, NDIMS, 100.0 * (z + 1), -10.0 * z);
+  }
+  for (z = 0; z < CZ - 1; z++) {
+    for (i = 0; i < CY * CX; i++) {
+      reals[z][i / CX][i % CX] = -10.0 * z + (i % 97);
+      add_value(&expected[z], reals[z][i / CX][i % CX]);
+    }
+  }
+  start[0] = 0;
+  if (miset_real_value_hyperslab(hvol, MI_TYPE_DOUBLE, start, count, reals) < 0) {
+    TESTRPT("Unable to write real values", 0);
+  }
+
+  /* and voxel values of the last one */
+  for (i = 0; i < CY * CX; i++) {
+    voxels[i / CX][i % CX] = VOXEL;
+    add_value(&expected[CZ - 1], VOXEL / 65535.0 * (100.0 * CZ + 10.0 * (CZ - 1)) -
+              10.0 * (CZ - 1));
+  }
+  start[0] = CZ - 1;
+  count[0] = 1;
+  if (miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count, voxels) < 0) {
+    TESTRPT("Unable to write voxels", 0);
+  }
+  error_cnt += check_volume(hvol);
+  if (miclose_volume(hvol) < 0) {
+    TESTRPT("Unable to close volume", 0);
+  }
+
+  /* The statistics are read back from the file */
+  if (miopen_volume(name, MI2_OPEN_READ, &hvol) < 0) {
+    TESTRPT("Unable to open volume", 0);
+  } else {
+    error_cnt += check_volume(hvol);
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  /* A volume without statistics has none to give */
+  for (i = 0; i < NDIMS; i++) {
+    micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                       MI_DIMATTR_REGULARLY_SAMPLED, lengths[i], &hdims[i]);
+  }
+  if (micreate_volume(name, NDIMS, hdims, MI_TYPE_USHORT, MI_CLASS_REAL,
+                      NULL, &hvol) < 0 || micreate_volume_image(hvol) < 0) {
+    TESTRPT("Unable to create test volume", 0);
+  } else {
+    if (miget_volume_statistics(hvol, &stats) >= 0) {
+      TESTRPT("Statistics of a volume without them", 0);
+    }
+    miclose_volume(hvol);
+  }
+  unlink(name);
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,106 @@
+/* Time taken to reorder volumes by restructure_array(), in place, and
+ * by transpose_array(), for a few common permutations and flips.
+ *
+ * usage: minc2-transpose-benchmark [edge [element size]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "restructure.h"
+#include "config.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+static const struct {
+  const char *name;
+  size_t ndims;
+  int map[4];
+  int dir[4];
+} cases[] = {
+  { "zyx->xyz", 3, { 2, 1, 0 }, { 1, 1, 1 } },
+  { "zyx->zxy", 3, { 0, 2, 1 }, { 1, 1, 1 } },
+  { "zyx->yzx", 3, { 1, 0, 2 }, { 1, 1, 1 } },
+  { "flip x", 3, { 0, 1, 2 }, { 1, 1, -1 } },
+  { "flip z,y", 3, { 0, 1, 2 }, { -1, -1, 1 } },
+  { "zyx->xyz, flip x", 3, { 2, 1, 0 }, { -1, 1, 1 } },
+  { "tzyx->zyxt", 4, { 1, 2, 3, 0 }, { 1, 1, 1, 1 } }
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t edge = 256;
+  size_t el_size = 2;
+  size_t raw[4];
+  size_t total;
+  unsigned char *src;
+  unsigned char *dst;
+  size_t c, i;
+
+  if (argc > 1) {
+    edge = (size_t) atol(argv[1]);
+  }
+  if (argc > 2) {
+    el_size = (size_t) atol(argv[2]);
+  }
+  total = edge * edge * edge * el_size;
+  src = malloc(total);
+  dst = malloc(total);
+  if (src == NULL || dst == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < total; i++) {
+    src[i] = (unsigned char) i;
+  }
+
+  printf("%lu^3 voxels of %lu bytes, seconds\n", (unsigned long) edge, (unsigned long) el_size);
+  printf("%-18s %12s %12s %8s\n", "reordering", "in place", "transpose", "speedup");
+  for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    size_t lengths_perm[4];
+    double t_in_place, t_transpose;
+
+    /* The 4D case keeps the same number of voxels */
+    if (cases[c].ndims == 4) {
+      raw[0] = 4;
+      raw[1] = edge / 4;
+      raw[2] = raw[3] = edge;
+    } else {
+      raw[0] = raw[1] = raw[2] = edge;
+    }
+    for (i = 0; i < cases[c].ndims; i++) {
+      lengths_perm[i] = raw[cases[c].map[i]];
+    }
+
+    t_transpose = now();
+    transpose_array(cases[c].ndims, src, dst, lengths_perm, el_size,
+                    cases[c].map, cases[c].dir);
+    t_transpose = now() - t_transpose;
+
+    t_in_place = now();
+    restructure_array(cases[c].ndims, src, lengths_perm, el_size,
+                      cases[c].map, cases[c].dir);
+    t_in_place = now() - t_in_place;
+
+    if (memcmp(src, dst, total) != 0) {
+      printf("%-18s results differ\n", cases[c].name);
+    }
+    printf("%-18s %12.3f %12.3f %7.1fx\n", cases[c].name, t_in_place, t_transpose,
+           t_in_place / t_transpose);
+  }
+  free(src);
+  free(dst);
+  return 0;
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "restructure.h"
+
+#define MAX_DIMS 5
+#define MAX_ELEMENTS 20000
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const size_t el_sizes[] = { 1, 2, 3, 4, 8, 16 };
+
+/* Reorder the same array with restructure_array() and transpose_array()
+ * and compare the results.
+ */
+static int
+compare_reorder(size_t ndims, const size_t lengths_perm[], const int map[],
+                const int dir[], size_t el_size, size_t misalign)
+{
+  static unsigned char in_place[MAX_ELEMENTS * 16];
+  static unsigned char src[MAX_ELEMENTS * 16 + 8];
+  static unsigned char dst[MAX_ELEMENTS * 16 + 8];
+  size_t total = el_size;
+  size_t i;
+  int error_cnt = 0;
+
+  for (i = 0; i < ndims; i++) {
+    total *= lengths_perm[i];
+  }
+  for (i = 0; i < total; i++) {
+    in_place[i] = (unsigned char)(i * 131 + i / 251);
+  }
+  memcpy(src + misalign, in_place, total);
+  memset(dst, 0xff, sizeof(dst));
+
+  restructure_array(ndims, in_place, lengths_perm, el_size, map, dir);
+  transpose_array(ndims, src + misalign, dst + misalign, lengths_perm, el_size, map, dir);
+  if (memcmp(in_place, dst + misalign, total) != 0) {
+    TESTRPT("Transposed array differs", (int) el_size);
+  }
+  return error_cnt;
+}
+
+/* Next permutation of map[0..n-1] in lexicographic order, 0 after the
+ * last one.
+ */
+static int
+next_permutation(int map[], int n)
+{
+  int i, j, t;
+
+  for (i = n - 2; i >= 0 && map[i] > map[i + 1]; i--)
+    ;
+  if (i < 0) {
+    return 0;
+  }
+  for (j = n - 1; map[j] < map[i]; j--)
+    ;
+  t = map[i]; map[i] = map[j]; map[j] = t;
+  for (i++, j = n - 1; i < j; i++, j--) {
+    t = map[i]; map[i] = map[j]; map[j] = t;
+  }
+  return 1;
+}
+
+int
+main(void)
+{
+  static const size_t shapes[][MAX_DIMS] = {
+    { 7, 0, 0, 0, 0 },
+    { 37, 45, 0, 0, 0 },
+    { 1, 70, 3, 0, 0 },
+    { 9, 33, 41, 0, 0 },
+    { 3, 1, 17, 35, 0 },
+    { 2, 5, 1, 6, 7 }
+  };
+  int error_cnt = 0;
+  size_t s;
+
+  for (s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+    size_t ndims = 0;
+    int map[MAX_DIMS];
+    size_t i;
+
+    while (ndims < MAX_DIMS && shapes[s][ndims] != 0) {
+      map[ndims] = (int) ndims;
+      ndims++;
+    }
+    do {
+      size_t lengths_perm[MAX_DIMS];
+      int dir[MAX_DIMS];
+      unsigned int flips;
+
+      for (i = 0; i < ndims; i++) {
+        lengths_perm[i] = shapes[s][map[i]];
+      }
+      for (flips = 0; flips < (1U << ndims); flips++) {
+        size_t e;
+
+        for (i = 0; i < ndims; i++) {
+          dir[i] = (flips & (1U << i)) ? -1 : 1;
+        }
+        for (e = 0; e < sizeof(el_sizes) / sizeof(el_sizes[0]); e++) {
+          error_cnt += compare_reorder(ndims, lengths_perm, map, dir, el_sizes[e], 0);
+        }
+        error_cnt += compare_reorder(ndims, lengths_perm, map, dir, 4, 2);
+      }
+    } while (next_permutation(map, (int) ndims));
+  }
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+#define N_ELEMENTS 1000         /* Several blocks of the converters */
+
+#define TESTRPT(msg, val) (error_cnt++, printf(\
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static const struct {
+  const char *name;
+  size_t size;
+  int is_signed;
+  double min;
+  double max;
+} int_types[] = {
+  { "8 bit signed", 1, 1, SCHAR_MIN, SCHAR_MAX },
+  { "8 bit unsigned", 1, 0, 0, UCHAR_MAX },
+  { "16 bit signed", 2, 1, SHRT_MIN, SHRT_MAX },
+  { "16 bit unsigned", 2, 0, 0, USHRT_MAX },
+  { "32 bit signed", 4, 1, INT_MIN, INT_MAX },
+  { "32 bit unsigned", 4, 0, 0, UINT_MAX }
+};
+
+/* Values converted to each integer type, all of them in range for
+ * some of the types and out of range for others.
+ */
+static const double float_values[] = {
+  -1.0e10, -4294967296.0, -2147483649.0, -2147483648.0, -65536.5,
+  -32769.0, -32768.0, -129.5, -128.9, -128.0, -127.5, -1.5, -0.7,
+  0.0, 0.7, 1.5, 126.9, 127.0, 127.9, 128.0, 255.0, 255.5, 256.0,
+  32766.5, 32767.0, 32768.0, 65535.0, 65535.9, 65536.0, 1.0e6,
+  2147483646.0, 2147483647.0, 2147483648.0, 4294967295.0,
+  4294967296.0, 1.0e10, HUGE_VAL, -HUGE_VAL
+};
+
+/* The HDF5 type of integer type \a k in byte order \a order.
+ */
+static hid_t
+int_file_type(size_t k, H5T_order_t order)
+{
+  int le = (order == H5T_ORDER_LE);
+
+  switch (k) {
+  case 0:
+    return le ? H5T_STD_I8LE : H5T_STD_I8BE;
+  case 1:
+    return le ? H5T_STD_U8LE : H5T_STD_U8BE;
+  case 2:
+    return le ? H5T_STD_I16LE : H5T_STD_I16BE;
+  case 3:
+    return le ? H5T_STD_U16LE : H5T_STD_U16BE;
+  case 4:
+    return le ? H5T_STD_I32LE : H5T_STD_I32BE;
+  default:
+    return le ? H5T_STD_U32LE : H5T_STD_U32BE;
+  }
+}
+
+/* The HDF5 floating point type of \a size bytes in byte order \a order.
+ */
+static hid_t
+float_file_type(size_t size, H5T_order_t order)
+{
+  if (size == sizeof(float)) {
+    return order == H5T_ORDER_LE ? H5T_IEEE_F32LE : H5T_IEEE_F32BE;
+  }
+  return order == H5T_ORDER_LE ? H5T_IEEE_F64LE : H5T_IEEE_F64BE;
+}
+
+/* Copy \a size bytes from \a src to \a dst, reversing them if \a order
+ * is not the native byte order.
+ */
+static void
+copy_bytes(void *dst, const void *src, size_t size, H5T_order_t order)
+{
+  size_t i;
+
+  if (order == H5Tget_order(H5T_NATIVE_INT)) {
+    memcpy(dst, src, size);
+  } else {
+    for (i = 0; i < size; i++) {
+      ((unsigned char *) dst)[i] = ((const unsigned char *) src)[size - 1 - i];
+    }
+  }
+}
+
+static void
+put_int(unsigned char *dst, size_t k, long long value, H5T_order_t order)
+{
+  union {
+    signed char c;
+    unsigned char uc;
+    short s;
+    unsigned short us;
+    int i;
+    unsigned int ui;
+  } u;
+
+  switch (k) {
+  case 0: u.c = (signed char) value; break;
+  case 1: u.uc = (unsigned char) value; break;
+  case 2: u.s = (short) value; break;
+  case 3: u.us = (unsigned short) value; break;
+  case 4: u.i = (int) value; break;
+  default: u.ui = (unsigned int) value; break;
+  }
+  copy_bytes(dst, &u, int_types[k].size, order);
+}
+
+static long long
+get_int(const unsigned char *src, size_t k, H5T_order_t order)
+{
+  union {
+    signed char c;
+    unsigned char uc;
+    short s;
+    unsigned short us;
+    int i;
+    unsigned int ui;
+  } u;
+
+  copy_bytes(&u, src, int_types[k].size, order);
+  switch (k) {
+  case 0: return u.c;
+  case 1: return u.uc;
+  case 2: return u.s;
+  case 3: return u.us;
+  case 4: return u.i;
+  default: return u.ui;
+  }
+}
+
+static void
+put_float(unsigned char *dst, size_t size, double value, H5T_order_t order)
+{
+  float f = (float) value;
+
+  copy_bytes(dst, size == sizeof(float) ? (void *) &f : (void *) &value, size, order);
+}
+
+static double
+get_float(const unsigned char *src, size_t size, H5T_order_t order)
+{
+  float f;
+  double d;
+
+  if (size == sizeof(float)) {
+    copy_bytes(&f, src, size, order);
+    return f;
+  }
+  copy_bytes(&d, src, size, order);
+  return d;
+}
+
+/* Integers spread over the whole range of type \a k, both ends
+ * included, converted to floating point.
+ */
+static int
+test_int_to_float(size_t k, H5T_order_t src_order, size_t dst_size, H5T_order_t dst_order)
+{
+  unsigned char *buffer = malloc(N_ELEMENTS * sizeof(double));
+  long long values[N_ELEMENTS];
+  size_t i;
+  int error_cnt = 0;
+
+  for (i = 0; i < N_ELEMENTS; i++) {
+    values[i] = (long long) (int_types[k].min +
+                             (int_types[k].max - int_types[k].min) * i / (N_ELEMENTS - 1));
+    put_int(buffer + i * int_types[k].size, k, values[i], src_order);
+  }
+  if (H5Tconvert(int_file_type(k, src_order), float_file_type(dst_size, dst_order),
+                 N_ELEMENTS, buffer, NULL, H5P_DEFAULT) < 0) {
+    TESTRPT("Unable to convert integers", (int) k);
+  } else {
+    for (i = 0; i < N_ELEMENTS; i++) {
+      double expected = (dst_size == sizeof(float)) ? (float) values[i] : (double) values[i];
+
+      if (get_float(buffer + i * dst_size, dst_size, dst_order) != expected) {
+        printf("%s %s to %s %s: %lld became %g\n", int_types[k].name,
+               src_order == H5T_ORDER_LE ? "LE" : "BE",
+               dst_size == sizeof(float) ? "float" : "double",
+               dst_order == H5T_ORDER_LE ? "LE" : "BE", values[i],
+               get_float(buffer + i * dst_size, dst_size, dst_order));
+        TESTRPT("Bad converted integer", (int) k);
+        break;
+      }
+    }
+  }
+  free(buffer);
+  return error_cnt;
+}
+
+/* Floating point values, in and out of range of type \a k, converted
+ * to integers. They are truncated and clamped to the range of the type.
+ */
+static int
+test_float_to_int(size_t k, H5T_order_t src_order, size_t src_size, H5T_order_t dst_order)
+{
+  const size_t n_values = sizeof(float_values) / sizeof(float_values[0]);
+  unsigned char *buffer = malloc(N_ELEMENTS * sizeof(double));
+  size_t i;
+  int error_cnt = 0;
+
+  for (i = 0; i < N_ELEMENTS; i++) {
+    put_float(buffer + i * src_size, src_size, float_values[i % n_values], src_order);
+  }
+  if (H5Tconvert(float_file_type(src_size, src_order), int_file_type(k, dst_order),
+                 N_ELEMENTS, buffer, NULL, H5P_DEFAULT) < 0) {
+    TESTRPT("Unable to convert floating point values", (int) k);
+  } else {
+    for (i = 0; i < N_ELEMENTS; i++) {
+      double x = float_values[i % n_values];
+      double expected;
+
+      if (src_size == sizeof(float)) {
+        x = (float) x;
+        /* HDF5's own float converters compare against the maximum of
+         * the type rounded to float, and overflow at 2^31 and 2^32.
+         */
+        if (x == int_types[k].max + 1.0) {
+          continue;
+        }
+      }
+      expected = (x > int_types[k].max) ? int_types[k].max :
+                 (x >= int_types[k].min) ? trunc(x) : int_types[k].min;
+      if (get_int(buffer + i * int_types[k].size, k, dst_order) != (long long) expected) {
+        printf("%s %s to %s %s: %.17g became %lld\n",
+               src_size == sizeof(float) ? "float" : "double",
+               src_order == H5T_ORDER_LE ? "LE" : "BE", int_types[k].name,
+               dst_order == H5T_ORDER_LE ? "LE" : "BE", x,
+               get_int(buffer + i * int_types[k].size, k, dst_order));
+        TESTRPT("Bad converted value", (int) k);
+        break;
+      }
+    }
+  }
+  free(buffer);
+  return error_cnt;
+}
+
+int
+main(void)
+{
+  static const H5T_order_t orders[] = { H5T_ORDER_LE, H5T_ORDER_BE };
+  static const size_t float_sizes[] = { sizeof(float), sizeof(double) };
+  size_t k, s, i, j;
+  int error_cnt = 0;
+
+  /* Registers the library's own converters */
+  miinit();
+
+  for (k = 0; k < sizeof(int_types) / sizeof(int_types[0]); k++) {
+    for (s = 0; s < sizeof(float_sizes) / sizeof(float_sizes[0]); s++) {
+      for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+          error_cnt += test_int_to_float(k, orders[i], float_sizes[s], orders[j]);
+          error_cnt += test_float_to_int(k, orders[i], float_sizes[s], orders[j]);
+        }
+      }
+    }
+  }
+
+  if (error_cnt != 0) {
+    fprintf(stderr, "%d error%s reported\n",
+            error_cnt, (error_cnt == 1) ? "" : "s");
+  } else {
+    fprintf(stderr, "No errors\n");
+  }
+  return (error_cnt);
+}
+
+/* kate: indent-mode cstyle; indent-width 2; replace-tabs on; */
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "minc2.h"
 
 #define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
@@ -26,6 +28,19 @@ int main(int argc, char **argv)
   if (r < 0) {
     TESTRPT("failed", r);
   }
+
+  /* -compression type level: the defaults expected from MINC_COMPRESS */
+  if (argc == 4 && !strcmp(argv[1], "-compression")) {
+    if (miget_props_compression_type(props, &compression_type) < 0 ||
+        compression_type != (micompression_t) atoi(argv[2])) {
+      TESTRPT("bad compression type from MINC_COMPRESS", compression_type);
+    }
+    if (miget_props_compression_level(props, &zlib_level) < 0 ||
+        zlib_level != atoi(argv[3])) {
+      TESTRPT("bad compression level from MINC_COMPRESS", zlib_level);
+    }
+    argc = 1;
+  }
   
   r = miset_props_multi_resolution(props, 1 , 2);
 
@@ -73,6 +88,42 @@ int main(int argc, char **argv)
     printf("Got zlib level %d \n", zlib_level);
   }
 
+  r = miset_props_compression_type(props, MI_COMPRESS_SHUFFLE_ZLIB);
+  if (r < 0) {
+    TESTRPT("failed", r);
+  }
+  r = miget_props_compression_type(props, &compression_type);
+  if (r < 0 || compression_type != MI_COMPRESS_SHUFFLE_ZLIB) {
+    TESTRPT("failed", r);
+  }
+  r = miset_props_compression_level(props, 7);
+  if (r < 0) {
+    TESTRPT("failed", r);
+  }
+  r = miget_props_compression_level(props, &zlib_level);
+  if (r < 0 || zlib_level != 7) {
+    TESTRPT("failed", r);
+  }
+  else {
+    printf("Got shuffle+zlib level %d \n", zlib_level);
+  }
+  r = miset_props_compression_level(props, MI2_MAX_ZLIB_LEVEL + 1);
+  if (r >= 0) {
+    TESTRPT("accepted an out of range level", r);
+  }
+
+  /* Zstandard is only available with its HDF5 filter plugin */
+  r = miset_props_compression_type(props, MI_COMPRESS_ZSTD);
+  if (r >= 0) {
+    r = miset_props_compression_level(props, MI2_MAX_ZSTD_LEVEL);
+    if (r < 0) {
+      TESTRPT("failed", r);
+    }
+  }
+  else {
+    printf("Zstandard filter not available\n");
+  }
+
   mifree_volume_props(props);
 
   while (--argc > 0) {